@@ -41,6 +41,26 @@ static const char* standardResponses[] = {
 
 
 
+// Holds the command lock shared or exclusive for the life of one command.
+class CommandLock {
+	RWLock &mLock;
+	public:
+	CommandLock(RWLock &wLock, bool shared) : mLock(wLock) { if (shared) { mLock.rlock(); } else { mLock.wlock(); } }
+	~CommandLock() { mLock.unlock(); }
+};
+
+// Can this command line run under the shared lock?
+bool Parser::runsShared(int argc, char **argv) const
+{
+	std::map<std::string,std::string>::const_iterator it = mSharedCommands.find(argv[0]);
+	if (it == mSharedCommands.end()) { return false; }
+	string editArgs = " " + it->second + " ";
+	for (int i = 1; i < argc; i++) {
+		if (editArgs.find(string(" ") + argv[i] + " ") != string::npos) { return false; }
+	}
+	return true;
+}
+
 CLIStatus Parser::execute(char* line, ostream& os) const
 {
 	LOG(INFO) << "executing console command: " << line;
@@ -88,7 +108,8 @@ CLIStatus Parser::execute(char* line, ostream& os) const
 	}
 	CLICommand func;
 	func = cfp->second;
-	// Do it.
+	// Do it.  Commands run on several CLI worker threads at once, so anything that changes state runs alone.
+	CommandLock lock(mCommandLock,runsShared(argc,argv));
 	CLIStatus retVal;
 	try {
 		retVal = (*func)(argc,argv,os);
@@ -106,8 +127,6 @@ CLIStatus Parser::execute(char* line, ostream& os) const
 // If it returns a negative number OpenBTS exists.
 CLIStatus Parser::process(const char* line, ostream& os) const
 {
-	static Mutex oneCommandAtATime;
-	ScopedLock lock(oneCommandAtATime);
 	char *newLine = strdup(line);
 	LOG(INFO) << "CLI executing command:" <<(line?line:"null");
 	CLIStatus retVal = execute(newLine,os);
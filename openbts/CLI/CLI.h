@@ -20,7 +20,9 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <iostream>
+#include <Threads.h>
 
 
 namespace CommandLine {
@@ -55,6 +57,9 @@ class Parser {
 
 	ParseTable mParseTable;
 	HelpTable mHelpTable;
+	// Commands that only report, and may run alongside each other, with any of their arguments that change things.
+	std::map<std::string,std::string> mSharedCommands;
+	mutable RWLock mCommandLock;			// Held shared by those, exclusive by everything else.
 	static const int mMaxArgs = 10;
 
 	/**
@@ -65,8 +70,10 @@ class Parser {
 		@return status code
 	*/
 	CLIStatus execute(char* line, ostream& os) const;
+	bool runsShared(int argc, char **argv) const;
 	int Execute(bool console, const char cmdbuf[], int outfd);
 	void Prompt() const;
+	static void *commandWorker(Parser *parser);
 
 	public:
 	std::string mCommandName;	// Name of the running program, eg, "OpenBTS"
@@ -80,9 +87,13 @@ class Parser {
 	CLIStatus process(const char* line, ostream& os) const;
 	void startCommandLine();	// (pat) Start a simple command line processor.
 
-	/** Add a command to the parsing table. */
-	void addCommand(const char* name, CLICommand func, const char* helpString)
-		{ mParseTable[name] = func; mHelpTable[name]=helpString; }
+	/**
+		Add a command to the parsing table.
+		@param shared True if the command changes nothing, so it may run at the same time as other shared commands.
+		@param editArgs Space separated arguments of a shared command that do change things; given any of them it runs alone.
+	*/
+	void addCommand(const char* name, CLICommand func, const char* helpString, bool shared=false, const char *editArgs="")
+		{ mParseTable[name] = func; mHelpTable[name]=helpString; if (shared) mSharedCommands[name] = editArgs; }
 
 	ParseTable::const_iterator begin() const { return mParseTable.begin(); }
 	ParseTable::const_iterator end() const { return mParseTable.end(); }
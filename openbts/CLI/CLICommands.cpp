@@ -32,6 +32,8 @@
 #include <GSMConfig.h>
 #include <GSMLogicalChannel.h>
 #include <GSMCCCH.h>
+#include <GSMExecutor.h>
+#include <GSML3Codec.h>
 #include <ControlTransfer.h>
 #include <L3TranEntry.h>
 #include <TRXManager.h>
@@ -45,6 +47,7 @@
 #include <SIP2Interface.h>
 #include <Peering.h>
 #include <GSMRadioResource.h>
+#include <MSPowerControl.h>
 #include <NodeManager.h>
 #include <CBS.h>
 
@@ -196,37 +199,32 @@ static CLIStatus nop(int argc, char** argv, ostream& os)
 }
 
 
-/** Print or clear the TMSI table. */
-static const char *tmsisHelp = "[-a | -l | -ll | -r | -tab | clear | dump [-l] <filename> | delete -tmsi <tmsi> | delete -imsi <imsi> | query <query> set name=value] -- print the TMSI table\n"
+/** Print the TMSI table. */
+static const char *tmsisHelp = "[-a | -l | -ll | -r | -tab | dump [-l] <filename>] -- print the TMSI table\n"
 	"   -l or -ll -- longer listing\n"
 	"   -a -- lists all TMSIs (default is to show 100 most recent in table)\n"
 	"   -r -- raw TMSI table listing\n"
 	"   -tab -- tab separated listing\n"
-	"   clear -- clear the TMSI table\n"
 	"   dump -- dump the TMSI table to specified filename\n"
-	"   delete -- delete entry for specified IMSI or TMSI\n"
-	"   set name=value -- set TMSI database field name to value. If value is a string, use apostrophes, e.g.: set IMSI='12345678901234'\n"
-	"   query -- run sql query, which may be quoted as shown: tmsis query \"UPDATE TMSI_TABLE SET AUTH=0 WHERE IMSI=='123456789012'\". This option may be removed in the future."
+	"   To change the table use tmsiedit; its options are also accepted here."
 	;
+static CLIStatus tmsiedit(int argc, char** argv, ostream& os);
 static CLIStatus tmsis(int argc, char** argv, ostream& os)
 {
+	int argc0 = argc;
+	char **argv0 = argv;
 	// (pat) We used to allow just "dump" or "clear", so be backward compatible for a while.
 	map<string,string> options = cliParse(argc,argv,os,"-a -l -ll -r -tab dump: clear delete -imsi: -tmsi: query: set:");
-	string imsiopt = translateIMSI(options["-imsi"]);
-	string tmsiopt = options["-tmsi"];
-	unsigned tmsi = strtoul(tmsiopt.c_str(),NULL,0);	// No bad effect if option is empty.
-	bool taboption = !!options.count("-tab");
-	string myquery;
 	if (argc) return BAD_NUM_ARGS;
+	// These are registered as editArgs, so the parser already holds the exclusive lock for them.
+	if (options.count("clear") || options.count("delete") || options.count("query") || options.count("set")) {
+		return tmsiedit(argc0,argv0,os);
+	}
+	bool taboption = !!options.count("-tab");
 	int verbose = 0;
 	if (options.count("-l")) { verbose = 1; }
 	if (options.count("-ll")) { verbose = 2; }
 	bool showAll = options.count("-a");
-	if (options.count("clear")) {
-		os << "clearing TMSI table" << endl;
-		gTMSITable.tmsiTabClear();
-		return SUCCESS;
-	}
 	if (options.count("dump")) {
 		ofstream fileout;
 		string filename = options["dump"];
@@ -236,6 +234,30 @@ static CLIStatus tmsis(int argc, char** argv, ostream& os)
 		gTMSITable.tmsiTabDump(verbose,options.count("-r"),fileout,showAll,taboption);
 		return SUCCESS;
 	}
+	gTMSITable.tmsiTabDump(verbose,options.count("-r"),os,showAll,taboption);
+	return SUCCESS;
+}
+
+/** Clear or change the TMSI table. */
+static const char *tmsieditHelp = "[clear | delete -tmsi <tmsi> | delete -imsi <imsi> | -tmsi <tmsi> set name=value | -imsi <imsi> set name=value | query <query>] -- change the TMSI table\n"
+	"   clear -- clear the TMSI table\n"
+	"   delete -- delete entry for specified IMSI or TMSI\n"
+	"   set name=value -- set TMSI database field name to value. If value is a string, use apostrophes, e.g.: set IMSI='12345678901234'\n"
+	"   query -- run sql query, which may be quoted as shown: tmsiedit query \"UPDATE TMSI_TABLE SET AUTH=0 WHERE IMSI=='123456789012'\". This option may be removed in the future."
+	;
+static CLIStatus tmsiedit(int argc, char** argv, ostream& os)
+{
+	map<string,string> options = cliParse(argc,argv,os,"clear delete -imsi: -tmsi: query: set:");
+	string imsiopt = translateIMSI(options["-imsi"]);
+	string tmsiopt = options["-tmsi"];
+	unsigned tmsi = strtoul(tmsiopt.c_str(),NULL,0);	// No bad effect if option is empty.
+	string myquery;
+	if (argc) return BAD_NUM_ARGS;
+	if (options.count("clear")) {
+		os << "clearing TMSI table" << endl;
+		gTMSITable.tmsiTabClear();
+		return SUCCESS;
+	}
 	if (options.count("delete")) {
 		if (tmsiopt.size()) {
 			if (gTMSITable.dropTmsi(tmsi)) {
@@ -271,7 +293,7 @@ static CLIStatus tmsis(int argc, char** argv, ostream& os)
 	if (options.count("query")) {
 		myquery = options["query"];
 		runmyquery:
-		if (gTMSITable.runQuery(myquery.c_str(),0)) {
+		if (gTMSITable.tmsiTabQuery(myquery.c_str())) {
 			os << "Query success."<<endl;
 			return SUCCESS;
 		} else {
@@ -279,8 +301,7 @@ static CLIStatus tmsis(int argc, char** argv, ostream& os)
 			return FAILURE;
 		}
 	}
-	gTMSITable.tmsiTabDump(verbose,options.count("-r"),os,showAll,taboption);
-	return SUCCESS;
+	return BAD_VALUE;
 }
 
 static const char *cbsHelp = "-- List or add Cell Broadcast Service messages.\n"
@@ -533,6 +554,9 @@ static CLIStatus printStats(int argc, char** argv, ostream& os)
 	//	<< '/' << gConfig.getNum("GPRS.Multislot.Max.Downlink") << '/' << gConfig.getNum("GPRS.Multislot.Max.Uplink") << endl;
 	os << "current PDCHs: " << GPRS::gL2MAC.macActiveChannels() << endl;
 	os << "utilization: " << 100 * GPRS::gL2MAC.macComputeUtilization() << "%" << endl;
+	os << "== Scheduling ==" << endl;
+	gBTS.clock().clockWaitText(os);
+	GSM::gChannelExecutor.ceText(os);
 	//os << "== Resources ==" << endl;
 	//os << format("timeslots: %d Combination-1 (TCH/F) and %d Combination-7 (SDCCH) timeslots",gNumC1s,gNumC7s) <<endl;
 	return SUCCESS;
@@ -1466,6 +1490,61 @@ static CLIStatus powerCommand(int argc, char **argv, ostream& os)
 	}
 
 	os << "current downlink power " << gPowerManager.power() << " dB wrt full scale" << endl;
+	os << gMSPowerControl.pcText() << endl;
+	return SUCCESS;
+}
+
+
+static const char *bertestHelp = "[CN TN [prbs|off|reset]] -- report exact uplink bit and frame error counts for each active channel, "
+	"or for one channel start (prbs) or stop (off) the PRBS9 test pattern in place of speech on a TCH, or restart its counts (reset).";
+
+static CLIStatus bertest(int argc, char **argv, ostream& os)
+{
+	using namespace GSM;
+	if (argc != 1 && argc != 3 && argc != 4) { return BAD_NUM_ARGS; }
+
+	L2ChanList chans;
+	gBTS.getChanVector(chans);
+	if (argc == 1) {
+		for (L2ChanList::iterator it = chans.begin(); it != chans.end(); it++) {
+			L2LogicalChannel *chan = *it;
+			if (!chan->l1active()) { continue; }
+			os << chan->CN() << " " << chan->TN() << " " << chan->typeAndOffset() << " " << chan->getBERCounts().text() << endl;
+		}
+		return SUCCESS;
+	}
+
+	unsigned cn = atoi(argv[1]), tn = atoi(argv[2]);
+	L2LogicalChannel *chan = NULL;
+	for (L2ChanList::iterator it = chans.begin(); it != chans.end(); it++) {
+		// Only a TCH can run the test, and a TCH has the whole timeslot, so prefer it if there is one.
+		if ((*it)->CN() != cn || (*it)->TN() != tn) { continue; }
+		if (chan == NULL || (*it)->chtype() == FACCHType) { chan = *it; }
+	}
+	if (chan == NULL) {
+		os << "no channel at CN=" << cn << " TN=" << tn << endl;
+		return BAD_VALUE;
+	}
+
+	if (argc == 4) {
+		string cmd(argv[3]);
+		if (cmd == "reset") {
+			chan->resetBERCounts();
+		} else if (cmd == "prbs" || cmd == "off") {
+			if (chan->chtype() != FACCHType) {
+				os << "the PRBS test runs only on a TCH" << endl;
+				return BAD_VALUE;
+			}
+			if (cmd == "prbs" && !chan->l1active()) {
+				os << "the PRBS test needs a TCH that is in use" << endl;
+				return BAD_VALUE;
+			}
+			static_cast<TCHFACCHLogicalChannel*>(chan)->setPRBSTest(cmd == "prbs");
+		} else {
+			return BAD_VALUE;
+		}
+	}
+	os << chan->CN() << " " << chan->TN() << " " << chan->typeAndOffset() << " " << chan->getBERCounts().text() << endl;
 	return SUCCESS;
 }
 
@@ -1704,53 +1783,85 @@ static CLIStatus memStat(int argc, char** argv, ostream& os)
 }
 
 
+static CLIStatus l3bench(int argc, char** argv, ostream& os)
+{
+	if (argc > 2) return BAD_NUM_ARGS;
+	unsigned iterations = 10000;
+	if (argc == 2) {
+		iterations = atoi(argv[1]);
+		if (iterations == 0) return BAD_VALUE;
+	}
+	unsigned failures = GSM::l3CodecConformance(os);
+	GSM::l3CodecBenchmark(os,iterations);
+	return failures ? FAILURE : SUCCESS;
+}
+
+
+static CLIStatus sipbench(int argc, char** argv, ostream& os)
+{
+	if (argc > 2) return BAD_NUM_ARGS;
+	unsigned iterations = 10000;
+	if (argc == 2) {
+		iterations = atoi(argv[1]);
+		if (iterations == 0) return BAD_VALUE;
+	}
+	SIP::sipParserBenchmark(os,iterations);
+	return SUCCESS;
+}
+
+
 //@} // CLI commands
 
 
 
 void Parser::addCommands()
 {
+	// The commands marked shared only report, so they may run alongside each other; the rest run one at a time.
 	mCommandName = string("OpenBTS");
-	addCommand("uptime", uptime, "-- show BTS uptime and BTS frame number.");
-	addCommand("help", showHelp, "[command] -- list available commands or gets help on a specific command.");
+	addCommand("uptime", uptime, "-- show BTS uptime and BTS frame number.", true);
+	addCommand("help", showHelp, "[command] -- list available commands or gets help on a specific command.", true);
 	addCommand("restart", exit_function, "[wait] -- restart OpenBTS (if running from upstart), shut down if manually run, either immediately, or waiting for existing calls to clear with a timeout in seconds");
 	addCommand("shutdown", nop, "[] -- shut down via upstart OpenBTS.  If OpenBTS was not started via upstart, it is a no op.");
-	addCommand("tmsis", tmsis, tmsisHelp);
+	addCommand("tmsis", tmsis, tmsisHelp, true, "clear delete query set");
+	addCommand("tmsiedit", tmsiedit, tmsieditHelp);
 	addCommand("sendsms", sendsms, "IMSI src# message... -- send direct SMS to IMSI on this BTS, addressed from source number src#.");
 	addCommand("sendsimple", sendsimple, "IMSI src# message... -- send SMS to IMSI via SIP interface, addressed from source number src#.");
-	addCommand("load", printStats, "-- print the current activity loads.");
+	addCommand("load", printStats, "-- print the current activity loads.", true);
 	addCommand("cellid", cellID, "[MCC MNC LAC CI] -- get/set location area identity (MCC, MNC, LAC) and cell ID (CI).");
-	addCommand("calls", calls, callsHelp);
+	addCommand("calls", calls, callsHelp, true);
 	//addCommand("trans", transactions, "[purge] -- print-only or print-and-purge completed transaction table (tabular format).");
 	addCommand("rawconfig", rawconfig, "[] OR [patt] OR [key val(s)] -- print the current configuration, print configuration values matching a pattern, or set/change a configuration value.");
 	addCommand("trxfactory", trxfactory, "-- print the radio's factory calibration and meta information.");
-	addCommand("audit", audit, "-- audit the current configuration for troubleshooting.");
+	addCommand("audit", audit, "-- audit the current configuration for troubleshooting.", true);
 	addCommand("config", config, "[] OR [patt] OR [key val(s)] -- print the current configuration, print configuration values matching a pattern, or set/change a configuration value.");
 	addCommand("devconfig", devconfig, "[] OR [patt] OR [key val(s)] -- print the current configuration, print configuration values matching a pattern, or set/change a configuration value.");
 	addCommand("regperiod", regperiod, "[GSM] [SIP] -- get/set the registration period (GSM T3212), in MINUTES.");
-	addCommand("alarms", alarms, "-- show latest alarms.");
-	addCommand("version", version,"-- print the version string.");
-	addCommand("page", page, "print the paging table.");
-	addCommand("chans", chans, chansHelp);
+	addCommand("alarms", alarms, "-- show latest alarms.", true);
+	addCommand("version", version,"-- print the version string.", true);
+	addCommand("page", page, "print the paging table.", true);
+	addCommand("chans", chans, chansHelp, true);
         addCommand("rxgain", rxgain, "[newRxgain] -- get/set the RX gain in dB.");
         addCommand("txatten", txatten, "[newTxAtten] -- get/set the TX attenuation in dB.");
 	addCommand("freqcorr", freqcorr, "[newOffset] -- get/set the new radio frequency offset.");
         addCommand("noise", noise, "-- report receive noise level in RSSI dB.");
 	addCommand("rmconfig", rmconfig, "key -- set a configuration value back to its default or remove a custom key/value pair.");
 	addCommand("unconfig", unconfig, "key -- disable a configuration key by setting an empty value.");
-	addCommand("notices", notices, "-- show startup copyright and legal notices.");
+	addCommand("notices", notices, "-- show startup copyright and legal notices.", true);
 	addCommand("endcall", endcall,endcallHelp);
-	addCommand("sysinfo", sysinfo, "-- print current system information messages.");
+	addCommand("sysinfo", sysinfo, "-- print current system information messages.", true);
 	addCommand("neighbors", neighbors, neighborsHelp);
 	addCommand("gprs", GPRS::gprsCLI,"GPRS mode sub-command.  Type: 'gprs help' for more.");
 	addCommand("sgsn", SGSN::sgsnCLI,"SGSN mode sub-command.  Type: 'sgsn help' for more.");
 	addCommand("crashme", crashme, "force crash of OpenBTS for testing purposes.");
 	addCommand("stats", stats,"[patt] OR clear -- print all, or selected, performance counters, OR clear all counters.");
 	addCommand("handover", handover,handoverHelp);
-	addCommand("memstat", memStat, "-- internal testing command: print memory use stats.");
+	addCommand("memstat", memStat, "-- internal testing command: print memory use stats.", true);
+	addCommand("l3bench", l3bench, "[iterations] -- internal testing command: check the table-driven L3 codec against parseL3 and the L3Message serializers, then time it against them.");
+	addCommand("sipbench", sipbench, "[iterations] -- internal testing command: time the SIP and SDP parsers on typical messages, and run the SIP parser on fuzzed copies of them.");
 	addCommand("cbs", cbscmd, cbsHelp);
 
 	addCommand("power", powerCommand, powerHelp);
+	addCommand("bertest", bertest, bertestHelp);
 }
 
 
@@ -16,12 +16,77 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "CLI.h"
 #include <Globals.h>
 #include <Configuration.h>
+#include <Interthread.h>
 
 using namespace CommandLine;
 
+static const int cCLIWorkers = 4;			// Commands that may be running at once, across all connections.
+static const int cStreamChunk = 16*1024;	// Largest piece of a streamed response.
+
+// A command read by the select loop, waiting for a worker.
+struct CLIRequest {
+	int mFd;
+	bool mConsole;
+	string mCmd;
+	CLIRequest(int wFd, bool wConsole, const char *wCmd) : mFd(wFd), mConsole(wConsole), mCmd(wCmd) {}
+};
+
+static InterthreadQueue<CLIRequest> sCLIRequests;
+static Thread sCLIWorkers[cCLIWorkers];
+// A worker writes {fd,status} here when it finishes a command, so the select loop listens to that fd again.
+static int sCLIDonePipe[2];
+
+static bool sendAll(int fd, const char *data, int len)
+{
+	while (len > 0) {
+		int sent = send(fd, data, len, MSG_NOSIGNAL);
+		if (sent <= 0) { return false; }
+		data += sent;
+		len -= sent;
+	}
+	return true;
+}
+
+// Output of a "stream" command.  It goes to the client as the command writes it, in <len>data chunks
+// ended by a zero length, so a huge table is neither held here in full nor limited by the client's buffer.
+// We send only when a chunk fills; sending on every endl would cost a syscall per line.
+class CLIChunkBuf : public std::streambuf {
+	int mFd;
+	bool mFailed;
+	unsigned mTotal;
+	char mBuf[cStreamChunk];
+
+	bool sendChunk(const char *data, int len) {
+		if (mFailed) { return false; }
+		int netLen = htonl(len);
+		if (!sendAll(mFd,(const char*)&netLen,sizeof(netLen)) || !sendAll(mFd,data,len)) { mFailed = true; }
+		mTotal += len;
+		return !mFailed;
+	}
+	bool flushChunk() {
+		int len = pptr() - pbase();
+		setp(mBuf, mBuf+sizeof(mBuf));
+		return len == 0 || sendChunk(mBuf,len);
+	}
+
+	protected:
+	int overflow(int c) {
+		if (!flushChunk()) { return EOF; }
+		if (c != EOF) { *pptr() = c; pbump(1); }
+		return c == EOF ? 0 : c;
+	}
+
+	public:
+	CLIChunkBuf(int wFd) : mFd(wFd), mFailed(false), mTotal(0) { setp(mBuf, mBuf+sizeof(mBuf)); }
+	// Send whatever is left and the terminating empty chunk.
+	bool finish() { flushChunk(); return sendChunk(mBuf,0); }
+	unsigned total() const { return mTotal; }
+};
+
 void Parser::Prompt() const
 {
     printf("%s> ",this->mCommandName.c_str()); fflush(stdout);
@@ -30,9 +95,22 @@ void Parser::Prompt() const
 int Parser::Execute(bool console, const char cmdbuf[], int outfd)
 {
     // step 2 - execute
-    gReports.incr("OpenBTS.CLI.Command");
+    static const ReportHandle sCommandReport = gReports.lookup("OpenBTS.CLI.Command");
+    gReports.incr(sCommandReport);
     const char *type = console ? "Console: " : "Socket: ";
     LOG(INFO) << type << "received command \"" << cmdbuf << "\"";
+    if (!console && strncmp(cmdbuf,"stream ",7) == 0)
+    {
+        CLIChunkBuf chunks(outfd);
+        std::ostream sout(&chunks);
+        int res = this->process(cmdbuf+7,sout);
+        if (!chunks.finish()) {
+            LOG(ERR) << type << "can't send CLI response";
+            gReports.incr("OpenBTS.CLI.Command.ResponseFailure");
+        }
+        LOG(INFO) << type << "streamed " << chunks.total() << "-char result";
+        return res;
+    }
     std::ostringstream sout;
     int res = this->process(cmdbuf,sout);
     const std::string rspString= sout.str();
@@ -70,6 +148,23 @@ int Parser::Execute(bool console, const char cmdbuf[], int outfd)
 }
 
 
+void *Parser::commandWorker(Parser *parser)
+{
+	while (true) {
+		CLIRequest *req = sCLIRequests.read();
+		int done[2];
+		done[0] = req->mFd;
+		done[1] = parser->Execute(req->mConsole, req->mCmd.c_str(), req->mFd);
+		delete req;
+		// Smaller than PIPE_BUF, so the workers' writes do not interleave.
+		if (write(sCLIDonePipe[1], done, sizeof(done)) != sizeof(done)) {
+			LOG(ERR) << "can't return CLI connection to the select loop";
+		}
+	}
+	return NULL;
+}
+
+
 // (pat) 4-2014: Moved this code written by Dave G. from OpenBTS.cpp to this directory so that it can be shared by multiple apps.
 // I did not bother to rename all the gReports variables.
 void Parser::cliServer()
@@ -126,8 +221,21 @@ void Parser::cliServer()
 		COUT(buf);
 	}
 
+	// Commands run on the workers.  While one is running, its connection is out of rdFds, so each
+	// connection still gets its responses in order, but a slow command no longer holds up the others.
+	if (pipe(sCLIDonePipe)) {
+		perror("creating CLI worker pipe");
+		LOG(ALERT) << "cannot create CLI worker pipe";
+		gReports.incr("OpenBTS.Exit.CLI.Socket");
+		exit(1);
+	}
+	for (int w = 0; w < cCLIWorkers; w++) {
+		sCLIWorkers[w].start((void*(*)(void*))commandWorker,this);
+	}
+
 	fd_set rdFds, curFds;
 	FD_ZERO(&rdFds);
+	FD_SET(sCLIDonePipe[0], &rdFds);
 	if (netSockFd != -1) FD_SET(netSockFd, &rdFds);
 	if (isatty(0)) // if not running from a terminal, don't bother
 	{
@@ -148,7 +256,13 @@ void Parser::cliServer()
 			{
 				if (!FD_ISSET(i, &curFds))
 					continue;
-                if (i == 0)
+                if (i == sCLIDonePipe[0])
+                {
+                    int done[2];
+                    if (read(i, done, sizeof(done)) != sizeof(done)) { continue; }
+                    if (done[1] < 0) { isRunning = false; break; }
+                    FD_SET(done[0], &rdFds);
+                } else if (i == 0)
                 {
                     if (NULL == fgets(cmdbuf, sizeof(cmdbuf)-1, stdin)) { continue; }
                     char *p = strchr(cmdbuf, '\n');
@@ -156,8 +270,8 @@ void Parser::cliServer()
                         *p = '\0';
                     else
                         cmdbuf[BUFSIZ-1] = '\0';
-                    int res = Execute(true, cmdbuf, 1); // and ignore the result
-                    if (res < 0) { isRunning = false; }
+                    FD_CLR(0, &rdFds);
+                    sCLIRequests.write(new CLIRequest(0, true, cmdbuf));
                 } else if (i == netSockFd) // accept (tcp)
 				{
 					if (netTcp)
@@ -212,37 +326,32 @@ void Parser::cliServer()
 					}
 					len = ntohl(len);
 					int off = 0;
+					bool closed = false;
 					while(len != 0)
 					{
 						nread = recv(i, &cmdbuf[off], len, 0);
-						if (nread < 0)
-						{
-							LOG(ERR) << "can't read CLI request from stream";
-							gReports.incr("OpenBTS.CLI.Command.ResponseFailure");
-							break;
-						}
-						if (nread == 0) // close
+						if (nread <= 0) // error or close
 						{
+							if (nread < 0) {
+								LOG(ERR) << "can't read CLI request from stream";
+								gReports.incr("OpenBTS.CLI.Command.ResponseFailure");
+							}
 							FD_CLR(i, &rdFds);
 							shutdown(i, SHUT_RDWR);
 							close(i);
-							continue; // go to next socket
+							closed = true;
+							break;
 						}
 						off += nread;
 						len -= nread;
 					}
+					if (closed) { continue; } // go to next socket
 					cmdbuf[off] = '\0';
 
-                    int res = Execute(false, cmdbuf, i);
-                    // (comment by Dave G) NOTE: This change was made because we need to exit as
-                    // quickly as possible, or we end up getting some other
-                    // threads faulting as objects vanish from under them.
-					// (pat 3-2014) I dont think the above helped.  But I had to fix up the exit routines in order to run gprof,
-					// so it is ok to exit normally now.
-                    if (res < 0) {
-						isRunning = false;
-						break;
-					}
+					// The worker hands the fd back through sCLIDonePipe with the status.
+					// A negative status (the exit command) ends this loop there.
+					FD_CLR(i, &rdFds);
+					sCLIRequests.write(new CLIRequest(i, false, cmdbuf));
 				}
 			}
 		} else if (selRet < 0) {
@@ -35,6 +35,7 @@
 #include <vector>
 #include <queue>
 #include <list>
+#include <semaphore.h>
 
 
 
@@ -192,6 +193,15 @@ template <class T, class Fifo=PtrList<T> > class InterthreadQueue {
 		while (mQ.size()>0) delete (T*)mQ.get();
 	}
 
+	/** Delete from the front until at most maxSize remain, taking the lock once.  Return the number deleted. */
+	unsigned trim(size_t maxSize)
+	{
+		ScopedLock lock(*mLockPointer);
+		unsigned count = 0;
+		for (; mQ.size() > maxSize; count++) delete (T*)mQ.get();
+		return count;
+	}
+
 	/** Empty the queue, but don't delete. */
 	void flushNoDelete()
 	{
@@ -735,6 +745,67 @@ template <class T, class C = std::vector<T*>, class Cmp = PointerCompare<T> > cl
 
 
 
+/**
+	Bounded lock-free queue for exactly one producer thread and one consumer thread,
+	for handing work between pipeline stages.  The producer owns mHead and the consumer
+	owns mTail; each only reads the other's index.  Entries are copied in and out, so T
+	should be small, typically a pointer plus some bookkeeping.
+	A POSIX semaphore counts the entries so that the consumer can sleep while the ring
+	is empty; posting it does not enter the kernel unless the consumer is waiting.
+	SIZE must be a power of 2.
+*/
+template <class T, unsigned SIZE> class InterthreadRing {
+
+	T mSlots[SIZE];
+	volatile unsigned mHead;	///< Next slot to write, free running.
+	volatile unsigned mTail;	///< Next slot to read, free running.
+	sem_t mCount;
+
+	public:
+
+	InterthreadRing() : mHead(0), mTail(0) { sem_init(&mCount,0,0); }
+	~InterthreadRing() { sem_destroy(&mCount); }
+
+	unsigned size() const { return mHead - mTail; }
+	unsigned capacity() const { return SIZE; }
+
+	/** Producer side: add an entry, or return false if the ring is full. */
+	bool write(const T& val)
+	{
+		if (mHead - mTail >= SIZE) return false;
+		mSlots[mHead & (SIZE-1)] = val;
+		__sync_synchronize();
+		mHead = mHead + 1;
+		sem_post(&mCount);
+		return true;
+	}
+
+	/** Consumer side: wait for and remove the oldest entry. */
+	T read()
+	{
+		while (sem_wait(&mCount) != 0) { }	// EINTR
+		__sync_synchronize();
+		T val = mSlots[mTail & (SIZE-1)];
+		__sync_synchronize();
+		mTail = mTail + 1;
+		return val;
+	}
+
+	/** Consumer side: remove the oldest entry if there is one. */
+	bool readNoBlock(T& val)
+	{
+		if (sem_trywait(&mCount) != 0) return false;
+		__sync_synchronize();
+		val = mSlots[mTail & (SIZE-1)];
+		__sync_synchronize();
+		mTail = mTail + 1;
+		return true;
+	}
+};
+
+
+
+
 class Semaphore {
 
 	private:
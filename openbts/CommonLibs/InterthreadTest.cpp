@@ -29,6 +29,7 @@
 #include "Threads.h"
 #include "Interthread.h"
 #include <iostream>
+#include <sched.h>
 #include "Configuration.h"
 ConfigurationTable gConfig;
 
@@ -91,6 +92,30 @@ void* mapReader(void*)
 	return NULL;
 }
 
+// The ring is deliberately small so that the writer keeps finding it full.
+static InterthreadRing<int,8> gRing;
+static const int cRingCount = 100000;
+
+void* ringWriter(void*)
+{
+	for (int i=0; i<cRingCount; i++) {
+		while (!gRing.write(i)) { sched_yield(); }
+	}
+	return NULL;
+}
+
+void* ringReader(void*)
+{
+	for (int i=0; i<cRingCount; i++) {
+		int val = gRing.read();
+		assert(val == i);
+	}
+	int extra;
+	assert(!gRing.readNoBlock(extra));
+	COUT("ring passed " << cRingCount << " values in order");
+	return NULL;
+}
+
 static const uint32_t Hyperframe = 1024;
 
 static int32_t FNDelta(int32_t v1, int32_t v2)
@@ -204,10 +229,17 @@ int main(int argc, char *argv[])
 	Thread mapWriterThread;
 	mapWriterThread.start(mapWriter,NULL);
 
+	Thread ringReaderThread;
+	ringReaderThread.start(ringReader,NULL);
+	Thread ringWriterThread;
+	ringWriterThread.start(ringWriter,NULL);
+
 	qReaderThread.join();
 	qWriterThread.join();
 	mapReaderThread.join();
 	mapWriterThread.join();
+	ringReaderThread.join();
+	ringWriterThread.join();
 }
 
 
@@ -38,8 +38,24 @@ static const char* createReportingTable = {
 };
 
 
+// Each thread gets a shard the first time it reports anything.  Zero means not yet assigned.
+static __thread unsigned tReportShard = 0;
+static unsigned gReportNextShard = 0;
+
+unsigned ReportingTable::rtShard()
+{
+	if (tReportShard == 0) {
+		tReportShard = __sync_fetch_and_add(&gReportNextShard,1) % cShards + 1;
+	}
+	return tReportShard - 1;
+}
+
 ReportingTable::ReportingTable(const char* filename)
+	: mShards(new ReportShard[cShards]())
 {
+	memset((void*)mGauge,0,sizeof(mGauge));
+	memset((void*)mGaugeSet,0,sizeof(mGaugeSet));
+	mNames.reserve(cMaxParams);
 	gLogEarly(LOG_INFO | mFacility, "opening reporting table from path %s", filename);
 	// Connect to the database.
 	int rc = sqlite3_open(filename,&mDB);
@@ -62,16 +78,67 @@ ReportingTable::ReportingTable(const char* filename)
 }
 
 
-bool ReportingTable::create(const char* paramName)
+// Caller holds mLock.
+ReportHandle ReportingTable::rtNewHandle(const std::string &name)
 {
-	// add this report name to the batch map
-	mLock.lock();
-	if (mBatch.find(paramName) == mBatch.end()) {
-		mBatch[paramName] = 0;
+	if (mNames.size() >= cMaxParams) {
+		LOG(ALERT) << "too many reporting parameters, ignoring " << name;
+		return cNoReport;
 	}
-	mLock.unlock();
+	mNames.push_back(name);
+	return mNames.size() - 1;
+}
 
-	// and to the database
+ReportHandle ReportingTable::lookup(const char* paramName)
+{
+	ScopedLock lock(mLock);
+	HandleMap::iterator it = mHandles.find(paramName);
+	if (it != mHandles.end()) { return it->second; }
+	ReportHandle h = rtNewHandle(paramName);
+	if (h != cNoReport) { mHandles[paramName] = h; }
+	return h;
+}
+
+// The handles for an indexed set are contiguous so incr() does not need to format the name.
+// If some of the names were already registered singly they end up with two handles,
+// which is harmless because commit() adds each handle into the database separately.
+ReportRange ReportingTable::lookup(const char* baseName, unsigned minIndex, unsigned maxIndex)
+{
+	ScopedLock lock(mLock);
+	RangeMap::iterator it = mRanges.find(baseName);
+	if (it != mRanges.end() && it->second.mMinIndex == minIndex && it->second.mMaxIndex == maxIndex) { return it->second; }
+	ReportRange range;
+	if (maxIndex < minIndex || mNames.size() + (maxIndex - minIndex + 1) > cMaxParams) {
+		LOG(ALERT) << "cannot register reporting parameters " << baseName << "." << minIndex << " to " << maxIndex;
+		return range;
+	}
+	range.mBase = mNames.size();
+	range.mMinIndex = minIndex;
+	range.mMaxIndex = maxIndex;
+	char name[strlen(baseName)+12];
+	for (unsigned i = minIndex; i <= maxIndex; i++) {
+		sprintf(name,"%s.%u",baseName,i);
+		ReportHandle h = rtNewHandle(name);
+		if (mHandles.find(name) == mHandles.end()) { mHandles[name] = h; }
+	}
+	mRanges[baseName] = range;
+	return range;
+}
+
+ReportHistogram ReportingTable::lookupHistogram(const char* baseName)
+{
+	ReportHistogram hist;
+	hist.mBuckets = lookup(baseName,0,ReportHistogram::cBuckets-1);
+	char name[strlen(baseName)+5];
+	sprintf(name,"%s.max",baseName);
+	hist.mMax = lookup(name);
+	return hist;
+}
+
+
+// Add the parameter to the database.
+bool ReportingTable::rtInsert(const char* paramName)
+{
 	char cmd[200];
 	sprintf(cmd,"INSERT OR IGNORE INTO REPORTING (NAME,CLEAREDTIME) VALUES (\"%s\",%ld)", paramName, time(NULL));
 	if (!sqlite3_command(mDB,cmd)) {
@@ -82,32 +149,41 @@ bool ReportingTable::create(const char* paramName)
 }
 
 
+bool ReportingTable::create(const char* paramName)
+{
+	// add this report name to the registry
+	lookup(paramName);
+	// and to the database
+	return rtInsert(paramName);
+}
+
 
 bool ReportingTable::incr(const char* paramName)
 {
-	mLock.lock();
-	mBatch[paramName]++;
-	mLock.unlock();
-
+	incr(lookup(paramName));
 	return true;
 }
 
 
-
 bool ReportingTable::max(const char* paramName, unsigned newVal)
 {
-	char cmd[200];
-	sprintf(cmd,"UPDATE REPORTING SET VALUE=MAX(VALUE,%u), UPDATETIME=%ld WHERE NAME=\"%s\"", newVal, time(NULL), paramName);
-	if (!sqlite3_command(mDB,cmd)) {
-		gLogEarly(LOG_CRIT|mFacility, "cannot maximize reporting parameter %s, error message: %s", paramName, sqlite3_errmsg(mDB));
-		return false;
-	}
+	max(lookup(paramName),newVal);
 	return true;
 }
 
 
 bool ReportingTable::clear(const char* paramName)
 {
+	ReportHandle h = lookup(paramName);
+	ScopedLock lock(mCommitLock);
+	// Discard anything not yet committed.
+	if (h != cNoReport) {
+		for (unsigned s = 0; s < cShards; s++) {
+			__sync_fetch_and_and(&mShards[s].mCount[h],0);
+			__sync_fetch_and_and(&mShards[s].mMax[h],0);
+		}
+		mGaugeSet[h] = false;
+	}
 	char cmd[200];
 	sprintf(cmd,"UPDATE REPORTING SET VALUE=0, UPDATETIME=0, CLEAREDTIME=%ld WHERE NAME=\"%s\"", time(NULL), paramName);
 	if (!sqlite3_command(mDB,cmd)) {
@@ -121,6 +197,15 @@ bool ReportingTable::clear(const char* paramName)
 
 bool ReportingTable::clear()
 {
+	ScopedLock lock(mCommitLock);
+	// Discard anything not yet committed.
+	for (unsigned s = 0; s < cShards; s++) {
+		for (unsigned h = 0; h < cMaxParams; h++) {
+			__sync_fetch_and_and(&mShards[s].mCount[h],0);
+			__sync_fetch_and_and(&mShards[s].mMax[h],0);
+		}
+	}
+	memset((void*)mGaugeSet,0,sizeof(mGaugeSet));
 	char cmd[200];
 	sprintf(cmd,"UPDATE REPORTING SET VALUE=0, UPDATETIME=0, CLEAREDTIME=%ld", time(NULL));
 	if (!sqlite3_command(mDB,cmd)) {
@@ -133,18 +218,28 @@ bool ReportingTable::clear()
 
 bool ReportingTable::create(const char* baseName, unsigned minIndex, unsigned maxIndex)
 {
+	lookup(baseName,minIndex,maxIndex);
 	size_t sz = strlen(baseName);
 	for (unsigned i = minIndex; i<=maxIndex; i++) {
-		char name[sz+10];
+		char name[sz+12];
 		sprintf(name,"%s.%u",baseName,i);
-		if (!create(name)) return false;
+		if (!rtInsert(name)) return false;
 	}
 	return true;
 }
 
+bool ReportingTable::createHistogram(const char* baseName)
+{
+	lookupHistogram(baseName);
+	if (!create(baseName,0,ReportHistogram::cBuckets-1)) return false;
+	char name[strlen(baseName)+5];
+	sprintf(name,"%s.max",baseName);
+	return rtInsert(name);
+}
+
 bool ReportingTable::incr(const char* baseName, unsigned index)
 {
-	char name[strlen(baseName)+10];
+	char name[strlen(baseName)+12];
 	sprintf(name,"%s.%u",baseName,index);
 	return incr(name);
 }
@@ -152,7 +247,7 @@ bool ReportingTable::incr(const char* baseName, unsigned index)
 
 bool ReportingTable::max(const char* baseName, unsigned index, unsigned newVal)
 {
-	char name[strlen(baseName)+10];
+	char name[strlen(baseName)+12];
 	sprintf(name,"%s.%u",baseName,index);
 	return max(name,newVal);
 }
@@ -160,45 +255,68 @@ bool ReportingTable::max(const char* baseName, unsigned index, unsigned newVal)
 
 bool ReportingTable::clear(const char* baseName, unsigned index)
 {
-	char name[strlen(baseName)+10];
+	char name[strlen(baseName)+12];
 	sprintf(name,"%s.%u",baseName,index);
 	return clear(name);
 }
 
 bool ReportingTable::commit()
 {
-	ReportBatch oustanding;
-	ReportBatch::iterator mp;
-	unsigned oustandingCount = 0;
+	ScopedLock commitLock(mCommitLock);
 
-	// copy out to free up access to mBatch as quickly as possible
-	mLock.lock();
-	mp = mBatch.begin();
-	while (mp != mBatch.end()) {
-		if (mp->second > 0) {
-			oustanding[mp->first] = mp->second;
-			mBatch[mp->first] = 0;
-			oustandingCount++;
-		}
-		mp++;
+	// Copy the names out to free up the registry as quickly as possible.
+	std::vector<std::string> names;
+	{
+		ScopedLock lock(mLock);
+		names = mNames;
 	}
-	mLock.unlock();
-
-	// now actually write them into the db if needed
-	if (oustandingCount > 0) {
-		Timeval timer;
-		char cmd[200];
 
-		// TODO : could wrap this in a BEGIN; COMMIT; pair to transactionize these X UPDATEs
-		mp = oustanding.begin();
-		while (mp != oustanding.end()) {
-			sprintf(cmd,"UPDATE REPORTING SET VALUE=VALUE+%u, UPDATETIME=%ld WHERE NAME=\"%s\"", mp->second, time(NULL), mp->first.c_str());
+	// Fold the shards.  Each slot is swapped with zero, so an update racing with us lands in the next commit.
+	Timeval timer;
+	char cmd[200];
+	unsigned oustandingCount = 0;
+	long now = time(NULL);
+	for (ReportHandle h = 0; h < names.size(); h++) {
+		unsigned count = 0, maxVal = 0;
+		bool haveMax = false;
+		for (unsigned s = 0; s < cShards; s++) {
+			if (mShards[s].mCount[h]) { count += __sync_fetch_and_and(&mShards[s].mCount[h],0); }
+			if (mShards[s].mMax[h]) {
+				unsigned m = __sync_fetch_and_and(&mShards[s].mMax[h],0);
+				if (m > maxVal) { maxVal = m; }
+				haveMax = true;
+			}
+		}
+		const char *name = names[h].c_str();
+		if (count) {
+			if (oustandingCount++ == 0) { sqlite3_command(mDB,"BEGIN"); }
+			sprintf(cmd,"UPDATE REPORTING SET VALUE=VALUE+%u, UPDATETIME=%ld WHERE NAME=\"%s\"", count, now, name);
+			if (!sqlite3_command(mDB,cmd)) {
+				LOG(CRIT) << "could not increment reporting parameter " << name << ", error message: " << sqlite3_errmsg(mDB);
+			}
+		}
+		if (haveMax) {
+			if (oustandingCount++ == 0) { sqlite3_command(mDB,"BEGIN"); }
+			sprintf(cmd,"UPDATE REPORTING SET VALUE=MAX(VALUE,%u), UPDATETIME=%ld WHERE NAME=\"%s\"", maxVal, now, name);
+			if (!sqlite3_command(mDB,cmd)) {
+				LOG(CRIT) << "could not maximize reporting parameter " << name << ", error message: " << sqlite3_errmsg(mDB);
+			}
+		}
+		if (mGaugeSet[h]) {
+			mGaugeSet[h] = false;
+			__sync_synchronize();
+			if (oustandingCount++ == 0) { sqlite3_command(mDB,"BEGIN"); }
+			sprintf(cmd,"UPDATE REPORTING SET VALUE=%u, UPDATETIME=%ld WHERE NAME=\"%s\"", mGauge[h], now, name);
 			if (!sqlite3_command(mDB,cmd)) {
-				LOG(CRIT) << "could not increment reporting parameter " << mp->first << ", error message: " << sqlite3_errmsg(mDB);
+				LOG(CRIT) << "could not set reporting parameter " << name << ", error message: " << sqlite3_errmsg(mDB);
 			}
-			mp++;
 		}
+	}
 
+	if (oustandingCount > 0) {
+		if (!sqlite3_command(mDB,"COMMIT")) {
+			LOG(CRIT) << "could not commit reporting parameters, error message: " << sqlite3_errmsg(mDB);
+		}
 		LOG(INFO) << "wrote " << oustandingCount << " entries in " << timer.elapsed() << "ms";
 	}
 
@@ -30,25 +30,86 @@
 #include <ostream>
 #include <map>
 #include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
 #include <Threads.h>
 #include <Timeval.h>
 
-typedef std::map<std::string, unsigned> ReportBatch;
+/**
+	A registered parameter, which is an index into the shards of the ReportingTable.
+	Look it up once, eg, in a function static, and pass it to incr() or max() on the fast path.
+*/
+typedef unsigned ReportHandle;
+static const ReportHandle cNoReport = ~0u;	///< Ignored by incr() and max().
+
+/** A contiguous set of handles for an indexed parameter set, eg, "OpenBTS.GSM.RR.RACH.TA.Accepted.0" to ".63". */
+struct ReportRange {
+	ReportHandle mBase;
+	unsigned mMinIndex, mMaxIndex;
+	ReportRange() : mBase(cNoReport), mMinIndex(1), mMaxIndex(0) {}
+	ReportHandle at(unsigned index) const {
+		return (mBase == cNoReport || index < mMinIndex || index > mMaxIndex) ? cNoReport : mBase + index - mMinIndex;
+	}
+};
+
+/**
+	A log2 histogram, stored as the indexed parameter set name.0 to name.(cBuckets-1) plus name.max.
+	Bucket 0 counts samples of 0 and bucket N counts samples in [2^(N-1),2^N); the last bucket also counts anything larger.
+	The units are up to the caller and should be in the name, eg, "OpenBTS.GSM.CC.SetupMsecs".
+*/
+struct ReportHistogram {
+	static const unsigned cBuckets = 20;
+	ReportRange mBuckets;
+	ReportHandle mMax;
+	ReportHistogram() : mMax(cNoReport) {}
+};
+
+/** Monotonic time in microseconds, for timing histogram samples. */
+inline uint64_t reportUsecs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 /**
 	Collect performance statistics into a database.
 	Parameters are counters or max/min trackers, all integer.
+	Each parameter name is registered once and gets a ReportHandle.  Each thread updates its own shard of
+	counters without locking, and commit() sums the shards into the database every 10 seconds, in one transaction.
+	The by-name methods are for infrequent events; they look up the handle first.
 */
 class ReportingTable {
 
 	private:
 
+	static const unsigned cMaxParams = 1024;
+	static const unsigned cShards = 16;		///< Threads are assigned round robin, so a shard may be shared.
+
+	/** One shard of counters; the slots are updated with atomic ops because a shard may be shared. */
+	struct ReportShard {
+		volatile unsigned mCount[cMaxParams];
+		volatile unsigned mMax[cMaxParams];
+	};
+
 	sqlite3* mDB;				///< database connection
 	int mFacility;				///< rsyslogd facility
-	ReportBatch mBatch;			///< batch of report updates, not yet stored in the db
-	mutable Mutex mLock;		///< control for multithreaded read/write access to the batch
+	ReportShard *mShards;		///< cShards of them
+	volatile unsigned mGauge[cMaxParams];	///< last value set, not sharded
+	volatile bool mGaugeSet[cMaxParams];
+	std::vector<std::string> mNames;		///< handle to name, protected by mLock; only grows
+	typedef std::map<std::string, ReportHandle> HandleMap;
+	HandleMap mHandles;			///< name to handle, protected by mLock
+	typedef std::map<std::string, ReportRange> RangeMap;
+	RangeMap mRanges;			///< indexed base name to handles, protected by mLock
+	mutable Mutex mLock;		///< control for multithreaded access to the name registry
+	Mutex mCommitLock;			///< serializes commit() and clear()
 	Thread mBatchCommitter;		///< thread responsible for committing batches of report updates to the db
 
+	ReportHandle rtNewHandle(const std::string &name);
+	static unsigned rtShard();
+	bool rtInsert(const char* paramName);
 
 
 	public:
@@ -66,6 +127,46 @@ class ReportingTable {
 	/** Create an indexed parameter set. */
 	bool create(const char* baseBame, unsigned minIndex, unsigned maxIndex);
 
+	/** Create the parameters for a histogram. */
+	bool createHistogram(const char* baseName);
+
+	/** Return the handle for a parameter, registering it if needed, or cNoReport if the table is full. */
+	ReportHandle lookup(const char* paramName);
+
+	/** Return the handles for an indexed parameter set. */
+	ReportRange lookup(const char* baseName, unsigned minIndex, unsigned maxIndex);
+
+	/** Return the handles for a histogram. */
+	ReportHistogram lookupHistogram(const char* baseName);
+
+	/** Increment a counter.  This is lock free. */
+	void incr(ReportHandle h) {
+		if (h < cMaxParams) { __sync_fetch_and_add(&mShards[rtShard()].mCount[h],1); }
+	}
+
+	/** Take a max of a parameter.  This is lock free. */
+	void max(ReportHandle h, unsigned newVal) {
+		if (h >= cMaxParams) { return; }
+		volatile unsigned *slot = &mShards[rtShard()].mMax[h];
+		unsigned old;
+		while (newVal > (old = *slot) && ! __sync_bool_compare_and_swap(slot,old,newVal)) {}
+	}
+
+	/** Set a gauge; the last value set before commit() is written to the database. */
+	void set(ReportHandle h, unsigned newVal) {
+		if (h >= cMaxParams) { return; }
+		mGauge[h] = newVal;
+		__sync_synchronize();
+		mGaugeSet[h] = true;
+	}
+
+	/** Add a sample to a histogram. */
+	void sample(const ReportHistogram &hist, unsigned value) {
+		unsigned bucket = value ? 32 - __builtin_clz(value) : 0;
+		incr(hist.mBuckets.at(bucket < ReportHistogram::cBuckets ? bucket : ReportHistogram::cBuckets-1));
+		max(hist.mMax,value);
+	}
+
 	/** Increment a counter. */
 	bool incr(const char* paramName);
 
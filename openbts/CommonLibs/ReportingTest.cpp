@@ -23,41 +23,110 @@
 */
 
 
-#include "stdlib.h"
-#include <syslog.h>
-#include <time.h>
-
+#include <stdio.h>
+#include <iostream>
 #include "Reporting.h"
+#include "Threads.h"
+using namespace std;
 
+#include "Configuration.h"
+ConfigurationTable gConfig;
 
-int main(int argc, char *argv[])
-{
+// Check that the per-thread shards sum to the right counts and maxes in commit(), and the histogram bucket edges.
 
-	srandom(time(NULL));
+static const char *testdb = "/tmp/ReportingTest.db";
+ReportingTable gReports(testdb);
 
-	ReportingTable rpt("./test.db",LOG_LOCAL7);
+static const unsigned numThreads = 40;		// More threads than shards, so some shards are shared.
+static const unsigned numIncrs = 20000;
 
-	rpt.create("count1");
-	rpt.create("count2");
-	rpt.create("max1");
-	rpt.create("max2");
+static int failures = 0;
+#define CHECK(cond) if (!(cond)) { cout << "FAIL line " << __LINE__ << ": " #cond << endl; failures++; }
 
-	rpt.incr("count1");
-	rpt.incr("count2");
-	rpt.incr("count1");
+static ReportHandle sCount, sMax;
 
-	rpt.clear("max1");
-	rpt.max("max1",random());
-	rpt.max("max2",random());
+static void *incrThread(void *arg)
+{
+	unsigned id = (unsigned)(long)arg;
+	for (unsigned i = 0; i < numIncrs; i++) {
+		gReports.incr(sCount);
+		gReports.max(sMax,id * numIncrs + i);
+	}
+	return NULL;
+}
 
-	rpt.create("indexed",5,10);
-	for (int i=0; i<20; i++) {
-		rpt.incr("indexed",random()%6 + 5);
+static unsigned reportValue(sqlite3 *db, const char *name)
+{
+	unsigned value = ~0u;
+	if (! sqlite3_single_lookup(db,"REPORTING","NAME",name,"VALUE",value)) {
+		cout << "no value for " << name << endl;
+	}
+	return value;
+}
+
+int main(int argc, char *argv[])
+{
+	gReports.clear();
+	sqlite3 *db;
+	CHECK(sqlite3_open(testdb,&db) == 0);
+	sqlite3_busy_timeout(db,1000);
+
+	// Counters and maxes from many threads.
+	CHECK(gReports.create("Test.Count"));
+	CHECK(gReports.create("Test.Max"));
+	sCount = gReports.lookup("Test.Count");
+	sMax = gReports.lookup("Test.Max");
+	CHECK(sCount != cNoReport && sMax != cNoReport && sCount != sMax);
+	CHECK(gReports.lookup("Test.Count") == sCount);
+	Thread threads[numThreads];
+	for (unsigned t = 0; t < numThreads; t++) { threads[t].start(incrThread,(void*)(long)t); }
+	for (unsigned t = 0; t < numThreads; t++) { threads[t].join(); }
+	CHECK(gReports.commit());
+	CHECK(reportValue(db,"Test.Count") == numThreads * numIncrs);
+	CHECK(reportValue(db,"Test.Max") == numThreads * numIncrs - 1);
+	// The shards were zeroed by the commit, so a second commit must not add them again.
+	gReports.incr(sCount);
+	gReports.max(sMax,5);
+	CHECK(gReports.commit());
+	CHECK(reportValue(db,"Test.Count") == numThreads * numIncrs + 1);
+	CHECK(reportValue(db,"Test.Max") == numThreads * numIncrs - 1);
+	// The by-name methods go to the same slots.
+	CHECK(gReports.incr("Test.Count"));
+	CHECK(gReports.commit());
+	CHECK(reportValue(db,"Test.Count") == numThreads * numIncrs + 2);
+
+	// Indexed parameters.
+	CHECK(gReports.create("Test.Indexed",5,10));
+	ReportRange range = gReports.lookup("Test.Indexed",5,10);
+	CHECK(range.at(4) == cNoReport && range.at(11) == cNoReport);
+	for (unsigned i = 5; i <= 10; i++) {
+		for (unsigned j = 0; j < i; j++) { gReports.incr(range.at(i)); }
+	}
+	CHECK(gReports.commit());
+	for (unsigned i = 5; i <= 10; i++) {
+		char name[40];
+		snprintf(name,sizeof(name),"Test.Indexed.%u",i);
+		CHECK(reportValue(db,name) == i);
 	}
 
-	rpt.create("indexedMax",5,10);
-	for (int i=5; i<=10; i++) {
-		rpt.max("indexedMax", i, random());
+	// Histogram bucket edges: bucket 0 is 0, bucket N is [2^(N-1),2^N), and the last bucket takes the rest.
+	CHECK(gReports.createHistogram("Test.Hist"));
+	ReportHistogram hist = gReports.lookupHistogram("Test.Hist");
+	static const unsigned samples[] = { 0, 1, 2, 3, 4, 7, 8, 15, 16, (1u<<18)-1, 1u<<18, (1u<<19)-1, 1u<<19, 0xffffffffu };
+	static const unsigned expected[ReportHistogram::cBuckets] = { 1, 1, 2, 2, 2, 1, 0,0,0,0,0,0,0,0,0,0,0,0, 1, 4 };
+	for (unsigned i = 0; i < sizeof(samples)/sizeof(samples[0]); i++) { gReports.sample(hist,samples[i]); }
+	CHECK(gReports.commit());
+	for (unsigned b = 0; b < ReportHistogram::cBuckets; b++) {
+		char name[40];
+		snprintf(name,sizeof(name),"Test.Hist.%u",b);
+		unsigned value = reportValue(db,name);
+		if (value != expected[b]) { cout << name << "=" << value << " expected " << expected[b] << endl; }
+		CHECK(value == expected[b]);
 	}
+	CHECK(reportValue(db,"Test.Hist.max") == 0xffffffffu);
 
+	gReports.reportShutdown();
+	sqlite3_close(db);
+	cout << (failures ? "FAILED" : "PASSED") << endl;
+	return failures ? 1 : 0;
 }
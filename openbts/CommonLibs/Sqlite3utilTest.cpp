@@ -0,0 +1,115 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <iostream>
+#include "sqlite3util.h"
+#include "Timeval.h"
+#include "Utils.h"
+using namespace std;
+
+#include "Configuration.h"
+ConfigurationTable gConfig;
+
+// Exercise the prepared statement cache and the write-behind queue, and compare the write-behind
+// against one autocommit statement per update, which is what TMSITable used to do.
+
+static const char *testdb = "/tmp/Sqlite3utilTest.db";
+static const unsigned numRows = 2000;
+
+static int failures = 0;
+#define CHECK(cond) if (!(cond)) { cout << "FAIL line " << __LINE__ << ": " #cond << endl; failures++; }
+
+int main(int argc, char *argv[])
+{
+	unlink(testdb);
+	sqlite3 *db;
+	CHECK(sqlite3_open(testdb,&db) == 0);
+	CHECK(sqlite_command(db,enableWAL));
+	sqlite3_busy_timeout(db,1000);
+	CHECK(sqlite_command(db,"CREATE TABLE T (K INTEGER PRIMARY KEY, V TEXT, N INTEGER DEFAULT 0)"));
+
+	// Statement cache: the same sql text must return the same statement, reset and with no bindings.
+	sqlStatementCache cache;
+	cache.scSetDB(db);
+	Timeval start;
+	CHECK(sqlite_command(db,"BEGIN"));
+	for (unsigned i = 0; i < numRows; i++) {
+		sqlite3_stmt *stmt = cache.scGet("INSERT INTO T (K,V) VALUES (?,?)");
+		sqlStmtReset reset(stmt);
+		CHECK(stmt != NULL);
+		sqlite3_bind_int(stmt,1,i);
+		sqlite3_bind_text(stmt,2,format("%u",i*7).c_str(),-1,SQLITE_TRANSIENT);
+		CHECK(sqlite3_run_query(db,stmt) == SQLITE_DONE);
+	}
+	CHECK(sqlite_command(db,"COMMIT"));
+	CHECK(cache.scSize() == 1);
+	cout << "cached insert of " << numRows << " rows: " << start.elapsed() << " ms" << endl;
+
+	start.now();
+	for (unsigned i = 0; i < numRows; i++) {
+		sqlite3_stmt *stmt = cache.scGet("SELECT V FROM T WHERE K == ?");
+		sqlStmtReset reset(stmt);
+		sqlite3_bind_int(stmt,1,i);
+		if (sqlite3_run_query(db,stmt) != SQLITE_ROW) { CHECK(0); continue; }
+		CHECK(format("%u",i*7) == (const char*)sqlite3_column_text(stmt,0));
+	}
+	cout << "cached lookup of " << numRows << " rows: " << start.elapsed() << " ms" << endl;
+	start.now();
+	for (unsigned i = 0; i < numRows; i++) {
+		sqlQuery q(db,"T","V","K",i);
+		CHECK(q.sqlSuccess());
+	}
+	cout << "sqlQuery lookup of " << numRows << " rows: " << start.elapsed() << " ms" << endl;
+
+	// Write-behind: everything queued must be visible on our connection after wbFlush.
+	sqlWriteBehind writer;
+	CHECK(writer.wbOpen(testdb,"test"));
+	start.now();
+	for (unsigned i = 0; i < numRows; i++) {
+		CHECK(writer.wbWrite(format("UPDATE T SET N=N+1 WHERE K == %u",i)));
+	}
+	cout << "queue " << numRows << " updates: " << start.elapsed() << " ms" << endl;
+	writer.wbFlush();
+	cout << "queue and commit " << numRows << " updates: " << start.elapsed() << " ms" << endl;
+	sqlQuery sum(db,"T","SUM(N)","");
+	CHECK(sum.getResultInt(0) == numRows);
+	writer.wbText(cout);
+
+	start.now();
+	for (unsigned i = 0; i < numRows; i++) {
+		CHECK(sqlite_command(db,format("UPDATE T SET N=N+1 WHERE K == %u",i).c_str()));
+	}
+	cout << "synchronous " << numRows << " updates: " << start.elapsed() << " ms" << endl;
+
+	writer.wbClose();
+	CHECK(!writer.wbWrite("UPDATE T SET N=0"));
+	cache.scClear();
+	sqlite3_close(db);
+	unlink(testdb);
+
+	cout << (failures ? "FAILED" : "PASSED") << endl;
+	return failures ? 1 : 0;
+}
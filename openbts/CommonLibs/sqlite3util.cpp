@@ -408,3 +408,131 @@ bool sqlite_command(sqlite3* DB, const char* query, int *pResultCode, unsigned r
 
 
 
+
+
+sqlite3_stmt *sqlStatementCache::scGet(const char *sql)
+{
+	if (mscDB == NULL) return NULL;
+	StmtMap::iterator it = mscStmts.find(sql);
+	if (it != mscStmts.end()) {
+		sqlite3_reset(it->second);
+		sqlite3_clear_bindings(it->second);
+		return it->second;
+	}
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_statement(mscDB,&stmt,sql)) return NULL;
+	mscStmts[sql] = stmt;
+	return stmt;
+}
+
+void sqlStatementCache::scClear()
+{
+	for (StmtMap::iterator it = mscStmts.begin(); it != mscStmts.end(); it++) {
+		sqlite3_finalize(it->second);
+	}
+	mscStmts.clear();
+}
+
+
+bool sqlWriteBehind::wbOpen(const char *path, const char *name, unsigned batchMax)
+{
+	if (mwbRunning) return true;
+	mwbName = name;
+	mwbBatchMax = batchMax ? batchMax : 1;
+	if (sqlite3_open(path,&mwbDB)) {
+		// (pat) You must not call LOG() from this file because it causes infinite recursion through gGetLoggingLevel and ConfigurationTable::lookup
+		_LOG(ALERT) << "Cannot open " << name << " write-behind connection to " << path << ": " << sqlite3_errmsg(mwbDB);
+		sqlite3_close(mwbDB);
+		mwbDB = NULL;
+		return false;
+	}
+	// The owner's connection writes to the same file, so let sqlite wait out its locks rather than failing the batch.
+	sqlite3_busy_timeout(mwbDB,2000);
+	mwbRunning = true;
+	mwbThread.start((void*(*)(void*))wbServiceLoop,this);
+	return true;
+}
+
+void sqlWriteBehind::wbClose()
+{
+	if (!mwbRunning) return;
+	wbFlush();
+	mwbLock.lock();
+	mwbRunning = false;
+	mwbWakeup.signal();
+	mwbLock.unlock();
+	mwbThread.join();
+	sqlite3_close(mwbDB);
+	mwbDB = NULL;
+}
+
+bool sqlWriteBehind::wbWrite(const std::string &sql)
+{
+	ScopedLock lock(mwbLock);
+	if (!mwbRunning) return false;
+	mwbQueue.push_back(sql);
+	if (mwbQueue.size() > mwbMaxDepth) { mwbMaxDepth = mwbQueue.size(); }
+	mwbWakeup.signal();
+	return true;
+}
+
+void sqlWriteBehind::wbFlush()
+{
+	ScopedLock lock(mwbLock);
+	while (mwbRunning && (mwbQueue.size() || mwbBusy)) {
+		mwbDone.wait(mwbLock,1000);
+	}
+}
+
+void sqlWriteBehind::wbText(std::ostream &os) const
+{
+	ScopedLock lock(mwbLock);
+	os << mwbName << " write-behind:" << " queued=" << mwbQueue.size() << " maxQueued=" << mwbMaxDepth
+		<< " writes=" << mwbWrites << " batches=" << mwbBatches << " failures=" << mwbFailures << endl;
+}
+
+void *sqlWriteBehind::wbServiceLoop(sqlWriteBehind *wb)
+{
+	wb->wbRun();
+	return NULL;
+}
+
+void sqlWriteBehind::wbRun()
+{
+	vector<string> batch;
+	batch.reserve(mwbBatchMax);
+	mwbLock.lock();
+	while (mwbRunning) {
+		if (mwbQueue.empty()) {
+			mwbWakeup.wait(mwbLock,1000);
+			continue;
+		}
+		while (mwbQueue.size() && batch.size() < mwbBatchMax) {
+			batch.push_back(mwbQueue.front());
+			mwbQueue.pop_front();
+		}
+		mwbBusy = batch.size();
+		mwbLock.unlock();
+
+		// If BEGIN fails we still run the statements, just without the batching.
+		bool inTransaction = batch.size() > 1 && sqlite_command(mwbDB,"BEGIN");
+		unsigned failures = 0;
+		for (unsigned i = 0; i < batch.size(); i++) {
+			if (!sqlite_command(mwbDB,batch[i].c_str())) { failures++; }
+		}
+		if (inTransaction && !sqlite_command(mwbDB,"COMMIT")) {
+			_LOG(ERR) << mwbName << " write-behind commit failed: " << sqlite3_errmsg(mwbDB);
+			sqlite_command(mwbDB,"ROLLBACK");
+			failures = batch.size();
+		}
+
+		mwbLock.lock();
+		mwbWrites += batch.size();
+		mwbBatches++;
+		mwbFailures += failures;
+		mwbBusy = 0;
+		batch.clear();
+		mwbDone.broadcast();
+	}
+	mwbLock.unlock();
+}
@@ -28,6 +28,10 @@
 #include <sqlite3.h>
 #include <string>
 #include <vector>
+#include <map>
+#include <deque>
+#include <ostream>
+#include "Threads.h"
 
 // (pat) Dont put statics in .h files - they generate a zillion g++ error messages.
 extern const char *enableWAL;
@@ -103,4 +107,90 @@ bool sqlite3_exists(sqlite3* DB, const char* tableName,
 bool sqlite_command(sqlite3* DB, const char* query, int *pResultCode = NULL, unsigned retries=5);
 bool inline sqlite3_command(sqlite3* DB, const char* query, unsigned retries = 5) { return sqlite_command(DB,query,NULL,retries); }
 
+
+// The sqlQuery and sqlite_command wrappers above parse the sql text on every call, which for a hot lookup costs
+// more than the lookup itself.  The following classes let a caller keep prepared statements around and bind the variable parts.
+
+/**
+	A per-connection cache of prepared statements keyed by their sql text, which should use '?' placeholders for the variable parts.
+	The cache does no locking; the owner must serialize access to the connection, and each statement
+	must be finished (see sqlStmtReset) before the same sql text is fetched again.
+*/
+class sqlStatementCache {
+	sqlite3 *mscDB;
+	typedef std::map<std::string,sqlite3_stmt*> StmtMap;
+	StmtMap mscStmts;
+
+	public:
+	sqlStatementCache() : mscDB(0) {}
+	~sqlStatementCache() { scClear(); }
+
+	/** Set the connection, discarding any statements prepared on the previous one. */
+	void scSetDB(sqlite3 *db) { scClear(); mscDB = db; }
+
+	/** Return a reset statement with no bindings, preparing it on first use, or NULL on error. */
+	sqlite3_stmt *scGet(const char *sql);
+
+	/** Finalize all the cached statements. */
+	void scClear();
+	unsigned scSize() const { return mscStmts.size(); }
+};
+
+/** Reset a cached statement when it goes out of scope so it does not hold a read transaction open. */
+class sqlStmtReset {
+	sqlite3_stmt *mStmt;
+	public:
+	sqlStmtReset(sqlite3_stmt *wStmt) : mStmt(wStmt) {}
+	~sqlStmtReset() { if (mStmt) sqlite3_reset(mStmt); }
+};
+
+
+/**
+	An asynchronous write-behind queue for one database file.
+	Statements are run in order by a background thread on its own connection, batched into a single transaction
+	so a burst of updates costs one journal commit instead of one per statement.
+	Use this only for writes that nobody needs to see immediately, eg, access timestamps and reporting tables;
+	wbFlush() waits for everything queued so far to be committed.
+*/
+class sqlWriteBehind {
+	sqlite3 *mwbDB;
+	std::string mwbName;		///< for messages
+	unsigned mwbBatchMax;		///< most statements per transaction
+	mutable Mutex mwbLock;
+	Signal mwbWakeup;			///< signaled when a statement is queued
+	Signal mwbDone;				///< signaled when a batch is committed
+	std::deque<std::string> mwbQueue;
+	unsigned mwbBusy;			///< statements taken off the queue but not yet committed
+	Thread mwbThread;
+	volatile bool mwbRunning;
+	// Statistics, protected by mwbLock.
+	unsigned long mwbWrites, mwbBatches, mwbFailures;
+	unsigned mwbMaxDepth;
+
+	static void *wbServiceLoop(sqlWriteBehind *wb);
+	void wbRun();
+
+	public:
+	sqlWriteBehind() : mwbDB(0), mwbBatchMax(0), mwbBusy(0), mwbThread(32*1024*sizeof(void*)), mwbRunning(false),
+		mwbWrites(0), mwbBatches(0), mwbFailures(0), mwbMaxDepth(0) {}
+	~sqlWriteBehind() { wbClose(); }
+
+	/**
+		Open a second connection to the database file and start the writer thread.
+		The file should be in WAL mode so readers on other connections are not blocked by the writer.
+		@return true on success.
+	*/
+	bool wbOpen(const char *path, const char *name, unsigned batchMax = 64);
+	/** Flush the queue, stop the writer thread and close its connection. */
+	void wbClose();
+	bool wbRunning() const { return mwbRunning; }
+
+	/** Queue a statement; if the writer is not running the statement is dropped and false returned. */
+	bool wbWrite(const std::string &sql);
+	/** Wait until every statement queued before this call has been committed. */
+	void wbFlush();
+	/** Print statistics. */
+	void wbText(std::ostream &os) const;
+};
+
 #endif
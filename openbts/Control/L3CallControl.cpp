@@ -52,6 +52,7 @@ class CCBase : public SSDBase {
 	MachineStatus sendReleaseComplete(TermCause cause, bool sendCause);
 	MachineStatus sendRelease(TermCause cause, bool sendCause);
 	void handleTerminationRequest();
+	void sampleSetupTime();
 };
 
 class MOCMachine : public CCBase {
@@ -401,6 +402,13 @@ MachineStatus MOCMachine::sendCMServiceReject(MMRejectCause rejectCause, bool fa
 
 bool CCBase::isVeryEarly() { return (channel()->chtype()==GSM::FACCHType); }
 
+// Called when the call connects.
+void CCBase::sampleSetupTime()
+{
+	static const ReportHistogram sSetupReport = gReports.lookupHistogram("OpenBTS.GSM.CC.SetupMsecs");
+	gReports.sample(sSetupReport,(reportUsecs() - tran()->mStartUsecs) / 1000);
+}
+
 
 // GSM 04.08 5.2.1.2
 // This is where we set the TI [Transaction Identifier] in the TranEntry to what the MS sent us in the L3Setup message.
@@ -672,6 +680,7 @@ MachineStatus MOCMachine::machineRunState(int state, const GSM::L3Message *l3msg
 		case L3CASE_SIP(dialogActive): {
 			// Success!  The call is connected.
 			tran()->mConnectTime = time(NULL);
+			sampleSetupTime();
 
 			if (gConfig.getBool("GSM.Cipher.Encrypt")) {
 				int encryptionAlgorithm = gTMSITable.tmsiTabGetPreferredA5Algorithm(tran()->subscriberIMSI().c_str());
@@ -1006,6 +1015,7 @@ MachineStatus MTCMachine::machineRunState(int state, const GSM::L3Message* l3msg
 		case L3CASE_SIP(dialogActive): {		// SIP Dialog received SIP ACK to 200 OK.
 			// Success!  The call is connected.
 			tran()->mConnectTime = time(NULL);
+			sampleSetupTime();
 
 			// (pat) To doug: The place to move cipher starting is probably InCallMachine::machineRunState case stateStart.
 			if (gConfig.getBool("GSM.Cipher.Encrypt")) {
@@ -172,7 +172,8 @@ static BestNeighbor YesHandover(BestNeighbor &np, L3Cause::BSSCause why)
 }
 
 
-static BestNeighbor HandoverDecision(const L3MeasurementResults* measurements, SACCHLogicalChannel* sacch)
+// If there is no handover yet but the best neighbor is within GSM.Handover.Prepare.Margin of one, set prepare.
+static BestNeighbor HandoverDecision(const L3MeasurementResults* measurements, SACCHLogicalChannel* sacch, bool &prepare)
 {
 	ChannelHistory *chp = sacch->getChannelHistory();
 	int myRXLEV_DL = chp->getAvgRxlev();
@@ -194,8 +195,11 @@ static BestNeighbor HandoverDecision(const L3MeasurementResults* measurements, S
 		return NoHandover(bestn);
 	}
 
-	if (bestn.mRxlev - myRXLEV_DL >= margin) { return YesHandover(bestn,L3Cause::Downlink_Strength); }
+	int rxdiff = bestn.mRxlev - myRXLEV_DL;
+	if (rxdiff >= margin) { return YesHandover(bestn,L3Cause::Downlink_Strength); }
 
+	int prepareMargin = gConfig.GSM.Handover.Prepare.Margin;
+	prepare = prepareMargin && rxdiff >= margin - prepareMargin;
 	return NoHandover(bestn);
 }
 
@@ -212,9 +216,10 @@ void HandoverDetermination(const L3MeasurementResults* measurements, SACCHLogica
 	// Currently processNeighborParams() detects this condition when it gets a Peer report (but not at startup!)
 	// but we dont save the BSIC in memory so we dont have that information here where we need it.
 
-	BestNeighbor bestn = HandoverDecision(measurements, sacch);
-	LOG(DEBUG) << bestn;
-	if (! bestn.mValid) {
+	bool prepare = false;
+	BestNeighbor bestn = HandoverDecision(measurements, sacch, prepare);
+	LOG(DEBUG) << bestn <<LOGVAR(prepare);
+	if (! bestn.mValid && ! prepare) {
 		// No handover for now.
 		return;
 	}
@@ -226,7 +231,7 @@ void HandoverDetermination(const L3MeasurementResults* measurements, SACCHLogica
 		return;
 	}
 	if (gNeighborTable.holdingOff(peerstr.c_str())) {
-		LOG(NOTICE) << "skipping "<<bestn.mHandoverCause<< " handover to " << peerstr << " due to holdoff";
+		if (bestn.mValid) { LOG(NOTICE) << "skipping "<<bestn.mHandoverCause<< " handover to " << peerstr << " due to holdoff"; }
 		return;
 	}
 
@@ -265,6 +270,13 @@ void HandoverDetermination(const L3MeasurementResults* measurements, SACCHLogica
 		LOG(DEBUG) << "skipping handover for transaction " << tran->tranID() << " because age "<<age<<"<"<<holdoff;
 		return;
 	}
+
+	if (! bestn.mValid) {
+		// Not yet, but close enough that the neighbor should get a channel ready for us.
+		gPeerInterface.sendHandoverPrepare(peerstr,tran);
+		return;
+	}
+
 	LOG(INFO) << "preparing "<<bestn.mHandoverCause<<" handover of " << tran->tranID()
 		<< " to " << peerstr << " with downlink RXLEV=" << bestn.mRxlev << " dbm";
 
@@ -285,8 +297,8 @@ void HandoverDetermination(const L3MeasurementResults* measurements, SACCHLogica
 #endif
 
 	// Form and send the message.
-	// This message is re-sent every 0.5s (the periodicity of measurement reports) until the peer answers.
-	// pats TODO: we could surely do this a better way.
+	// A text message is re-sent every 0.5s (the periodicity of measurement reports) until the peer answers;
+	// a binary one is resent by the peering service loop every Peering.ResendTimeout.
 	gPeerInterface.sendHandoverRequest(peerstr,tran,bestn.mHandoverCause);
 }
 
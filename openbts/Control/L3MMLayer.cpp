@@ -137,6 +137,14 @@ bool MMContext::mmIsEmpty()
 	return mmcMMU ? mmcMMU->mmuIsEmpty() : true;
 }
 
+bool MMContext::mmHasPendingMTSMS()
+{
+	ScopedLock lock(gMMLock,__FILE__,__LINE__);
+	if (! mmcMMU) { return false; }
+	ScopedLock lock2(mmcMMU->mmuLock,__FILE__,__LINE__);
+	return mmcMMU->mmuMTSMSq.size() != 0;
+}
+
 // Return the Mobility Management state.  Defined in 24.008 section 4.
 // Except the only thing we really care about is whether any MM procedure is currently running, which is boolean.
 bool MMContext::mmInMobilityManagement()
@@ -182,6 +190,12 @@ bool MMContext::mmCheckNewActivity()
 	// What to do about that?
 	// When we detach the MMUser, if it has anything on it, just leave it there,
 	// and paging will restart.
+	// smqueue sends the whole backlog for an MS at once when the MS reappears, but the SIP MESSAGEs
+	// straggle in, so after an MT-SMS hold the channel for SMS.MT.Linger seconds in case another one
+	// arrives for this MS; otherwise each would cost another page and another SDCCH.
+	if (mmcMTSMSTime && time(NULL) - mmcMTSMSTime < gConfig.getNum("SMS.MT.Linger")) {
+		return false;
+	}
 	if (mmIsEmpty() && mmcDuration() > 5) {
 		LOG(DEBUG) <<"closing"<<this;
 		mmcChan->chanClose(L3RRCause::Normal_Event,L3_RELEASE_REQUEST,TermCause::Local(L3Cause::No_Transaction_Expected));
@@ -760,6 +774,7 @@ void MMContext::MMContextInit()
 	//mVoiceTrans = NULL;
 	memset(mmcTE,0,sizeof(mmcTE));
 	mmcOpenTime = time(NULL);
+	mmcMTSMSTime = 0;
 	LOG(DEBUG)<<"MMContext ALLOC "<<(void*)this;
 }
 
@@ -904,6 +919,7 @@ void MMContext::mmDisconnectTran(TranEntry *tran)
 				mmcTE[TE_MOSMS1] = mmcTE[TE_MOSMS2];
 				mmcTE[TE_MOSMS2] = NULL;
 			}
+			if (tx == TE_MTSMS) { mmcMTSMSTime = time(NULL); }
 			return;
 		}
 	}
@@ -127,6 +127,7 @@ class MMContext : public MemCheckMMContext /*: public RefCntBase*/ {
 	void mmcUnlink();
 	void mmcLink(MMUser *mmu);
 	time_t mmcOpenTime;
+	time_t mmcMTSMSTime;	// When the last MT-SMS finished on this channel, or 0.
 
 	// These are the Transactions/Procedures that may be active simultaneously:
 	public:
@@ -180,6 +181,7 @@ class MMContext : public MemCheckMMContext /*: public RefCntBase*/ {
 	string mmGetImsi(bool verbose);		// If the IMSI is known, return it, else ""
 
 	bool mmIsEmpty();
+	bool mmHasPendingMTSMS();	// Is another MT-SMS queued for the MS on this channel?
 	bool mmCheckNewActivity();	// Check for new activity.  Return true if any found. Also checks for normal channel release.
 	bool mmCheckSipMsgs();		// Return true if anything happened.
 	bool mmCheckTimers();		// Return true if anything happened.
@@ -462,6 +462,9 @@ bool MTSMSMachine::createRPData(RPData &rp_data)
 		LOG(WARNING) << "Unsupported content type (in incoming SIP MESSAGE) -- type: " << contentType;
 		return false;
 	}
+	// If another MT-SMS is already queued for this MS, tell it so it keeps the link up; GSM 03.40 9.2.3.2.
+	// It will be started on this channel by mmuServiceMTQueues as soon as this one finishes.
+	rp_data.setMoreMessages(channel()->chanGetContext(true)->mmHasPendingMTSMS());
 	return true;
 }
 
@@ -587,6 +590,8 @@ MachineStatus MTSMSMachine::machineRunState1(int state,const L3Frame*frame,const
 			}
 
 			gReports.incr("OpenBTS.GSM.SMS.MTSMS.Complete");
+			static const ReportHistogram sDeliveryReport = gReports.lookupHistogram("OpenBTS.GSM.SMS.MTSMS.DeliveryMsecs");
+			gReports.sample(sDeliveryReport,(reportUsecs() - tran()->mStartUsecs) / 1000);
 
 			// Step 4
 			// Send CP-ACK to the MS.
@@ -702,23 +702,13 @@ static unsigned newUpdateCallTraffic(TranEntry *transaction, GSM::TCHFACCHLogica
 	if (transaction->getGSMState() != CCState::Active) { return false; }
 	unsigned activity = 0;
 
-	// Both the rx and tx directions block if rtp_session_set_blocking_mode() is true.
+	// Neither direction blocks: the RTP engine (or the RTP library in non-blocking mode) does its own pacing.
 
 	// Transfer in the uplink direction (GSM->RTP).
-	// Flush FIFO to limit latency.
-	unsigned numFlushed = 0;
-	{
-		unsigned maxQ = gConfig.getNum("GSM.MaxSpeechLatency");
-		static Timeval testTimeStart;
-		while (TCH->queueSize()>maxQ) {
-			if (numFlushed == 0) testTimeStart.now();
-			numFlushed++;
-			// (pat) LOG is too slow to call in here.  With 1000 backed up the delay is 1/2 sec.
-			//LOG(DEBUG) <<TCH <<" ulFrame flushed"<<LOGVAR(TCH->queueSize());
-			delete TCH->recvTCH();
-		}
-		if (numFlushed) { LOG(DEBUG) <<TCH <<" ulFrame flushed "<<numFlushed <<" in "<<testTimeStart.elapsed() << " msecs"; }
-	}
+	// Flush FIFO to limit latency.  This used to pop and delete one frame at a time, taking the queue lock for each;
+	// with 1000 backed up the delay was 1/2 sec.  Now it is one pass under one lock.
+	unsigned numFlushed = TCH->flushTCH(gConfig.getNum("GSM.MaxSpeechLatency"));
+	if (numFlushed) { LOG(DEBUG) <<TCH <<" ulFrame flushed "<<numFlushed; }
 
 
 	if (SIP::AudioFrame *ulFrame = TCH->recvTCH()) {
@@ -730,7 +720,7 @@ static unsigned newUpdateCallTraffic(TranEntry *transaction, GSM::TCHFACCHLogica
 	}
 
 	// Transfer in the downlink direction (RTP->GSM).
-	// Blocking call.  On average returns 1 time per 20 ms.
+	// Non-blocking.  On average returns a frame 1 time per 20 ms.
 	// Returns non-zero if anything really happened.
 	// Make the rxFrame buffer big enough for G.711.
 	if (SIP::AudioFrame *dlFrame = transaction->rxFrame()) {
@@ -903,7 +893,7 @@ static void l3CallTrafficLoop(L3LogicalChannel *dcch)
 		LOG(DEBUG) <<dcch <<" after checkem Messages";
 
 		// Finally, get down to business: transfer vocoder data.
-		// This is a blocking call, blocking 20ms on average.
+		// This does not block; if nothing moved we fall through to the 20ms delay below.
 		if (tran != NULL) {
 			static unsigned bytes = 0;
 			if (unsigned theseBytes = newUpdateCallTraffic(tran,tch)) {
@@ -930,7 +920,8 @@ static void l3CallTrafficLoop(L3LogicalChannel *dcch)
 		// (pat) When we are using blocking mode in the RTP library, we never get here.
 		if (needReports) {
 			LOG(DEBUG) <<dcch << "calling gReports CC.CallMinutes";
-			gReports.incr("OpenBTS.GSM.CC.CallMinutes");
+			static const ReportHandle sCallMinutesReport = gReports.lookup("OpenBTS.GSM.CC.CallMinutes");
+			gReports.incr(sCallMinutesReport);
 			LOG(DEBUG) <<dcch << " after gReports CC.CallMinutes";
 			needReports = false;
 			continue;
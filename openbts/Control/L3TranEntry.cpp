@@ -157,6 +157,7 @@ TranEntry::TranEntry(
 	***/
 
 	mStartTime = time(NULL);
+	mStartUsecs = reportUsecs();
 	mConnectTime = 0;	// Means never connected.
 	//mEndTime = 0;
 	//gNewTransactionTable.ttAdd(this);
@@ -513,6 +514,8 @@ ostream& operator<<(ostream& os, const TranEntry* entry)
 void TranEntry::runQuery(const char* query) const
 {
 	// Caller should hold mLock and should have already checked isRemoved()..
+	// Updates are batched by the write-behind thread so channel changes do not wait for sqlite.
+	if (gNewTransactionTable.getWriter().wbWrite(query)) return;
 	for (unsigned i=0; i<mNumSQLTries; i++) {
 		if (sqlite3_command(gNewTransactionTable.getDB(),query)) return;
 	}
@@ -830,7 +833,8 @@ void NewTransactionTable::ttInit()
 
 #if EXTERNAL_TRANSACTION_TABLE
 	// Connect to the database.
-	const char *path = gConfig.getStr("Control.Reporting.TransactionTable").c_str();
+	string pathStr = gConfig.getStr("Control.Reporting.TransactionTable");
+	const char *path = pathStr.c_str();
 	int rc = sqlite3_open(path,&mDB);
 	if (rc) {
 		LOG(ALERT) << "Cannot open Transaction Table database at " << path << ": " << sqlite3_errmsg(mDB);
@@ -845,6 +849,9 @@ void NewTransactionTable::ttInit()
 	// Clear any previous entires.
 	if (!sqlite3_command(gNewTransactionTable.getDB(),"DELETE FROM TRANSACTION_TABLE"))
 		LOG(WARNING) << "cannot clear previous transaction table";
+	if (!mWriter.wbOpen(path,"TransactionTable")) {
+		LOG(WARNING) << "transaction table updates will be synchronous";
+	}
 #endif
 }
 
@@ -855,6 +862,7 @@ NewTransactionTable::~NewTransactionTable()
 {
 	// Don't bother disposing of the memory,
 	// since this is only invoked when the application exits.
+	mWriter.wbClose();
 	if (mDB) sqlite3_close(mDB);
 }
 #endif
@@ -1198,14 +1206,21 @@ unsigned NewTransactionTable::countChan(const L3LogicalChannel* chan)
 
 size_t NewTransactionTable::dump(ostream& os, bool showAll) const
 {
-	ScopedLock lock(mttLock,__FILE__,__LINE__);
-	size_t sz = 0;
-	for (NewTransactionMap::const_iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if ((!showAll) && itr->second->deadOrRemoved()) continue;
-		sz++;
-		os << *(itr->second) << endl;
+	// Format the entries under the lock but write them after, so a slow CLI client does not hold up the table.
+	vector<string> lines;
+	{
+		ScopedLock lock(mttLock,__FILE__,__LINE__);
+		for (NewTransactionMap::const_iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
+			if ((!showAll) && itr->second->deadOrRemoved()) continue;
+			ostringstream ss;
+			ss << *(itr->second);
+			lines.push_back(ss.str());
+		}
+	}
+	for (vector<string>::const_iterator it = lines.begin(); it != lines.end(); ++it) {
+		os << *it << endl;
 	}
-	return sz;
+	return lines.size();
 }
 
 
@@ -30,6 +30,7 @@
 #include <Interthread.h>
 #include <Timeval.h>
 #include <Sockets.h>
+#include <sqlite3util.h>
 
 
 #include <GSML3CommonElements.h>
@@ -564,6 +565,7 @@ class TranEntry : public MemCheckTranEntry, public RefCntBase, public TranEntryP
 	// The following block is used to contain the fields from the TRANSACTION_TABLE that are useful for statistics
 	public:
 	time_t mStartTime;		// transaction creation time.
+	uint64_t mStartUsecs;	// reportUsecs() at creation, for the latency histograms.
 	time_t mConnectTime;	// When call is connected, or 0 if never.
 	L3CDR *createCDR(bool makeCMR, TermCause cause);
 };
@@ -587,6 +589,7 @@ class NewTransactionTable {
 
 #if EXTERNAL_TRANSACTION_TABLE
 	sqlite3 *mDB;			///< database connection
+	sqlWriteBehind mWriter;	///< the table is only a mirror for external tools, so TranEntry updates are written asynchronously
 #endif
 
 	NewTransactionMap mTable;
@@ -752,6 +755,7 @@ class NewTransactionTable {
 #if EXTERNAL_TRANSACTION_TABLE
 	/** Accessor to database connection. */
 	sqlite3* getDB() { return mDB; }
+	sqlWriteBehind &getWriter() { return mWriter; }
 #endif
 
 	/**
@@ -168,6 +168,47 @@ bool TMSITable::runQuery(const char *query, int checkChanges) const
 	return true;
 }
 
+// Updates that nobody is waiting on go to the write-behind connection so the L3 procedure does not wait for sqlite I/O.
+void TMSITable::runQueryLater(const char *query) const
+{
+	LOG(DEBUG)<<LOGVAR(query);
+	if (!mTmsiWriter.wbWrite(query)) { runQuery(query); }
+}
+
+void TMSITable::indexAdd(const string &imsi, uint32_t tmsi, int assigned) const
+{
+	// The index is only a cache; if it gets huge just start over.
+	if (mImsiIndex.size() >= 100000) { indexClear(); }
+	indexDropImsi(imsi);
+	indexDropTmsi(tmsi);
+	TmsiIndexEntry &ent = mImsiIndex[imsi];
+	ent.mTmsi = tmsi;
+	ent.mAssigned = assigned;
+	mTmsiIndex[tmsi] = imsi;
+}
+
+void TMSITable::indexDropImsi(const string &imsi) const
+{
+	map<string,TmsiIndexEntry>::iterator it = mImsiIndex.find(imsi);
+	if (it == mImsiIndex.end()) { return; }
+	mTmsiIndex.erase(it->second.mTmsi);
+	mImsiIndex.erase(it);
+}
+
+void TMSITable::indexDropTmsi(uint32_t tmsi) const
+{
+	map<uint32_t,string>::iterator it = mTmsiIndex.find(tmsi);
+	if (it == mTmsiIndex.end()) { return; }
+	mImsiIndex.erase(it->second);
+	mTmsiIndex.erase(it);
+}
+
+void TMSITable::indexClear() const
+{
+	mImsiIndex.clear();
+	mTmsiIndex.clear();
+}
+
 // pat 9-2013: I am adding an extra table to hold attributes including a version number of the TMSI table file.
 // (pat) If the TMSI_TABLE version does not match expected, drop the TMSI_TABLE before returning, and the caller will recreate it.
 bool TMSITable::tmsiTabCheckVersion()
@@ -195,9 +236,22 @@ void TMSITable::tmsiTabCleanup()
 	unsigned oldest_allowed = time(NULL) - (maxage * 60*60);
 	char query[102];
 	snprintf(query,100,"DELETE FROM TMSI_TABLE WHERE ACCESSED <= %u",oldest_allowed);
+	// The ACCESSED updates go through the write-behind queue, so the delete must too.  Run directly it could
+	// overtake a queued update and remove a row that was just used.
+	if (mTmsiWriter.wbWrite(query)) {
+		mTmsiWriter.wbFlush();
+		ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+		indexClear();
+		mA5Cache.clear();
+		LOG(INFO) << "Deleted expired entries from TMSITable with age < Control.TMSITable.Maxage="<<maxage<<" hours";
+		return;
+	}
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
 	runQuery(query,false);
 	int changes = sqlite3_changes(mTmsiDB);
 	if (changes) {
+		indexClear();
+		mA5Cache.clear();
 		LOG(INFO) << "Deleted "<<changes<<" expired entries from TMSITable with age < Control.TMSITable.Maxage="<<maxage<<" hours";
 	}
 }
@@ -210,11 +264,25 @@ void TMSITable::tmsiTabClearAuthCache()
 
 void TMSITable::tmsiTabClear()
 {
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
 	runQuery("DELETE FROM TMSI_TABLE WHERE 1");
+	indexClear();
+	mA5Cache.clear();
 	//clearAuthFailures();
 	//authFailures.clear();
 }
 
+bool TMSITable::tmsiTabQuery(const char *query)
+{
+	// Let the queued updates land first so they do not overwrite what the query does.
+	mTmsiWriter.wbFlush();
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+	bool result = runQuery(query,0);
+	indexClear();
+	mA5Cache.clear();
+	return result;
+}
+
 void TMSITable::tmsiTabInit()
 {
 	tmsiTabCleanup();
@@ -284,6 +352,12 @@ int TMSITable::tmsiTabOpen(const char* wPath)
 	if (!sqlite_command(mTmsiDB,enableWAL)) {
 		LOG(EMERG) << "Cannot enable WAL mode on database at " << wPath << ", error message: " << sqlite3_errmsg(mTmsiDB);
 	}
+	// There is a second writer now, the write-behind connection, so wait out its short batches instead of failing.
+	sqlite3_busy_timeout(mTmsiDB,1000);
+	mTmsiStmts.scSetDB(mTmsiDB);
+	if (!mTmsiWriter.wbOpen(wPath,"TMSITable")) {
+		LOG(ERR) << "TMSITable updates will be synchronous";
+	}
 	LOG(INFO) << "Opened TMSI table version "<<TmsiTableDefinition::tmsiTableVersion<< ":"<<wPath;
 	// (mike) 2014-06: to free ourselves of the in-tree sqlite3 code, the system library must be used.
 	//        However, sqlite3_db_filename is not available in Ubuntu 12.04. Removing dependence for now.
@@ -294,6 +368,8 @@ int TMSITable::tmsiTabOpen(const char* wPath)
 
 TMSITable::~TMSITable()
 {
+	mTmsiWriter.wbClose();
+	mTmsiStmts.scClear();
 	if (mTmsiDB) sqlite3_close(mTmsiDB);
 }
 
@@ -302,6 +378,10 @@ bool TMSITable::dropTmsi(uint32_t tmsi)
 	char query[100];
 	LOG(DEBUG) << "Removing TMSITable entry for"<<LOGVAR(tmsi);
 	snprintf(query,100,"DELETE FROM TMSI_TABLE WHERE TMSI == %d",tmsi2table(tmsi));
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+	map<uint32_t,string>::iterator it = mTmsiIndex.find(tmsi);
+	if (it != mTmsiIndex.end()) { mA5Cache.erase(it->second); }
+	indexDropTmsi(tmsi);
 	return runQuery(query,1);
 }
 
@@ -310,6 +390,9 @@ bool TMSITable::dropImsi(const char *imsi)
 	char query[100];
 	LOG(DEBUG) << "Removing TMSITable entry for"<<LOGVAR(imsi);
 	snprintf(query,100,"DELETE FROM TMSI_TABLE WHERE IMSI == '%s'",imsi);
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+	indexDropImsi(imsi);
+	mA5Cache.erase(imsi);
 	return runQuery(query,1);
 }
 
@@ -456,6 +539,7 @@ void TMSITable::tmsiTabUpdate(string imsi, TmsiTableStore *store)
 	if (! q1.cnt) { return; }	// Nothing changed.
 	q1.addc("ACCESSED",(unsigned)time(NULL));
 	q1.appendf(" WHERE IMSI='%s'",imsi);	// You must include the quotes around IMSI
+	indexDropImsi(imsi);	// The store may have changed TMSI_ASSIGNED.
 	runQuery(q1.c_str(),true);
 }
 
@@ -533,6 +617,7 @@ uint32_t TMSITable::tmsiTabCreateOrUpdate(
 		queryp->append(format(" WHERE IMSI=='%s'",imsi));
 	}
 
+	indexDropImsi(imsi);
 	if (!runQuery(queryp->c_str(),1)) {
 		LOG(ALERT) << "TMSI creation failed for"<<LOGVAR(imsi)<<" query:"<<*queryp;
 		return 0;
@@ -666,7 +751,7 @@ void TMSITable::tmsiTabTouchTmsi(unsigned TMSI) const
 {
 	char query[100];
 	snprintf(query,100,"UPDATE TMSI_TABLE SET ACCESSED = %u WHERE TMSI == %d", (unsigned)time(NULL),tmsi2table(TMSI));
-	runQuery(query);
+	runQueryLater(query);
 }
 
 // Update timestamp by IMSI.
@@ -674,7 +759,7 @@ void TMSITable::tmsiTabTouchImsi(string IMSI) const
 {
 	char query[100];
 	snprintf(query,100,"UPDATE TMSI_TABLE SET ACCESSED = %u WHERE IMSI == '%s'", (unsigned)time(NULL),IMSI.c_str());
-	runQuery(query);
+	runQueryLater(query);
 }
 
 void TMSITable::tmsiTabReallocationComplete(unsigned TMSI) const
@@ -682,6 +767,7 @@ void TMSITable::tmsiTabReallocationComplete(unsigned TMSI) const
 	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__); // This lock should be redundant - sql serializes access, but it may prevent sql retry failures.
 	char query[100];
 	snprintf(query,100,"UPDATE TMSI_TABLE SET TMSI_ASSIGNED = 1 WHERE TMSI == %d",tmsi2table(TMSI));
+	indexDropTmsi(TMSI);
 	runQuery(query);
 }
 
@@ -690,16 +776,19 @@ void TMSITable::tmsiTabReallocationComplete(unsigned TMSI) const
 bool TMSITable::tmsiTabGetStore(string imsi, TmsiTableStore *store) const
 {
 	store->store_valid = true;	// We have either updated the store or confirmed the imsi does not exist in the TMSI_TABLE.
-	sqlQuery q11(mTmsiDB,"TMSI_TABLE","AUTH,AUTH_EXPIRY,TMSI_ASSIGNED,REJECT_CODE,WELCOME_SENT", "IMSI",imsi.c_str());
-	if (!q11.sqlSuccess()) {
-		LOG(INFO) << "No TMSI_TABLE table entry for"<<LOGVAR(imsi) <<LOGVAR2("query",q11.mQueryString);
+	static const char *q11 = "SELECT AUTH,AUTH_EXPIRY,TMSI_ASSIGNED,REJECT_CODE,WELCOME_SENT FROM TMSI_TABLE WHERE IMSI == ?";
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+	sqlite3_stmt *stmt = mTmsiStmts.scGet(q11);
+	sqlStmtReset reset(stmt);
+	if (!stmt || sqlite3_bind_text(stmt,1,imsi.c_str(),-1,SQLITE_TRANSIENT) || sqlite3_run_query(mTmsiDB,stmt) != SQLITE_ROW) {
+		LOG(INFO) << "No TMSI_TABLE table entry for"<<LOGVAR(imsi) <<LOGVAR2("query",q11);
 		return false;
 	}
-	store->auth = (Authorization) q11.getResultInt(0);			//store->auth_valid = true;
-	store->authExpiry = q11.getResultInt(1);	//store->authExpiry_valid = true;
-	store->assigned = q11.getResultInt(2);		//store->assigned_valid = true;
-	store->rejectCode = q11.getResultInt(3);	//store->rejectCode_valid = true;
-	store->welcomeSent = q11.getResultInt(4);	//store->welcomeSent_valid = true;
+	store->auth = (Authorization) sqlite3_column_int(stmt,0);			//store->auth_valid = true;
+	store->authExpiry = sqlite3_column_int64(stmt,1);	//store->authExpiry_valid = true;
+	store->assigned = sqlite3_column_int(stmt,2);		//store->assigned_valid = true;
+	store->rejectCode = sqlite3_column_int(stmt,3);	//store->rejectCode_valid = true;
+	store->welcomeSent = sqlite3_column_int(stmt,4);	//store->welcomeSent_valid = true;
 	LOG(DEBUG) <<LOGVAR2("auth",store->auth)<<LOGVAR2("authExpiry",store->authExpiry)
 		<<LOGVAR2("assigned",store->assigned)<<LOGVAR2("rejectCode",store->rejectCode)<<LOGVAR2("welcomSent",store->welcomeSent);
 	return true;
@@ -710,13 +799,22 @@ string TMSITable::tmsiTabGetIMSI(unsigned tmsi, unsigned *pAuthorizationResult)
 {
 	string imsi;
 	if (pAuthorizationResult) tmsiTabTouchTmsi(tmsi);
-	sqlQuery q4(mTmsiDB,"TMSI_TABLE","IMSI,AUTH", "TMSI",tmsi2table(tmsi));
-	if (!q4.sqlSuccess()) {
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+	if (!pAuthorizationResult) {
+		// The index does not hold AUTH, so it can only answer the plain lookup.
+		map<uint32_t,string>::const_iterator it = mTmsiIndex.find(tmsi);
+		if (it != mTmsiIndex.end()) { return it->second; }
+	}
+	sqlite3_stmt *stmt = mTmsiStmts.scGet("SELECT IMSI,AUTH,TMSI_ASSIGNED FROM TMSI_TABLE WHERE TMSI == ?");
+	sqlStmtReset reset(stmt);
+	if (!stmt || sqlite3_bind_int(stmt,1,tmsi2table(tmsi)) || sqlite3_run_query(mTmsiDB,stmt) != SQLITE_ROW) {
 		if (pAuthorizationResult) { *pAuthorizationResult = 0; }
 	} else {
-		imsi = q4.getResultText(0);
-		int auth = q4.getResultInt(1);
+		const char *ptr = (const char*)sqlite3_column_text(stmt,0);
+		if (ptr) { imsi = ptr; }
+		int auth = sqlite3_column_int(stmt,1);
 		if (pAuthorizationResult) { *pAuthorizationResult = auth; }
+		if (imsi.size()) { indexAdd(imsi,tmsi,sqlite3_column_int(stmt,2)); }
 		LOG(DEBUG) <<LOGVAR(tmsi) <<LOGVAR(imsi) <<LOGVAR(auth);
 	}
 	return imsi;
@@ -725,26 +823,35 @@ string TMSITable::tmsiTabGetIMSI(unsigned tmsi, unsigned *pAuthorizationResult)
 unsigned TMSITable::tmsiTabCheckAuthorization(string imsi) const
 {
 	tmsiTabTouchImsi(imsi);
-	unsigned auth = 0;
-	if (! sqlite3_single_lookup(mTmsiDB,"TMSI_TABLE","IMSI",imsi.c_str(),"AUTH",auth)) {
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+	sqlite3_stmt *stmt = mTmsiStmts.scGet("SELECT AUTH FROM TMSI_TABLE WHERE IMSI == ?");
+	sqlStmtReset reset(stmt);
+	if (!stmt || sqlite3_bind_text(stmt,1,imsi.c_str(),-1,SQLITE_TRANSIENT) || sqlite3_run_query(mTmsiDB,stmt) != SQLITE_ROW) {
 		return 0;	// If IMSI not found, unauthorized.
 	}
-	return auth;
+	return (unsigned) sqlite3_column_int64(stmt,0);
 }
 
 // If onlyIfKnown only return the TMSI if the handset has received and acknowleged it.
 // Note that if onlyIfKnown is false, this may return invalid TMSIs; the caller must check validity.
 unsigned TMSITable::tmsiTabGetTMSI(const string imsi, bool onlyIfKnown) const
 {
-	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__); // This lock should be redundant - sql serializes access, but it may prevent sql retry failures.
-	sqlQuery q3(mTmsiDB,"TMSI_TABLE","TMSI,TMSI_ASSIGNED", "IMSI",imsi.c_str());
-	if (! q3.sqlSuccess()) {
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__); // Protects the index and the statement cache.
+	map<string,TmsiIndexEntry>::const_iterator it = mImsiIndex.find(imsi);
+	if (it != mImsiIndex.end()) {
+		if (onlyIfKnown && it->second.mAssigned == 0) { return 0; }
+		return it->second.mTmsi;
+	}
+	sqlite3_stmt *stmt = mTmsiStmts.scGet("SELECT TMSI,TMSI_ASSIGNED FROM TMSI_TABLE WHERE IMSI == ?");
+	sqlStmtReset reset(stmt);
+	if (!stmt || sqlite3_bind_text(stmt,1,imsi.c_str(),-1,SQLITE_TRANSIENT) || sqlite3_run_query(mTmsiDB,stmt) != SQLITE_ROW) {
 		LOG(DEBUG) << "not found"<<LOGVAR(imsi);
 		return 0;
 	} else {
-		LOG(DEBUG) << "found"<<LOGVAR(imsi)<<LOGVAR(onlyIfKnown)<<LOGVAR(q3.getResultInt(0))<<LOGVAR(q3.getResultInt(1));
-		int rawtmsi = q3.getResultInt(0);	// the returned tmsi.
-		int tmsiAssigned = q3.getResultInt(1);	// true if the tmsi has been sent to the handset in a tmsi assignment.
+		int rawtmsi = sqlite3_column_int(stmt,0);	// the returned tmsi.
+		int tmsiAssigned = sqlite3_column_int(stmt,1);	// true if the tmsi has been sent to the handset in a tmsi assignment.
+		LOG(DEBUG) << "found"<<LOGVAR(imsi)<<LOGVAR(onlyIfKnown)<<LOGVAR(rawtmsi)<<LOGVAR(tmsiAssigned);
+		indexAdd(imsi,table2tmsi(rawtmsi),tmsiAssigned);
 		if (onlyIfKnown && tmsiAssigned == 0) { return 0; }
 		return table2tmsi(rawtmsi);		// the returned tmsi.
 	}
@@ -914,7 +1021,14 @@ bool TMSITable::classmark(const char* IMSI, const GSM::L3MobileStationClassmark2
 		"UPDATE TMSI_TABLE SET A5_SUPPORT=%u,ACCESSED=%u,POWER_CLASS=%u "
 		" WHERE IMSI=\"%s\"",
 		A5Bits,(unsigned)time(NULL),classmark.powerClass(),IMSI);
-	runQuery(query,1);
+	ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+	// Like the index this is only a cache, but entries may be ahead of the table, so let the queue catch up before dropping them.
+	if (mA5Cache.size() >= 100000) {
+		mTmsiWriter.wbFlush();
+		mA5Cache.clear();
+	}
+	mA5Cache[IMSI] = A5Bits;
+	runQueryLater(query);
 	return true;
 }
 
@@ -930,6 +1044,12 @@ unsigned getPreferredA5Algorithm(unsigned A5Bits)
 
 int TMSITable::tmsiTabGetPreferredA5Algorithm(const char* IMSI)
 {
+	{
+		// A5_SUPPORT may still be in the write-behind queue; the cache has it.
+		ScopedLock lock(sTmsiMutex,__FILE__,__LINE__);
+		map<string,unsigned>::const_iterator it = mA5Cache.find(IMSI);
+		if (it != mA5Cache.end()) { return getPreferredA5Algorithm(it->second); }
+	}
 	sqlQuery query(mTmsiDB,"TMSI_TABLE","A5_SUPPORT", "IMSI",IMSI);
 	if (!query.sqlSuccess()) return 0;
 	int cm = query.getResultInt(0);
@@ -25,9 +25,7 @@
 #include <Timeval.h>
 #include <Threads.h>
 #include <ScalarTypes.h>
-
-
-struct sqlite3;
+#include <sqlite3util.h>
 
 namespace GSM {
 class L3LocationAreaIdentity;
@@ -103,6 +101,27 @@ class TMSITable {
 	private:
 
 	sqlite3 *mTmsiDB;			///< database connection
+	mutable sqlStatementCache mTmsiStmts;	///< prepared lookups on mTmsiDB, protected by sTmsiMutex
+	mutable sqlWriteBehind mTmsiWriter;		///< for updates nobody waits on, like the ACCESSED time
+
+	// In-memory IMSI<->TMSI index in front of the TMSI_TABLE so location update and paging response storms
+	// do not all go to sqlite for the same mapping.  Entries are added on lookup and discarded whenever
+	// the row they came from is written, so the index never holds anything the table does not.
+	// Protected by sTmsiMutex.
+	struct TmsiIndexEntry {
+		uint32_t mTmsi;		///< the TMSI as returned by tmsiTabGetTMSI, ie, possibly an invalid (fake) tmsi.
+		int mAssigned;		///< the TMSI_ASSIGNED column.
+	};
+	mutable std::map<std::string,TmsiIndexEntry> mImsiIndex;
+	mutable std::map<uint32_t,std::string> mTmsiIndex;
+	// A5_SUPPORT as last written by classmark(), by IMSI, so the cipher choice does not have to wait for the
+	// write-behind queue to commit it.  Protected by sTmsiMutex.
+	mutable std::map<std::string,unsigned> mA5Cache;
+	void indexAdd(const std::string &imsi, uint32_t tmsi, int assigned) const;
+	void indexDropImsi(const std::string &imsi) const;
+	void indexDropTmsi(uint32_t tmsi) const;
+	void indexClear() const;
+
 	void tmsiTabCleanup();
 	void tmsiTabInit();
 
@@ -163,6 +182,8 @@ class TMSITable {
 	
 	/** Clear the table completely. */
 	void tmsiTabClear();
+	/** Run an arbitrary query from the CLI, after any queued updates, and drop the cached lookups it may have invalidated. */
+	bool tmsiTabQuery(const char *query);
 	// Clear the authorization cache.
 	void tmsiTabClearAuthCache();
 
@@ -198,6 +219,8 @@ class TMSITable {
 	/** Update the "accessed" time on a record. */
 	void tmsiTabTouchTmsi(unsigned TMSI) const;
 	void tmsiTabTouchImsi(string IMSI) const;
+	/** Run an update on the write-behind connection, or synchronously if that is not running. */
+	void runQueryLater(const char *query) const;
 };
 
 
@@ -128,7 +128,8 @@ MSInfo::MSInfo(uint32_t tlli)
 	//msTxxxx(5000)		// Needs initialization to prevent abort when we test it,
 						// but we will set it again to the real value when we use it.
 {
-	gReports.incr("GPRS.MSInfo");
+	static const ReportHandle sMSInfoReport = gReports.lookup("GPRS.MSInfo");
+	gReports.incr(sMSInfoReport);
 	gL2MAC.macAddMS(this);
 }
 
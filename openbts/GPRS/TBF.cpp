@@ -163,7 +163,8 @@ ChannelCodingType TBF::mtChannelCoding() const
 TBF::TBF(MSInfo *wms, RLCDirType wdir)
 	:  mtState(TBFState::Unused), mtDebugId(++Stats.countTBF), mtMS(wms), mtDir(wdir), mtTFI(-1)
 {
-	gReports.incr("GPRS.TBF");
+	static const ReportHandle sTBFReport = gReports.lookup("GPRS.TBF");
+	gReports.incr(sTBFReport);
 	RN_MEMCHKNEW(TBF)
 	mtChannelCodingMax = ChannelCodingMax;	// This may be changed by caller.
 	mtCCMin = mtCCMax = (ChannelCodingType)-1;
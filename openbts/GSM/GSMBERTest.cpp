@@ -0,0 +1,97 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses; see the COPYING file in the main directory for licensing information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#include "GSMBERTest.h"
+#include <Utils.h>
+#include <sstream>
+
+namespace GSM {
+using namespace std;
+
+// A frame with more than this fraction of payload errors means we are not looking at the pattern any more.
+static const unsigned cPRBSLossDivisor = 4;
+
+void BERCounts::bcReset()
+{
+	mFrames = mBadFrames = 0;
+	mRawBits = mRawErrors = 0;
+	mPayloadBits = mPayloadErrors = 0;
+	mSyncLosses = 0;
+	mStart = Utils::timef();
+}
+
+string BERCounts::text() const
+{
+	ostringstream ss;
+	ss << "secs=" << (unsigned)(Utils::timef() - mStart)
+		<< " frames=" << mFrames << " bad=" << mBadFrames
+		<< " FER=" << (mFrames ? (double)mBadFrames / mFrames : 0)
+		<< " rawbits=" << mRawBits << " rawerrors=" << mRawErrors
+		<< " rawBER=" << (mRawBits ? (double)mRawErrors / mRawBits : 0);
+	if (mPayloadBits || mSyncLosses) {
+		ss << " prbsbits=" << mPayloadBits << " prbserrors=" << mPayloadErrors
+			<< " residualBER=" << (mPayloadBits ? (double)mPayloadErrors / mPayloadBits : 0)
+			<< " synclosses=" << mSyncLosses;
+	}
+	return ss.str();
+}
+
+void PRBSChecker::reset()
+{
+	ScopedLock lock(mLock);
+	mInSync = false;
+	mBits = mErrors = mSyncLosses = 0;
+}
+
+void PRBSChecker::check(const BitVector2 &payload)
+{
+	ScopedLock lock(mLock);
+	unsigned start = 0;
+	if (!mInSync) {
+		if (payload.size() <= 9) { return; }
+		mRef.load(payload);
+		start = 9;
+	}
+	unsigned errors = 0;
+	for (unsigned i = start; i < payload.size(); i++) {
+		errors += payload.bit(i) != mRef.next();
+	}
+	unsigned compared = payload.size() - start;
+	if (errors * cPRBSLossDivisor > compared) {
+		// Either the seed bits were wrong or the source slipped.  Dont count this frame; lock on again next time.
+		if (mInSync) { mSyncLosses++; }
+		mInSync = false;
+		return;
+	}
+	mInSync = true;
+	mBits += compared;
+	mErrors += errors;
+}
+
+void PRBSChecker::skip(unsigned bits)
+{
+	ScopedLock lock(mLock);
+	if (!mInSync) { return; }
+	while (bits--) { mRef.next(); }
+}
+
+void PRBSChecker::addTo(BERCounts &counts) const
+{
+	ScopedLock lock(mLock);
+	counts.mPayloadBits += mBits;
+	counts.mPayloadErrors += mErrors;
+	counts.mSyncLosses += mSyncLosses;
+}
+
+};	// namespace GSM
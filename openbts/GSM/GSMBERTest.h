@@ -0,0 +1,77 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses; see the COPYING file in the main directory for licensing information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#ifndef GSMBERTEST_H
+#define GSMBERTEST_H
+
+#include <stdint.h>
+#include <string>
+#include <BitVector.h>
+#include <Threads.h>
+
+namespace GSM {
+
+// Exact bit and frame error counts for one channel since the last reset.
+// The DecoderStats averages decay, so at low error rates they need a very long hold to mean anything;
+// these just count, and the caller picks the window by resetting.
+struct BERCounts {
+	uint64_t mFrames;			// Frames decoded, not counting stolen frames.
+	uint64_t mBadFrames;		// Frames that failed parity.
+	uint64_t mRawBits;			// Convolutionally coded bits received.
+	uint64_t mRawErrors;		// Of those, bits the Viterbi decoder corrected.
+	uint64_t mPayloadBits;		// PRBS test: decoded payload bits compared against the pattern.
+	uint64_t mPayloadErrors;	// PRBS test: of those, bits that were wrong.
+	uint64_t mSyncLosses;		// PRBS test: times the checker lost the pattern and started over.
+	double mStart;				// When the counts were last reset, in seconds.
+
+	BERCounts() { bcReset(); }
+	void bcReset();
+	std::string text() const;
+};
+
+// The ITU-T O.150 2^9-1 pseudo-random pattern, x^9 + x^5 + 1.
+class PRBS9 {
+	unsigned mState;		// The last 9 bits generated, most recent in bit 0.
+	public:
+	PRBS9() : mState(0x1ff) {}
+	bool next() {
+		bool bit = ((mState >> 8) ^ (mState >> 4)) & 1;
+		mState = ((mState << 1) | bit) & 0x1ff;
+		return bit;
+	}
+	void fill(BitVector2 &bits) { for (unsigned i = 0; i < bits.size(); i++) { bits[i] = next(); } }
+	// Continue the pattern from 9 received bits.
+	void load(const BitVector2 &bits) { mState = 0; for (unsigned i = 0; i < 9; i++) { mState = (mState << 1) | bits.bit(i); } }
+};
+
+// Compares decoded TCH payloads against the PRBS9 pattern.
+// The payload source (a test set, or the MS in a TCH loop echoing our downlink) may start anywhere
+// in the pattern and at any delay, so the checker locks onto whatever it receives and then expects
+// the pattern to carry on frame after frame.  Bad frames advance the pattern without being counted.
+class PRBSChecker {
+	mutable Mutex mLock;
+	PRBS9 mRef;
+	bool mInSync;
+	uint64_t mBits, mErrors, mSyncLosses;
+
+	public:
+	PRBSChecker() { reset(); }
+	void reset();
+	void check(const BitVector2 &payload);
+	void skip(unsigned bits);
+	void addTo(BERCounts &counts) const;
+};
+
+};	// namespace GSM
+#endif
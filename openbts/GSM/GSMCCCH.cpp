@@ -348,7 +348,8 @@ bool CCCHLogicalChannel::processRaches()
 		int initialTA = rach->initialTA();
 		assert(initialTA >= 0 && initialTA <= 62);	// enforced by AccessGrantResponder.
 		//LCH->l1InitPhy(rach->RSSI(),initialTA,gBTS.clock().systime(rach->mWhen.FN()));
-		gReports.incr("OpenBTS.GSM.RR.RACH.TA.Accepted",(int)(initialTA));
+		static const ReportRange sTAAcceptedReport = gReports.lookup("OpenBTS.GSM.RR.RACH.TA.Accepted",0,63);
+		gReports.incr(sTAAcceptedReport.at(initialTA));
 		L2LogicalChannel *LCH = rach->mChan;
 
 		// TODO: Update T3101.
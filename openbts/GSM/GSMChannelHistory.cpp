@@ -29,73 +29,60 @@ namespace GSM {
 // Return the averaged RXLEV from the serving BTS as reported by the handset.
 int ChannelHistory::getAvgRxlev()
 {
-	ScopedLock lock(mSCellLock);
-	FrameNum now = gBTS.time().FN();
-	return round(ComputeTrend(mSCellData,now,&SCellPoint::getFrameNum,&SCellPoint::getRxlev,gConfig.GSM.Handover.RXLEV_DL.History));
+	ScopedLock lock(mHistoryLock);
+	float avg;
+	if (! mSCellData.mhAverage(gConfig.GSM.Handover.RXLEV_DL.History,avg)) { return -1000; }	// Impossible value.
+	return round(avg);
 }
 
-
-bool NeighborHistory::nhGetAvgRxlev(FrameNum fn, float &avg, int algorithm)
+void NeighborHistory::nhInit(unsigned wKey, unsigned wARFCN, unsigned wBSIC)
 {
-	ScopedLock lock(nhLock);
-	if (nhList.size() == 0) { return false; }
-	avg = ComputeTrend(nhList,fn,&NCellPoint::getFrameNum,&NCellPoint::getRxlev,gConfig.GSM.Handover.RXLEV_DL.History,algorithm);
-	return true;
+	nhKey = wKey;
+	nhARFCN = wARFCN;
+	nhBSIC = wBSIC;
+	nhRxlev.mhClear();
+	nhTimestamp = 0;
+	nhConsecutiveCount = 0;
 }
 
-NeighborHistory& ChannelHistory::getNeighborData(unsigned arfcn, unsigned BSIC)
+bool NeighborHistory::nhGetAvgRxlev(float &avg)
 {
-	unsigned key = makeKey(arfcn,BSIC);
-	NeighborMap::iterator it;
-	if ((it = mNeighborData.find(key)) == mNeighborData.end()) {
-		// Create a new entry.  You would think this could be easier, but not if you want to avoid the extra unnecessary construction.
-		// C++11 adds emplace but we cant use that yet.
-		//std::pair<unsigned,NeighborHistory> mapentry(key,NeighborHistory(arfcn,BSIC));
-		//std::pair<NeighborMap::iterator,bool> blah = mNeighborData.insert(mapentry);
-		//return blah.first->second;
-		//std::pair<NeighborMap::iterator,bool> blah = mNeighborData.insert( NeighborMap::value_type(key,newone) );
-		NeighborHistory newone((unsigned)arfcn,BSIC);
-		it = mNeighborData.insert( NeighborMap::value_type(key,newone) ).first;
-	}
-	return it->second;
+	return nhRxlev.mhAverage(gConfig.GSM.Handover.RXLEV_DL.History,avg);
 }
 
-// Clear all neighbor data.
-void ChannelHistory::neighborClearMeasurements()
+void NeighborHistory::nhAddPoint(int rxlev, FrameNum when, FrameNum now)
 {
-	LOG(DEBUG);
-	mNeighborData.clear();
+	nhRxlev.mhAdd(when,rxlev,true,gConfig.GSM.Handover.History.Max,now);
 }
 
-void NeighborHistory::nhAddPoint(NCellPoint &npt, FrameNum now)
+// Caller holds mHistoryLock.
+NeighborHistory& ChannelHistory::getNeighborData(unsigned arfcn, unsigned BSIC)
 {
-	ScopedLock lock(nhLock);
-	nhList.push_front(npt);		// This makes a copy of npt.
-	int maxlen = gConfig.GSM.Handover.History.Max;
-	while ((int)nhList.size() > maxlen) { nhList.pop_back(); }
-	// Throw away points that are too old.
-	int maxage = (1+maxlen) * 2*52;		// Each report requires 2 * 52-multiframes, 480ms.
-	while (nhList.size()) {
-		NCellPoint &bk = nhList.back();
-		if (FNDelta(now,bk.ncpFrame) > maxage) { nhList.pop_back(); continue; }
-		break;
+	unsigned key = makeKey(arfcn,BSIC);
+	for (unsigned i = 0; i < mNumNeighbors; i++) {
+		if (mNeighborData[i].nhKey == key) { return mNeighborData[i]; }
 	}
+	// Create a new entry, or reuse the one heard from least recently.
+	unsigned slot = mNumNeighbors;
+	if (mNumNeighbors < cMaxNeighbors) {
+		mNumNeighbors++;
+	} else {
+		slot = 0;
+		for (unsigned i = 1; i < cMaxNeighbors; i++) {
+			if (mNeighborData[i].nhTimestamp < mNeighborData[slot].nhTimestamp) { slot = i; }
+		}
+	}
+	mNeighborData[slot].nhInit(key,arfcn,BSIC);
+	return mNeighborData[slot];
 }
 
-void ChannelHistory::chAddPoint(SCellPoint &spt, FrameNum now)
+// Clear all neighbor data.
+void ChannelHistory::neighborClearMeasurements()
 {
-	LOG(DEBUG) << LOGVAR(spt.scpFrame) << LOGVAR(now);
-	ScopedLock lock(mSCellLock);
-	mSCellData.push_front(spt);
-	int maxlen = gConfig.GSM.Handover.History.Max;
-	while ((int)mSCellData.size() > maxlen) { mSCellData.pop_back(); }
-	// Throw away points that are too old.
-	int maxage = (1+maxlen) * 2*52;		// Each report requires 2 * 52-multiframes, 480ms.
-	while (mSCellData.size()) {
-		SCellPoint &bk = mSCellData.back();
-		if (FNDelta(now,bk.scpFrame) > maxage) { mSCellData.pop_back(); continue; }
-		break;
-	}
+	LOG(DEBUG);
+	ScopedLock lock(mHistoryLock);
+	mNumNeighbors = 0;
+	mSCellData.mhClear();
 }
 
 // Find the neighbor with the highest RXLEV.
@@ -103,21 +90,23 @@ void ChannelHistory::chAddPoint(SCellPoint &spt, FrameNum now)
 Control::BestNeighbor ChannelHistory::neighborFindBest(Control::NeighborPenalty penalty)
 {
 	Control::BestNeighbor best;
-	FrameNum sampleFN = gBTS.time().FN();
+	int minReports = gConfig.GSM.Handover.RXLEV_DL.History;
+	bool penalized = ! penalty.mPenaltyTime.passed();
 	LOG(DEBUG) <<LOGVAR(penalty);
-	for (NeighborMap::iterator it = mNeighborData.begin(); it != mNeighborData.end(); it++) {
-		NeighborHistory &nh = it->second;
+	ScopedLock lock(mHistoryLock);
+	for (unsigned i = 0; i < mNumNeighbors; i++) {
+		NeighborHistory &nh = mNeighborData[i];
 		LOG(DEBUG) <<LOGVAR(nh.nhBSIC) <<LOGVAR(nh.nhARFCN) <<LOGVAR(nh.nhConsecutiveCount) <<LOGVAR(nh.nhTimestamp);
-		if (nh.nhConsecutiveCount < gConfig.GSM.Handover.RXLEV_DL.History) {
+		if (nh.nhConsecutiveCount < minReports) {
 			LOG(DEBUG) << "skipping," <<LOGVAR(nh.nhConsecutiveCount);
 			continue;
 		}
 		float thisRxlev;
-		if (! nh.nhGetAvgRxlev(sampleFN,thisRxlev)) {	// If no points, ignore it.
+		if (! nh.nhGetAvgRxlev(thisRxlev)) {	// If no points, ignore it.
 			LOG(DEBUG) <<"skipping, no RXLEV data?";
 			continue;
 		}
-		if (penalty.match(best.mARFCN,best.mBSIC) && ! penalty.mPenaltyTime.passed()) {
+		if (penalized && penalty.match(nh.nhARFCN,nh.nhBSIC)) {
 			LOG(DEBUG) <<"skipping, "<<LOGVAR(penalty);
 			continue;
 		}
@@ -129,9 +118,9 @@ Control::BestNeighbor ChannelHistory::neighborFindBest(Control::NeighborPenalty
 			}
 			best.mValid = true;
 			best.mRxlev = thisRxlev;
-			unsigned bestkey = it->first;
-			crackKey(bestkey,&best.mARFCN,&best.mBSIC);
-			LOG(DEBUG) <<"found:"<<LOGVAR(bestkey) <<LOGVAR(best.mARFCN) <<LOGVAR(best.mBSIC) <<LOGVAR(thisRxlev) <<LOGVAR(best.mRxlev);
+			best.mARFCN = nh.nhARFCN;
+			best.mBSIC = nh.nhBSIC;
+			LOG(DEBUG) <<"found:"<<LOGVAR(nh.nhKey) <<LOGVAR(best.mARFCN) <<LOGVAR(best.mBSIC) <<LOGVAR(thisRxlev) <<LOGVAR(best.mRxlev);
 		}
 	}
 	return best;
@@ -140,16 +129,13 @@ Control::BestNeighbor ChannelHistory::neighborFindBest(Control::NeighborPenalty
 
 // The MS reports the 6 best cells, but that could vary from report to report.
 // So we dont delete a neighbor just because it does not appear in a single report.
+// Caller holds mHistoryLock.
 void ChannelHistory::neighborAddMeasurement(FrameNum when, unsigned arfcn, unsigned BSIC, int rxlevdb)
 {
 	NeighborHistory &nh = this->getNeighborData(arfcn,BSIC);	// creates an entry if necessary.
 
-	{	NCellPoint npt;
-		npt.ncpFrame = when;
-		npt.ncpRxlev = rxlevdb;
-		nh.nhAddPoint(npt,when);
-		LOG(DEBUG) <<LOGVAR(when) <<LOGVAR(arfcn) <<LOGVAR(BSIC) <<LOGVAR(rxlevdb) <<LOGVAR(npt.ncpRxlev);
-	}
+	nh.nhAddPoint(rxlevdb,when,when);
+	LOG(DEBUG) <<LOGVAR(when) <<LOGVAR(arfcn) <<LOGVAR(BSIC) <<LOGVAR(rxlevdb);
 
 	bool isConsecutive = nh.nhTimestamp == this->mReportTimestamp-1;
 	LOG(DEBUG) <<LOGVAR(arfcn) <<LOGVAR(BSIC) <<LOGVAR(nh.nhTimestamp) <<LOGVAR(this->mReportTimestamp) <<LOGVAR(isConsecutive);
@@ -166,20 +152,17 @@ bool ChannelHistory::neighborAddMeasurements(SACCHLogicalChannel* SACCH,const L3
 {
 
 	Time sampleTime = gBTS.time();	// This thread could be running behind the clock, but it is close enough for government work.
+	FrameNum now = sampleTime.FN();
 
+	ScopedLock lock(mHistoryLock);
 	this->mReportTimestamp++;
 
-	{	SCellPoint spt;
-		spt.scpFrame = sampleTime.FN();
-		// These are reported by the handset.
-		spt.scpValid = measurements->isServingCellValid();
-		if (spt.scpValid) {
-			spt.scpRxlev = measurements->RXLEV_FULL_SERVING_CELL_dBm();
-			spt.scpRxqual  = measurements->RXQUAL_FULL_SERVING_CELL();
-		} else {
-			spt.scpRxlev = -1000;	// Impossible value.
-			spt.scpRxqual  = 8;		// Impossible value.
-		}
+	// These are reported by the handset.
+	// RXQUAL_FULL_SERVING_CELL is not used for handover yet, so it is not kept.
+	if (measurements->isServingCellValid()) {
+		mSCellData.mhAdd(now,measurements->RXLEV_FULL_SERVING_CELL_dBm(),true,gConfig.GSM.Handover.History.Max,now);
+	} else {
+		mSCellData.mhAdd(now,0,false,gConfig.GSM.Handover.History.Max,now);
 	}
 
 	// Save the RXLEV for the neighbors.
@@ -201,7 +184,7 @@ bool ChannelHistory::neighborAddMeasurements(SACCHLogicalChannel* SACCH,const L3
 			LOG(INFO) << "Measurement report with invalid freq index:" << thisFreq << " arfcn:" << arfcn;  // SVGDBG seeing this error  (pat) Maybe fixed 10-17-2014 by ticket #1915
 			continue;
 		}
-		this->neighborAddMeasurement(sampleTime.FN(),(unsigned)arfcn,thisBSCI,thisRxLevel);
+		this->neighborAddMeasurement(now,(unsigned)arfcn,thisBSCI,thisRxLevel);
 	}
 	return measurements->isServingCellValid() && measurements->NO_NCELL() > 0;
 }
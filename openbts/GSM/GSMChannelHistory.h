@@ -30,101 +30,107 @@ class SACCHLogicalChannel;
 typedef int FrameNum;
 
 
-template<typename PointListType, typename PointType,typename YValueType>
-	float inline ComputeTrend(
-		PointListType &data, 		// currently it is always: std::deque<PointType> &data,
-		FrameNum x0,				// this doesnt need to be an argument; it is always the current frame number. 
-		FrameNum (PointType::*xmethod)(),				// method pointer to retrieve X values from data.
-		YValueType (PointType::*ymethod)(bool &valid),	// method pointer to retrieve Y values from data.
-		int maxpoints,
-		int algorithm=0				// Which algorithm to use.
-	)
-{
-	// Init accumulator variables.
-	float sumy = 0;
-	int npoints = 0;
-	// Process the points.  Run backwards so exponential decay weights the first point most heavily.
-	// Running backwards we have to skip points until we get to maxpoints.
-	int skip = data.size() - maxpoints;	// may already be negative, which means skip no points.
-	for (typename PointListType::reverse_iterator it = data.rbegin(); it != data.rend(); it++) {
-		if (skip-- > 0) continue;
-		PointType &pt = *it;
-		bool valid = true;	// useless init to quiet g++.
-		YValueType y = (pt.*ymethod)(valid);
-		if (!valid) { continue; }
-		sumy += y;
-		npoints++;
+// GSM 5.08 A3.1 wants 32 samples, and GSM.Handover.History.Max allows up to 128.
+const unsigned cMaxHistoryPoints = 128;
+
+// Fixed size history of measurement points, most recent first, for one cell.
+// The sum over the most recent points is updated as points come and go, so the average used
+// for handover costs the same few instructions however long the history is.
+// The average is over the valid Y values among the most recent 'npoints' points, as before.
+template<typename YValueType>
+class MeasurementHistory {
+	struct Point {
+		FrameNum mhFrame;		// When the report was received in GSM frame numbers.
+		YValueType mhY;
+		bool mhValid;
+	};
+	Point mhPoints[cMaxHistoryPoints];
+	unsigned mhNext;		// Slot for the next point; free running.
+	unsigned mhSize;		// Number of points held.
+	unsigned mhWindow;		// The running sum covers this many of the most recent points.
+	YValueType mhSum;		// Sum of the valid Y values in the window.
+	unsigned mhCount;		// Number of valid points in the window.
+
+	// Age 0 is the most recent point.
+	Point &mhAt(unsigned age) { return mhPoints[(mhNext - 1 - age) % cMaxHistoryPoints]; }
+
+	void mhDropOldest() {
+		Point &pt = mhAt(mhSize-1);
+		if (mhSize <= mhWindow && pt.mhValid) { mhSum -= pt.mhY; mhCount--; }
+		mhSize--;
 	}
 
-	return (float) sumy / npoints;
-}
-
-
-// Neighbor Cell Data Point
-struct NCellPoint {
-
-	// The measurement report scales rxlev; this is post scaled, ie, actual db.
-	int ncpRxlev;			// Value is negative in dB.
-	FrameNum ncpFrame;		// When the report was received in GSM frame numbers.
 	public:
-	NCellPoint() {}
-	//NCellPoint(int wRxlev, Time wTime) : ncpRxlev(wRxlev), ncpFrame(wTime.FN()) {}
-	int getRxlev(bool &valid) { valid=true; return ncpRxlev; }
-	FrameNum getFrameNum() { return ncpFrame; }
+	MeasurementHistory() { mhWindow = 0; mhClear(); }
+
+	void mhClear() { mhNext = mhSize = 0; mhSum = 0; mhCount = 0; }
+	unsigned mhLength() const { return mhSize; }
+
+	// Add a point, then throw away points beyond maxlen or too old to matter.
+	void mhAdd(FrameNum when, YValueType y, bool valid, int maxlen, FrameNum now) {
+		if (maxlen > (int)cMaxHistoryPoints) { maxlen = cMaxHistoryPoints; }
+		if (mhSize == cMaxHistoryPoints) { mhDropOldest(); }
+		Point &pt = mhPoints[mhNext++ % cMaxHistoryPoints];
+		pt.mhFrame = when;
+		pt.mhY = y;
+		pt.mhValid = valid;
+		mhSize++;
+		if (valid) { mhSum += y; mhCount++; }
+		// The point now one past the window leaves it.
+		if (mhSize > mhWindow) {
+			Point &old = mhAt(mhWindow);
+			if (old.mhValid) { mhSum -= old.mhY; mhCount--; }
+		}
+		while ((int)mhSize > maxlen) { mhDropOldest(); }
+		int maxage = (1+maxlen) * 2*52;		// Each report requires 2 * 52-multiframes, 480ms.
+		while (mhSize && FNDelta(now,mhAt(mhSize-1).mhFrame) > maxage) { mhDropOldest(); }
+	}
+
+	// Return false if there are no valid points, otherwise the average of the valid Y values among the most recent npoints points.
+	bool mhAverage(unsigned npoints, float &avg) {
+		if (npoints != mhWindow) {
+			// The configured window changed, so start the running sum over.
+			mhWindow = npoints;
+			mhSum = 0; mhCount = 0;
+			for (unsigned age = 0; age < mhSize && age < mhWindow; age++) {
+				Point &pt = mhAt(age);
+				if (pt.mhValid) { mhSum += pt.mhY; mhCount++; }
+			}
+		}
+		if (mhCount == 0) { return false; }
+		avg = (float) mhSum / mhCount;
+		return true;
+	}
 };
-typedef std::deque<NCellPoint> NCellPointList;
 
 class ChannelHistory;
 class NeighborHistory {
-	// The most recent point is on the front of the vector.
-	NCellPointList nhList;
-	Mutex nhLock;
+	// The measurement report scales rxlev; these are post scaled, ie, actual db, negative.
+	MeasurementHistory<int> nhRxlev;
 
 	friend class ChannelHistory;
-	// These are the identifying information for this neighbor, used for the key in the map.
+	// These are the identifying information for this neighbor, used for the key in the table.
 	// It does not absolutely need to be in this struct, it could be passed around everywhere, but this is simpler.
+	unsigned nhKey;
 	unsigned nhARFCN;
 	unsigned nhBSIC;
 
 	public:
 	// No special destructor is needed.
-	NeighborHistory(unsigned wARFCN,unsigned wBSIC) : nhARFCN(wARFCN), nhBSIC(wBSIC) {}
+	NeighborHistory() : nhKey(0), nhARFCN(0), nhBSIC(0) {}
 
 	// timestamp of most recent report;
 	Int_z nhTimestamp;
 	// Number of consecutive reports.
 	Int_z nhConsecutiveCount;
 
+	void nhInit(unsigned wKey, unsigned wARFCN, unsigned wBSIC);
 
-	void nhAddPoint(NCellPoint &npt, FrameNum now);
-
-	void nhClear();
-
-	// Return true if there was data available and compute and return the averaged RXLEV, where 'averaged' is computed by one of several algorithms.
-	bool nhGetAvgRxlev(FrameNum fn, float &avg, int algorithm=0);
-
-	// Return the latest point, which is the front.
-	bool nhGetLatest(NCellPoint &latest);	// not used.
-	void nhText(string &result,bool full);
-};
-
-// Serving Cell Data Point
-struct SCellPoint {
-	// Max age: 32 reports, each SACCH frame requiring 2 * 52-multiframes each, approximately 16 seconds, plus slop.
-	//const int cMaxAgeFrames = 32 * 2 * 52 + (2*52-1);
-
-	// The measurement report scales rxlev; this is post scaled, ie, actual db.
-	FrameNum scpFrame;		// When the report was received in GSM frame numbers.
-
-	bool scpValid;			// Measurements from MS were valid in this report.
-	int scpRxlev;			// serving cell RXLEV reported by MS.  Value is negative in dB.
-	int scpRxqual;			// value is 0-7.  GSM5.08 8.2.24:  0 is good, 7 is BER > 12.8%
-	public:
-	FrameNum getFrameNum() { return scpFrame; }
-	int getRxlev(bool &valid) { valid=scpValid; return scpRxlev; }
+	void nhAddPoint(int rxlev, FrameNum when, FrameNum now);
 
+	// Return true if there was data available and compute and return the averaged RXLEV.
+	bool nhGetAvgRxlev(float &avg);
 };
-typedef std::deque<SCellPoint> SCellPointList;
 
 // GSM 5.08 A3.1 specifies BSS processing of measurement reports and recommended. operator control parameters.
 // We are required to save 32 samples.
@@ -139,27 +145,30 @@ typedef std::deque<SCellPoint> SCellPointList;
 // and the neighbor RSSI drops.  If it were just 2db more, it would be causing a spurious handover back and
 // forth every 9.5 seconds.  This cache alleviates that problem.
 class ChannelHistory {
-	// The unsigned key is the frequency index combined with the BSIC.
-	// The Peering code creates the frequency index; it is sent in one of several sysinfo messages, for us probably type2.
-	typedef std::map<unsigned,NeighborHistory> NeighborMap;
-	NeighborMap mNeighborData;
+	// Neighbors are held in a small flat table searched by key, the frequency index combined with the BSIC.
+	// The MS reports at most 6 neighbors at a time, so when the table is full the neighbor heard from least recently is reused.
+	enum { cMaxNeighbors = 32 };
+	NeighborHistory mNeighborData[cMaxNeighbors];
+	unsigned mNumNeighbors;
 
-	// The most recent point is on the front of the vector.
-	SCellPointList mSCellData;
-	mutable Mutex mSCellLock;
+	// Serving cell RXLEV reported by the MS, with invalid reports kept as invalid points.
+	MeasurementHistory<int> mSCellData;
 
-	void chAddPoint(SCellPoint &spt,FrameNum now);
+	// One lock for the whole history, taken once per measurement report and once per handover decision.
+	mutable Mutex mHistoryLock;
 
 	//int cNumReports;	// Neighbor must appear in 2 of last cNumReports measurement reports.
 	Int_z mReportTimestamp;	// Incremented each time a report arrives.
+
+	NeighborHistory &getNeighborData(unsigned arfcn, unsigned BSIC);
+	void neighborAddMeasurement(FrameNum when, unsigned freq, unsigned BSIC, int RSSI);
+
 	public:
+	ChannelHistory() : mNumNeighbors(0) {}
+
 	unsigned makeKey(unsigned arfcn, unsigned BSIC) { return (arfcn<<6) + BSIC; }
 	void crackKey(unsigned key, unsigned *arfcn, unsigned *BSIC) { *BSIC = key & 0x3f; *arfcn = key>>6; }
 
-	NeighborHistory &getNeighborData(unsigned arfcn, unsigned BSIC);
-
-	// Argument is current RSSI, and return is the averaged RSSI to use for handover determination purposes.
-	void neighborAddMeasurement(FrameNum when, unsigned freq, unsigned BSIC, int RSSI);
 	bool neighborAddMeasurements(SACCHLogicalChannel* SACCH,const L3MeasurementResults* measurements);
 	void neighborClearMeasurements();	// Call to clear everything.
 	Control::BestNeighbor neighborFindBest(Control::NeighborPenalty penalty);
@@ -0,0 +1,97 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+// Feeds random measurement reports to MeasurementHistory and to a plain deque that keeps
+// points and averages them the way the handover history did before the ring and running sums.
+// The history length, the averaged window and the report gaps all vary, and the two must agree
+// on every average and on the number of points held.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+
+#include "GSMChannelHistory.h"
+
+using namespace GSM;
+
+// GSMCommon refers to the configuration, so the test must have one.
+OpenBTSConfig gConfig;
+
+class ReferenceHistory {
+	struct Point { FrameNum frame; int y; bool valid; };
+	std::deque<Point> mPoints;		// Most recent first.
+
+	public:
+	unsigned length() const { return mPoints.size(); }
+
+	void add(FrameNum when, int y, bool valid, int maxlen, FrameNum now) {
+		Point pt = { when, y, valid };
+		mPoints.push_front(pt);
+		if (maxlen > (int)cMaxHistoryPoints) { maxlen = cMaxHistoryPoints; }
+		while ((int)mPoints.size() > maxlen) { mPoints.pop_back(); }
+		int maxage = (1+maxlen) * 2*52;
+		while (mPoints.size() && FNDelta(now,mPoints.back().frame) > maxage) { mPoints.pop_back(); }
+	}
+
+	bool average(unsigned npoints, float &avg) {
+		float sum = 0;
+		int n = 0;
+		for (unsigned i = 0; i < mPoints.size() && i < npoints; i++) {
+			if (mPoints[i].valid) { sum += mPoints[i].y; n++; }
+		}
+		if (n == 0) { return false; }
+		avg = sum / n;
+		return true;
+	}
+};
+
+int main(int argc, char **argv)
+{
+	MeasurementHistory<int> history;
+	ReferenceHistory reference;
+	FrameNum fn = 0;
+	int bad = 0, checked = 0;
+
+	srandom(3);
+	for (int it = 0; it < 200000; it++) {
+		// Alternate runs at the 5.08 length of 32 with runs at random lengths up to the limit.
+		int maxlen = (it / 5000) % 2 ? 32 : 2 + random() % 127;
+		unsigned window = 2 + (it / 777) % 31;
+		// One report per two multiframes, with the occasional long gap that ages points out.
+		fn = (fn + ((random() % 20 == 0) ? 2000 + random() % 4000 : 104)) % gHyperframe;
+		int y = -(random() % 100);
+		bool valid = random() % 5 != 0;
+
+		history.mhAdd(fn,y,valid,maxlen,fn);
+		reference.add(fn,y,valid,maxlen,fn);
+		if (random() % 3) { continue; }
+
+		float avg = 0, refavg = 0;
+		bool ok = history.mhAverage(window,avg);
+		bool refok = reference.average(window,refavg);
+		checked++;
+		if (ok != refok || (ok && avg != refavg) || history.mhLength() != reference.length()) {
+			if (bad++ < 5) {
+				printf("iteration %d: average %d %g length %u, reference %d %g length %u\n",
+					it,ok,avg,history.mhLength(),refok,refavg,reference.length());
+			}
+		}
+	}
+
+	printf("%d of %d checks differ\n",bad,checked);
+	printf(bad ? "FAILED\n" : "PASSED\n");
+	return bad ? 1 : 0;
+}
@@ -19,6 +19,8 @@
 
 #include <OpenBTSConfig.h>
 #include <math.h>
+#include <time.h>
+#include <errno.h>
 #include "GSMCommon.h"
 
 using namespace GSM;
@@ -223,33 +225,55 @@ ostream& GSM::operator<<(ostream& os, const Time& t)
 void Clock::clockSet(const Time& when)
 {
 	ScopedLock lock(mLock);
+	mSeq++;		// Now odd; readers will retry until we are done.
+	__sync_synchronize();
 	mBaseTime = Timeval(0);
 	mBaseFN = when.FN();
+	__sync_synchronize();
+	mSeq++;
 	isValid = true;
 }
 
 
+void Clock::readBase(int32_t &baseFN, Timeval &baseTime) const
+{
+	while (true) {
+		uint32_t seq = mSeq;
+		__sync_synchronize();
+		if (seq & 1) continue;	// clockSet in progress.
+		baseFN = mBaseFN;
+		baseTime = mBaseTime;
+		__sync_synchronize();
+		if (seq == mSeq) return;
+	}
+}
+
+
 int32_t Clock::FN() const
 {
-	ScopedLock lock(mLock);
+	int32_t baseFN;
+	Timeval baseTime;
+	readBase(baseFN,baseTime);
 	Timeval now;
-	int32_t deltaSec = now.sec() - mBaseTime.sec();
-	int32_t deltaUSec = now.usec() - mBaseTime.usec();
+	int32_t deltaSec = now.sec() - baseTime.sec();
+	int32_t deltaUSec = now.usec() - baseTime.usec();
 	int64_t elapsedUSec = 1000000LL*deltaSec + deltaUSec;
 	int64_t elapsedFrames = elapsedUSec / gFrameMicroseconds;
-	int32_t currentFN = (mBaseFN + elapsedFrames) % gHyperframe;
+	int32_t currentFN = (baseFN + elapsedFrames) % gHyperframe;
 	return currentFN;
 }
 
 double Clock::systime(const GSM::Time& when) const
 {
-	ScopedLock lock(mLock);
+	int32_t baseFN;
+	Timeval baseTime;
+	readBase(baseFN,baseTime);
 	const double slotMicroseconds = (48.0 / 13e6) * 156.25;
 	const double frameMicroseconds = slotMicroseconds * 8.0;
-	int32_t elapsedFrames = when.FN() - mBaseFN;
+	int32_t elapsedFrames = when.FN() - baseFN;
 	if (elapsedFrames<0) elapsedFrames += gHyperframe;
 	double elapsedUSec = elapsedFrames * frameMicroseconds + when.TN() * slotMicroseconds;
-	double baseSeconds = mBaseTime.sec() + mBaseTime.usec()*1e-6;
+	double baseSeconds = baseTime.sec() + baseTime.usec()*1e-6;
 	double st = baseSeconds + 1e-6*elapsedUSec;
 	return st;
 }
@@ -265,13 +289,50 @@ Timeval Clock::systime2(const GSM::Time& when) const
 
 void Clock::wait(const Time& when) const
 {
-	int32_t now = FN();
-	int32_t target = when.FN();
-	int32_t delta = FNDelta(target,now);
-	if (delta<1) return;
-	static const int32_t maxSleep = 51*26;
-	if (delta>maxSleep) delta=maxSleep;
-	sleepFrames(delta);
+	waitUntil(when);
+}
+
+
+long Clock::waitUntil(const Time& when) const
+{
+	int32_t baseFN;
+	Timeval baseTime;
+	readBase(baseFN,baseTime);
+
+	// The frame boundary for the target FN, computed the same way as FN() so that FN() >= when.FN() on return.
+	int64_t baseUSec = 1000000LL*baseTime.sec() + baseTime.usec();
+	int32_t framesFromBase = FNDelta(when.FN(),baseFN);
+	int64_t targetUSec = baseUSec + (int64_t)framesFromBase * gFrameMicroseconds;
+
+	Timeval now;
+	int64_t nowUSec = 1000000LL*now.sec() + now.usec();
+	if (targetUSec <= nowUSec) return 0;
+	static const int64_t maxSleepUSec = 51*26*(int64_t)gFrameMicroseconds;
+	if (targetUSec - nowUSec > maxSleepUSec) targetUSec = nowUSec + maxSleepUSec;
+
+	// gettimeofday and CLOCK_REALTIME share a time base.
+	struct timespec deadline;
+	deadline.tv_sec = targetUSec / 1000000;
+	deadline.tv_nsec = (targetUSec % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_REALTIME,TIMER_ABSTIME,&deadline,NULL) == EINTR) {}
+
+	Timeval woke;
+	long slack = (long)(1000000LL*woke.sec() + woke.usec() - targetUSec);
+	__sync_fetch_and_add(&mWaitCount,1);
+	__sync_fetch_and_add(&mWaitSlackTotal,(int64_t)slack);
+	int32_t oldMax = mWaitSlackMax;
+	while (slack > oldMax && !__sync_bool_compare_and_swap(&mWaitSlackMax,oldMax,(int32_t)slack)) { oldMax = mWaitSlackMax; }
+	return slack;
+}
+
+
+void Clock::clockWaitText(std::ostream &os) const
+{
+	uint32_t count = mWaitCount;
+	int64_t total = mWaitSlackTotal;
+	os << "clock waits: " << count;
+	if (count) { os << " average slack: " << (total / count) << "us max slack: " << mWaitSlackMax << "us"; }
+	os << endl;
 }
 
 
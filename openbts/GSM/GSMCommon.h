@@ -517,21 +517,30 @@ class Clock {
 	private:
 
 	Bool_z isValid;
-	mutable Mutex mLock;
+	mutable Mutex mLock;		///< Serializes writers only; readers use the mSeq seqlock.
+	volatile uint32_t mSeq;		///< Seqlock sequence, odd while a writer is updating the base.
 	int32_t mBaseFN;
 	Timeval mBaseTime;	// Defaults to now.
 
+	// Measured slack of waitUntil, in microseconds.  Positive means we woke up late.
+	mutable volatile uint32_t mWaitCount;
+	mutable volatile int64_t mWaitSlackTotal;
+	mutable volatile int32_t mWaitSlackMax;
+
+	/** Read the clock base consistently without taking the lock. */
+	void readBase(int32_t &baseFN, Timeval &baseTime) const;
+
 	public:
 
 	Clock(const Time& when = Time(0))
-		:mBaseFN(when.FN())
+		:mSeq(0),mBaseFN(when.FN()),mWaitCount(0),mWaitSlackTotal(0),mWaitSlackMax(0)
 	{}
 
 	/** Set the clock to a value. */
 	void clockSet(const Time&);
 	bool isClockValid() { return isValid; }	// Dont need a semaphore for POD.
 
-	/** Read the clock. */
+	/** Read the clock.  Lock-free; only retries if it races with clockSet. */
 	int32_t FN() const;
 
 	/** Read the clock. */
@@ -540,6 +549,16 @@ class Clock {
 	/** Block until the clock passes a given time. */
 	void wait(const Time&) const;
 
+	/**
+		Block until the clock reaches the given time, using an absolute-deadline sleep
+		so the wakeup does not accumulate the jitter of a relative sleepFrames().
+		@return The measured slack in microseconds, positive if we woke up late, 0 if the time had already passed.
+	*/
+	long waitUntil(const Time&) const;
+
+	/** Print the waitUntil slack statistics. */
+	void clockWaitText(std::ostream &os) const;
+
 	/** Return the system time associated with a given timestamp. */
 	// (pat) in secs with microsec resolution.
 	// (pat) This is updated at every CLOCK IND from the transceiver, so it is possible
@@ -20,6 +20,8 @@
 #include "GSMTransfer.h"
 #include "GSMLogicalChannel.h"
 #include "GSMCCCH.h"
+#include "GSMExecutor.h"
+#include "MSPowerControl.h"
 #include "GPRSExport.h"
 #include <ControlCommon.h>
 #include <Logger.h>
@@ -99,6 +101,11 @@ void GSMConfig::gsmInit()
 
 	mBand = (GSMBand)gConfig.getNum("GSM.Radio.Band");
  	regenerateBeacon();
+
+	// Start the channel executor before any channels are created; lcinit queues the channel service tasks on it.
+	unsigned lanes = gConfig.getNum("GSM.Executor.Threads");
+	if (lanes == 0) { lanes = gConfig.getNum("GSM.Radio.ARFCNs"); }
+	gChannelExecutor.ceStart(mClock,lanes,gConfig.getBool("GSM.Executor.CPUAffinity"));
 }
 
 void GSMConfig::gsmStart()
@@ -110,6 +117,7 @@ void GSMConfig::gsmStart()
 		GPRS::gprsStart();
 	}
 	gPowerManager.pmStart();
+	gMSPowerControl.pcStart();
 	// Do not call this until the paging channels are installed.
 	PagerStart();
 
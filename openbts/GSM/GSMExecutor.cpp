@@ -0,0 +1,137 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#define LOG_GROUP LogGroup::GSM		// Can set Log.Level.GSM for debugging
+
+#include "GSMExecutor.h"
+#include <Logger.h>
+#include <sched.h>
+
+
+using namespace std;
+
+namespace GSM {
+
+ChannelExecutor gChannelExecutor;
+
+
+void ChannelExecutor::ceStart(const Clock &wClock, unsigned numLanes, bool pinCpus)
+{
+	if (mRunning) return;
+	mClock = &wClock;
+	if (numLanes == 0) numLanes = 1;
+	long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for (unsigned ln = 0; ln < numLanes; ln++) {
+		Lane *lane = new Lane;
+		lane->mExecutor = this;
+		lane->mLaneNum = ln;
+		lane->mCpu = (pinCpus && numCpus > 0) ? (int)(ln % numCpus) : -1;
+		mLanes.push_back(lane);
+	}
+	mRunning = true;
+	for (unsigned ln = 0; ln < numLanes; ln++) {
+		mLanes[ln]->mLaneThread.start((void*(*)(void*))laneServiceLoop,mLanes[ln]);
+	}
+	LOG(NOTICE) << "channel executor started with " << numLanes << " lanes" << (pinCpus ? " pinned" : "");
+}
+
+
+void ChannelExecutor::ceSchedule(FrameTask *task, unsigned CN, unsigned frames)
+{
+	assert(mRunning);
+	Lane *lane = laneFor(CN);
+	ScopedLock lock(lane->mLaneLock);
+	if (task->mFtScheduled) return;
+	task->mFtScheduled = true;
+	int32_t when = (mClock->FN() + frames) % gHyperframe;
+	lane->mLaneQueue.push(Entry(when,lane->mSeq++,task));
+	lane->mLaneWakeup.signal();
+}
+
+
+void *ChannelExecutor::laneServiceLoop(Lane *lane)
+{
+	if (lane->mCpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(lane->mCpu,&cpus);
+		if (pthread_setaffinity_np(pthread_self(),sizeof(cpus),&cpus)) {
+			LOG(WARNING) << "could not pin executor lane " << lane->mLaneNum << " to cpu " << lane->mCpu;
+		}
+	}
+	lane->mExecutor->laneRun(lane);
+	return NULL;
+}
+
+
+void ChannelExecutor::laneRun(Lane *lane)
+{
+	lane->mLaneLock.lock();
+	while (mRunning) {
+		if (lane->mLaneQueue.empty()) {
+			lane->mLaneWakeup.wait(lane->mLaneLock,1000);
+			continue;
+		}
+		Entry next = lane->mLaneQueue.top();
+		int32_t now = mClock->FN();
+		int32_t delta = FNDelta(next.mFN,now);
+		if (delta > 0) {
+			// Sleep until the deadline, or until someone queues an earlier task.
+			lane->mLaneWakeup.wait(lane->mLaneLock,(delta*gFrameMicroseconds+999)/1000);
+			continue;
+		}
+		lane->mLaneQueue.pop();
+		lane->mRuns++;
+		if (delta < 0) {
+			lane->mLateRuns++;
+			if (-delta > lane->mMaxLateFrames) { lane->mMaxLateFrames = -delta; }
+		}
+		FrameTask *task = next.mTask;
+
+		// Run the task without holding the lane lock so it may schedule other tasks.
+		lane->mLaneLock.unlock();
+		unsigned frames = 0;
+		try {
+			frames = task->frameTaskRun();
+		} catch (...) {
+			LOG(ERR) << "executor task " << task->frameTaskName() << " killed by unexpected exception";
+		}
+		lane->mLaneLock.lock();
+
+		if (frames) {
+			// Reschedule relative to when we actually ran so a late lane does not try to catch up with back-to-back runs.
+			lane->mLaneQueue.push(Entry((now + frames) % gHyperframe,lane->mSeq++,task));
+		} else {
+			task->mFtScheduled = false;
+		}
+	}
+	lane->mLaneLock.unlock();
+}
+
+
+void ChannelExecutor::ceText(std::ostream &os) const
+{
+	for (unsigned ln = 0; ln < mLanes.size(); ln++) {
+		const Lane *lane = mLanes[ln];
+		ScopedLock lock(lane->mLaneLock);
+		os << "lane " << ln << " cpu=" << lane->mCpu << " tasks=" << lane->mLaneQueue.size()
+			<< " runs=" << lane->mRuns << " late=" << lane->mLateRuns << " maxLateFrames=" << lane->mMaxLateFrames << endl;
+	}
+}
+
+};	// namespace GSM
+
+// vim: ts=4 sw=4
@@ -0,0 +1,141 @@
+/**@file A small, TDMA-clock-driven thread pool for channel service routines. */
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#ifndef GSMEXECUTOR_H
+#define GSMEXECUTOR_H
+
+#include <ostream>
+#include <queue>
+#include <vector>
+
+#include <Threads.h>
+#include "GSMCommon.h"
+
+
+namespace GSM {
+
+class ChannelExecutor;
+
+/**
+	A unit of periodic channel work that is run by the ChannelExecutor instead of by a dedicated thread.
+	Formerly every dedicated channel had its own threads that spent nearly all their time in sleepFrames();
+	with several TRX that is hundreds of sleeping threads, each with its own stack and its own wakeups.
+	A FrameTask is instead queued on an executor lane by GSM::Time deadline and run when the TDMA clock reaches it.
+	The task must not block; if it needs to wait, it returns the number of frames until it wants to run again.
+
+	So far only the per-channel control service (the T3101/T3109/T3111 and radio link checks) runs here.
+	The LAPDm upstream loop, the L3 message loop, the SACCH service loop, the TCH/FACCH encoder and the
+	DCCHDispatcher still have their own threads, because they block in queue reads and in L1Encoder::waitToSend()
+	inside l2sendf and transmit.  Moving them needs those sends turned into timed queue entries the lane drains
+	at the transmit deadline, which has not been done.
+*/
+class FrameTask {
+	friend class ChannelExecutor;
+	Bool_z mFtScheduled;		///< True while the task sits in an executor lane.
+
+	public:
+	virtual ~FrameTask() {}
+
+	/**
+		Run one step of the task.
+		@return The number of frames until the task should run again, or 0 to retire the task.
+	*/
+	virtual unsigned frameTaskRun() = 0;
+
+	/** Name used in executor statistics and logging. */
+	virtual const char *frameTaskName() const { return "FrameTask"; }
+
+	bool frameTaskScheduled() const { return mFtScheduled; }
+};
+
+
+/**
+	A fixed pool of worker threads ("lanes"), each running the FrameTasks assigned to it in GSM::Time deadline order.
+	Tasks are assigned to lanes by ARFCN so that all the work for one carrier is serialized on one thread,
+	which can optionally be pinned to a CPU.
+*/
+class ChannelExecutor {
+
+	struct Entry {
+		int32_t mFN;			///< deadline frame number
+		unsigned mSeq;			///< tie breaker so equal deadlines run in FIFO order
+		FrameTask *mTask;
+		Entry(int32_t wFN, unsigned wSeq, FrameTask *wTask) : mFN(wFN), mSeq(wSeq), mTask(wTask) {}
+	};
+
+	/** Orders the priority_queue so the earliest deadline is on top, modulo the hyperframe. */
+	struct EntryLater {
+		bool operator()(const Entry &a, const Entry &b) const {
+			int cmp = FNCompare(a.mFN,b.mFN);
+			return cmp ? cmp > 0 : a.mSeq > b.mSeq;
+		}
+	};
+
+	struct Lane {
+		ChannelExecutor *mExecutor;
+		unsigned mLaneNum;
+		int mCpu;				///< CPU to pin to, or -1 for none.
+		mutable Mutex mLaneLock;
+		Signal mLaneWakeup;
+		std::priority_queue<Entry,std::vector<Entry>,EntryLater> mLaneQueue;
+		unsigned mSeq;
+		Thread mLaneThread;
+		// Statistics, protected by mLaneLock.
+		uint64_t mRuns;			///< Number of task steps run.
+		uint64_t mLateRuns;		///< Number of task steps run one or more frames after their deadline.
+		int32_t mMaxLateFrames;	///< Worst lateness seen.
+		Lane() : mExecutor(0), mLaneNum(0), mCpu(-1), mSeq(0), mLaneThread(32*1024*sizeof(void*)), mRuns(0), mLateRuns(0), mMaxLateFrames(0) {}
+	};
+
+	const Clock *mClock;
+	std::vector<Lane*> mLanes;
+	volatile bool mRunning;
+
+	static void *laneServiceLoop(Lane *lane);
+	void laneRun(Lane *lane);
+	Lane *laneFor(unsigned CN) const { return mLanes[CN % mLanes.size()]; }
+
+	public:
+	ChannelExecutor() : mClock(0), mRunning(false) {}
+
+	/**
+		Start the worker lanes.
+		@param wClock The TDMA clock used to evaluate deadlines.
+		@param numLanes The number of worker threads; 0 means one per configured ARFCN.
+		@param pinCpus If true, pin lane N to CPU N modulo the number of online CPUs.
+	*/
+	void ceStart(const Clock &wClock, unsigned numLanes, bool pinCpus);
+
+	bool ceRunning() const { return mRunning; }
+	unsigned ceNumLanes() const { return mLanes.size(); }
+
+	/**
+		Queue a task to run the given number of frames from now on the lane serving ARFCN CN.
+		A task that is already scheduled is left alone; it will be rescheduled by its own return value.
+	*/
+	void ceSchedule(FrameTask *task, unsigned CN, unsigned frames = 0);
+
+	/** Print per-lane statistics. */
+	void ceText(std::ostream &os) const;
+};
+
+extern ChannelExecutor gChannelExecutor;
+
+};	// namespace GSM
+
+#endif
+// vim: ts=4 sw=4
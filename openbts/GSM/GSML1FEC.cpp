@@ -28,11 +28,13 @@
 #include "GSMConfig.h"
 #include "GSMTDMA.h"
 #include "GSMTAPDump.h"
+#include "MSPowerControl.h"
 #include "GSMLogicalChannel.h"
 #include <ControlCommon.h>
 #include <OpenBTSConfig.h>
 #include <TRXManager.h>
 #include <Logger.h>
+#include <Reporting.h>
 #include <TMSITable.h>
 #include <assert.h>
 #include <math.h>
@@ -470,6 +472,7 @@ void L1Decoder::decInit()
 	//if (!mRunning) decStart();
 	//mRunning = true;
 	mDecoderStats.decoderStatsInit();
+	resetBERCounts();
 	//mFER=0.0F;
 	mBadFrameTracker = 0;
 	//mT3111.reset();
@@ -546,6 +549,7 @@ void L1Decoder::countGoodFrame(unsigned nframes)	// Number of bursts to count.
 	static const float b = 1.0F - a;
 	mDecoderStats.mAveFER *= b;
 	mDecoderStats.mStatTotalFrames += nframes;
+	{ ScopedLock lock(mBERLock); mBERCounts.mFrames++; }
 	OBJLOG(BLATHER) <<"L1Decoder FER=" << mDecoderStats.mAveFER;
 }
 
@@ -556,6 +560,9 @@ void L1Decoder::countBER(unsigned bec, unsigned frameSize)
 	float thisBER = (float) bec / frameSize;
 	mDecoderStats.mLastBER = thisBER;
 	mDecoderStats.mAveBER = b*mDecoderStats.mAveBER + a * thisBER;
+	ScopedLock lock(mBERLock);
+	mBERCounts.mRawBits += frameSize;
+	mBERCounts.mRawErrors += bec;
 }
 
 
@@ -567,12 +574,26 @@ void L1Decoder::countBadFrame(unsigned nframes)	// Number of bursts to count.
 	mDecoderStats.mAveFER = b*mDecoderStats.mAveFER + a;
 	mDecoderStats.mStatTotalFrames += nframes;
 	mDecoderStats.mStatBadFrames += nframes;
+	{ ScopedLock lock(mBERLock); mBERCounts.mFrames++; mBERCounts.mBadFrames++; }
 	OBJLOG(BLATHER) <<"L1Decoder FER=" << mDecoderStats.mAveFER;
 }
 
+// Unlike the DecoderStats counts these are per decoded frame, not per burst, so a bad TCH frame counts once, not four times.
+BERCounts L1Decoder::getBERCounts() const
+{
+	ScopedLock lock(mBERLock);
+	return mBERCounts;
+}
+
+void L1Decoder::resetBERCounts()
+{
+	ScopedLock lock(mBERLock);
+	mBERCounts.bcReset();
+}
+
 void SACCHL1Decoder::countBadFrame(unsigned nframes)
 {
-	RSSIBumpDown(gConfig.getNum("Control.SACCHTimeout.BumpDown"));
+	RSSIBumpDown(gMSPowerControl.pcBumpDown());
 	L1Decoder::countBadFrame(nframes);
 }
 
@@ -753,6 +774,7 @@ void XCCHL1Decoder::writeLowSideRx(const RxBurst& inBurst)
 	// Accept the burst into the deinterleaving buffer.
 	// Return true if we are ready to interleave.
 	if (!processBurst(inBurst)) return;
+	uint64_t blockStart = reportUsecs();
 	if (mEncrypted == ENCRYPT_YES) {
 		decrypt();
 	}
@@ -793,6 +815,8 @@ void XCCHL1Decoder::writeLowSideRx(const RxBurst& inBurst)
 			countBadFrame(1);
 		}
 	}
+	static const ReportHistogram sBurstToL2Report = gReports.lookupHistogram("OpenBTS.GSM.L1.BurstToL2Usecs");
+	gReports.sample(sBurstToL2Report,reportUsecs() - blockStart);
 }
 
 
@@ -984,7 +1008,7 @@ void XCCHL1Decoder::handleGoodFrame()
 void MSPhysReportInfo::processPhysInfo(const RxBurst &inBurst)
 {
 	// RSSI is dB wrt full scale.
-	unsigned count = min((int)mReportCount,(int)gConfig.getNum("GSM.Radio.RSSIAveragePeriod"));
+	unsigned count = min((int)mReportCount,gConfig.GSM.Radio.RSSIAveragePeriod);
 	mRSSI = (inBurst.RSSI()  + count * mRSSI) / (count+1);
 
 	// Timing error is a float in symbol intervals.
@@ -1717,6 +1741,26 @@ void TCHFACCHL1Decoder::deinterleaveTCH(int blockOffset )
 
 void TCHFACCHL1Decoder::addToSpeechQ(AudioFrame *newFrame)  { mSpeechQ.write(newFrame); }
 
+BERCounts TCHFACCHL1Decoder::getBERCounts() const
+{
+	BERCounts counts = L1Decoder::getBERCounts();
+	// Until the decoder gets to a pending reset the old PRBS counts are as good as gone.
+	if (!mPRBSReset) { mPRBSCheck.addTo(counts); }
+	return counts;
+}
+
+void TCHFACCHL1Decoder::resetBERCounts()
+{
+	L1Decoder::resetBERCounts();
+	mPRBSReset = true;
+}
+
+void TCHFACCHL1Decoder::decInit()
+{
+	XCCHL1Decoder::decInit();
+	mPRBSTest = false;
+}
+
 
 // (pat) See GSM 6.12 5.2 and 5.03 table 2 (in section 5.4)
 // I did not get this to work in that I did not see any silence frames.
@@ -2084,7 +2128,17 @@ bool TCHFRL1Decoder::decodeTCH(bool stolen, const SoftVector *wC)	// result goes
 	}
 
 	// (pat) Slight weirdness to avoid modifying existing GSM_FR code too much.
-	return (mAMRMode == TCH_FS) ? decodeTCH_GSM(stolen,wC) : decodeTCH_AFS(stolen,wC);
+	bool good = (mAMRMode == TCH_FS) ? decodeTCH_GSM(stolen,wC) : decodeTCH_AFS(stolen,wC);
+	if (mPRBSReset) {
+		// Only this thread changes the checker, so it cannot be reset in the middle of a frame.
+		mPRBSReset = false;
+		mPRBSCheck.reset();
+	}
+	if (mPRBSTest) {
+		// On a good frame mPrevGoodFrame is what we just decoded; otherwise the pattern just moves along.
+		if (good) { mPRBSCheck.check(mPrevGoodFrame); } else { mPRBSCheck.skip(mPrevGoodFrame.size()); }
+	}
+	return good;
 }
 
 
@@ -2141,7 +2195,7 @@ TCHFACCHL1Encoder::TCHFACCHL1Encoder(
 	const TDMAMapping& wMapping,
 	L1FEC *wParent)
 	:XCCHL1Encoder(wCN, wTN, wMapping, wParent), 
-	mPreviousFACCH(true),mOffset(0)
+	mPreviousFACCH(true),mOffset(0),mPRBSTest(false)
 {
 	for(int k = 0; k<8; k++) {
 		mI[k].resize(114);
@@ -2169,6 +2223,7 @@ void TCHFACCHL1Encoder::encInit()
 	// But it's gone now.
 	XCCHL1Encoder::encInit();
 	mPreviousFACCH = true;
+	mPRBSTest = false;
 }
 
 
@@ -2261,6 +2316,15 @@ void TCHFRL1Encoder::encodeTCH(const AudioFrame* aFrame)
 	if (mAMRMode == TCH_FS) { encodeTCH_GSM(aFrame); } else { encodeTCH_AFS(aFrame); }
 }
 
+void TCHFRL1Encoder::encodeTCHTest(PRBS9 &prbs)
+{
+	BitVector2 payload(getTCHPayloadSize());
+	prbs.fill(payload);
+	AudioFrameRtp frame(mAMRMode);
+	frame.append(payload);
+	encodeTCH(&frame);
+}
+
 
 void TCHFACCHL1Encoder::sendFrame( const L2Frame& frame )
 {
@@ -2306,7 +2370,7 @@ void TCHFACCHL1Encoder::dispatch()
 	// Since Asterisk is local, latency should be small.
 	OBJLOG(DEBUG) <<"TCHFACCHL1Encoder speechQ.size=" << mSpeechQ.size();
 	int maxQ = gConfig.getNum("GSM.MaxSpeechLatency");
-	while ((int)mSpeechQ.size() > maxQ) delete mSpeechQ.read();
+	mSpeechQ.trim(maxQ);
 
 	// Send, by priority: (1) FACCH, (2) TCH, (3) filler.
 	if (L2Frame *fFrame = mL2Q.readNoBlock()) {
@@ -2326,6 +2390,11 @@ void TCHFACCHL1Encoder::dispatch()
 		delete fFrame;
 		// Flush the vocoder FIFO to limit latency.
 		while (mSpeechQ.size()>0) delete mSpeechQ.read();
+	} else if (mPRBSTest) {
+		// BER test: the pattern replaces the speech, which is discarded.
+		while (mSpeechQ.size()>0) delete mSpeechQ.read();
+		encodeTCHTest(mPRBS);
+		OBJLOG(DEBUG) <<"TCHFACCHL1Encoder PRBS c[]=" << mC;
 	} else if (AudioFrame *tFrame = mSpeechQ.readNoBlock()) {
 		OBJLOG(DEBUG) <<"TCHFACCHL1Encoder TCH " << *tFrame;
 		// Encode the speech frame into c[] as per GSM 05.03 3.1.2.
@@ -2526,8 +2595,8 @@ void MSPhysReportInfo::setPhy(const SACCHL1Decoder& other)
 
 static float boundMSPower(float orderedMSPower)
 {
-	float maxPower = gConfig.getNum("GSM.MS.Power.Max");
-	float minPower = gConfig.getNum("GSM.MS.Power.Min");
+	float maxPower = gConfig.GSM.MS.Power.Max;
+	float minPower = gConfig.GSM.MS.Power.Min;
 	if (orderedMSPower>maxPower) orderedMSPower=maxPower;
 	else if (orderedMSPower<minPower) orderedMSPower=minPower;
 	return orderedMSPower;
@@ -2541,7 +2610,7 @@ void SACCHL1Encoder::setMSPower(float orderedPower)
 void SACCHL1Encoder::setMSTiming(float orderedTiming)
 {
 	mOrderedMSTiming = orderedTiming;
-	float maxTiming = gConfig.getNum("GSM.MS.TA.Max");
+	float maxTiming = gConfig.GSM.MS.TA.Max;
 	if (mOrderedMSTiming<0.0F) mOrderedMSTiming=0.0F;
 	else if (mOrderedMSTiming>maxTiming) mOrderedMSTiming=maxTiming;
 }
@@ -2632,58 +2701,9 @@ void SACCHL1Encoder::sendFrame(const L2Frame& frame)
 	OBJLOG(BLATHER) << "SACCHL1Encoder " << frame;
 
 	// Physical header, GSM 04.04 6, 7.1
-	// Power and timing control, GSM 05.08 4, GSM 05.10 5, 6.
-
-	SACCHL1Decoder &sib = *SACCHSibling();
-
-	if (sib.isValid()) {
-		// Power.  GSM 05.08 4.
-		// Power expressed in dBm, RSSI in dB wrt max.
-		float RSSI = sib.getRSSI();
-		float RSSITarget = gConfig.getNum("GSM.Radio.RSSITarget");
-		// (pat) RSSI and RSSITarget are both negative, so deltaP is positive if power is too high.
-		float deltaP = RSSI - RSSITarget;
-		// SNRTarget == 0 disables:
-		if (float SNRTarget = gConfig.getNum("GSM.Radio.SNRTarget")) {
-			float SNR = sib.getAveSNR();
-			if (deltaP > 0 && SNR < SNRTarget) {	// If RSSITarget is met but SNR looks bad...
-				// How do we decide what the target power should be from SNR?  And I dont want to call log().
-				// We only change upward based on SNR - we rely on RSSITarget to keep the power down.
-				deltaP = SNR - SNRTarget;	// So how about something simple like this?  eg: SNR == 10 is ok, SNR==6 would be bad, so add 4dB?  
-			}
-		}
-		float actualPower = sib.actualMSPower();
-		int configPowerDamping = gConfig.getNum("GSM.MS.Power.Damping");
-		// Use the power damping algorithm.
-		float targetMSPower = actualPower - deltaP;
-		float powerDamping = configPowerDamping*0.01F;
-		if (configPowerDamping < 90 && deltaP < 4) {
-			// (pat 2-2014) Adjust the power in the upward direction faster than in the downward direction
-			// if we are in danger of losing the signal.
-			// This is intended to lessen signal degradation from, eg, just turning your head.
-			// But this may not be worth the effort.  If the signal has dropped much lower than this
-			// we will already have lost communication with the MS so we will never get here,
-			// instead RSSIBumpDown will be used, although that could indirectly induce this greater jump here.
-			powerDamping /= 2;	// This should probably be log response.
-		}
-		// (pat) Now, how fast does RSSI as seen in OpenBTS respond to changes ordered in the MS by mOrderedPower?
-		// Do we need the damping factor to take that into account, or should we instead wait a bit after ordering
-		// a power change before ordering another?  I guess we rely on the powerDamping factor to handle it.
-		setMSPower(powerDamping*mOrderedMSPower + (1.0F-powerDamping)*targetMSPower);
-		OBJLOG(DEBUG) <<"SACCHL1Encoder RSSI=" << RSSI << " target=" << RSSITarget
-			<< " deltaP=" << deltaP << " actual=" << actualPower << " order=" << mOrderedMSPower;
-		// Timing.  GSM 05.10 5, 6.
-		// Time expressed in symbol periods.
-		float timingError = sib.timingError();
-		float actualTiming = sib.actualMSTiming();
-		float targetMSTiming = actualTiming + timingError;
-		float TADamping = gConfig.getNum("GSM.MS.TA.Damping")*0.01F;
-		setMSTiming(TADamping*mOrderedMSTiming + (1.0F-TADamping)*targetMSTiming);
-		OBJLOG(DEBUG) << "SACCHL1Encoder timingError=" << timingError
-			<< " actualTA=" << actualTiming << " orderedTA=" << mOrderedMSTiming
-			<< " targetTA=" << targetMSTiming;
+	// Power and timing control, GSM 05.08 4, GSM 05.10 5, 6, is done for all channels at once
+	// by gMSPowerControl, which updates mOrderedMSPower and mOrderedMSTiming once per SACCH multiframe.
 
-	}
 	// Write physical header into mU and then call base class.
 
 	// SACCH physical header, GSM 04.04 6.1, 7.1.
@@ -38,6 +38,7 @@
 
 #include "GSM610Tables.h"
 #include "GSM503Tables.h"
+#include "GSMBERTest.h"
 
 #include <OpenBTSConfig.h>
 
@@ -341,6 +342,8 @@ class L1Decoder {
 	int mFN[8];
 
 	DecoderStats mDecoderStats;
+	mutable Mutex mBERLock;			///< protects mBERCounts, which the CLI reads from another thread
+	BERCounts mBERCounts;
 
 	public:
 
@@ -403,6 +406,9 @@ class L1Decoder {
 	/** Total frame error rate since last open(). */
 	float FER() const { return mDecoderStats.mAveFER; }			// (pat) old routine, switched to new variable.
 	DecoderStats getDecoderStats() const { return mDecoderStats; }	// (pat) new routine, more stats
+	/** Exact error counts since open() or the last resetBERCounts(). */
+	virtual BERCounts getBERCounts() const;
+	virtual void resetBERCounts();
 
 	/** Return the multiplexing parameters. */
 	const TDMAMapping& mapping() const { return mMapping; }
@@ -1075,6 +1081,8 @@ class TCHFRL1Encoder : virtual public SharedL1Encoder
 	void setAmrMode(AMRMode wMode);
 	/** Encode a full speed AMR vocoder frame into c[]. */
 	void encodeTCH(const SIP::AudioFrame* aFrame);	// Not that the const does any good.
+	/** Encode the next payload's worth of the test pattern into c[], as if it were a vocoder frame. */
+	void encodeTCHTest(PRBS9 &prbs);
 
 	// (pat) Irritating and pointless but harmless double-initialization of Parity and BitVector2s.  Stupid language.
 	// (pat) Assume TCH_FS until someone changes the mode to something else.
@@ -1102,6 +1110,9 @@ class TCHFACCHL1Encoder :
 
 	L2FrameFIFO mL2Q;				///< input queue for L2 FACCH frames
 
+	volatile bool mPRBSTest;		///< if true, send the PRBS9 pattern in place of speech
+	PRBS9 mPRBS;
+
 	Thread mEncoderThread;
 	friend void TCHFACCHL1EncoderRoutine( TCHFACCHL1Encoder * encoder );	
 
@@ -1114,6 +1125,9 @@ public:
 	/** Enqueue a traffic frame for transmission by the FEC to be sent to the radio. */
 	void sendTCH(SIP::AudioFrame *frame) { mSpeechQ.write(frame); }
 
+	/** Start or stop sending the test pattern on the downlink. */
+	void setPRBSTest(bool on) { mPRBSTest = on; }
+
 	/** Extend open() to set up semaphores. */
 	void encInit();
 
@@ -1172,6 +1186,9 @@ class TCHFRL1Decoder : virtual public SharedL1Decoder
 	bool decodeTCH_GSM(bool stolen, const SoftVector *wC);
 	bool decodeTCH_AFS(bool stolen, const SoftVector *wC);
 	protected:
+	volatile bool mPRBSTest;	///< if true, check decoded payloads against the PRBS9 pattern
+	volatile bool mPRBSReset;	///< set from the CLI; the decoder restarts mPRBSCheck before its next frame
+	PRBSChecker mPRBSCheck;
 	virtual void addToSpeechQ(SIP::AudioFrame *newFrame) = 0;	// Where the upstream result from decodeTCH goes.
 	void setViterbi(AMRMode wMode) {
 		if (mViterbi) { delete mViterbi; }
@@ -1184,10 +1201,12 @@ class TCHFRL1Decoder : virtual public SharedL1Decoder
 	*/
 	bool decodeTCH(bool stolen, const SoftVector *wC);	// result goes to mSpeechQ
 	void setAmrMode(AMRMode wMode);
+	/** Start or stop checking the uplink payload against the test pattern; either way the PRBS counts start over. */
+	void setPRBSTest(bool on) { mPRBSReset = true; mPRBSTest = on; }
 
 	// (pat) Irritating and pointless but harmless double-initialization of Parity and BitVector2s.  Stupid language.
 	// (pat) Assume TCH_FS until someone changes the mode to something else.
-	TCHFRL1Decoder() : mTCHParity(0,0,0), mViterbi(0) { setAmrMode(TCH_FS); }
+	TCHFRL1Decoder() : mTCHParity(0,0,0), mViterbi(0), mPRBSTest(false), mPRBSReset(false) { setAmrMode(TCH_FS); }
 	//string debugId() const { static string id; return id.size() ? id : (id=format("TCHFRL1Decoder %s ",descriptiveString())); }
 };
 
@@ -1251,6 +1270,12 @@ class TCHFACCHL1Decoder :
 
 	/** Return count of internally-queued traffic frames. */
 	unsigned queueSize() const { return mSpeechQ.size(); }
+	/** Discard the oldest traffic frames so at most maxQ remain; return the number discarded. */
+	unsigned flushTCH(unsigned maxQ) { return mSpeechQ.trim(maxQ); }
+	BERCounts getBERCounts() const;
+	void resetBERCounts();
+	/** Extend decInit() to stop a PRBS test left running by the last user of the channel. */
+	void decInit();
 	const char* descriptiveString() const { return L1Decoder::descriptiveString(); }
 	//string debugId() const { static string id; return id.size() ? id : (id=format("TCHFACCHL1Decoder %s ",descriptiveString())); }
 
@@ -1438,6 +1463,8 @@ class SACCHL1Encoder : public XCCHL1Encoder {
 	//void orderedMSTiming(int timing) { mOrderedMSTiming = timing; }
 	void setMSPower(float orderedMSPower);
 	void setMSTiming(float orderedTiming);
+	float orderedMSPower() const { return mOrderedMSPower; }
+	float orderedMSTiming() const { return mOrderedMSTiming; }
 
 	void setPhy(const SACCHL1Encoder&);
 	void initPhy(float RSSI, float timingError);
@@ -1582,6 +1609,13 @@ public:
 	unsigned queueSize() const
 		{ assert(mTCHDecoder); return mTCHDecoder->queueSize(); }
 
+	unsigned flushTCH(unsigned maxQ)
+		{ assert(mTCHDecoder); return mTCHDecoder->flushTCH(maxQ); }
+
+	/** Send the PRBS9 test pattern in place of speech and check for it on the uplink. */
+	void setPRBSTest(bool on)
+		{ assert(mTCHDecoder && mTCHEncoder); mTCHDecoder->setPRBSTest(on); mTCHEncoder->setPRBSTest(on); }
+
 	//string debugId() const { static string id; return id.size() ? id : (id=format("TCHFACCHL1FEC %s ",descriptiveString())); }
 };
 
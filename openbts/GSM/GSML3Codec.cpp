@@ -0,0 +1,828 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#define LOG_GROUP LogGroup::GSM		// Can set Log.Level.GSM for debugging
+
+#include "GSML3Codec.h"
+#include "GSML3Message.h"
+#include "GSML3MMMessages.h"
+#include "GSML3RRMessages.h"
+#include "GSML3CCMessages.h"
+#include <SMSMessages.h>
+#include <Logger.h>
+#include <string.h>
+#include <time.h>
+#include <iomanip>
+#include <sstream>
+
+
+using namespace std;
+
+namespace GSM {
+
+#define NUMIES(tab) (sizeof(tab)/sizeof(tab[0]))
+
+// The descriptors, GSM 04.08 9.  Optional IEs the BTS never looks at are left out; the decoder skips unknown IEs.
+// The length limits are loose on purpose: they only need to be tight enough to keep a bad length from running
+// off the end of an IE, since the element classes do their own validation if the caller uses them.
+
+// ---- Mobility Management, 04.08 9.2 ----
+static const L3IEDesc sLocationUpdatingRequestIEs[] = {
+	{ L3IEVHalf, 0, 0, 0, "UpdateType" },
+	{ L3IEVHalf, 0, 0, 0, "CKSN" },
+	{ L3IEV, 0, 5, 5, "LAI" },
+	{ L3IEV, 0, 1, 1, "Classmark1" },
+	{ L3IELV, 0, 1, 8, "MobileIdentity" },
+	{ L3IETLV, 0x33, 0, 32, "ClassmarkForUMTS" },
+	{ L3IETVHalf, 0xc, 0, 0, "AdditionalUpdateParameters" },
+};
+static const L3IEDesc sIMSIDetachIndicationIEs[] = {
+	{ L3IEV, 0, 1, 1, "Classmark1" },
+	{ L3IELV, 0, 1, 8, "MobileIdentity" },
+};
+static const L3IEDesc sCMServiceRequestIEs[] = {
+	{ L3IEVHalf, 0, 0, 0, "ServiceType" },
+	{ L3IEVHalf, 0, 0, 0, "CKSN" },
+	{ L3IELV, 0, 3, 3, "Classmark2" },
+	{ L3IELV, 0, 1, 8, "MobileIdentity" },
+	{ L3IETVHalf, 0x8, 0, 0, "Priority" },
+};
+static const L3IEDesc sCMReestablishmentRequestIEs[] = {
+	{ L3IEVHalf, 0, 0, 0, "CKSN" },
+	{ L3IEVHalf, 0, 0, 0, "Spare" },
+	{ L3IELV, 0, 3, 3, "Classmark2" },
+	{ L3IELV, 0, 1, 8, "MobileIdentity" },
+	{ L3IETV, 0x13, 5, 5, "LAI" },
+};
+static const L3IEDesc sIdentityRequestIEs[] = {
+	{ L3IEVHalf, 0, 0, 0, "IdentityType" },
+	{ L3IEVHalf, 0, 0, 0, "Spare" },
+};
+static const L3IEDesc sIdentityResponseIEs[] = {
+	{ L3IELV, 0, 1, 8, "MobileIdentity" },
+};
+static const L3IEDesc sAuthenticationRequestIEs[] = {
+	{ L3IEVHalf, 0, 0, 0, "CKSN" },
+	{ L3IEVHalf, 0, 0, 0, "Spare" },
+	{ L3IEV, 0, 16, 16, "RAND" },
+};
+static const L3IEDesc sAuthenticationResponseIEs[] = {
+	{ L3IEV, 0, 4, 4, "SRES" },
+	{ L3IETLV, 0x21, 1, 12, "SRESExtension" },
+};
+static const L3IEDesc sLocationUpdatingAcceptIEs[] = {
+	{ L3IEV, 0, 5, 5, "LAI" },
+	{ L3IETLV, 0x17, 1, 8, "MobileIdentity" },
+	{ L3IET, 0xa1, 0, 0, "FollowOnProceed" },
+};
+static const L3IEDesc sMMCauseIEs[] = {
+	{ L3IEV, 0, 1, 1, "Cause" },
+};
+
+// ---- Radio Resource, 04.08 9.1 ----
+static const L3IEDesc sPagingResponseIEs[] = {
+	{ L3IEVHalf, 0, 0, 0, "CKSN" },
+	{ L3IEVHalf, 0, 0, 0, "Spare" },
+	{ L3IELV, 0, 3, 3, "Classmark2" },
+	{ L3IELV, 0, 1, 8, "MobileIdentity" },
+};
+static const L3IEDesc sClassmarkChangeIEs[] = {
+	{ L3IELV, 0, 3, 3, "Classmark2" },
+	{ L3IETLV, 0x20, 0, 32, "Classmark3" },
+};
+static const L3IEDesc sCipheringModeCompleteIEs[] = {
+	{ L3IETLV, 0x17, 1, 8, "MobileIdentity" },
+};
+static const L3IEDesc sRRCauseIEs[] = {
+	{ L3IEV, 0, 1, 1, "Cause" },
+};
+static const L3IEDesc sMeasurementReportIEs[] = {
+	{ L3IEV, 0, 16, 16, "Results" },
+};
+
+// ---- Call Control, 04.08 9.3 ----
+static const L3IEDesc sSetupIEs[] = {
+	{ L3IETVHalf, 0xd, 0, 0, "RepeatIndicator" },
+	{ L3IETLV, 0x04, 1, 14, "BearerCapability" },
+	{ L3IETLV, 0x1c, 0, 255, "Facility" },
+	{ L3IETLV, 0x1e, 2, 2, "Progress" },
+	{ L3IETV, 0x34, 1, 1, "Signal" },
+	{ L3IETLV, 0x5c, 1, 12, "CallingParty" },
+	{ L3IETLV, 0x5d, 0, 21, "CallingSubaddress" },
+	{ L3IETLV, 0x5e, 1, 17, "CalledParty" },
+	{ L3IETLV, 0x6d, 0, 21, "CalledSubaddress" },
+	{ L3IETLV, 0x7c, 0, 16, "LLC" },
+	{ L3IETLV, 0x7d, 0, 3, "HLC" },
+	{ L3IETLV, 0x7e, 1, 129, "UserUser" },
+	{ L3IETLV, 0x7f, 0, 1, "SSVersion" },
+	{ L3IET, 0xa1, 0, 0, "CLIRSuppression" },
+	{ L3IET, 0xa2, 0, 0, "CLIRInvocation" },
+	{ L3IETLV, 0x15, 1, 2, "CCCapabilities" },
+	{ L3IETLV, 0x40, 1, 255, "SupportedCodecs" },
+};
+static const L3IEDesc sCallConfirmedIEs[] = {
+	{ L3IETVHalf, 0xd, 0, 0, "RepeatIndicator" },
+	{ L3IETLV, 0x04, 1, 14, "BearerCapability" },
+	{ L3IETLV, 0x08, 2, 30, "Cause" },
+	{ L3IETLV, 0x15, 1, 2, "CCCapabilities" },
+	{ L3IETLV, 0x40, 1, 255, "SupportedCodecs" },
+};
+static const L3IEDesc sDisconnectIEs[] = {
+	{ L3IELV, 0, 2, 30, "Cause" },
+	{ L3IETLV, 0x1c, 0, 255, "Facility" },
+	{ L3IETLV, 0x1e, 2, 2, "Progress" },
+	{ L3IETLV, 0x7e, 1, 129, "UserUser" },
+	{ L3IETLV, 0x7f, 0, 1, "SSVersion" },
+};
+static const L3IEDesc sReleaseIEs[] = {
+	{ L3IETLV, 0x08, 2, 30, "Cause" },
+	{ L3IETLV, 0x1c, 0, 255, "Facility" },
+	{ L3IETLV, 0x7e, 1, 129, "UserUser" },
+	{ L3IETLV, 0x7f, 0, 1, "SSVersion" },
+};
+static const L3IEDesc sCCCommonIEs[] = {
+	{ L3IETLV, 0x1c, 0, 255, "Facility" },
+	{ L3IETLV, 0x1e, 2, 2, "Progress" },
+	{ L3IETLV, 0x7e, 1, 129, "UserUser" },
+	{ L3IETLV, 0x7f, 0, 1, "SSVersion" },
+};
+static const L3IEDesc sStartDTMFIEs[] = {
+	{ L3IETV, 0x2c, 1, 1, "KeypadFacility" },
+};
+static const L3IEDesc sCCStatusIEs[] = {
+	{ L3IELV, 0, 2, 30, "Cause" },
+	{ L3IEV, 0, 1, 1, "CallState" },
+};
+
+// ---- SMS CP layer, 04.11 7.2 ----
+static const L3IEDesc sCPDataIEs[] = {
+	{ L3IELV, 0, 0, 248, "UserData" },
+};
+static const L3IEDesc sCPErrorIEs[] = {
+	{ L3IEV, 0, 1, 1, "Cause" },
+};
+
+static const L3IEDesc *const sNoIEs = NULL;
+
+#define MSGDESC(pd,mti,name,ies) { pd, mti, name, ies, NUMIES(ies) }
+#define MSGDESC0(pd,mti,name) { pd, mti, name, sNoIEs, 0 }
+
+const L3MsgDesc gL3LocationUpdatingRequestDesc = MSGDESC(L3MobilityManagementPD,0x08,"LocationUpdatingRequest",sLocationUpdatingRequestIEs);
+const L3MsgDesc gL3LocationUpdatingAcceptDesc = MSGDESC(L3MobilityManagementPD,0x02,"LocationUpdatingAccept",sLocationUpdatingAcceptIEs);
+const L3MsgDesc gL3IdentityRequestDesc = MSGDESC(L3MobilityManagementPD,0x18,"IdentityRequest",sIdentityRequestIEs);
+const L3MsgDesc gL3AuthenticationRequestDesc = MSGDESC(L3MobilityManagementPD,0x12,"AuthenticationRequest",sAuthenticationRequestIEs);
+const L3MsgDesc gL3DisconnectDesc = MSGDESC(L3CallControlPD,0x25,"Disconnect",sDisconnectIEs);
+const L3MsgDesc gL3ReleaseCompleteDesc = MSGDESC(L3CallControlPD,0x2a,"ReleaseComplete",sReleaseIEs);
+const L3MsgDesc gL3ChannelReleaseDesc = MSGDESC(L3RadioResourcePD,0x0d,"ChannelRelease",sRRCauseIEs);
+
+static const L3MsgDesc sMsgDescs[] = {
+	MSGDESC(L3MobilityManagementPD,0x01,"IMSIDetachIndication",sIMSIDetachIndicationIEs),
+	MSGDESC(L3MobilityManagementPD,0x04,"LocationUpdatingReject",sMMCauseIEs),
+	MSGDESC(L3MobilityManagementPD,0x14,"AuthenticationResponse",sAuthenticationResponseIEs),
+	MSGDESC(L3MobilityManagementPD,0x19,"IdentityResponse",sIdentityResponseIEs),
+	MSGDESC0(L3MobilityManagementPD,0x1b,"TMSIReallocationComplete"),
+	MSGDESC0(L3MobilityManagementPD,0x21,"CMServiceAccept"),
+	MSGDESC(L3MobilityManagementPD,0x22,"CMServiceReject",sMMCauseIEs),
+	MSGDESC0(L3MobilityManagementPD,0x23,"CMServiceAbort"),
+	MSGDESC(L3MobilityManagementPD,0x24,"CMServiceRequest",sCMServiceRequestIEs),
+	MSGDESC(L3MobilityManagementPD,0x28,"CMReestablishmentRequest",sCMReestablishmentRequestIEs),
+	MSGDESC(L3MobilityManagementPD,0x31,"MMStatus",sMMCauseIEs),
+
+	MSGDESC(L3RadioResourcePD,0x12,"RRStatus",sRRCauseIEs),
+	MSGDESC(L3RadioResourcePD,0x15,"MeasurementReport",sMeasurementReportIEs),
+	MSGDESC(L3RadioResourcePD,0x16,"ClassmarkChange",sClassmarkChangeIEs),
+	MSGDESC(L3RadioResourcePD,0x27,"PagingResponse",sPagingResponseIEs),
+	MSGDESC(L3RadioResourcePD,0x29,"AssignmentComplete",sRRCauseIEs),
+	MSGDESC(L3RadioResourcePD,0x2c,"HandoverComplete",sRRCauseIEs),
+	MSGDESC(L3RadioResourcePD,0x32,"CipheringModeComplete",sCipheringModeCompleteIEs),
+
+	MSGDESC(L3CallControlPD,0x01,"Alerting",sCCCommonIEs),
+	MSGDESC(L3CallControlPD,0x02,"CallProceeding",sCCCommonIEs),
+	MSGDESC(L3CallControlPD,0x05,"Setup",sSetupIEs),
+	MSGDESC(L3CallControlPD,0x07,"Connect",sCCCommonIEs),
+	MSGDESC(L3CallControlPD,0x08,"CallConfirmed",sCallConfirmedIEs),
+	MSGDESC0(L3CallControlPD,0x0f,"ConnectAcknowledge"),
+	MSGDESC(L3CallControlPD,0x2d,"Release",sReleaseIEs),
+	MSGDESC0(L3CallControlPD,0x31,"StopDTMF"),
+	MSGDESC(L3CallControlPD,0x35,"StartDTMF",sStartDTMFIEs),
+	MSGDESC(L3CallControlPD,0x3d,"Status",sCCStatusIEs),
+
+	MSGDESC(L3SMSPD,0x01,"CP-DATA",sCPDataIEs),
+	MSGDESC0(L3SMSPD,0x04,"CP-ACK"),
+	MSGDESC(L3SMSPD,0x10,"CP-ERROR",sCPErrorIEs),
+};
+
+// Direct lookup by PD and MTI.  Filled at static init time from constant tables, so it is ready before main().
+static const L3MsgDesc *sMsgIndex[16][256];
+static void indexDesc(const L3MsgDesc *desc)
+{
+	assert(desc->mNumIEs <= L3FlatMaxIEs);
+	sMsgIndex[desc->mPD & 0xf][desc->mMTI] = desc;
+}
+static struct L3MsgIndexInit {
+	L3MsgIndexInit() {
+		for (unsigned i = 0; i < NUMIES(sMsgDescs); i++) { indexDesc(&sMsgDescs[i]); }
+		indexDesc(&gL3LocationUpdatingRequestDesc);
+		indexDesc(&gL3LocationUpdatingAcceptDesc);
+		indexDesc(&gL3IdentityRequestDesc);
+		indexDesc(&gL3AuthenticationRequestDesc);
+		indexDesc(&gL3DisconnectDesc);
+		indexDesc(&gL3ReleaseCompleteDesc);
+		indexDesc(&gL3ChannelReleaseDesc);
+	}
+} sL3MsgIndexInit;
+
+const L3MsgDesc *l3FindMsgDesc(L3PD pd, unsigned mti)
+{
+	if ((unsigned)pd > 0xf || mti > 0xff) return NULL;
+	return sMsgIndex[pd][mti];
+}
+
+
+bool L3FlatMessage::flatDecode(const L3Frame &frame)
+{
+	mDesc = NULL;
+	unsigned len = frame.size() / 8;
+	if (len < 2 || len > L3FlatMaxBytes || (frame.size() & 7)) return false;
+	frame.pack(mBytes);
+	return decodeInPlace(len);
+}
+
+bool L3FlatMessage::flatDecode(const unsigned char *bytes, unsigned len)
+{
+	mDesc = NULL;
+	if (len < 2 || len > L3FlatMaxBytes) return false;
+	memcpy(mBytes,bytes,len);
+	return decodeInPlace(len);
+}
+
+// Decode mBytes[0..len).
+bool L3FlatMessage::decodeInPlace(unsigned len)
+{
+	L3PD pd = (L3PD) (mBytes[0] & 0xf);
+	unsigned mti = mBytes[1];
+	// GSM 04.08 10.4: mask out the send sequence number, same as L3Frame::MTI().
+	if (pd == L3CallControlPD || pd == L3MobilityManagementPD || pd == L3NonCallSSPD) { mti &= 0xbf; }
+	const L3MsgDesc *desc = l3FindMsgDesc(pd,mti);
+	if (desc == NULL) return false;
+	mSize = len;
+	mTI = mBytes[0] >> 4;
+	mMTI = mti;
+	memset(mIE,0,sizeof(L3FlatIE)*desc->mNumIEs);
+
+	// Mandatory IEs in order.
+	unsigned rp = 2, ie = 0;
+	bool highNibble = false;	// The previous IE was a half octet in the low nibble of mBytes[rp].
+	for (; ie < desc->mNumIEs; ie++) {
+		const L3IEDesc &d = desc->mIEs[ie];
+		L3FlatIE &f = mIE[ie];
+		if (d.mFormat == L3IEVHalf) {
+			if (rp >= len) return false;
+			f.mPresent = true;
+			f.mOffset = rp;
+			if (highNibble) {
+				f.mHalf = mBytes[rp++] >> 4;
+			} else {
+				f.mHalf = mBytes[rp] & 0xf;
+			}
+			highNibble = !highNibble;
+			continue;
+		}
+		if (d.mFormat == L3IEV) {
+			if (rp + d.mMinLen > len) return false;
+			f.mPresent = true; f.mOffset = rp; f.mLength = d.mMinLen;
+			rp += d.mMinLen;
+			continue;
+		}
+		if (d.mFormat == L3IELV) {
+			if (rp >= len) return false;
+			unsigned vlen = mBytes[rp++];
+			if (vlen < d.mMinLen || vlen > d.mMaxLen || rp + vlen > len) return false;
+			f.mPresent = true; f.mOffset = rp; f.mLength = vlen;
+			rp += vlen;
+			continue;
+		}
+		break;
+	}
+
+	// Optional IEs in any order, GSM 04.07 11.2.4.  If an IE is repeated we keep the first one.
+	unsigned firstOptional = ie;
+	while (rp < len) {
+		unsigned iei = mBytes[rp];
+		unsigned which = desc->mNumIEs;
+		for (unsigned i = firstOptional; i < desc->mNumIEs; i++) {
+			const L3IEDesc &d = desc->mIEs[i];
+			if (d.mFormat == L3IETVHalf ? (iei>>4) == d.mIEI : iei == d.mIEI) { which = i; break; }
+		}
+		if (which == desc->mNumIEs) {
+			// Not one we know.  The high bit says it is a single octet IE, otherwise it is TLV.
+			if (iei & 0x80) { rp++; continue; }
+			if (rp + 1 >= len) return false;
+			rp += 2 + mBytes[rp+1];
+			continue;
+		}
+		const L3IEDesc &d = desc->mIEs[which];
+		L3FlatIE &f = mIE[which];
+		bool first = !f.mPresent;
+		switch (d.mFormat) {
+			case L3IETVHalf:
+				if (first) { f.mPresent = true; f.mOffset = rp; f.mHalf = iei & 0xf; }
+				rp++;
+				break;
+			case L3IET:
+				if (first) { f.mPresent = true; f.mOffset = rp; }
+				rp++;
+				break;
+			case L3IETV:
+				if (rp + 1 + d.mMinLen > len) return false;
+				if (first) { f.mPresent = true; f.mOffset = rp+1; f.mLength = d.mMinLen; }
+				rp += 1 + d.mMinLen;
+				break;
+			case L3IETLV: {
+				if (rp + 1 >= len) return false;
+				unsigned vlen = mBytes[rp+1];
+				if (vlen < d.mMinLen || vlen > d.mMaxLen || rp + 2 + vlen > len) return false;
+				if (first) { f.mPresent = true; f.mOffset = rp+2; f.mLength = vlen; }
+				rp += 2 + vlen;
+				break;
+			}
+			default:
+				LOG(ERR) << "L3 codec descriptor error in " << desc->mName;
+				return false;
+		}
+	}
+	if (rp != len) return false;	// The last IE ran off the end.
+	mDesc = desc;
+	return true;
+}
+
+
+void L3FlatMessage::flatInit(const L3MsgDesc *desc, unsigned ti)
+{
+	mDesc = desc;
+	mTI = ti & 0xf;
+	mMTI = desc->mMTI;
+	mSize = 0;		// mBytes is used as the value arena while building.
+	memset(mIE,0,sizeof(L3FlatIE)*desc->mNumIEs);
+}
+
+bool L3FlatMessage::flatSet(unsigned ie, const unsigned char *value, unsigned len)
+{
+	if (!mDesc || ie >= mDesc->mNumIEs) return false;
+	const L3IEDesc &d = mDesc->mIEs[ie];
+	switch (d.mFormat) {
+		case L3IEVHalf: case L3IETVHalf: return false;
+		case L3IET: if (len) return false; break;
+		case L3IEV: case L3IETV: if (len != d.mMinLen) return false; break;
+		case L3IELV: case L3IETLV: if (len < d.mMinLen || len > d.mMaxLen) return false; break;
+	}
+	if (mSize + len > L3FlatMaxBytes) return false;
+	L3FlatIE &f = mIE[ie];
+	f.mPresent = true;
+	f.mOffset = mSize;
+	f.mLength = len;
+	if (len) { memcpy(&mBytes[mSize],value,len); }
+	mSize += len;
+	return true;
+}
+
+bool L3FlatMessage::flatSetHalf(unsigned ie, unsigned value)
+{
+	if (!mDesc || ie >= mDesc->mNumIEs) return false;
+	const L3IEDesc &d = mDesc->mIEs[ie];
+	if (d.mFormat != L3IEVHalf && d.mFormat != L3IETVHalf) return false;
+	mIE[ie].mPresent = true;
+	mIE[ie].mHalf = value & 0xf;
+	return true;
+}
+
+unsigned L3FlatMessage::flatLength() const
+{
+	if (!mDesc) return 0;
+	unsigned len = 2, halves = 0;
+	for (unsigned ie = 0; ie < mDesc->mNumIEs; ie++) {
+		const L3IEDesc &d = mDesc->mIEs[ie];
+		const L3FlatIE &f = mIE[ie];
+		switch (d.mFormat) {
+			case L3IEVHalf: halves++; break;
+			case L3IEV: len += d.mMinLen; break;
+			case L3IELV: len += 1 + f.mLength; break;
+			case L3IETVHalf: case L3IET: if (f.mPresent) len++; break;
+			case L3IETV: if (f.mPresent) len += 1 + d.mMinLen; break;
+			case L3IETLV: if (f.mPresent) len += 2 + f.mLength; break;
+		}
+	}
+	return len + (halves+1)/2;
+}
+
+bool L3FlatMessage::flatEncode(L3Frame &frame) const
+{
+	if (!mDesc) return false;
+	unsigned char buf[L3FlatMaxBytes+2];
+	unsigned wp = 0;
+	buf[wp++] = (mTI << 4) | (mDesc->mPD & 0xf);
+	buf[wp++] = mMTI;
+	bool highNibble = false;
+	for (unsigned ie = 0; ie < mDesc->mNumIEs; ie++) {
+		const L3IEDesc &d = mDesc->mIEs[ie];
+		const L3FlatIE &f = mIE[ie];
+		bool mandatory = d.mFormat == L3IEVHalf || d.mFormat == L3IEV || d.mFormat == L3IELV;
+		if (!f.mPresent) {
+			if (mandatory) {
+				LOG(ERR) << mDesc->mName << " missing mandatory IE " << d.mName;
+				return false;
+			}
+			continue;
+		}
+		unsigned need = 2 + f.mLength;
+		if (wp + need > L3FlatMaxBytes) return false;
+		switch (d.mFormat) {
+			case L3IEVHalf:
+				if (highNibble) { buf[wp++] |= f.mHalf << 4; } else { buf[wp] = f.mHalf; }
+				highNibble = !highNibble;
+				continue;
+			case L3IEV:
+				break;
+			case L3IELV:
+				buf[wp++] = f.mLength;
+				break;
+			case L3IETVHalf:
+				buf[wp++] = (d.mIEI << 4) | f.mHalf;
+				continue;
+			case L3IET:
+				buf[wp++] = d.mIEI;
+				continue;
+			case L3IETV:
+				buf[wp++] = d.mIEI;
+				break;
+			case L3IETLV:
+				buf[wp++] = d.mIEI;
+				buf[wp++] = f.mLength;
+				break;
+		}
+		memcpy(&buf[wp],&mBytes[f.mOffset],f.mLength);
+		wp += f.mLength;
+	}
+	if (highNibble) { wp++; }	// A trailing half octet; the high nibble is spare.
+	frame.resize(wp*8);
+	frame.unpack(buf);
+	frame.L2Length(wp);
+	return true;
+}
+
+
+void L3FlatMessage::text(std::ostream &os) const
+{
+	if (!mDesc) { os << "(undecoded)"; return; }
+	os << mDesc->mName << " TI=" << mTI;
+	for (unsigned ie = 0; ie < mDesc->mNumIEs; ie++) {
+		const L3IEDesc &d = mDesc->mIEs[ie];
+		const L3FlatIE &f = mIE[ie];
+		if (!f.mPresent) continue;
+		os << " " << d.mName << "=";
+		if (d.mFormat == L3IEVHalf || d.mFormat == L3IETVHalf) { os << (unsigned) f.mHalf; continue; }
+		if (d.mFormat == L3IET) { os << "yes"; continue; }
+		os << hex << setfill('0');
+		for (unsigned i = 0; i < f.mLength; i++) { os << setw(2) << (unsigned) mBytes[f.mOffset+i]; }
+		os << dec << setfill(' ');
+	}
+}
+
+std::ostream& operator<<(std::ostream& os, const L3FlatMessage& msg)
+{
+	msg.text(os);
+	return os;
+}
+
+
+// ---- Benchmark and conformance ----
+
+// Build m from the IE values of a decoded message, the way a caller building a message for flatEncode would.
+// Only the first numIEs IEs of the descriptor are copied.
+static void flatCopy(const L3FlatMessage &values, L3FlatMessage &m, unsigned numIEs = L3FlatMaxIEs)
+{
+	const L3MsgDesc *desc = values.flatDesc();
+	m.flatInit(desc,values.flatTI());
+	for (unsigned ie = 0; ie < desc->mNumIEs && ie < numIEs; ie++) {
+		if (!values.flatHas(ie)) continue;
+		L3IEFormat fmt = desc->mIEs[ie].mFormat;
+		if (fmt == L3IEVHalf || fmt == L3IETVHalf) {
+			m.flatSetHalf(ie,values.flatHalf(ie));
+		} else {
+			m.flatSet(ie,values.flatValue(ie),values.flatValueLength(ie));
+		}
+	}
+}
+
+static double nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Typical uplink messages, as hex.
+static const struct { const char *name; const char *hex; } sDecodeSamples[] = {
+	{ "LocationUpdatingRequest", "05087000f110000157080910101032547698" },
+	{ "LocationUpdatingRequest+N(SD)", "05487000f11000015705f412345678" },
+	{ "IMSIDetachIndication", "05015705f412345678" },
+	{ "CMServiceRequest", "0524710357581e05f412345678" },
+	{ "IdentityResponse", "0559080910101032547698" },
+	{ "AuthenticationResponse", "055412345678" },
+	{ "PagingResponse", "0627070357581e05f412345678" },
+	{ "MeasurementReport", "06153c3c0140000000000000000000000000" },
+	{ "AssignmentComplete", "062900" },
+	{ "Setup", "03050401a05e04812143f5" },
+	{ "Alerting", "8301" },
+	{ "Connect", "8307" },
+	{ "Disconnect", "032502e090" },
+	{ "Release", "032d0802e090" },
+	{ "ReleaseComplete", "832a0802e090" },
+	{ "StartDTMF", "03352c31" },
+	{ "CP-DATA", "09011a000107910121436587f90010000a8121436587f9000003c13018" },
+	{ "CP-ACK", "1904" },
+};
+
+// Typical downlink messages built with the L3Message classes.
+static L3Message *makeLUAccept() { return new L3LocationUpdatingAccept(L3LocationAreaIdentity("001","01",1),L3MobileIdentity(0x12345678)); }
+static L3Message *makeIdentityRequest() { return new L3IdentityRequest(IMSIType); }
+static L3Message *makeAuthRequest() { return new L3AuthenticationRequest(L3CipheringKeySequenceNumber(1),L3RAND(0x0123456789abcdefULL,0xfedcba9876543210ULL)); }
+static L3Message *makeDisconnect() { return new L3Disconnect(1); }
+static L3Message *makeReleaseComplete() { return new L3ReleaseComplete(1,L3Cause::Normal_Call_Clearing); }
+static L3Message *makeChannelRelease() { return new L3ChannelRelease(); }
+static const struct { const char *name; L3Message *(*make)(); } sEncodeSamples[] = {
+	{ "LocationUpdatingAccept", makeLUAccept },
+	{ "IdentityRequest", makeIdentityRequest },
+	{ "AuthenticationRequest", makeAuthRequest },
+	{ "Disconnect", makeDisconnect },
+	{ "ReleaseComplete", makeReleaseComplete },
+	{ "ChannelRelease", makeChannelRelease },
+};
+
+static void benchLine(std::ostream &os, const char *name, double oldNs, double newNs, const char *note)
+{
+	os << setw(32) << left << name << right << fixed << setprecision(0)
+		<< setw(10) << oldNs << setw(10) << newNs << setprecision(1) << setw(8) << (newNs > 0 ? oldNs/newNs : 0) << "x " << note << endl;
+	os.unsetf(ios::fixed);
+}
+
+void l3CodecBenchmark(std::ostream &os, unsigned iterations)
+{
+	if (iterations == 0) iterations = 1;
+	os << "decode, ns per message" << endl;
+	os << setw(32) << left << "message" << right << setw(10) << "parseL3" << setw(10) << "flat" << setw(9) << "speedup" << endl;
+	for (unsigned s = 0; s < NUMIES(sDecodeSamples); s++) {
+		L3Frame frame(SAPI0,sDecodeSamples[s].hex);
+		L3Message *check = parseL3(frame);
+		L3FlatMessage flat;
+		bool flatOk = flat.flatDecode(frame);
+		const char *note = check ? (flatOk ? "" : "flat decode FAILED") : (flatOk ? "parseL3 failed" : "both failed");
+		delete check;
+
+		double start = nowNs();
+		for (unsigned i = 0; i < iterations; i++) { delete parseL3(frame); }
+		double oldNs = (nowNs() - start) / iterations;
+		start = nowNs();
+		for (unsigned i = 0; i < iterations; i++) { L3FlatMessage m; m.flatDecode(frame); }
+		double newNs = (nowNs() - start) / iterations;
+		benchLine(os,sDecodeSamples[s].name,oldNs,newNs,note);
+	}
+
+	os << "encode, ns per message" << endl;
+	os << setw(32) << left << "message" << right << setw(10) << "L3Message" << setw(10) << "flat" << setw(9) << "speedup" << endl;
+	for (unsigned s = 0; s < NUMIES(sEncodeSamples); s++) {
+		// Take the IE values from the L3Message encoding so the two paths build the same message.
+		L3Message *msg = sEncodeSamples[s].make();
+		L3Frame expect(*msg);
+		delete msg;
+		L3FlatMessage values;
+		if (!values.flatDecode(expect)) {
+			benchLine(os,sEncodeSamples[s].name,0,0,"flat decode FAILED");
+			continue;
+		}
+
+		double start = nowNs();
+		for (unsigned i = 0; i < iterations; i++) {
+			L3Message *m = sEncodeSamples[s].make();
+			L3Frame f(*m);
+			delete m;
+		}
+		double oldNs = (nowNs() - start) / iterations;
+
+		L3Frame f(L3_DATA);
+		start = nowNs();
+		for (unsigned i = 0; i < iterations; i++) {
+			L3FlatMessage m;
+			flatCopy(values,m);
+			m.flatEncode(f);
+		}
+		double newNs = (nowNs() - start) / iterations;
+		benchLine(os,sEncodeSamples[s].name,oldNs,newNs,f == expect ? "" : "encodings DIFFER");
+	}
+}
+
+
+// Every message in the descriptor tables, as it appears on the air.
+// parseL3 must decode the uplink ones to the same message.  The downlink ones are exactly what the L3Message classes
+// write, so flatEncode must give the same bytes as the serializers the BTS uses.
+enum L3ConformanceParse {
+	L3NotParsed,		///< parseL3 does not handle it.
+	L3Parsed,			///< parseL3 must find the same message, and the same mobile identity if it has one.
+	L3ParsedWritten		///< Also the message parseL3 returns must write back the same bytes.
+};
+static L3Message *makeLUReject() { return new L3LocationUpdatingReject(L3RejectCause::IMSI_Unknown_In_HLR); }
+static L3Message *makeCMServiceAccept() { return new L3CMServiceAccept(); }
+static L3Message *makeCMServiceReject() { return new L3CMServiceReject(L3RejectCause::Service_Option_Not_Supported); }
+static L3Message *makeAlerting() { return new L3Alerting(1); }
+static L3Message *makeCallProceeding() { return new L3CallProceeding(1); }
+static L3Message *makeSetup() { return new L3Setup(1,L3CallingPartyBCDNumber("2125551212")); }
+static L3Message *makeConnect() { return new L3Connect(1); }
+static L3Message *makeConnectAcknowledge() { return new L3ConnectAcknowledge(1); }
+static L3Message *makeRelease() { return new L3Release(1,L3Cause::Normal_Call_Clearing); }
+static L3Message *makeCCStatus() { return new L3CCStatus(1,L3Cause::Message_Type_Not_Implemented,L3CallState(10)); }
+static L3Message *makeCPAck() { return new SMS::CPAck(1); }
+static L3Message *makeCPError() { return new SMS::CPError(1,SMS::CPCause(0x11)); }
+static const struct { const char *hex; L3ConformanceParse parse; L3Message *(*make)(); } sConformanceSamples[] = {
+	// MM.  parseL3 leaves out CM Re-establishment Request on purpose.
+	{ "05015705f412345678", L3Parsed, NULL },
+	{ "050200f11000011705f412345678", L3NotParsed, makeLUAccept },
+	{ "050402", L3NotParsed, makeLUReject },
+	{ "05087000f1100001570809101010325476983303575886c1", L3Parsed, NULL },
+	{ "0512010123456789abcdeffedcba9876543210", L3NotParsed, makeAuthRequest },
+	{ "0554123456782104aabbccdd", L3Parsed, NULL },
+	{ "051801", L3NotParsed, makeIdentityRequest },
+	{ "0559080910101032547698", L3Parsed, NULL },
+	{ "051b", L3Parsed, NULL },
+	{ "0521", L3NotParsed, makeCMServiceAccept },
+	{ "052220", L3NotParsed, makeCMServiceReject },
+	{ "0523", L3ParsedWritten, NULL },
+	{ "0524710357581e05f41234567881", L3Parsed, NULL },
+	{ "0528010357581e05f4123456781300f1100001", L3NotParsed, NULL },
+	{ "053161", L3Parsed, NULL },
+	// RR.  The RR factory has Channel Release, but L3ChannelRelease has no parseBody.
+	{ "060d00", L3NotParsed, makeChannelRelease },
+	{ "061201", L3Parsed, NULL },
+	{ "06153c3c0140000000000000000000000000", L3Parsed, NULL },
+	{ "0616035758a620036014ef", L3Parsed, NULL },
+	{ "0627070357581e05f412345678", L3Parsed, NULL },
+	{ "062900", L3Parsed, NULL },
+	{ "062c00", L3Parsed, NULL },
+	{ "063217083a21436587092143", L3Parsed, NULL },
+	// CC.  L3ProgressIndicator has no parseV, so these leave out Progress.
+	{ "1301", L3ParsedWritten, makeAlerting },
+	{ "1302", L3ParsedWritten, makeCallProceeding },
+	{ "13055c06a11252552121", L3ParsedWritten, makeSetup },
+	{ "1307", L3ParsedWritten, makeConnect },
+	{ "83080401a0150101", L3Parsed, NULL },
+	{ "130f", L3ParsedWritten, makeConnectAcknowledge },
+	{ "132502e190", L3ParsedWritten, makeDisconnect },
+	{ "132d0802e190", L3ParsedWritten, makeRelease },
+	{ "132a0802e190", L3ParsedWritten, makeReleaseComplete },
+	{ "8331", L3Parsed, NULL },
+	{ "83352c31", L3Parsed, NULL },
+	{ "133d02e1e1ca", L3ParsedWritten, makeCCStatus },
+	// SMS CP.  CPError has no parseBody, so parseL3 cannot be used on CP-ERROR.
+	{ "09011a000107910121436587f90010000a8121436587f9000003c13018", L3ParsedWritten, NULL },
+	{ "1904", L3ParsedWritten, makeCPAck },
+	{ "191011", L3NotParsed, makeCPError },
+};
+
+// The mobile identity parseL3 found, for the messages that carry one.
+static const L3MobileIdentity *parsedMobileID(const L3Message *msg)
+{
+	if (const L3LocationUpdatingRequest *m = dynamic_cast<const L3LocationUpdatingRequest*>(msg)) return &m->mobileID();
+	if (const L3IMSIDetachIndication *m = dynamic_cast<const L3IMSIDetachIndication*>(msg)) return &m->mobileID();
+	if (const L3CMServiceRequest *m = dynamic_cast<const L3CMServiceRequest*>(msg)) return &m->mobileID();
+	if (const L3IdentityResponse *m = dynamic_cast<const L3IdentityResponse*>(msg)) return &m->mobileID();
+	if (const L3PagingResponse *m = dynamic_cast<const L3PagingResponse*>(msg)) return &m->mobileID();
+	return NULL;
+}
+
+static bool l3IEMandatory(L3IEFormat format) { return format == L3IEVHalf || format == L3IEV || format == L3IELV; }
+
+// Check one sample against the codec, parseL3 and the serializer.
+// Return a description of the first disagreement, or an empty string; checked gets what was compared.
+static string conformanceCheck(const L3Frame &frame, L3ConformanceParse parse, L3Message *(*make)(), string &checked)
+{
+	L3FlatMessage flat;
+	if (!flat.flatDecode(frame)) return "flatDecode failed";
+	const L3MsgDesc *desc = flat.flatDesc();
+
+	// Encoding the decoded values must give back the message, less the send sequence number, which flatDecode masks out.
+	unsigned char bytes[L3FlatMaxBytes];
+	frame.pack(bytes);
+	unsigned char mti = bytes[1];
+	bytes[1] = flat.flatMTI();
+	L3FlatMessage copy;
+	flatCopy(flat,copy);
+	L3Frame encoded(L3_DATA);
+	bool same = copy.flatEncode(encoded) && encoded.size() == frame.size();
+	if (same) {
+		unsigned char encodedBytes[L3FlatMaxBytes];
+		encoded.pack(encodedBytes);
+		same = !memcmp(encodedBytes,bytes,encoded.size()/8);
+	}
+	if (!same) return "flatEncode differs from the message";
+	bytes[1] = mti;
+
+	// The message cut short must decode only where it ends between optional IEs.
+	// Since the encoding matched, the optional IEs are in descriptor order, so those places are the lengths
+	// of the message with the mandatory IEs and the first few optional ones.
+	bool boundary[L3FlatMaxBytes+1];
+	memset(boundary,0,sizeof(boundary));
+	for (unsigned n = 0; n <= desc->mNumIEs; n++) {
+		if (n < desc->mNumIEs && l3IEMandatory(desc->mIEs[n].mFormat)) continue;
+		L3FlatMessage part;
+		flatCopy(flat,part,n);
+		boundary[part.flatLength()] = true;
+	}
+	for (unsigned n = 2; n < frame.size()/8; n++) {
+		L3FlatMessage part;
+		if (part.flatDecode(bytes,n) != boundary[n]) {
+			ostringstream ss;
+			ss << "flatDecode " << (boundary[n] ? "rejects" : "accepts") << " the first " << n << " bytes";
+			return ss.str();
+		}
+	}
+	checked = "flat";
+
+	if (parse != L3NotParsed) {
+		L3Message *msg = parseL3(frame);
+		if (msg == NULL) return "parseL3 failed";
+		string problem;
+		if (msg->PD() != desc->mPD || (unsigned) msg->MTI() != desc->mMTI) {
+			problem = "parseL3 found a different message";
+		} else if (const L3MobileIdentity *id = parsedMobileID(msg)) {
+			unsigned ie = 0;
+			while (ie < desc->mNumIEs && strcmp(desc->mIEs[ie].mName,"MobileIdentity")) { ie++; }
+			L3Frame written(L3_DATA,8*id->lengthV());
+			size_t wp = 0;
+			id->writeV(written,wp);
+			unsigned char idBytes[L3FlatMaxBytes];
+			written.pack(idBytes);
+			if (!flat.flatHas(ie) || flat.flatValueLength(ie) != id->lengthV() || memcmp(idBytes,flat.flatValue(ie),id->lengthV())) {
+				problem = "parseL3 found a different mobile identity";
+			}
+		}
+		if (problem.empty() && parse == L3ParsedWritten && !(L3Frame(*msg) == frame)) {
+			problem = "the message from parseL3 writes different bytes";
+		}
+		delete msg;
+		if (!problem.empty()) return problem;
+		checked += parse == L3ParsedWritten ? ", parseL3 and back" : ", parseL3";
+	}
+
+	if (make) {
+		L3Message *msg = make();
+		L3Frame written(*msg);
+		delete msg;
+		if (!(written == frame)) return "the L3Message serializer writes different bytes";
+		checked += ", serializer";
+	}
+	return "";
+}
+
+unsigned l3CodecConformance(std::ostream &os)
+{
+	unsigned failures = 0, count = 0;
+	for (unsigned pd = 0; pd < 16; pd++) {
+		for (unsigned mti = 0; mti < 256; mti++) {
+			const L3MsgDesc *desc = sMsgIndex[pd][mti];
+			if (desc == NULL) continue;
+			count++;
+			string problem = "no sample", checked;
+			for (unsigned s = 0; s < NUMIES(sConformanceSamples); s++) {
+				L3Frame frame(SAPI0,sConformanceSamples[s].hex);
+				if (l3FindMsgDesc(frame.PD(),frame.MTI()) != desc) continue;
+				problem = conformanceCheck(frame,sConformanceSamples[s].parse,sConformanceSamples[s].make,checked);
+				break;
+			}
+			os << setw(32) << left << desc->mName << right;
+			if (problem.empty()) {
+				os << "ok: " << checked << endl;
+			} else {
+				os << "FAILED: " << problem << endl;
+				failures++;
+			}
+		}
+	}
+	os << failures << " of " << count << " messages failed" << endl;
+	return failures;
+}
+
+};	// namespace GSM
+
+// vim: ts=4 sw=4
@@ -0,0 +1,175 @@
+/**@file Table-driven codec for the common L3 messages, GSM 04.07 11.2 and 04.08 9. */
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#ifndef GSML3CODEC_H
+#define GSML3CODEC_H
+
+#include <ostream>
+#include "GSMCommon.h"
+#include "GSMTransfer.h"
+
+
+namespace GSM {
+
+// (pat) The L3Message classes decode a message by allocating the message object, then running a parseV/parseLV/parseTLV
+// virtual on every element object, each of which reads the L3Frame one bit-field at a time.
+// That is fine for most of the protocol, but a location update or SMS storm spends real time doing it.
+// This codec decodes the frequent messages in one pass over the packed bytes, using a static descriptor table per message,
+// into an L3FlatMessage that records where each IE is.  Nothing is allocated: the L3FlatMessage holds its own copy
+// of the message bytes, so it can live on the stack.  The same descriptors are used to encode.
+// The values are left in their over-the-air encoding; the caller picks out the fields it needs, or hands the
+// bytes to the L3ProtocolElement class if it needs the whole thing.
+// Nothing on the receive or send paths uses it yet.  The l3bench command checks it against parseL3() and the
+// L3Message serializers for every message in the tables, then times it against them.
+
+/** IE format, GSM 04.07 11.2.1.1. */
+enum L3IEFormat {
+	L3IEVHalf,		///< Type 1 V, half octet.  Two consecutive VHalf IEs share an octet, the first listed in the low nibble.
+	L3IEV,			///< Type 3 V, fixed length mMinLen.
+	L3IELV,			///< Type 4 LV.
+	L3IETVHalf,		///< Type 1 TV: IEI in the high nibble, value in the low nibble.
+	L3IET,			///< Type 2 T, a single octet IEI.
+	L3IETV,			///< Type 3 TV, fixed value length mMinLen.
+	L3IETLV			///< Type 4 TLV.
+};
+
+struct L3IEDesc {
+	L3IEFormat mFormat;
+	unsigned char mIEI;			///< IEI for the T formats; for L3IETVHalf just the high nibble, eg, 0xd for repeat indicator.
+	unsigned char mMinLen;		///< Value length limits in bytes, not including the T or L.
+	unsigned char mMaxLen;
+	const char *mName;
+};
+
+/**
+	Descriptor for one message.  The mandatory IEs (V and LV formats) are listed first in transmission order,
+	followed by the optional ones, which may arrive in any order.
+*/
+struct L3MsgDesc {
+	L3PD mPD;
+	unsigned char mMTI;
+	const char *mName;
+	const L3IEDesc *mIEs;
+	unsigned mNumIEs;
+};
+
+/** Find the descriptor for a message, or NULL if the codec does not handle it. */
+const L3MsgDesc *l3FindMsgDesc(L3PD pd, unsigned mti);
+
+// Largest L3 message we handle, which is the largest LAPDm can reassemble.
+static const unsigned L3FlatMaxBytes = 251;
+static const unsigned L3FlatMaxIEs = 20;
+
+struct L3FlatIE {
+	bool mPresent;
+	unsigned char mOffset;		///< Byte offset of the value in mBytes.
+	unsigned char mLength;		///< Length of the value in bytes; 0 for half octet and T IEs.
+	unsigned char mHalf;		///< The value of a half octet IE.
+};
+
+/** A decoded L3 message.  The IE indexes are the position of the IE in the descriptor, see the L3Flat* enums below. */
+class L3FlatMessage {
+	unsigned char mBytes[L3FlatMaxBytes];	///< The message as received, or the values being built for an encode.
+	unsigned mSize;
+	L3FlatIE mIE[L3FlatMaxIEs];
+	const L3MsgDesc *mDesc;
+	unsigned mTI;			///< The high nibble of the first octet: TI for CC, SS and SMS, skip indicator for the others.
+	unsigned mMTI;
+	bool decodeInPlace(unsigned len);
+
+	public:
+	L3FlatMessage() : mSize(0), mDesc(0), mTI(0), mMTI(0) {}
+
+	/**
+		Decode a message in place.
+		@return false if the codec does not handle the message or the message is malformed,
+			in which case the caller can fall back to parseL3().
+	*/
+	bool flatDecode(const unsigned char *bytes, unsigned len);
+	bool flatDecode(const L3Frame &frame);
+
+	/** Start building a message for flatEncode. */
+	void flatInit(const L3MsgDesc *desc, unsigned ti = 0);
+	/** Set the value of an IE; the bytes are copied.  Return false if they do not fit. */
+	bool flatSet(unsigned ie, const unsigned char *value, unsigned len);
+	bool flatSetHalf(unsigned ie, unsigned value);
+	/** Set a T format IE. */
+	bool flatSetT(unsigned ie) { return flatSet(ie,NULL,0); }
+
+	/** The encoded length in bytes. */
+	unsigned flatLength() const;
+	/** Encode into an L3 frame; return false if a mandatory IE was not set. */
+	bool flatEncode(L3Frame &frame) const;
+
+	const L3MsgDesc *flatDesc() const { return mDesc; }
+	L3PD flatPD() const { return mDesc ? mDesc->mPD : L3UndefinedPD; }
+	unsigned flatMTI() const { return mMTI; }
+	unsigned flatTI() const { return mTI; }
+
+	bool flatHas(unsigned ie) const { return ie < L3FlatMaxIEs && mIE[ie].mPresent; }
+	const unsigned char *flatValue(unsigned ie) const { return &mBytes[mIE[ie].mOffset]; }
+	unsigned flatValueLength(unsigned ie) const { return mIE[ie].mLength; }
+	unsigned flatHalf(unsigned ie) const { return mIE[ie].mHalf; }
+
+	void text(std::ostream &os) const;
+};
+std::ostream& operator<<(std::ostream& os, const L3FlatMessage& msg);
+
+
+// IE indexes for the messages in the codec, in descriptor order.
+struct L3FlatLocationUpdatingRequest { enum { UpdateType, CKSN, LAI, Classmark1, MobileIdentity, ClassmarkForUMTS, AdditionalUpdateParameters }; };
+struct L3FlatIMSIDetachIndication { enum { Classmark1, MobileIdentity }; };
+struct L3FlatCMServiceRequest { enum { ServiceType, CKSN, Classmark2, MobileIdentity, Priority }; };
+struct L3FlatCMReestablishmentRequest { enum { CKSN, Spare, Classmark2, MobileIdentity, LAI }; };
+struct L3FlatIdentityRequest { enum { IdentityType, Spare }; };
+struct L3FlatIdentityResponse { enum { MobileIdentity }; };
+struct L3FlatAuthenticationRequest { enum { CKSN, Spare, RAND }; };
+struct L3FlatAuthenticationResponse { enum { SRES, SRESExtension }; };
+struct L3FlatLocationUpdatingAccept { enum { LAI, MobileIdentity, FollowOnProceed }; };
+struct L3FlatMMCause { enum { Cause }; };	// Location Updating Reject, CM Service Reject, MM Status.
+struct L3FlatPagingResponse { enum { CKSN, Spare, Classmark2, MobileIdentity }; };
+struct L3FlatClassmarkChange { enum { Classmark2, Classmark3 }; };
+struct L3FlatCipheringModeComplete { enum { MobileIdentity }; };
+struct L3FlatRRCause { enum { Cause }; };	// Assignment Complete, Handover Complete, RR Status, Channel Release.
+struct L3FlatMeasurementReport { enum { Results }; };
+struct L3FlatSetup { enum { RepeatIndicator, BearerCapability, Facility, Progress, Signal, CallingParty, CallingSubaddress,
+	CalledParty, CalledSubaddress, LLC, HLC, UserUser, SSVersion, CLIRSuppression, CLIRInvocation, CCCapabilities, SupportedCodecs }; };
+struct L3FlatCallConfirmed { enum { RepeatIndicator, BearerCapability, Cause, CCCapabilities, SupportedCodecs }; };
+struct L3FlatDisconnect { enum { Cause, Facility, Progress, UserUser, SSVersion }; };
+struct L3FlatRelease { enum { Cause, Facility, UserUser, SSVersion }; };	// Release and Release Complete.
+struct L3FlatCCCommon { enum { Facility, Progress, UserUser, SSVersion }; };	// Alerting, Call Proceeding, Connect.
+struct L3FlatStartDTMF { enum { KeypadFacility }; };
+struct L3FlatCCStatus { enum { Cause, CallState }; };
+struct L3FlatCPData { enum { UserData }; };
+struct L3FlatCPError { enum { Cause }; };
+
+extern const L3MsgDesc gL3LocationUpdatingRequestDesc, gL3LocationUpdatingAcceptDesc, gL3IdentityRequestDesc,
+	gL3AuthenticationRequestDesc, gL3DisconnectDesc, gL3ReleaseCompleteDesc, gL3ChannelReleaseDesc;
+
+/** Decode and encode the common messages with both this codec and the L3Message classes and print the times. */
+void l3CodecBenchmark(std::ostream &os, unsigned iterations);
+
+/**
+	Check every message in the descriptor tables against parseL3() and the L3Message serializers, and print the results.
+	@return The number of messages that disagree.
+*/
+unsigned l3CodecConformance(std::ostream &os);
+
+};	// namespace GSM
+
+#endif
+// vim: ts=4 sw=4
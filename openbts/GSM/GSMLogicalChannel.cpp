@@ -434,10 +434,7 @@ void L2LogicalChannel::lcinit()
 		mlcMessageLoopRunning=true;
 		mlcMessageServiceThread.start2((void*(*)(void*))MessageServiceLoop,this,8000*sizeof(void*));
 	}
-	if (!mlcControlLoopRunning) {
-		mlcControlLoopRunning=true;
-		mlcControlServiceThread.start2((void*(*)(void*))ControlServiceLoop,this,8000*sizeof(void*));
-	}
+	gChannelExecutor.ceSchedule(&mlcControlServiceTask,CN(),26);
 }
 
 void L2LogicalChannel::lcopen()
@@ -512,28 +509,26 @@ void L2LogicalChannel::serviceHost()
 	}
 }
 
-void *L2LogicalChannel::ControlServiceLoop(L2LogicalChannel* hostchan)
+unsigned L2LogicalChannel::ControlServiceTask::frameTaskRun()
 {
-	while (!gBTS.btsShutdown()) {
-		sleepFrames(26);	// We dont have to do this very often.
-		if (hostchan->l1active()) {
-			hostchan->serviceHost();
-		}
+	L2LogicalChannel *hostchan = mHostChan;
+	if (gBTS.btsShutdown()) { return 0; }
+	if (hostchan->l1active()) {
+		hostchan->serviceHost();
+	}
 
-		// The SACCH is deactivated before the host channel, so we check l1active to see if SACCH is still running.
-		SACCHLogicalChannel *sacch = hostchan->getSACCH();
-		if (sacch->l1active() && sacch->sacchRadioFailure()) {
-			// GSM 4.08 3.4.13.2:  layer2 is supposed to inform layer3 directly, bypassing LAPDm.
-			// The layer3 response is identical to a normal RELEASE from layer3: deactivate the SACCH,
-			// start T3109, recycle the channel when it expires.
-			// Just because we cannot hear the MS on SACCH does not mean that it cannot hear it, or that
-			// we have completely lost contact, so LAPDm can go ahead with the normal release procedure,
-			// ie, send a DISC on the main link and wait for a response - if we get it we can use T3111.
-			hostchan->startNormalRelease();
-		}
+	// The SACCH is deactivated before the host channel, so we check l1active to see if SACCH is still running.
+	SACCHLogicalChannel *sacch = hostchan->getSACCH();
+	if (sacch->l1active() && sacch->sacchRadioFailure()) {
+		// GSM 4.08 3.4.13.2:  layer2 is supposed to inform layer3 directly, bypassing LAPDm.
+		// The layer3 response is identical to a normal RELEASE from layer3: deactivate the SACCH,
+		// start T3109, recycle the channel when it expires.
+		// Just because we cannot hear the MS on SACCH does not mean that it cannot hear it, or that
+		// we have completely lost contact, so LAPDm can go ahead with the normal release procedure,
+		// ie, send a DISC on the main link and wait for a response - if we get it we can use T3111.
+		hostchan->startNormalRelease();
 	}
-	//hostchan->mlcControlLoopRunning=false;
-	return NULL;
+	return 26;	// We dont have to do this very often.
 }
 
 // This drives messages from layer3 down through LAPDm, layer1, and all the way to the radio.
@@ -37,6 +37,7 @@
 #include "GSML3RRElements.h"
 #include "GSMTDMA.h"
 #include "GSMChannelHistory.h"
+#include "GSMExecutor.h"
 #include <L3LogicalChannel.h>
 
 #include <Logger.h>
@@ -161,6 +162,9 @@ public:
 	/** Receive FER. */
 	float FER() const { devassert(mL1); return mL1->FER(); }
 	DecoderStats getDecoderStats() const { return mL1->decoder()->getDecoderStats(); }
+	/** Exact uplink error counts, and restart them. */
+	BERCounts getBERCounts() const { devassert(mL1); return mL1->decoder()->getBERCounts(); }
+	void resetBERCounts() { devassert(mL1); mL1->decoder()->resetBERCounts(); }
 	/** Control whether to accept a handover. */
 	HandoverRecord& handoverPending(bool flag, unsigned handoverRef) { devassert(mL1); return mL1->handoverPending(flag, handoverRef); }
 	//@}
@@ -294,11 +298,19 @@ class L2LogicalChannel: public L2SAPMux, public Control::L3LogicalChannel
 	//Z100TimerThreadSafe mTRecycle;	// Additional delay before recycling channel.
 
 	static void *MessageServiceLoop(L2LogicalChannel*);
-	static void *ControlServiceLoop(L2LogicalChannel*);
 	Thread mlcMessageServiceThread;	///< a thread for the service L3 queue loop
-	Thread mlcControlServiceThread;	///< a thread for the service loop
 	Bool_z mlcMessageLoopRunning;			///< true if the service loops are started
-	Bool_z mlcControlLoopRunning;			///< true if the service loops are started
+
+	// The timer checks formerly done by a dedicated ControlServiceLoop thread per channel,
+	// which spent its life in sleepFrames(26).  Now run by gChannelExecutor on the lane for our ARFCN.
+	class ControlServiceTask : public FrameTask {
+		L2LogicalChannel *mHostChan;
+		public:
+		ControlServiceTask(L2LogicalChannel *wHostChan) : mHostChan(wHostChan) {}
+		unsigned frameTaskRun();
+		const char *frameTaskName() const { return "ControlService"; }
+	};
+	ControlServiceTask mlcControlServiceTask;
 
 	protected:
 	SACCHLogicalChannel *mSACCH;	///< The associated SACCH, if any.
@@ -306,7 +318,7 @@ class L2LogicalChannel: public L2SAPMux, public Control::L3LogicalChannel
 	void startNormalRelease();
 
 	public:
-	L2LogicalChannel() : mSACCH(NULL) {}
+	L2LogicalChannel() : mlcControlServiceTask(this), mSACCH(NULL) {}
 	SACCHLogicalChannel* getSACCH() { return mSACCH; }
 	const SACCHLogicalChannel* getSACCH() const { return mSACCH; }
 	void lcinit();
@@ -545,6 +557,8 @@ class SACCHLogicalChannel : public L2SAPMux, public ChannelHistory
 		{ mSACCHL1->l1InitPhy(RSSI,timingError,wTimestamp); }
 	void setPhy(const SACCHLogicalChannel& other) { mSACCHL1->setPhy(*other.mSACCHL1); }
 	void RSSIBumpDown(int dB) { devassert(mL1); mSACCHL1->RSSIBumpDown(dB); }
+	// The MS power and timing loop reads the decoder and writes the encoder.
+	SACCHL1FEC *getSACCHL1() const { return mSACCHL1; }
 
 	//@}
 
@@ -599,6 +613,13 @@ class TCHFACCHLogicalChannel : public L2LogicalChannel {
 	unsigned queueSize() const
 		{ devassert(mTCHL1); return mTCHL1->queueSize(); }
 
+	unsigned flushTCH(unsigned maxQ)
+		{ devassert(mTCHL1); return mTCHL1->flushTCH(maxQ); }
+
+	/** Replace the speech with the PRBS9 test pattern in both directions. */
+	void setPRBSTest(bool on)
+		{ devassert(mTCHL1); mTCHL1->setPRBSTest(on); }
+
 	// (pat) 3-28: Moved this higher in the hierarchy so we can use it on SDCCH as well.
 	//bool radioFailure() const
 	//	{ devassert(mTCHL1); return mTCHL1->radioFailure(); }
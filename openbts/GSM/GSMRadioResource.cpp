@@ -142,8 +142,10 @@ void AccessGrantResponder(
 		float RSSI, float timingError,
 		int TN)	// The TN the RACH arrived on.  Only non-0 if there are multiple beacon timeslots.
 {
-	gReports.incr("OpenBTS.GSM.RR.RACH.TA.All",(int)(timingError));
-	gReports.incr("OpenBTS.GSM.RR.RACH.RA.All",RA);
+	static const ReportRange sTAAllReport = gReports.lookup("OpenBTS.GSM.RR.RACH.TA.All",0,63);
+	static const ReportRange sRAAllReport = gReports.lookup("OpenBTS.GSM.RR.RACH.RA.All",0,255);
+	gReports.incr(sTAAllReport.at((int)(timingError)));
+	gReports.incr(sRAAllReport.at(RA));
 
 	// Are we holding off new allocations?
 	if (gBTS.btsHold()) {
@@ -0,0 +1,120 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses; see the COPYING file in the main directory for licensing information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#define LOG_GROUP LogGroup::GSM		// Can set Log.Level.GSM for debugging
+
+#include "MSPowerControl.h"
+#include <Logger.h>
+#include <Timeval.h>
+#include <OpenBTSConfig.h>
+#include <GSMConfig.h>
+#include <GSMLogicalChannel.h>
+#include <GSML1FEC.h>
+
+#include <string.h>
+#include <sstream>
+
+namespace GSM {
+using namespace std;
+
+MSPowerControl gMSPowerControl;
+
+MSPowerControl::MSPowerControl() :
+	mBumpDown(0), mPasses(0), mPassTime(0)
+{
+	memset(&mStats,0,sizeof(mStats));
+}
+
+// Collect every dedicated channel that has had at least one measurement report since it was opened.
+void MSPowerControl::pcGather()
+{
+	mBatch.mpbClear();
+
+	// The pools are filled in at startup and never change after that.
+	L2ChanList chans;
+	for (SDCCHList::const_iterator it = gBTS.SDCCHPool().begin(); it != gBTS.SDCCHPool().end(); it++) { chans.push_back(*it); }
+	for (TCHList::const_iterator it = gBTS.TCHPool().begin(); it != gBTS.TCHPool().end(); it++) {
+		if ((*it)->inUseByGPRS()) { continue; }
+		chans.push_back(*it);
+	}
+
+	for (L2ChanList::iterator it = chans.begin(); it != chans.end(); it++) {
+		SACCHLogicalChannel *sacch = (*it)->getSACCH();
+		if (sacch == NULL) { continue; }
+		SACCHL1Decoder *dec = sacch->getSACCHL1()->decoder();
+		if (!dec->decActive() || !dec->isValid()) { continue; }
+		mBatch.mpbGather(dec,sacch->getSACCHL1()->encoder());
+	}
+}
+
+// Config values are read once for the whole batch.
+void MSPowerControl::pcCompute()
+{
+	MSPowerParams params;
+	params.RSSITarget = gConfig.GSM.Radio.RSSITarget;
+	params.SNRTarget = gConfig.GSM.Radio.SNRTarget;
+	params.powerDamping = gConfig.GSM.MS.Power.Damping;
+	params.TADamping = gConfig.GSM.MS.TA.Damping;
+	params.minPower = gConfig.GSM.MS.Power.Min;
+	params.maxPower = gConfig.GSM.MS.Power.Max;
+	params.maxTiming = gConfig.GSM.MS.TA.Max;
+	mBumpDown = gConfig.getNum("Control.SACCHTimeout.BumpDown");
+
+	MSPowerStats stats;
+	mBatch.mpbCompute(params,stats);
+
+	ScopedLock lock(mStatsLock);
+	mStats = stats;
+}
+
+void MSPowerControl::pcRunOnce()
+{
+	Timeval start;
+	pcGather();
+	pcCompute();
+	mBatch.mpbScatter();
+	long elapsed = start.elapsed();
+
+	ScopedLock lock(mStatsLock);
+	mPasses++;
+	mPassTime = mPasses == 1 ? elapsed : 0.9*mPassTime + 0.1*elapsed;
+}
+
+void *MSPowerControl::pcServiceLoop(MSPowerControl *pc)
+{
+	while (true) {
+		pc->pcRunOnce();
+		sleepFrames(104);	// One SACCH multiframe.
+	}
+	return NULL;
+}
+
+void MSPowerControl::pcStart()
+{
+	mThread.start((void*(*)(void*))pcServiceLoop,this);
+}
+
+string MSPowerControl::pcText() const
+{
+	ScopedLock lock(mStatsLock);
+	ostringstream ss;
+	ss << "MS power control: " << mStats.channels << " channels"
+		<< ", power settled " << mStats.powerSettled << " mean error " << mStats.meanPowerError << " dB"
+		<< ", TA settled " << mStats.timingSettled << " mean error " << mStats.meanTimingError << " symbols"
+		<< ", mean BER " << mStats.meanBER
+		<< ", " << mPasses << " passes averaging " << mPassTime << " ms";
+	return ss.str();
+}
+
+};	// namespace GSM
@@ -0,0 +1,204 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses; see the COPYING file in the main directory for licensing information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#ifndef MSPOWERCONTROL_H
+#define MSPOWERCONTROL_H
+
+#include <math.h>
+#include <string>
+#include <vector>
+#include <Threads.h>
+#include <Logger.h>
+
+namespace GSM {
+class SACCHL1Decoder;
+class SACCHL1Encoder;
+
+// The settings for one pass, read from the config once per batch.
+struct MSPowerParams {
+	float RSSITarget;		// dB wrt full scale.
+	float SNRTarget;		// 0 disables.
+	int powerDamping;		// Percent.
+	int TADamping;			// Percent.
+	float minPower, maxPower;	// dBm.
+	float maxTiming;		// Symbols.
+};
+
+// Convergence statistics from one pass.
+struct MSPowerStats {
+	unsigned channels;
+	unsigned powerSettled;		// Channels within cPowerSettledDB of the RSSI target.
+	unsigned timingSettled;		// Channels within cTimingSettled symbols of the right TA.
+	float meanPowerError;		// Mean absolute power error, dB.
+	float meanTimingError;		// Mean absolute timing error, symbols.
+	float meanBER;
+};
+
+static const float cPowerSettledDB = 2.0F;	// A channel this close to the RSSI target counts as settled.
+static const float cTimingSettled = 0.5F;	// Likewise for timing error, in symbols.
+
+// One pass of the closed loop over a set of channels.
+// Gather copies what the loop needs out of each decoder into flat arrays, compute works only on the arrays,
+// and scatter writes the new orders back to the encoders.
+// It is a template on the L1 classes so it can be run against stand-ins; see MSPowerControlTest.
+template <class Decoder, class Encoder>
+class MSPowerBatch {
+	// One entry per channel in the current pass.  Kept between passes so they do not reallocate.
+	std::vector<Decoder*> mDecoder;
+	std::vector<Encoder*> mEncoder;
+	std::vector<unsigned> mReportCount;	// To notice a channel that was reopened while we were computing.
+	std::vector<float> mRSSI;			// Averaged RSSI, dB wrt full scale.
+	std::vector<float> mSNR;			// Averaged SNR.
+	std::vector<float> mBER;			// Averaged BER.
+	std::vector<float> mTimingError;	// Averaged timing error, symbols.
+	std::vector<float> mActualPower;	// Power the MS says it is using, dBm.
+	std::vector<float> mActualTiming;	// TA the MS says it is using, symbols.
+	std::vector<float> mOrderedPower;	// In: the current order; out: the new order.
+	std::vector<float> mOrderedTiming;
+
+	public:
+	unsigned mpbSize() const { return mDecoder.size(); }
+	float mpbOrderedPower(unsigned i) const { return mOrderedPower[i]; }
+	float mpbOrderedTiming(unsigned i) const { return mOrderedTiming[i]; }
+
+	void mpbClear() {
+		mDecoder.clear();
+		mEncoder.clear();
+		mReportCount.clear();
+		mRSSI.clear();
+		mSNR.clear();
+		mBER.clear();
+		mTimingError.clear();
+		mActualPower.clear();
+		mActualTiming.clear();
+		mOrderedPower.clear();
+		mOrderedTiming.clear();
+	}
+
+	void mpbGather(Decoder *dec, Encoder *enc) {
+		mDecoder.push_back(dec);
+		mEncoder.push_back(enc);
+		mReportCount.push_back(dec->mReportCount);
+		mRSSI.push_back(dec->getRSSI());
+		mSNR.push_back(dec->getDecoderStats().mAveSNR);
+		mBER.push_back(dec->getDecoderStats().mAveBER);
+		mTimingError.push_back(dec->timingError());
+		mActualPower.push_back(dec->actualMSPower());
+		mActualTiming.push_back(dec->actualMSTiming());
+		mOrderedPower.push_back(enc->orderedMSPower());
+		mOrderedTiming.push_back(enc->orderedMSTiming());
+	}
+
+	// The closed loop itself.
+	void mpbCompute(const MSPowerParams &params, MSPowerStats &stats) {
+		const unsigned n = mDecoder.size();
+		const float powerDamping = params.powerDamping*0.01F;
+		const float TADamping = params.TADamping*0.01F;
+
+		unsigned powerSettled = 0, timingSettled = 0;
+		float powerError = 0, timingError = 0, ber = 0;
+
+		for (unsigned i = 0; i < n; i++) {
+			// Power.  GSM 05.08 4.
+			// Power expressed in dBm, RSSI in dB wrt max.
+			// RSSI and RSSITarget are both negative, so deltaP is positive if power is too high.
+			float deltaP = mRSSI[i] - params.RSSITarget;
+			if (params.SNRTarget && deltaP > 0 && mSNR[i] < params.SNRTarget) {
+				// If RSSITarget is met but SNR looks bad, we only change upward based on SNR
+				// and rely on RSSITarget to keep the power down.
+				deltaP = mSNR[i] - params.SNRTarget;
+			}
+			float targetMSPower = mActualPower[i] - deltaP;
+			float damping = powerDamping;
+			if (params.powerDamping < 90 && deltaP < 4) {
+				// Adjust the power in the upward direction faster than in the downward direction
+				// if we are in danger of losing the signal.
+				damping /= 2;
+			}
+			float power = damping*mOrderedPower[i] + (1.0F-damping)*targetMSPower;
+			mOrderedPower[i] = power > params.maxPower ? params.maxPower : (power < params.minPower ? params.minPower : power);
+
+			// Timing.  GSM 05.10 5, 6.
+			// Time expressed in symbol periods.
+			float targetMSTiming = mActualTiming[i] + mTimingError[i];
+			float timing = TADamping*mOrderedTiming[i] + (1.0F-TADamping)*targetMSTiming;
+			mOrderedTiming[i] = timing < 0.0F ? 0.0F : (timing > params.maxTiming ? params.maxTiming : timing);
+
+			float absDeltaP = fabsf(deltaP), absTimingError = fabsf(mTimingError[i]);
+			powerSettled += absDeltaP <= cPowerSettledDB;
+			timingSettled += absTimingError <= cTimingSettled;
+			powerError += absDeltaP;
+			timingError += absTimingError;
+			ber += mBER[i];
+		}
+
+		stats.channels = n;
+		stats.powerSettled = powerSettled;
+		stats.timingSettled = timingSettled;
+		stats.meanPowerError = n ? powerError / n : 0;
+		stats.meanTimingError = n ? timingError / n : 0;
+		stats.meanBER = n ? ber / n : 0;
+	}
+
+	// Return the number of encoders written.
+	unsigned mpbScatter() {
+		unsigned written = 0;
+		for (unsigned i = 0; i < mDecoder.size(); i++) {
+			// If the channel was closed and reopened since mpbGather the report count started over,
+			// and the encoder already has its initial orders from the RACH.
+			if (mDecoder[i]->mReportCount < mReportCount[i]) { continue; }
+			mEncoder[i]->setMSPower(mOrderedPower[i]);
+			mEncoder[i]->setMSTiming(mOrderedTiming[i]);
+			written++;
+			LOG(DEBUG) << mEncoder[i]->descriptiveString() << " RSSI=" << mRSSI[i] << " SNR=" << mSNR[i]
+				<< " actual=" << mActualPower[i] << " order=" << mOrderedPower[i]
+				<< " timingError=" << mTimingError[i] << " actualTA=" << mActualTiming[i] << " orderedTA=" << mOrderedTiming[i];
+		}
+		return written;
+	}
+};
+
+// MS power and timing advance control, GSM 05.08 4 and GSM 05.10 5, 6.
+// This used to be done by each SACCHL1Encoder as it sent each frame.  Now one thread runs the loop for every
+// dedicated channel once per SACCH multiframe, which is how often the MS sends a measurement report anyway.
+// Each pass copies what it needs out of the decoders into flat arrays, computes the new orders,
+// and writes them back to the encoders, which just put them in the next physical header.
+class MSPowerControl {
+	Thread mThread;
+	MSPowerBatch<SACCHL1Decoder,SACCHL1Encoder> mBatch;
+	volatile int mBumpDown;		// Control.SACCHTimeout.BumpDown, read once per pass.
+
+	// Convergence statistics from the most recent pass.
+	mutable Mutex mStatsLock;
+	unsigned mPasses;
+	MSPowerStats mStats;
+	double mPassTime;			// Running average time of one pass, ms.
+
+	void pcGather();
+	void pcCompute();
+	static void *pcServiceLoop(MSPowerControl*);
+
+	public:
+	MSPowerControl();
+	void pcStart();
+	void pcRunOnce();
+	std::string pcText() const;
+	// The RSSI penalty for a lost SACCH frame, in dB.
+	int pcBumpDown() const { return mBumpDown; }
+};
+
+extern MSPowerControl gMSPowerControl;
+
+};	// namespace GSM
+#endif
@@ -0,0 +1,253 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+// Runs MSPowerBatch against stand-ins for the SACCH decoder and encoder.
+// One batch pass must give every channel the orders the old per-frame loop in SACCHL1Encoder::sendFrame gave it,
+// a channel reopened during the pass must keep its own orders, and repeated passes against simulated handsets
+// must bring every one of them to the RSSI target and the right timing advance.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+#include "MSPowerControl.h"
+#include <OpenBTSConfig.h>
+
+using namespace std;
+using namespace GSM;
+
+// Logger refers to the configuration, so the test must have one.
+OpenBTSConfig gConfig;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED line %d: %s\n",__LINE__,#cond); failures++; } } while (0)
+
+// What the batch reads from a SACCHL1Decoder.
+struct TestDecoder {
+	struct Stats { float mAveSNR, mAveBER; };
+	unsigned mReportCount;
+	float mRSSI, mTimingError;
+	Stats mStats;
+	int mActualPower, mActualTiming;
+
+	float getRSSI() const { return mRSSI; }
+	Stats getDecoderStats() const { return mStats; }
+	float timingError() const { return mTimingError; }
+	int actualMSPower() const { return mActualPower; }
+	int actualMSTiming() const { return mActualTiming; }
+};
+
+// What the batch writes to a SACCHL1Encoder.
+struct TestEncoder {
+	float mPower, mTiming;
+
+	float orderedMSPower() const { return mPower; }
+	float orderedMSTiming() const { return mTiming; }
+	void setMSPower(float power) { mPower = power; }
+	void setMSTiming(float timing) { mTiming = timing; }
+	const char *descriptiveString() const { return "TestEncoder"; }
+};
+
+typedef MSPowerBatch<TestDecoder,TestEncoder> TestBatch;
+
+static float uniform(float lo, float hi) { return lo + (hi - lo) * (random() / (float)RAND_MAX); }
+
+// The loop as SACCHL1Encoder::sendFrame ran it for one channel, including the bounds applied by setMSPower and setMSTiming.
+static void referenceLoop(const MSPowerParams &p, const TestDecoder &sib, float &orderedPower, float &orderedTiming)
+{
+	float deltaP = sib.getRSSI() - p.RSSITarget;
+	if (float SNRTarget = p.SNRTarget) {
+		float SNR = sib.getDecoderStats().mAveSNR;
+		if (deltaP > 0 && SNR < SNRTarget) { deltaP = SNR - SNRTarget; }
+	}
+	float targetMSPower = sib.actualMSPower() - deltaP;
+	float powerDamping = p.powerDamping*0.01F;
+	if (p.powerDamping < 90 && deltaP < 4) { powerDamping /= 2; }
+	orderedPower = powerDamping*orderedPower + (1.0F-powerDamping)*targetMSPower;
+	if (orderedPower > p.maxPower) { orderedPower = p.maxPower; }
+	else if (orderedPower < p.minPower) { orderedPower = p.minPower; }
+
+	float targetMSTiming = sib.actualMSTiming() + sib.timingError();
+	float TADamping = p.TADamping*0.01F;
+	orderedTiming = TADamping*orderedTiming + (1.0F-TADamping)*targetMSTiming;
+	if (orderedTiming < 0.0F) { orderedTiming = 0.0F; }
+	else if (orderedTiming > p.maxTiming) { orderedTiming = p.maxTiming; }
+}
+
+static MSPowerParams defaultParams()
+{
+	MSPowerParams p;
+	p.RSSITarget = -50;
+	p.SNRTarget = 10;
+	p.powerDamping = 50;
+	p.TADamping = 50;
+	p.minPower = 5;
+	p.maxPower = 33;
+	p.maxTiming = 62;
+	return p;
+}
+
+static void testAgainstReference()
+{
+	const unsigned n = 300;
+	vector<TestDecoder> dec(n);
+	vector<TestEncoder> enc(n);
+	TestBatch batch;
+
+	for (int pass = 0; pass < 20; pass++) {
+		MSPowerParams p = defaultParams();
+		p.SNRTarget = (pass % 3) ? 10 : 0;
+		p.powerDamping = (pass % 2) ? 50 : 95;
+		p.TADamping = 10 * (pass % 10);
+
+		batch.mpbClear();
+		unsigned powerSettled = 0, timingSettled = 0;
+		for (unsigned i = 0; i < n; i++) {
+			dec[i].mReportCount = 1 + random() % 100;
+			dec[i].mRSSI = uniform(-100,-10);
+			dec[i].mTimingError = uniform(-5,5);
+			dec[i].mStats.mAveSNR = uniform(0,30);
+			dec[i].mStats.mAveBER = uniform(0,0.1);
+			dec[i].mActualPower = 5 + random() % 29;
+			dec[i].mActualTiming = random() % 64;
+			enc[i].mPower = uniform(0,40);
+			enc[i].mTiming = uniform(0,63);
+			batch.mpbGather(&dec[i],&enc[i]);
+
+			float deltaP = dec[i].mRSSI - p.RSSITarget;
+			if (p.SNRTarget && deltaP > 0 && dec[i].mStats.mAveSNR < p.SNRTarget) { deltaP = dec[i].mStats.mAveSNR - p.SNRTarget; }
+			powerSettled += fabsf(deltaP) <= cPowerSettledDB;
+			timingSettled += fabsf(dec[i].mTimingError) <= cTimingSettled;
+		}
+		CHECK(batch.mpbSize() == n);
+
+		MSPowerStats stats;
+		batch.mpbCompute(p,stats);
+		CHECK(stats.channels == n);
+		CHECK(stats.powerSettled == powerSettled);
+		CHECK(stats.timingSettled == timingSettled);
+
+		// Compute must not touch the encoders; scatter writes them all.
+		vector<TestEncoder> before = enc;
+		for (unsigned i = 0; i < n; i++) { CHECK(enc[i].mPower == before[i].mPower); }
+		CHECK(batch.mpbScatter() == n);
+
+		int bad = 0;
+		for (unsigned i = 0; i < n; i++) {
+			float power = before[i].mPower, timing = before[i].mTiming;
+			referenceLoop(p,dec[i],power,timing);
+			if (enc[i].mPower != power || enc[i].mTiming != timing) {
+				if (bad++ < 5) {
+					printf("pass %d channel %u: batch %g %g, reference %g %g\n",pass,i,enc[i].mPower,enc[i].mTiming,power,timing);
+				}
+			}
+		}
+		if (bad) { failures++; }
+	}
+}
+
+static void testReopened()
+{
+	TestDecoder dec[3];
+	TestEncoder enc[3];
+	TestBatch batch;
+	MSPowerParams p = defaultParams();
+
+	for (unsigned i = 0; i < 3; i++) {
+		dec[i].mReportCount = 20;
+		dec[i].mRSSI = -80;
+		dec[i].mTimingError = 2;
+		dec[i].mStats.mAveSNR = 20;
+		dec[i].mStats.mAveBER = 0;
+		dec[i].mActualPower = 10;
+		dec[i].mActualTiming = 5;
+		enc[i].mPower = 10;
+		enc[i].mTiming = 5;
+		batch.mpbGather(&dec[i],&enc[i]);
+	}
+	MSPowerStats stats;
+	batch.mpbCompute(p,stats);
+
+	// Channel 1 closes and opens for another MS, which has sent one report and has its RACH orders.
+	dec[1].mReportCount = 1;
+	enc[1].mPower = 33;
+	enc[1].mTiming = 40;
+	// Channel 2 just gets another report, which is fine.
+	dec[2].mReportCount = 21;
+
+	CHECK(batch.mpbScatter() == 2);
+	CHECK(enc[0].mPower > 10 && enc[0].mTiming > 5);
+	CHECK(enc[1].mPower == 33 && enc[1].mTiming == 40);
+	CHECK(enc[2].mPower == enc[0].mPower && enc[2].mTiming == enc[0].mTiming);
+}
+
+// Handsets at random distances and path losses that obey the orders, in whole dB and symbols as a real MS reports them.
+static void testConverges()
+{
+	const unsigned n = 100;
+	vector<TestDecoder> dec(n);
+	vector<TestEncoder> enc(n);
+	vector<float> loss(n), distance(n);
+	TestBatch batch;
+	MSPowerParams p = defaultParams();
+	p.SNRTarget = 0;
+
+	for (unsigned i = 0; i < n; i++) {
+		// Every one can reach the target within the power limits.
+		loss[i] = uniform(p.minPower - p.RSSITarget, p.maxPower - p.RSSITarget);
+		distance[i] = uniform(0,p.maxTiming);
+		// Initial orders from the RACH: full power, TA 0.
+		enc[i].mPower = p.maxPower;
+		enc[i].mTiming = 0;
+		dec[i].mReportCount = 0;
+		dec[i].mStats.mAveSNR = 20;
+		dec[i].mStats.mAveBER = 0.01;
+	}
+
+	MSPowerStats stats;
+	for (int pass = 0; pass < 40; pass++) {
+		batch.mpbClear();
+		for (unsigned i = 0; i < n; i++) {
+			dec[i].mReportCount++;
+			dec[i].mActualPower = (int)roundf(enc[i].mPower);
+			dec[i].mActualTiming = (int)roundf(enc[i].mTiming);
+			dec[i].mRSSI = dec[i].mActualPower - loss[i];
+			dec[i].mTimingError = distance[i] - dec[i].mActualTiming;
+			batch.mpbGather(&dec[i],&enc[i]);
+		}
+		batch.mpbCompute(p,stats);
+		batch.mpbScatter();
+	}
+
+	printf("after 40 passes: power settled %u mean error %g dB, TA settled %u mean error %g symbols, mean BER %g\n",
+		stats.powerSettled,stats.meanPowerError,stats.timingSettled,stats.meanTimingError,stats.meanBER);
+	CHECK(stats.powerSettled == n);
+	CHECK(stats.timingSettled == n);
+	CHECK(stats.meanPowerError < 1.0F);
+	CHECK(fabsf(stats.meanBER - 0.01F) < 1e-6);
+}
+
+int main(int argc, char **argv)
+{
+	srandom(5);
+	testAgainstReference();
+	testReopened();
+	testConverges();
+	printf(failures ? "FAILED\n" : "PASSED\n");
+	return failures ? 1 : 0;
+}
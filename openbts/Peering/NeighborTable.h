@@ -47,8 +47,9 @@ struct NeighborEntry {
 	Int_z mNoise;
 	int mTchAvail;
 	int mTchTotal;
+	bool mBinary;		// The peer takes binary messages (PeerMessage.h).
 	string neC0PlusBSIC() const;
-	NeighborEntry() : mUpdated(0), mHoldoff(0), mC0(-1), mBSIC(-1), mNumArfcns(-1), mTchAvail(-1), mTchTotal(-1) {}
+	NeighborEntry() : mUpdated(0), mHoldoff(0), mC0(-1), mBSIC(-1), mNumArfcns(-1), mTchAvail(-1), mTchTotal(-1), mBinary(false) {}
 };
 
 typedef vector<NeighborEntry> NeighborEntryVector;
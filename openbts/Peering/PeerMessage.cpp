@@ -0,0 +1,141 @@
+/**@file Binary messages for the peer-to-peer protocol. */
+/*
+* Copyright 2014 Range Networks, Inc.
+
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#include "PeerMessage.h"
+
+#include <sstream>
+
+namespace Peering {
+using namespace std;
+
+const char *PeerMessageType2Str(unsigned type)
+{
+	switch (type) {
+		case PeerAck: return "ACK";
+		case PeerHandoverRequest: return "REQ HANDOVER";
+		case PeerHandoverResponse: return "RSP HANDOVER";
+		case PeerHandoverComplete: return "IND HANDOVER_COMPLETE";
+		case PeerHandoverFailure: return "IND HANDOVER_FAILURE";
+		case PeerHandoverPrepare: return "REQ HANDOVER_PREPARE";
+		case PeerHandoverPrepared: return "RSP HANDOVER_PREPARE";
+		default: return "unknown";
+	}
+}
+
+PeerMessage::PeerMessage(PeerMessageType type, uint32_t seq, uint32_t tranID)
+{
+	mData.reserve(64);
+	mData.push_back((char)cPeerMagic);
+	mData.push_back((char)cPeerVersion);
+	mData.push_back((char)type);
+	mData.push_back(0);
+	putWord(seq);
+	putWord(tranID);
+}
+
+uint32_t PeerMessage::getWord(size_t pos) const
+{
+	const unsigned char *p = (const unsigned char*)mData.data() + pos;
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void PeerMessage::putWord(uint32_t value)
+{
+	mData.push_back((char)(value >> 24));
+	mData.push_back((char)(value >> 16));
+	mData.push_back((char)(value >> 8));
+	mData.push_back((char)value);
+}
+
+bool PeerMessage::parse(const char *buf, size_t len)
+{
+	if (len < cPeerHeaderLen || !isBinary(buf,len)) { return false; }
+	if ((uint8_t)buf[1] != cPeerVersion) { return false; }
+
+	// Walk the elements once so the accessors can trust the lengths.
+	const unsigned char *p = (const unsigned char*)buf;
+	size_t pos = cPeerHeaderLen;
+	while (pos < len) {
+		if (pos + 3 > len) { return false; }
+		size_t ielen = (p[pos+1] << 8) | p[pos+2];
+		pos += 3 + ielen;
+	}
+	if (pos != len) { return false; }
+
+	mData.assign(buf,len);
+	return true;
+}
+
+void PeerMessage::addNum(PeerIE tag, uint32_t value)
+{
+	mData.push_back((char)tag);
+	mData.push_back(0);
+	mData.push_back(4);
+	putWord(value);
+}
+
+void PeerMessage::addBytes(PeerIE tag, const void *value, size_t len)
+{
+	if (len > 0xffff) { len = 0xffff; }		// Could not be sent in a datagram anyway.
+	mData.push_back((char)tag);
+	mData.push_back((char)(len >> 8));
+	mData.push_back((char)len);
+	mData.append((const char*)value,len);
+}
+
+bool PeerMessage::find(PeerIE tag, size_t &pos, size_t &len) const
+{
+	const unsigned char *p = (const unsigned char*)mData.data();
+	for (pos = cPeerHeaderLen; pos < mData.size(); pos += 3 + len) {
+		len = (p[pos+1] << 8) | p[pos+2];
+		if (p[pos] == tag) {
+			pos += 3;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool PeerMessage::getNum(PeerIE tag, unsigned &value) const
+{
+	size_t pos, len;
+	if (!find(tag,pos,len) || len != 4) { return false; }
+	value = getWord(pos);
+	return true;
+}
+
+bool PeerMessage::getString(PeerIE tag, string &value) const
+{
+	size_t pos, len;
+	if (!find(tag,pos,len)) { return false; }
+	value.assign(mData,pos,len);
+	return true;
+}
+
+string PeerMessage::text() const
+{
+	ostringstream ss;
+	ss << PeerMessageType2Str(type()) << " seq=" << seq() << " tran=" << tranID();
+	unsigned num;
+	if (getNum(PeerIEReplyTo,num)) { ss << " replyto=" << num; }
+	if (getNum(PeerIECause,num)) { ss << " cause=" << num; }
+	if (getNum(PeerIEHold,num)) { ss << " hold=" << num; }
+	ss << " len=" << size();
+	return ss.str();
+}
+
+}; //namespace
@@ -0,0 +1,108 @@
+/**@file Binary messages for the peer-to-peer protocol. */
+/*
+* Copyright 2014 Range Networks, Inc.
+
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+
+#ifndef PEERMESSAGE_H
+#define PEERMESSAGE_H
+
+#include <stdint.h>
+#include <string>
+
+
+namespace Peering {
+
+// A binary message is a fixed header followed by information elements, all in network byte order:
+//		magic(1) version(1) type(1) reserved(1) sequence(4) transaction(4)
+//		{ tag(1) length(2) value(length) } ...
+// The magic byte is not printable, so a text message, which starts with REQ, RSP, IND or ACK, is never taken
+// for a binary one and both kinds can share the peering port.
+// The sequence number is unique per sender.  Replies carry the sequence number of the request they answer
+// in PeerIEReplyTo, which is how the sender stops retransmitting.
+// The transaction is the transaction ID on the BTS that started the exchange, as in the text messages.
+const uint8_t cPeerMagic = 0xb7;
+const uint8_t cPeerVersion = 1;
+const unsigned cPeerHeaderLen = 12;
+
+enum PeerMessageType {
+	PeerAck = 1,				///< ACK HANDOVER_COMPLETE or ACK HANDOVER_FAILURE
+	PeerHandoverRequest = 2,	///< REQ HANDOVER
+	PeerHandoverResponse = 3,	///< RSP HANDOVER
+	PeerHandoverComplete = 4,	///< IND HANDOVER_COMPLETE
+	PeerHandoverFailure = 5,	///< IND HANDOVER_FAILURE
+	PeerHandoverPrepare = 6,	///< ask a neighbor to reserve a channel for a likely handover
+	PeerHandoverPrepared = 7	///< answer to PeerHandoverPrepare
+};
+
+enum PeerIE {
+	PeerIEReplyTo = 1,		///< sequence number of the request being answered
+	PeerIECause = 2,		///< RR cause, 0 for success
+	PeerIEHoldoff = 3,		///< handover holdoff in seconds
+	PeerIEParams = 4,		///< handover parameters, the key=value text of TranEntry::handoverString
+	PeerIECommand = 5,		///< packed L3 Handover Command
+	PeerIEIMSI = 6,			///< IMSI digits
+	PeerIEHold = 7			///< milliseconds a reservation will be held
+};
+
+const char *PeerMessageType2Str(unsigned type);
+
+class PeerMessage {
+
+	private:
+
+	std::string mData;		///< the message in wire format
+
+	uint32_t getWord(size_t pos) const;
+	void putWord(uint32_t value);
+
+	/** Find an information element, return its offset and length. */
+	bool find(PeerIE tag, size_t &pos, size_t &len) const;
+
+	public:
+
+	/** An empty message, to be filled by parse(). */
+	PeerMessage() {}
+
+	/** A new message with no information elements. */
+	PeerMessage(PeerMessageType type, uint32_t seq, uint32_t tranID);
+
+	/** True if the buffer holds a binary message rather than a text one. */
+	static bool isBinary(const char *buf, size_t len) { return len && (uint8_t)buf[0] == cPeerMagic; }
+
+	/** Take a received message, checking the header and element lengths. */
+	bool parse(const char *buf, size_t len);
+
+	unsigned type() const { return (uint8_t)mData[2]; }
+	uint32_t seq() const { return getWord(4); }
+	uint32_t tranID() const { return getWord(8); }
+
+	void addNum(PeerIE tag, uint32_t value);
+	void addBytes(PeerIE tag, const void *value, size_t len);
+	void addString(PeerIE tag, const std::string &value) { addBytes(tag,value.data(),value.size()); }
+
+	bool getNum(PeerIE tag, unsigned &value) const;
+	bool getString(PeerIE tag, std::string &value) const;
+
+	const char *data() const { return mData.data(); }
+	size_t size() const { return mData.size(); }
+
+	/** One line description for the log. */
+	std::string text() const;
+};
+
+}; //namespace
+
+#endif
@@ -0,0 +1,127 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+// A binary peering message must come back from parse() as it was built, and parse() must
+// refuse text messages, short or foreign headers, and elements whose lengths do not add up.
+
+#include <stdio.h>
+#include <string>
+
+#include "PeerMessage.h"
+
+using namespace std;
+using namespace Peering;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED line %d: %s\n",__LINE__,#cond); failures++; } } while (0)
+
+static bool parses(const string &wire)
+{
+	PeerMessage msg;
+	return msg.parse(wire.data(),wire.size());
+}
+
+static void testRoundTrip()
+{
+	// The handover command holds arbitrary bytes, including zeros.
+	string command("\x06\x2b\x00\x81\xff\x00\x10",7);
+	string params(300,'p');
+
+	PeerMessage sent(PeerHandoverResponse,0xdeadbeef,12345);
+	sent.addNum(PeerIEReplyTo,7);
+	sent.addNum(PeerIECause,0);
+	sent.addString(PeerIECommand,command);
+	sent.addString(PeerIEParams,params);
+	sent.addString(PeerIEIMSI,"");
+
+	PeerMessage got;
+	CHECK(PeerMessage::isBinary(sent.data(),sent.size()));
+	CHECK(got.parse(sent.data(),sent.size()));
+	CHECK(got.type() == PeerHandoverResponse);
+	CHECK(got.seq() == 0xdeadbeef);
+	CHECK(got.tranID() == 12345);
+
+	unsigned num = 99;
+	CHECK(got.getNum(PeerIEReplyTo,num) && num == 7);
+	CHECK(got.getNum(PeerIECause,num) && num == 0);
+	string value;
+	CHECK(got.getString(PeerIECommand,value) && value == command);
+	CHECK(got.getString(PeerIEParams,value) && value == params);
+	CHECK(got.getString(PeerIEIMSI,value) && value.empty());
+
+	// Absent elements, and a string element asked for as a number.
+	CHECK(!got.getNum(PeerIEHoldoff,num));
+	CHECK(!got.getString(PeerIEHold,value));
+	CHECK(!got.getNum(PeerIECommand,num));
+
+	// A header with no elements is a whole message.
+	PeerMessage bare(PeerAck,1,2);
+	CHECK(got.parse(bare.data(),bare.size()) && got.type() == PeerAck && got.size() == cPeerHeaderLen);
+}
+
+static void testMalformed()
+{
+	PeerMessage good(PeerHandoverRequest,5,6);
+	good.addNum(PeerIECause,101);
+	good.addString(PeerIEParams,"IMSI=001010000000001 cause=Downlink_Strength");
+	string wire(good.data(),good.size());
+	CHECK(parses(wire));
+
+	// Text messages share the port and must never be taken for binary.
+	CHECK(!PeerMessage::isBinary("REQ HANDOVER 5",14));
+	CHECK(!parses("REQ HANDOVER 5 IMSI=001010000000001"));
+	CHECK(!parses(""));
+
+	// Short header, and a header from another version.
+	CHECK(!parses(wire.substr(0,cPeerHeaderLen-1)));
+	string other = wire;
+	other[1] = cPeerVersion + 1;
+	CHECK(!parses(other));
+
+	// Every truncation inside an element leaves a length that runs past the end.
+	// Cutting after the 7 byte cause element leaves a shorter message that is still whole.
+	size_t boundary = cPeerHeaderLen + 7;
+	CHECK(parses(wire.substr(0,boundary)));
+	for (size_t len = cPeerHeaderLen + 1; len < wire.size(); len++) {
+		if (len != boundary && parses(wire.substr(0,len))) { printf("truncation to %u accepted\n",(unsigned)len); failures++; }
+	}
+
+	// An element length that is too long, and one that is too short so the rest does not make an element.
+	string longer = wire;
+	longer[cPeerHeaderLen+2] = 5;
+	CHECK(!parses(longer));
+	string shorter = wire;
+	shorter[cPeerHeaderLen+2] = 3;
+	CHECK(!parses(shorter));
+
+	// A length of 0xffff from a corrupt datagram.
+	string huge = wire;
+	huge[cPeerHeaderLen+1] = (char)0xff;
+	huge[cPeerHeaderLen+2] = (char)0xff;
+	CHECK(!parses(huge));
+
+	// Trailing garbage after the last element.
+	CHECK(!parses(wire + string("\x02\x00",2)));
+}
+
+int main(int argc, char **argv)
+{
+	testRoundTrip();
+	testMalformed();
+	printf(failures ? "FAILED\n" : "PASSED\n");
+	return failures ? 1 : 0;
+}
@@ -26,6 +26,7 @@
 #include <GSMLogicalChannel.h>
 #include <GSML3RRElements.h>
 #include <L3TranEntry.h>
+#include <Reporting.h>
 //#include <TransactionTable.h>
 
 #undef WARNING
@@ -74,6 +75,19 @@ using namespace Control;
 // d when we receive the handover complete the InboundHandoverMachine calls newSipDialogHandover, which sends the re-INVITE.
 //   then when the dialog becomas active, we send the IND HANDOVER_COMPLETE.
 // E = processHandoverComplete in BS1
+//
+// Handover preparation, binary peers only:
+// When the best neighbor comes within GSM.Handover.Prepare.Margin of a handover, BS1 sends REQ HANDOVER_PREPARE.
+// BS2 allocates and starts a TCH and a handover reference and holds them for most of T3101.
+// If REQ HANDOVER for that transaction arrives in time, BS2 answers at once from the reservation
+// instead of allocating a channel and waiting for SACCH to start; otherwise T3101 releases the channel.
+
+// How long the service loop waits for a message before servicing the retransmit timers.
+static const unsigned cPeerPollMsecs = 10;
+// The most channels we reserve for neighbors at once.
+static const unsigned cPeerMaxReservations = 8;
+// How long after lcstart() before the handover command may be sent, which is about 30 frames.
+static const unsigned cPeerSacchStartMsecs = 140;
 
 
 string sockaddr2string(const struct sockaddr_in* peer, bool noempty)
@@ -120,6 +134,18 @@ static void logMessage(const char*sendOrRecv, const struct sockaddr_in* peer, co
 
 }
 
+static void logBinary(const char*sendOrRecv, const struct sockaddr_in* peer, const PeerMessage &msg)
+{
+	// Binary messages are all handover messages.
+	LOG(INFO) << "Peering "<<sendOrRecv <<LOGVAR2("peer",sockaddr2string(peer,true)) <<" "<<msg.text();
+	WATCHLEVEL(INFO," Peering "<<sendOrRecv <<LOGVAR2("peer",sockaddr2string(peer,true)) <<" "<<msg.text());
+}
+
+static bool samePeer(const struct sockaddr_in* a, const struct sockaddr_in* b)
+{
+	return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
 void PeerMessageFIFOMap::addFIFO(unsigned transactionID)
 {
 	PeerMessageFIFO* newFIFO = new PeerMessageFIFO;
@@ -157,7 +183,8 @@ void PeerMessageFIFOMap::writeFIFO(unsigned transactionID, const char* msg)
 
 PeerInterface::PeerInterface()
 	:mSocket(gConfig.getNum("Peering.Port")),
-	mReferenceCounter(0)
+	mReferenceCounter(0),
+	mSequence(0)
 {
 	mSocket.nonblocking();
 }
@@ -203,14 +230,14 @@ void* PeerInterface::serviceLoop1(void*)
 }
 
 // this loop services, among other things, the IND and ACK HANDOVER_COMPLETE, which affects the 
-// handover gap in the call.  so it needs to be short.  Like 10msec = 10000usec
+// handover gap in the call.  so it needs to be short.  drive() waits on the socket for up to cPeerPollMsecs,
+// so messages are handled as they arrive and the retransmit timers run at least that often.
 void* PeerInterface::serviceLoop2(void*)
 {
 	// gTRX.C0() needs some time to get ready
 	sleep(8);
 	while (!gBTS.btsShutdown()) {
 		drive();
-		usleep(10000);
 	}
 	return NULL;
 }
@@ -218,16 +245,176 @@ void* PeerInterface::serviceLoop2(void*)
 
 void PeerInterface::drive()
 {
-	int numRead = mSocket.read(mReadBuffer);
-	if (numRead<0) {
+	int numRead = mSocket.read(mReadBuffer,cPeerPollMsecs);
+	if (numRead>=0) {
+		if (PeerMessage::isBinary(mReadBuffer,numRead)) {
+			processBinary(mSocket.source(),mReadBuffer,numRead);
+		} else {
+			mReadBuffer[numRead] = '\0';
+			//LOG(INFO) << "received " << mReadBuffer;
+			LOG(DEBUG) << "received " << mReadBuffer;
+			process(mSocket.source(),mReadBuffer);
+		}
+	}
+	serviceTimers();
+}
+
+
+void PeerInterface::serviceTimers()
+{
+	vector<PeerPending> resend;
+	vector<PeerDeferred> deferred;
+	{
+		ScopedLock lock(mStateLock);
+		if (mPending.size()) {
+			unsigned timeout = gConfig.getNum("Peering.ResendTimeout");
+			for (PeerPendingMap::iterator it = mPending.begin(); it != mPending.end(); ) {
+				PeerPendingMap::iterator thisone = it++;
+				PeerPending &pp = thisone->second;
+				if (!pp.ppNext.passed()) { continue; }
+				if (pp.ppTries == 0) {
+					LOG(NOTICE) << "no reply from peer " << sockaddr2string(&pp.ppPeer,true) << " to binary message"<<LOGVAR2("seq",thisone->first);
+					mPending.erase(thisone);
+					continue;
+				}
+				pp.ppTries--;
+				pp.ppNext.future(timeout);
+				resend.push_back(pp);
+			}
+		}
+
+		for (PeerDeferredList::iterator it = mDeferred.begin(); it != mDeferred.end(); ) {
+			if (it->pdWhen.passed()) {
+				deferred.push_back(*it);
+				it = mDeferred.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		// An expired reservation needs nothing else; the unused channel is released on T3101.
+		for (PeerReservationList::iterator it = mReservations.begin(); it != mReservations.end(); ) {
+			if (it->prExpiry.passed()) {
+				LOG(INFO) << "unused handover reservation expired"<<LOGVAR2("peer",sockaddr2string(&it->prPeer,true))
+					<<LOGVAR2("tran",it->prOtherTransID);
+				it = mReservations.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		// Forget outbound handovers that are neither waiting for RSP HANDOVER nor prepared.
+		uint64_t stale = reportUsecs() - 60*1000000ULL;
+		for (PeerOutboundMap::iterator it = mOutbound.begin(); it != mOutbound.end(); ) {
+			PeerOutboundMap::iterator thisone = it++;
+			PeerOutbound &po = thisone->second;
+			if (po.poPrepareExpiry.passed() && (po.poRequestUsecs == 0 || po.poRequestUsecs < stale)) {
+				mOutbound.erase(thisone);
+			}
+		}
+	}
+
+	for (vector<PeerDeferred>::iterator it = deferred.begin(); it != deferred.end(); it++) {
+		if (it->pdBinary) {
+			sendBinary(&it->pdPeer,it->pdReply);
+		} else {
+			sendMessage(&it->pdPeer,it->pdText.c_str());
+		}
+	}
+
+	for (vector<PeerPending>::iterator it = resend.begin(); it != resend.end(); it++) {
+		LOG(DEBUG) << "resending binary message to " << sockaddr2string(&it->ppPeer,true);
+		ScopedLock lock(mLock);
+		mSocket.send((const struct sockaddr*)&it->ppPeer,it->ppData.data(),it->ppData.size());
+	}
+}
+
+
+void PeerInterface::stopPending(uint32_t seq)
+{
+	ScopedLock lock(mStateLock);
+	mPending.erase(seq);
+}
+
+
+bool PeerInterface::peerIsBinary(const struct sockaddr_in* peer)
+{
+	NeighborEntry entry;
+	return gConfig.getBool("Peering.Binary") && gNeighborTable.ntFindByPeerAddr(peer,&entry) && entry.mBinary;
+}
+
+
+bool PeerInterface::peerIsBinary(const string &peer)
+{
+	NeighborEntry entry;
+	return gConfig.getBool("Peering.Binary") && gNeighborTable.ntFindByIP(peer,&entry) && entry.mBinary;
+}
+
+
+// Turn the packed handover command from a binary RSP HANDOVER back into the hex the text message carries.
+static string hexCommand(const string &packed)
+{
+	BitVector bits(packed.size()*8);
+	bits.unpack((const unsigned char*)packed.data());
+	return bits.hexstr();
+}
+
+
+void PeerInterface::processBinary(const struct sockaddr_in* peer, const char* data, size_t len)
+{
+	PeerMessage msg;
+	if (!msg.parse(data,len)) {
+		LOG(ERR) << "malformed binary peering message from " << sockaddr2string(peer,true) <<LOGVAR(len);
 		return;
 	}
+	logBinary("receive",peer,msg);
 
-	mReadBuffer[numRead] = '\0';
-	//LOG(INFO) << "received " << mReadBuffer;
-	LOG(DEBUG) << "received " << mReadBuffer;
+	// Any reply stops the retransmission of the request it answers.
+	unsigned replyTo;
+	if (msg.getNum(PeerIEReplyTo,replyTo)) { stopPending(replyTo); }
 
-	process(mSocket.source(),mReadBuffer);
+	switch (msg.type()) {
+		case PeerAck:
+			// sendUntilAck is waiting on the transaction FIFO in another thread.
+			mFIFOMap.writeFIFO(msg.tranID(),"ACK binary");
+			return;
+		case PeerHandoverRequest: {
+			string text;
+			if (!msg.getString(PeerIEParams,text)) { break; }
+			SimpleKeyValue params;
+			params.addItems(text.c_str());
+			handoverRequest(peer,msg.tranID(),params,&msg);
+			return;
+		}
+		case PeerHandoverResponse: {
+			unsigned cause;
+			string command;
+			if (!msg.getNum(PeerIECause,cause)) { break; }
+			if (!cause && !msg.getString(PeerIECommand,command)) { break; }
+			handoverResponse(msg.tranID(),cause,hexCommand(command));
+			return;
+		}
+		case PeerHandoverComplete:
+			handoverComplete(peer,msg.tranID(),&msg);
+			return;
+		case PeerHandoverFailure: {
+			unsigned cause = 0, holdoff = gConfig.GSM.Handover.FailureHoldoff;
+			msg.getNum(PeerIECause,cause);
+			msg.getNum(PeerIEHoldoff,holdoff);
+			handoverFailure(peer,msg.tranID(),cause,holdoff,&msg);
+			return;
+		}
+		case PeerHandoverPrepare:
+			handoverPrepare(peer,msg);
+			return;
+		case PeerHandoverPrepared:
+			handoverPrepared(msg);
+			return;
+		default:
+			LOG(NOTICE) << "unrecognized binary peering message from " << sockaddr2string(peer,true) << ": " << msg.text();
+			return;
+	}
+	LOG(ERR) << "binary peering message from " << sockaddr2string(peer,true) << " is missing elements: " << msg.text();
 }
 
 
@@ -317,8 +504,10 @@ void PeerInterface::processNeighborParams(const struct sockaddr_in* peer, const
 			int myNoise = gTRX.ARFCN(0)->getNoiseLevel();
 			unsigned tchTotal = gBTS.TCHTotal();
 			unsigned tchAvail = tchTotal - gBTS.TCHActive();
-			snprintf(rsp, sizeof(rsp), "RSP NEIGHBOR_PARAMS V=2 C0=%u BSIC=%u btsid=%u noise=%d arfcns=%d TchAvail=%u TchTotal=%u",
-					gTRX.C0(), gBTS.BSIC(), btsid, myNoise, (int)gConfig.getNum("GSM.Radio.ARFCNs"), tchAvail, tchTotal);
+			// binary=1 says we take the binary handover messages.  Older versions ignore it.
+			snprintf(rsp, sizeof(rsp), "RSP NEIGHBOR_PARAMS V=2 C0=%u BSIC=%u btsid=%u noise=%d arfcns=%d TchAvail=%u TchTotal=%u binary=%d",
+					gTRX.C0(), gBTS.BSIC(), btsid, myNoise, (int)gConfig.getNum("GSM.Radio.ARFCNs"), tchAvail, tchTotal,
+					(int)gConfig.getBool("Peering.Binary"));
 			sendMessage(peer,rsp);
 		}
 		return;
@@ -353,6 +542,9 @@ void PeerInterface::processNeighborParams(const struct sockaddr_in* peer, const
 			newentry.mNumArfcns = keys.getNumOrBust("arfcns");
 			newentry.mTchAvail = keys.getNumOrBust("TchAvail");
 			newentry.mTchTotal = keys.getNumOrBust("TchTotal");
+			{	bool valid;
+				newentry.mBinary = keys.getNum("binary",valid) && valid;
+			}
 		}
 
 		newentry.mIPAddress = sockaddr2string(peer, false);
@@ -442,6 +634,21 @@ static void addHandoverPenalty(GSM::L2LogicalChannel *chan,NeighborEntry &nentry
 	chan->chanSetHandoverPenalty(npenalty);
 }
 
+// The L3 HandoverCommand that BS1 will send to the phone to tell it to come to us, BS2, on this channel,
+// packed for a binary message or in hex for a text one.
+static string handoverCommand(GSM::L2LogicalChannel *chan, unsigned horef, bool packed)
+{
+	const GSM::L3ChannelDescription desc = chan->channelDescription();
+	L3HandoverCommand handoverMsg(
+		GSM::L3CellDescription(gTRX.C0(),gBTS.NCC(),gBTS.BCC()),
+		GSM::L3ChannelDescription2(desc),
+		GSM::L3HandoverReference(horef),
+		GSM::L3PowerCommandAndAccessType(),
+		GSM::L3SynchronizationIndication(true, true));
+	L3Frame handoverFrame(handoverMsg);
+	return packed ? handoverFrame.packToString() : handoverFrame.hexstr();
+}
+
 // (pat) This is BS2 which has received a request from BS1 to transfer the MS from BS1 to BS2.
 // Manufacture a TransactionEntry and SIPEngine from the peering message.
 void PeerInterface::processHandoverRequest(const struct sockaddr_in* peer, const char* message)
@@ -458,6 +665,11 @@ void PeerInterface::processHandoverRequest(const struct sockaddr_in* peer, const
 	// Break message into space-delimited tokens, stuff into a SimpleKeyValue and then unpack it.
 	SimpleKeyValue params;
 	params.addItems(message);
+	handoverRequest(peer,oldTransID,params,NULL);
+}
+
+void PeerInterface::handoverRequest(const struct sockaddr_in* peer, unsigned oldTransID, SimpleKeyValue &params, const PeerMessage *request)
+{
 	const char* IMSI = params.get("IMSI");
 	GSM::L3MobileIdentity mobileID = GSM::L3MobileIdentity(IMSI);
 
@@ -475,49 +687,66 @@ void PeerInterface::processHandoverRequest(const struct sockaddr_in* peer, const
 	// and the channel that goes with it
 	GSM::L2LogicalChannel* chan = NULL;
 	unsigned horef;
+	PeerReservation res;
+	bool prepared = false;
 
 	// if this is the first REQ HANDOVER
 	if (!transaction) {
-		WATCH(Utils::timestr() << " Peering recv:"<<message);
+		WATCH(Utils::timestr() << " Peering recv: REQ HANDOVER " << oldTransID << " " << mobileID);
 
 		//LOG(INFO) << "initial REQ HANDOVER for " << mobileID << " " << oldTransID;
 		LOG(DEBUG) << "initial REQ HANDOVER for " << mobileID << " " << oldTransID;
 
-		// Get a channel allocation.
-		// For now, we are assuming a full-rate channel.
-		// And check gBTS.hold()
-		time_t start = time(NULL);
-		if (!gBTS.btsHold()) {
-			chan = gBTS.getTCH(); 	// (pat) Starts T3101.  Better finish before it expires.
-			if (!chan) { LOG(CRIT) << "congestion, incoming handover request denied"; }
-		}
-		LOG(DEBUG) << "getTCH took " << (time(NULL) - start) << " seconds";
+		if (takeReservation(peer,oldTransID,res)) {
+			// REQ HANDOVER_PREPARE already got us a running channel and a handover reference.
+			chan = res.prChan;
+			horef = res.prRef;
+			prepared = true;
+			LOG(INFO) << "using reserved " << chan << " for handover of " << mobileID;
+		} else {
+			// Get a channel allocation.
+			// For now, we are assuming a full-rate channel.
+			// And check gBTS.hold()
+			time_t start = time(NULL);
+			if (!gBTS.btsHold()) {
+				chan = gBTS.getTCH(); 	// (pat) Starts T3101.  Better finish before it expires.
+				if (!chan) { LOG(CRIT) << "congestion, incoming handover request denied"; }
+			}
+			LOG(DEBUG) << "getTCH took " << (time(NULL) - start) << " seconds";
 
-		// (doug) FIXME -- Somehow, getting from getTCH above to the test below can take several seconds.
-		// (doug) FIXME -- #797.
+			// (doug) FIXME -- Somehow, getting from getTCH above to the test below can take several seconds.
+			// (doug) FIXME -- #797.
 
-		// If getTCH took so long that there's too little time left in T3101, ignore this REQ and get the next one.
-		if (chan && chan->debug3101remaining() < 1000) {
-			LOG(NOTICE) << "handover TCH allocation took too long; risk of T3101 timeout; trying again";
-			chan->l2sendp(L3_HARDRELEASE_REQUEST);	// (pat) added 9-6-2013
-			return;
-		}
+			// If getTCH took so long that there's too little time left in T3101, ignore this REQ and get the next one.
+			if (chan && chan->debug3101remaining() < 1000) {
+				LOG(NOTICE) << "handover TCH allocation took too long; risk of T3101 timeout; trying again";
+				chan->l2sendp(L3_HARDRELEASE_REQUEST);	// (pat) added 9-6-2013
+				return;
+			}
 
-		// If there's no channel available, send failure.
-		if (!chan) {
-			char rsp[50];
-			// RR Cause 101 "cell allocation not available"
-			// GSM 04.08 10.5.2.31
-			sprintf(rsp,"RSP HANDOVER %u 101", oldTransID);
-			sendMessage(peer,rsp);
-			return;
+			// If there's no channel available, send failure.
+			if (!chan) {
+				// RR Cause 101 "cell allocation not available"
+				// GSM 04.08 10.5.2.31
+				if (request) {
+					PeerMessage rsp = newMessage(PeerHandoverResponse,oldTransID);
+					rsp.addNum(PeerIECause,101);
+					sendReply(peer,*request,rsp);
+				} else {
+					char rsp[50];
+					sprintf(rsp,"RSP HANDOVER %u 101", oldTransID);
+					sendMessage(peer,rsp);
+				}
+				return;
+			}
+
+			// Allocate a new inbound handover reference.  It is placed in the L3HandoverCommand and then used
+			// in Layer1 as a really cheap validation on an inbound handover access
+			// to make sure the incoming handset is the one we want.
+			horef = 0xff & (++mReferenceCounter);
 		}
 
 		// build a new transaction record.
-		// Allocate a new inbound handover reference.  It is placed in the L3HandoverCommand and then used
-		// in Layer1 as a really cheap validation on an inbound handover access
-		// to make sure the incoming handset is the one we want.
-		horef = 0xff & (++mReferenceCounter);
 		transaction = Control::TranEntry::newHandover(peer,horef,params,chan,oldTransID);
 		mFIFOMap.addFIFO(transaction->tranID());
 		LOG(INFO) "creating new transaction " << *transaction;
@@ -529,44 +758,165 @@ void PeerInterface::processHandoverRequest(const struct sockaddr_in* peer, const
 		// This starts T3103.
 		chan->handoverPending(true,horef);
 	} else {
+		// A retransmitted REQ HANDOVER.  The channel is already running, so answer from the transaction,
+		// unless the answer to the first one is still waiting for SACCH, which will answer this one too.
 		chan = transaction->getL2Channel();
 		horef = transaction->getHandoverEntry(true)->mInboundReference;
 		LOG(DEBUG) << *transaction;
+		if (!acceptDeferred(peer,oldTransID)) { acceptHandover(peer,oldTransID,chan,horef,request,Timeval()); }
+		return;
 	}
 
-	// (pat 6-2014) FIXME We dont have TA yet, so we are just starting the channel with 0 TA.
-	// What is the correct procedure?  Should we not start SACCH until we receive the HandoverReference?
-	chan->lcstart();
+	if (prepared) {
+		// The channel was started when it was reserved; it only needs to have been running long enough.
+		acceptHandover(peer,oldTransID,chan,horef,request,res.prReady);
+	} else {
+		// (pat 6-2014) FIXME We dont have TA yet, so we are just starting the channel with 0 TA.
+		// What is the correct procedure?  Should we not start SACCH until we receive the HandoverReference?
+		chan->lcstart();
 
-	// Send accept.
-	// FIXME TODO_NOW: Get rid of this sleepFrames...
-	sleepFrames(30);	// Pat added delay to let SACCH get started.
+		// Send accept once SACCH has had time to start.  The service loop sends it, so it does not hold up peering.
+		acceptHandover(peer,oldTransID,chan,horef,request,Timeval(cPeerSacchStartMsecs));
+	}
+}
 
-	const GSM::L3ChannelDescription desc = chan->channelDescription();
-#if 1
-	// Build the L3 HandoverCommand that BS1 will send to the phone to tell it to come to us, BS2.
-	L3HandoverCommand handoverMsg(
-		GSM::L3CellDescription(gTRX.C0(),gBTS.NCC(),gBTS.BCC()),
-		GSM::L3ChannelDescription2(desc),
-		GSM::L3HandoverReference(horef),
-		GSM::L3PowerCommandAndAccessType(),
-		GSM::L3SynchronizationIndication(true, true));
+void PeerInterface::acceptHandover(const struct sockaddr_in* peer, unsigned oldTransID, GSM::L2LogicalChannel *chan, unsigned horef,
+	const PeerMessage *request, const Timeval &when)
+{
+	PeerDeferred pd;
+	pd.pdPeer = *peer;
+	pd.pdOtherTransID = oldTransID;
+	pd.pdBinary = request != NULL;
+	if (request) {
+		pd.pdReply = newMessage(PeerHandoverResponse,oldTransID);
+		pd.pdReply.addNum(PeerIECause,0);
+		pd.pdReply.addString(PeerIECommand,handoverCommand(chan,horef,true));
+	} else {
+		pd.pdText = format("RSP HANDOVER %u 0 0x%s",oldTransID,handoverCommand(chan,horef,false).c_str());
+	}
 
-	L3Frame handoverFrame(handoverMsg);
-	string handoverHex = handoverFrame.hexstr();
-	char rsp[50];
-	sprintf(rsp,"RSP HANDOVER %u 0 0x%s",oldTransID,handoverHex.c_str());
-#else
-	char rsp[50];
-	sprintf(rsp,"RSP HANDOVER %u 0  %u  %u %u %u  %u %u %u %u",
-		oldTransID,
-		horef,
-		gTRX.C0(), gBTS.NCC(), gBTS.BCC(),
-		desc.typeAndOffset(), desc.TN(), desc.TSC(), desc.ARFCN()
-		);
-#endif
-	sendMessage(peer,rsp);
-	return;
+	if (when.passed()) {
+		if (request) {
+			sendReply(peer,*request,pd.pdReply);
+		} else {
+			sendMessage(peer,pd.pdText.c_str());
+		}
+		return;
+	}
+
+	if (request) { pd.pdReply.addNum(PeerIEReplyTo,request->seq()); }
+	pd.pdWhen = when;
+	ScopedLock lock(mStateLock);
+	mDeferred.push_back(pd);
+}
+
+bool PeerInterface::acceptDeferred(const struct sockaddr_in* peer, unsigned otherTransID)
+{
+	ScopedLock lock(mStateLock);
+	for (PeerDeferredList::iterator it = mDeferred.begin(); it != mDeferred.end(); it++) {
+		if (it->pdOtherTransID == otherTransID && samePeer(&it->pdPeer,peer)) { return true; }
+	}
+	return false;
+}
+
+bool PeerInterface::takeReservation(const struct sockaddr_in* peer, unsigned otherTransID, PeerReservation &res)
+{
+	ScopedLock lock(mStateLock);
+	for (PeerReservationList::iterator it = mReservations.begin(); it != mReservations.end(); it++) {
+		if (it->prOtherTransID == otherTransID && samePeer(&it->prPeer,peer)) {
+			bool valid = !it->prExpiry.passed();
+			if (valid) { res = *it; }
+			mReservations.erase(it);
+			return valid;
+		}
+	}
+	return false;
+}
+
+// This is BS2, asked by BS1 to get ready for a handover that is likely but not yet decided.
+void PeerInterface::handoverPrepare(const struct sockaddr_in* peer, const PeerMessage &request)
+{
+	unsigned oldTransID = request.tranID();
+	PeerMessage rsp = newMessage(PeerHandoverPrepared,oldTransID);
+
+	NeighborEntry nentry;
+	if (! gNeighborTable.ntFindByPeerAddr(peer, &nentry)) {
+		LOG(WARNING)<<"Could not find handover neighbor from peer address:"<< sockaddr2string(peer, true);
+		return;
+	}
+
+	// A repeated request gets the reservation we already made.
+	long hold = 0;
+	unsigned reservations;
+	{
+		ScopedLock lock(mStateLock);
+		for (PeerReservationList::iterator it = mReservations.begin(); it != mReservations.end(); it++) {
+			if (it->prOtherTransID == oldTransID && samePeer(&it->prPeer,peer)) { hold = it->prExpiry.remaining(); }
+		}
+		reservations = mReservations.size();
+	}
+
+	if (hold <= 0) {
+		// A reservation is only a guess, so it may not take the last free channel from a local call.
+		GSM::L2LogicalChannel *chan = NULL;
+		if (!gBTS.btsHold() && reservations < cPeerMaxReservations && gBTS.TCHTotal() > gBTS.TCHActive() + 1) {
+			chan = gBTS.getTCH();
+		}
+		if (!chan) {
+			LOG(INFO) << "no channel to reserve for handover from " << sockaddr2string(peer,true)<<LOGVAR(oldTransID);
+			rsp.addNum(PeerIECause,101);	// RR Cause 101 "cell allocation not available"
+			sendReply(peer,request,rsp);
+			return;
+		}
+
+		PeerReservation res;
+		res.prPeer = *peer;
+		res.prOtherTransID = oldTransID;
+		res.prChan = chan;
+		res.prRef = 0xff & (++mReferenceCounter);
+		// Start the channel now, so the SACCH start-up is out of the way when REQ HANDOVER comes.
+		// It restarts T3101, which releases the channel if the handover never happens.
+		chan->lcstart();
+		res.prReady.future(cPeerSacchStartMsecs);
+		// Keep the margin that handoverRequest demands of T3101 for a new channel.
+		hold = T3101ms - 1500;
+		res.prExpiry.future(hold);
+		{
+			ScopedLock lock(mStateLock);
+			mReservations.push_back(res);
+		}
+		LOG(INFO) << "reserved " << chan << " for handover from " << sockaddr2string(peer,true)<<LOGVAR(oldTransID);
+	}
+
+	rsp.addNum(PeerIECause,0);
+	rsp.addNum(PeerIEHold,hold);
+	sendReply(peer,request,rsp);
+}
+
+// This is BS1, told by BS2 whether it reserved a channel for us.
+void PeerInterface::handoverPrepared(const PeerMessage &response)
+{
+	unsigned replyTo, cause, hold = 0;
+	if (!response.getNum(PeerIEReplyTo,replyTo) || !response.getNum(PeerIECause,cause)) {
+		LOG(ERR) << "binary peering message is missing elements: " << response.text();
+		return;
+	}
+	response.getNum(PeerIEHold,hold);
+
+	ScopedLock lock(mStateLock);
+	PeerOutboundMap::iterator it = mOutbound.find(response.tranID());
+	if (it == mOutbound.end() || it->second.poPrepareSeq != replyTo) {
+		LOG(DEBUG) << "stale handover preparation response " << response.text();
+		return;
+	}
+	PeerOutbound &po = it->second;
+	if (cause) {
+		// Leave poPrepareExpiry alone; we will ask again when it passes.
+		LOG(INFO) << "neighbor " << po.poPeer << " cannot prepare for handover of " << response.tranID() <<LOGVAR(cause);
+		return;
+	}
+	po.poPrepared = true;
+	po.poPrepareExpiry.future(hold);
 }
 
 void PeerInterface::processHandoverComplete(const struct sockaddr_in* peer, const char* message)
@@ -577,7 +927,11 @@ void PeerInterface::processHandoverComplete(const struct sockaddr_in* peer, cons
 		LOG(ALERT) << "cannot parse peering message " << message;
 		return;
 	}
+	handoverComplete(peer,transactionID,NULL);
+}
 
+void PeerInterface::handoverComplete(const struct sockaddr_in* peer, unsigned transactionID, const PeerMessage *request)
+{
 	// Don't need to HARDRELEASE channel because that happens (if all is successful) in
 	// outboundHandoverTransfer (Control/CallControl.cpp).
 	// Don't need to remove the transaction because that happens (if all is successful) in 
@@ -588,6 +942,12 @@ void PeerInterface::processHandoverComplete(const struct sockaddr_in* peer, cons
 
 	// FIXME -- We need to speed up channel recycling.  See #816.
 
+	if (request) {
+		PeerMessage ack = newMessage(PeerAck,transactionID);
+		sendReply(peer,*request,ack);
+		return;
+	}
+
 	char rsp[50];
 	sprintf(rsp,"ACK HANDOVER_COMPLETE %u", transactionID);
 	sendMessage(peer,rsp);
@@ -613,11 +973,22 @@ void PeerInterface::processHandoverFailure(const struct sockaddr_in* peer, const
 		LOG(ALERT) << "peering message missing parameters " << message;
 	}
 
+	handoverFailure(peer,transactionID,cause,holdoff,NULL);
+}
+
+void PeerInterface::handoverFailure(const struct sockaddr_in* peer, unsigned transactionID, unsigned cause, unsigned holdoff, const PeerMessage *request)
+{
 	// Set holdoff on this BTS.
 
 	// FIXME -- We need to decide what else to do here.  See #817.
 	gNeighborTable.setHoldOff(peer,holdoff);
 
+	if (request) {
+		PeerMessage ack = newMessage(PeerAck,transactionID);
+		sendReply(peer,*request,ack);
+		return;
+	}
+
 	char rsp[50];
 	sprintf(rsp,"ACK HANDOVER_FAILURE %u", transactionID);
 	sendMessage(peer,rsp);
@@ -634,17 +1005,41 @@ void PeerInterface::processHandoverResponse(const struct sockaddr_in* peer, cons
 	unsigned cause;
 	unsigned transactionID;
 	LOG(DEBUG) <<LOGVAR(message);
-#if 1
 	// This is "Handover Accept" in the ladder diagram; we are "BS1" receiving it.
 	// FIXME -- Error-check for correct message format.
 	char handoverCommandBuffer[82]; handoverCommandBuffer[0] = 0;
 	int n = sscanf(message,"RSP HANDOVER %u %u 0x%80s", &transactionID, &cause, handoverCommandBuffer);
 
+	if (n >= 2 && cause) {
+		handoverResponse(transactionID,cause,"");
+		return;
+	}
+
 	if (n < 3 || strlen(handoverCommandBuffer) < 4) {	// It is bigger than 8.  I'm just quickly checking for emptiness.
 		LOG(ERR) << "Invalid peering handover message:"<<message;
 		return;
 	}
 
+	handoverResponse(transactionID,cause,handoverCommandBuffer);
+}
+
+void PeerInterface::handoverResponse(unsigned transactionID, unsigned cause, const string &hexCommand)
+{
+	// The request is answered either way, so this is the end of the preparation.
+	uint64_t requestUsecs = 0;
+	bool prepared = false;
+	{
+		ScopedLock lock(mStateLock);
+		PeerOutboundMap::iterator it = mOutbound.find(transactionID);
+		if (it != mOutbound.end()) {
+			PeerOutbound &po = it->second;
+			requestUsecs = po.poRequestUsecs;
+			prepared = po.poPrepared;
+			if (po.poRequestSeq) { mPending.erase(po.poRequestSeq); }
+			mOutbound.erase(it);
+		}
+	}
+
 	if (cause) {
 		LOG(NOTICE) << "handover of" <<LOGVAR(transactionID) << " refused with"<<LOGVAR(cause);
 		return;
@@ -657,44 +1052,17 @@ void PeerInterface::processHandoverResponse(const struct sockaddr_in* peer, cons
 		return;
 	}
 	HandoverEntry *hop = transaction->getHandoverEntry(true);
-	hop->mHexEncodedL3HandoverCommand = string(handoverCommandBuffer);
+	hop->mHexEncodedL3HandoverCommand = hexCommand;
 	transaction->setGSMState(CCState::HandoverOutbound);
-#else
-	unsigned reference;
-	unsigned C0, NCC, BCC;
-	unsigned typeAndOffset, TN, TSC, ARFCN;
-
-	// This is "Handover Accept" in the ladder diagram; we are "BS1" receiving it.
-	// FIXME -- Error-check for correct message format.
-	sscanf(message,"RSP HANDOVER %u %u  %u  %u %u %u  %u %u %u %u",
-		&transactionID, &cause,
-		&reference,
-		&C0, &NCC, &BCC,
-		&typeAndOffset, &TN, &TSC, &ARFCN
-		);
 
-	if (cause) {
-		LOG(NOTICE) << "handover of transaction " << transactionID << " refused with cause " << cause;
-		return;
+	// Duplicate responses to a repeated request find no entry and are not counted.
+	if (requestUsecs) {
+		static const ReportHistogram sPreparationReport = gReports.lookupHistogram("OpenBTS.GSM.RR.Handover.PreparationMsecs");
+		unsigned msecs = (reportUsecs() - requestUsecs) / 1000;
+		gReports.sample(sPreparationReport,msecs);
+		LOG(INFO) << "handover of " << transactionID << " prepared in " << msecs << " ms"
+			<< (prepared ? " with a reserved channel" : "");
 	}
-
-	Control::TranEntry *transaction = gNewTransactionTable.ttFindById(transactionID);
-	if (!transaction) {
-		LOG(NOTICE) << "received handover response with no matching transaction " << transactionID;
-		return;
-	}
-
-	// Set the handover parameters and state to HandoverOutbound.
-	// The state change will trigger the call management loop
-	// to send the Handover Command to the handset.
-	transaction->setOutboundHandover(
-		GSM::L3HandoverReference(reference),
-		GSM::L3CellDescription(C0,NCC,BCC),
-		GSM::L3ChannelDescription2((GSM::TypeAndOffset)typeAndOffset,TN,TSC,ARFCN),
-		GSM::L3PowerCommandAndAccessType(),
-		GSM::L3SynchronizationIndication(true, true)
-	);
-#endif
 }
 
 void PeerInterface::sendMessage(const struct sockaddr_in* peer, const char *message)
@@ -704,20 +1072,56 @@ void PeerInterface::sendMessage(const struct sockaddr_in* peer, const char *mess
 	mSocket.send((const struct sockaddr*)peer,message);
 }
 
+void PeerInterface::sendBinary(const struct sockaddr_in* peer, const PeerMessage &msg)
+{
+	logBinary("send",peer,msg);
+	ScopedLock lock(mLock);
+	mSocket.send((const struct sockaddr*)peer,msg.data(),msg.size());
+}
+
+void PeerInterface::sendReliable(const struct sockaddr_in* peer, const PeerMessage &msg)
+{
+	unsigned timeout = gConfig.getNum("Peering.ResendTimeout");
+	unsigned count = gConfig.getNum("Peering.ResendCount");
+	{
+		ScopedLock lock(mStateLock);
+		PeerPending &pp = mPending[msg.seq()];
+		pp.ppPeer = *peer;
+		pp.ppData.assign(msg.data(),msg.size());
+		pp.ppNext.future(timeout);
+		pp.ppTries = count - 1;
+	}
+	sendBinary(peer,msg);
+}
+
+void PeerInterface::sendReply(const struct sockaddr_in* peer, const PeerMessage &request, PeerMessage &reply)
+{
+	reply.addNum(PeerIEReplyTo,request.seq());
+	sendBinary(peer,reply);
+}
+
 // (pat) The FIFO is specific to the transaction id, which is why there cant be any other acks in there.
 // We may leave a whole bunch of acks in the fifo but the fifo is used solely for this single message
 // and is destroyed when the TranEntry is destroyed.
-bool PeerInterface::sendUntilAck(const Control::HandoverEntry* hop, const char* message)
+bool PeerInterface::sendUntilAck(const Control::HandoverEntry* hop, const char* message, PeerMessage &binary)
 {
-	LOG(DEBUG) << "sending message until ACK: " << message;
 	const struct sockaddr_in* peer = &hop->mInboundPeer;
 	char *ack = NULL;
 	unsigned timeout = gConfig.getNum("Peering.ResendTimeout");
 	unsigned count = gConfig.getNum("Peering.ResendCount");
-	while (!ack && count>0) {
-		sendMessage(peer,message);
-		ack = mFIFOMap.readFIFO(hop->tranID(),timeout);
-		count--;
+	if (peerIsBinary(peer)) {
+		// The service loop resends it; we only wait for the ACK.
+		LOG(DEBUG) << "sending message until ACK: " << binary.text();
+		sendReliable(peer,binary);
+		ack = mFIFOMap.readFIFO(hop->tranID(),timeout*count);
+		if (!ack) { stopPending(binary.seq()); }
+	} else {
+		LOG(DEBUG) << "sending message until ACK: " << message;
+		while (!ack && count>0) {
+			sendMessage(peer,message);
+			ack = mFIFOMap.readFIFO(hop->tranID(),timeout);
+			count--;
+		}
 	}
 
 	// Timed out?
@@ -745,28 +1149,93 @@ void PeerInterface::sendHandoverComplete(const Control::HandoverEntry* hop)
 {
 	char ind[100];
 	sprintf(ind,"IND HANDOVER_COMPLETE %u", hop->tranID());
-	gPeerInterface.sendUntilAck(hop,ind);
+	PeerMessage binary = newMessage(PeerHandoverComplete,hop->tranID());
+	gPeerInterface.sendUntilAck(hop,ind,binary);
 }
 
 void PeerInterface::sendHandoverFailure(const Control::HandoverEntry *hop, GSM::RRCause cause,unsigned holdoff)
 {
 	char ind[100];
 	sprintf(ind,"IND HANDOVER_FAILURE %u %u %u", hop->tranID(),cause,holdoff);
-	gPeerInterface.sendUntilAck(hop,ind);
+	PeerMessage binary = newMessage(PeerHandoverFailure,hop->tranID());
+	binary.addNum(PeerIECause,cause);
+	binary.addNum(PeerIEHoldoff,holdoff);
+	gPeerInterface.sendUntilAck(hop,ind,binary);
 }
 
 bool PeerInterface::sendHandoverRequest(string peer, const RefCntPointer<TranEntry> tran, string cause)
 {
-	string msg = string("REQ HANDOVER ") + tran->handoverString(peer,cause);
+	string params = tran->handoverString(peer,cause);
 	struct sockaddr_in peerAddr;
 	if (!resolveAddress(&peerAddr,peer.c_str())) {
 		LOG(ALERT) << "cannot resolve peer address " << peer;
 		return false;
 	}
+
+	unsigned tranID = tran->tranID();
+	bool binary = peerIsBinary(peer);
+	{
+		ScopedLock lock(mStateLock);
+		PeerOutbound &po = mOutbound[tranID];
+		if (po.poPeer != peer) {
+			po = PeerOutbound();
+			po.poPeer = peer;
+		}
+		if (!po.poRequestUsecs) { po.poRequestUsecs = reportUsecs(); }
+		// HandoverDetermination calls us on every measurement report until RSP HANDOVER arrives,
+		// but a binary request is already being resent on its own timer.
+		if (binary && po.poRequestSeq && mPending.count(po.poRequestSeq)) { return true; }
+	}
+
+	if (binary) {
+		PeerMessage msg = newMessage(PeerHandoverRequest,tranID);
+		msg.addString(PeerIEParams,params);
+		{
+			ScopedLock lock(mStateLock);
+			mOutbound[tranID].poRequestSeq = msg.seq();
+		}
+		sendReliable(&peerAddr,msg);
+		return true;
+	}
+
+	string msg = string("REQ HANDOVER ") + params;
 	//LOG(INFO) <<LOGVAR(peer) <<LOGVAR(msg);
 	LOG(DEBUG) <<LOGVAR(peer) <<LOGVAR(msg);
 	gPeerInterface.sendMessage(&peerAddr,msg.c_str());
 	return true;
 }
 
+void PeerInterface::sendHandoverPrepare(string peer, const RefCntPointer<TranEntry> tran)
+{
+	if (!peerIsBinary(peer)) { return; }	// There is no text form of this message.
+
+	struct sockaddr_in peerAddr;
+	if (!resolveAddress(&peerAddr,peer.c_str())) {
+		LOG(ALERT) << "cannot resolve peer address " << peer;
+		return;
+	}
+
+	unsigned tranID = tran->tranID();
+	unsigned retry = gConfig.getNum("Peering.ResendTimeout") * gConfig.getNum("Peering.ResendCount");
+	PeerMessage msg = newMessage(PeerHandoverPrepare,tranID);
+	{
+		ScopedLock lock(mStateLock);
+		PeerOutbound &po = mOutbound[tranID];
+		if (po.poPeer != peer) {
+			po = PeerOutbound();
+			po.poPeer = peer;
+		} else if (!po.poPrepareExpiry.passed()) {
+			return;		// Already asked, or already prepared.
+		}
+		po.poPrepared = false;
+		po.poPrepareSeq = msg.seq();
+		// If the neighbor never answers, ask again once the resends have run out.
+		po.poPrepareExpiry.future(retry);
+	}
+
+	msg.addString(PeerIEIMSI,tran->subscriber().mImsi);
+	LOG(INFO) << "asking " << peer << " to prepare for handover of " << tranID;
+	sendReliable(&peerAddr,msg);
+}
+
 };
@@ -26,6 +26,10 @@
 #include <Utils.h>
 //#include <ControlTransfer.h>
 #include <GSML3RRElements.h>
+#include "PeerMessage.h"
+
+#include <list>
+#include <map>
 
 
 namespace Control {
@@ -33,6 +37,10 @@ class TranEntry;
 class HandoverEntry;
 };
 
+namespace GSM {
+class L2LogicalChannel;
+};
+
 
 
 namespace Peering {
@@ -89,10 +97,60 @@ class PeerInterface {
 	Mutex mLock;
 
 	volatile unsigned mReferenceCounter;
+	volatile uint32_t mSequence;		///< sequence number of the last binary message sent
 
 	Thread mServer1;
 	Thread mServer2;
 
+	/** A binary message waiting for its reply or ACK. */
+	struct PeerPending {
+		struct ::sockaddr_in ppPeer;
+		std::string ppData;
+		Timeval ppNext;				///< when to send it again
+		unsigned ppTries;			///< sends left
+	};
+	typedef std::map<uint32_t,PeerPending> PeerPendingMap;
+
+	/** A channel this BTS (BS2) has reserved for a handover a neighbor expects to make. */
+	struct PeerReservation {
+		struct ::sockaddr_in prPeer;
+		unsigned prOtherTransID;	///< transaction on the neighbor
+		GSM::L2LogicalChannel *prChan;
+		unsigned prRef;				///< handover reference
+		Timeval prReady;			///< SACCH is running after this
+		Timeval prExpiry;			///< give up on it after this, well before T3101 releases the channel
+	};
+	typedef std::list<PeerReservation> PeerReservationList;
+
+	/** An outbound handover on this BTS (BS1), by transaction ID. */
+	struct PeerOutbound {
+		std::string poPeer;
+		uint32_t poRequestSeq;		///< binary REQ HANDOVER being retransmitted, or 0
+		uint64_t poRequestUsecs;	///< when REQ HANDOVER was first sent, or 0
+		uint32_t poPrepareSeq;		///< binary REQ HANDOVER_PREPARE being retransmitted, or 0
+		bool poPrepared;			///< the neighbor holds a channel for us
+		Timeval poPrepareExpiry;	///< ask the neighbor again after this
+		PeerOutbound() : poRequestSeq(0), poRequestUsecs(0), poPrepareSeq(0), poPrepared(false) {}
+	};
+	typedef std::map<unsigned,PeerOutbound> PeerOutboundMap;
+
+	/** An accepting RSP HANDOVER held back until SACCH is running on the channel it offers. */
+	struct PeerDeferred {
+		struct ::sockaddr_in pdPeer;
+		unsigned pdOtherTransID;	///< transaction on the neighbor
+		bool pdBinary;
+		PeerMessage pdReply;		///< the binary reply, if pdBinary
+		std::string pdText;			///< the text reply, otherwise
+		Timeval pdWhen;				///< send it after this
+	};
+	typedef std::list<PeerDeferred> PeerDeferredList;
+
+	Mutex mStateLock;					///< protects the four tables below; never held while taking mLock
+	PeerPendingMap mPending;
+	PeerReservationList mReservations;
+	PeerOutboundMap mOutbound;
+	PeerDeferredList mDeferred;
+
 	/**
 		Send a message repeatedly until the ACK arrives.
 		@param transaction Carries the peer address and transaction ID.
@@ -100,7 +158,7 @@ class PeerInterface {
 		@erturn true on ack, false on timeout
 	*/
 	// (pat) Made this private and put the methods that use it in Peering.cpp
-	bool sendUntilAck(const Control::HandoverEntry*, const char* message);
+	bool sendUntilAck(const Control::HandoverEntry*, const char* message, PeerMessage &binary);
 	/**
 		Send a message on the peering interface.
 		@param IP The IP address of the remote peer.
@@ -108,6 +166,52 @@ class PeerInterface {
 	*/
 	void sendMessage(const struct ::sockaddr_in* peer, const char* message);
 
+	/** Send a binary message once. */
+	void sendBinary(const struct ::sockaddr_in* peer, const PeerMessage &msg);
+
+	/** Send a binary message and keep sending it every Peering.ResendTimeout until answered. */
+	void sendReliable(const struct ::sockaddr_in* peer, const PeerMessage &msg);
+
+	/** Send a binary reply to a binary request. */
+	void sendReply(const struct ::sockaddr_in* peer, const PeerMessage &request, PeerMessage &reply);
+
+	/** Start a binary message. */
+	PeerMessage newMessage(PeerMessageType type, unsigned tranID)
+		{ return PeerMessage(type,__sync_add_and_fetch(&mSequence,1),tranID); }
+
+	/** True if this peer takes binary messages. */
+	bool peerIsBinary(const struct ::sockaddr_in* peer);
+	bool peerIsBinary(const string &peer);
+
+	/** Stop retransmitting a binary message. */
+	void stopPending(uint32_t seq);
+
+	/** Resend unanswered binary messages, send deferred replies and drop expired reservations. */
+	void serviceTimers();
+
+	/** Accept a REQ HANDOVER with the handover command for this channel, once the time comes. */
+	void acceptHandover(const struct ::sockaddr_in* peer, unsigned oldTransID, GSM::L2LogicalChannel *chan, unsigned horef,
+		const PeerMessage *request, const Timeval &when);
+
+	/** True if the accepting reply to this neighbor transaction is still waiting to be sent. */
+	bool acceptDeferred(const struct ::sockaddr_in* peer, unsigned otherTransID);
+
+	/** Take the channel reserved for this neighbor transaction, if any. */
+	bool takeReservation(const struct ::sockaddr_in* peer, unsigned otherTransID, PeerReservation &res);
+
+	/** Parse and dispatch a binary message. */
+	void processBinary(const struct ::sockaddr_in* peer, const char* data, size_t len);
+
+	//@{
+	/** The message handlers shared by the text and binary formats; request is NULL for a text message. */
+	void handoverRequest(const struct ::sockaddr_in* peer, unsigned oldTransID, SimpleKeyValue &params, const PeerMessage *request);
+	void handoverResponse(unsigned transactionID, unsigned cause, const string &hexCommand);
+	void handoverComplete(const struct ::sockaddr_in* peer, unsigned transactionID, const PeerMessage *request);
+	void handoverFailure(const struct ::sockaddr_in* peer, unsigned transactionID, unsigned cause, unsigned holdoff, const PeerMessage *request);
+	void handoverPrepare(const struct ::sockaddr_in* peer, const PeerMessage &request);
+	void handoverPrepared(const PeerMessage &response);
+	//@}
+
 	public:
 
 	/** Initialize the interface.  */
@@ -170,6 +274,13 @@ class PeerInterface {
 	/** Send REQ HANDOVER */
 	bool sendHandoverRequest(string peer, const RefCntPointer<Control::TranEntry> tran, string cause);
 
+	/**
+		Ask the neighbor to reserve a channel for a handover that looks likely,
+		so that REQ HANDOVER is answered without waiting for a channel.
+		Only sent to neighbors that take binary messages, and at most once per reservation.
+	*/
+	void sendHandoverPrepare(string peer, const RefCntPointer<Control::TranEntry> tran);
+
 	//@}
 };
 
@@ -0,0 +1,162 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+// Sends hand built RTP packets over the loopback to a stream on the RTP engine.
+// The engine must find the payload after any CSRCs and header extension and without the padding,
+// and must drop a packet whose header runs past its end instead of playing out part of the header.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <OpenBTSConfig.h>
+#include "SIPRtpEngine.h"
+
+using namespace std;
+using namespace SIP;
+
+OpenBTSConfig gConfig;
+
+static const unsigned cTestPort = 16484;
+static const unsigned cPayloadType = 3;
+static const unsigned cFrameLen = 33;
+
+static int failures = 0;
+
+// Build a packet with cc CSRCs, an extension of extWords words if ext is set, and padding bytes of padding.
+// Each packet gets its own SSRC, so the stream resyncs on it and plays it out on the next tick.
+static unsigned buildPacket(unsigned char *pkt, uint32_t ssrc, unsigned cc, bool ext, unsigned extWords, unsigned padding)
+{
+	unsigned len = 0;
+	pkt[len++] = 0x80 | (padding ? 0x20 : 0) | (ext ? 0x10 : 0) | cc;
+	pkt[len++] = cPayloadType;
+	pkt[len++] = 0; pkt[len++] = 1;
+	pkt[len++] = 0; pkt[len++] = 0; pkt[len++] = 0x10; pkt[len++] = 0;
+	pkt[len++] = ssrc >> 24; pkt[len++] = ssrc >> 16; pkt[len++] = ssrc >> 8; pkt[len++] = ssrc;
+	for (unsigned i = 0; i < 4 * cc; i++) { pkt[len++] = 0xcc; }
+	if (ext) {
+		pkt[len++] = 0xbe; pkt[len++] = 0xde;
+		pkt[len++] = extWords >> 8; pkt[len++] = extWords;
+		for (unsigned i = 0; i < 4 * extWords; i++) { pkt[len++] = 0xee; }
+	}
+	for (unsigned i = 0; i < cFrameLen; i++) { pkt[len++] = i; }
+	for (unsigned i = 0; i < padding; i++) { pkt[len++] = (i == padding-1) ? padding : 0; }
+	return len;
+}
+
+// Send len bytes of pkt and return the frame played out for it, if any.
+static bool sendAndReceive(RtpStream *stream, int sock, const unsigned char *pkt, unsigned len, RtpMediaFrame &frame)
+{
+	struct sockaddr_in to;
+	memset(&to,0,sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	to.sin_port = htons(cTestPort);
+	sendto(sock,pkt,len,0,(struct sockaddr*)&to,sizeof(to));
+	usleep(100*1000);	// Five ticks of the play out clock.
+	bool got = false;
+	while (RtpMediaFrame *f = stream->rsRxFront()) {
+		frame = *f;
+		got = true;
+		stream->rsRxPop();
+	}
+	return got;
+}
+
+static void expectFrame(const char *name, RtpStream *stream, int sock, const unsigned char *pkt, unsigned len)
+{
+	RtpMediaFrame frame;
+	if (!sendAndReceive(stream,sock,pkt,len,frame)) {
+		printf("%s: no frame\n",name);
+		failures++;
+		return;
+	}
+	bool good = frame.mLength == cFrameLen;
+	for (unsigned i = 0; good && i < cFrameLen; i++) { good = frame.mData[i] == i; }
+	printf("%s: %u byte frame%s\n",name,frame.mLength,good ? "" : ", wrong payload");
+	if (!good) { failures++; }
+}
+
+static void expectNothing(const char *name, RtpStream *stream, int sock, const unsigned char *pkt, unsigned len)
+{
+	RtpMediaFrame frame;
+	if (sendAndReceive(stream,sock,pkt,len,frame)) {
+		printf("%s: played out a %u byte frame\n",name,frame.mLength);
+		failures++;
+		return;
+	}
+	printf("%s: dropped\n",name);
+}
+
+int main(int argc, char **argv)
+{
+	gConfig.set("RTP.Engine","1");
+	gConfig.set("RTP.Engine.Threads","1");
+	rtpEngineStart();
+
+	int sock = socket(AF_INET,SOCK_DGRAM,0);
+	struct sockaddr_in local;
+	memset(&local,0,sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(sock,(struct sockaddr*)&local,sizeof(local));
+	socklen_t localLen = sizeof(local);
+	getsockname(sock,(struct sockaddr*)&local,&localLen);
+
+	RtpStream *stream = RtpStream::rsOpen(cTestPort,"127.0.0.1",ntohs(local.sin_port),cPayloadType,0,0);
+	if (stream == NULL) {
+		printf("cannot open RTP stream\nFAILED\n");
+		return 1;
+	}
+
+	unsigned char pkt[200];
+	unsigned len;
+	len = buildPacket(pkt,1,0,false,0,0);
+	expectFrame("plain",stream,sock,pkt,len);
+	len = buildPacket(pkt,2,3,false,0,0);
+	expectFrame("3 CSRCs",stream,sock,pkt,len);
+	len = buildPacket(pkt,3,0,true,2,0);
+	expectFrame("extension",stream,sock,pkt,len);
+	len = buildPacket(pkt,4,0,false,0,4);
+	expectFrame("padding",stream,sock,pkt,len);
+	len = buildPacket(pkt,5,2,true,1,3);
+	expectFrame("CSRCs, extension and padding",stream,sock,pkt,len);
+
+	// The extension bit is set but the packet ends before the extension header.
+	len = buildPacket(pkt,6,0,true,0,0);
+	expectNothing("truncated extension header",stream,sock,pkt,cRtpHeaderBytes + 2);
+	len = buildPacket(pkt,7,2,true,0,0);
+	expectNothing("CSRCs then truncated extension header",stream,sock,pkt,cRtpHeaderBytes + 8 + 3);
+	// The extension length runs past the end of the packet.
+	len = buildPacket(pkt,8,0,true,0,0);
+	pkt[cRtpHeaderBytes+3] = 100;
+	expectNothing("extension longer than the packet",stream,sock,pkt,len);
+	// The padding count is the whole packet.
+	len = buildPacket(pkt,9,0,false,0,4);
+	pkt[len-1] = len;
+	expectNothing("padding longer than the packet",stream,sock,pkt,len);
+
+	// And the stream still works.
+	len = buildPacket(pkt,10,1,true,1,0);
+	expectFrame("after the bad ones",stream,sock,pkt,len);
+
+	stream->rsClose();
+	close(sock);
+	printf(failures ? "FAILED\n" : "PASSED\n");
+	return failures ? 1 : 0;
+}
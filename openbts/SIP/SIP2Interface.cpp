@@ -143,6 +143,8 @@ void SipDialogMap::dmAddLocalTag(SipDialog *dialog)
 bool SipDialogMap::dmRemoveDialog(SipBase *dialog)
 {
 	string callid = dialog->callId(), localtag = dialog->dsLocalTag();
+	// Take it off the timer wheel first; only dialogs in the map may be on the wheel, because the map keeps them alive.
+	SipTimerWheel::stwDetach(dialog);
 	SipDialogRef dialog1;
 	bool extant1 = mDialogMap.getNoBlock(makeTagKey(callid,localtag),dialog1);	// Removes the element.
 	if (extant1) {
@@ -154,6 +156,7 @@ bool SipDialogMap::dmRemoveDialog(SipBase *dialog)
 		gSipInterface.mDeadDialogs.push_back(dialog2);
 	}
 	LOG(DEBUG) << LOGVAR(callid) <<LOGVAR(localtag) <<LOGVAR(extant1) <<LOGVAR(extant2);
+	if (extant1 || extant2) { SipTimerWheel::stwWakeup(); }	// So the service loop starts polling mDeadDialogs.
 	return extant1;
 }
 
@@ -178,6 +181,7 @@ void SipDialogMap::dmAddCallDialog(SipDialog*dialog)
 	// Calling SipDialogRef here 'takes over' the deallocation of the Dialog from this point on;
 	// The dialog will be deleted when the last reference to it is decremented.
 	mDialogMap.write(key,SipDialogRef(dialog));
+	mDialogWheel.stwAttach(dialog);
 }
 
 
@@ -197,20 +201,21 @@ void MySipInterface::iterateDialogs(SipDialogMethodPointer method)
 }
 #endif
 
+// Formerly this polled every dialog in the map.  Now the timer wheel hands us just the dialogs
+// whose earliest timer has expired or whose SIP state has changed.
 void SipDialogMap::dmPeriodicService() 
 {
 	try {
-#if USE_SCOPED_ITERATORS
-		DialogMap_t::ScopedIterator it(mDialogMap);
-#else
+		// Dialogs are detached from the wheel before they leave the map, so holding the map lock keeps them alive.
 		ScopedLock lock(mDialogMap.qGetLock());
-		DialogMap_t::iterator it;
-#endif
-		for (it = mDialogMap.begin(); it != mDialogMap.end(); ) {
-			SipDialogRef dialog = it->second;
-			it++;
+		mDialogWheel.stwAdvance();
+		while (SipTimerClient *client = mDialogWheel.stwPop()) {
+			SipDialogRef dialog(dynamic_cast<SipDialog*>(static_cast<SipBaseProtected*>(client)));
+			if (! dialog.self()) { continue; }
 			if (dialog->dialogPeriodicService()) {
 				gSipInterface.dmRemoveDialog(dialog.self());
+			} else {
+				dialog->stcRearm();
 			}
 		}
 	} catch(exception &e) {
@@ -226,6 +231,7 @@ void SipDialogMap::dmPeriodicService()
 void SipTUMap::tuMapAdd(SipTransaction*tup) {
 	LOG(DEBUG) <<LOGVAR(tup);
 	string key = tuMakeKey(tup);
+	ScopedLock lock(mTUMap.qGetLock());
 	if (SipTransaction *existingTU = mTUMap.readNoBlock(key)) {
 		LOG(ERR) << "Warning: adding second SipTransaction with branch:"<<tup->stBranch()
 				<<LOGVAR(key) <<LOGVAR(existingTU) <<LOGVAR(tup);
@@ -233,6 +239,8 @@ void SipTUMap::tuMapAdd(SipTransaction*tup) {
 	// Deletes the old.
 	// Take care not to create deadlock here?  To delete the old SipTransaction we have to lock it.
 	mTUMap.write(key,tup);
+	// A TU is detached from the wheel by its destructor, which is run from inside mTUMap with the lock held.
+	mTUWheel.stwAttach(tup);
 }
 
 void SipTUMap::tuMapRemove(SipTransaction*tup, bool /*whine*/) {
@@ -240,18 +248,20 @@ void SipTUMap::tuMapRemove(SipTransaction*tup, bool /*whine*/) {
 	mTUMap.remove(tuMakeKey(tup));	// This deletes it!
 }
 
+// Service the TUs whose timers have expired or that have terminated.
 void SipTUMap::tuMapPeriodicService() {
 	ScopedLock lock(mTUMap.qGetLock());
 	int cnt = 0;
-	//InterthreadMap<string,SipTransaction>::ScopedIterator sit(mTUMap);
-	for (TUMap_t::iterator sit = mTUMap.begin(); sit != mTUMap.end();) {
-		SipTransaction *me = sit->second;
-		sit++;
+	mTUWheel.stwAdvance();
+	while (SipTimerClient *client = mTUWheel.stwPop()) {
+		SipTransaction *me = static_cast<SipTransaction*>(client);
 		bool deleteme = me->TLPeriodicServiceV();
 		LOG(DEBUG) <<LOGVAR(deleteme)<<LOGVAR(me);
 		if (deleteme) {
 			gSipInterface.tuMapRemove(me,true);
 			cnt++;
+		} else {
+			me->stcRearm();
 		}
 	}
 	if (cnt) LOG(DEBUG) <<"finished, number deleted="<<cnt;
@@ -355,6 +365,9 @@ void SipDialogMap::printDialogs(ostream&os)
 void printDialogs(ostream &os)
 {
 	gSipInterface.printDialogs(os);
+	os << "SIP timer wheels: transactions ("; gSipInterface.tuMapTimerText(os);
+	os << ") dialogs ("; gSipInterface.dmTimerText(os); os << ")\n";
+	rtpEngineText(os);
 }
 
 
@@ -695,19 +708,23 @@ static void driveLoop2( MySipInterface * si)
 	}
 }
 
-// (pat) Every now and then check every SipDialog engine for SIP timer expiration.
+// Service the SIP transactions and dialogs whose timers have expired, then sleep until the next deadline.
+// Arming an earlier deadline from another thread wakes us up.
 static void periodicServiceLoop(MySipInterface *si)
 {
 	while (! gBTS.btsShutdown()) {
 		si->tuMapPeriodicService();
 		si->dmPeriodicService();
 		si->purgeDeadDialogs();
-		// This timing is entirely non-critical, so dont bother to compute the exact next timeout,
-		// just delay a while and retry.
-		// Implicit assumption that Timer.E < Timer.F
-		unsigned howlong = gConfig.getNum("SIP.Timer.E")/2;
-		if (howlong < 250) { howlong = 250; }	// Dont eat all the cpu cycles if someone accidently sets this too low.
-		msleep(howlong);
+		int64_t next = si->tuMapNextServiceTime(), dmnext = si->dmNextServiceTime();
+		if (next < 0 || (dmnext >= 0 && dmnext < next)) { next = dmnext; }
+		// The dead dialogs wait on the L3 transactions, which do not tell us when they finish, so we still poll for those.
+		long maxWait = 10000;
+		if (si->mDeadDialogs.size()) {
+			maxWait = gConfig.getNum("SIP.Timer.E")/2;
+			if (maxWait < 250) { maxWait = 250; }	// Dont eat all the cpu cycles if someone accidently sets this too low.
+		}
+		SipTimerWheel::stwWait(next,maxWait);
 	}
 }
 
@@ -757,6 +774,7 @@ void MySipInterface::msiInit()
 	//ortp_set_log_level_mask(ORTP_MESSAGE|ORTP_WARNING|ORTP_ERROR);
 
 	ortp_set_log_handler(ortpLogFunc);
+	rtpEngineStart();
 
 	mDriveThread.start((void *(*)(void*))driveLoop2, &gSipInterface );
 	mPeriodicServiceThread.start((void *(*)(void*))periodicServiceLoop, &gSipInterface );
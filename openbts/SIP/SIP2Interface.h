@@ -51,6 +51,7 @@ class SipDialogMap {
 	//Mutex mDialogMapLock;
 	typedef InterthreadMap1<string,SipDialogRef> DialogMap_t;
 	DialogMap_t mDialogMap;
+	SipTimerWheel mDialogWheel;		// Every dialog in mDialogMap is attached, and only those.
 	string makeTagKey(string callid, string localTag);
 	public:
 	SipDialogRef findDialogByMsg(SipMessage *msg);
@@ -58,6 +59,8 @@ class SipDialogMap {
 	void dmAddLocalTag(SipDialog*dialog);
 	void printDialogs(ostream&os);
 	void dmPeriodicService();
+	int64_t dmNextServiceTime() { return mDialogWheel.stwNextTime(); }
+	void dmTimerText(ostream &os) { mDialogWheel.stwText(os); }
 	bool dmRemoveDialog(SipBase *dialog);
 	//SipBase *dmFindDialogById(unsigned id);
 	SipDialogRef dmFindDialogByRtp(RtpSession *session);
@@ -75,6 +78,7 @@ class SipDialogMap {
 // would want to view those as multiple identical requests and respond to all but the first with a repeated request error.
 class SipTUMap {
 	InterthreadMap<string,SipTransaction> mTUMap;
+	SipTimerWheel mTUWheel;			// Every TU in mTUMap is attached.
 	// (pat 7-23-2013) We are supposed to use the via-branch to identify the transaction, but unfortunately
 	// sipauthserve is non-compliant and does not return it.
 	string tuMakeKey(string callid, string method, int seqnum) {
@@ -88,6 +92,8 @@ class SipTUMap {
 	void tuMapAdd(SipTransaction*tup);
 	void tuMapRemove(SipTransaction*tup, bool /*whine*/=true);
 	void tuMapPeriodicService();
+	int64_t tuMapNextServiceTime() { return mTUWheel.stwNextTime(); }
+	void tuMapTimerText(ostream &os) { mTUWheel.stwText(os); }
 	// Attempt to dispatch an incoming SIP message to a TU; return true if a transaction wanted this message.
 	// This has to be locked so someone doesnt delete the TU between the time we get its pointer
 	// and send it the message.
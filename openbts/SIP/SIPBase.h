@@ -111,7 +111,9 @@ class SipEngine {
 };
 
 // This class is for variables that not even SipBase is allowed to change directly.
-class SipBaseProtected
+// It is the SipTimerClient for the dialog timers so that a change of SIP state, which may make the dialog deletable,
+// kicks the periodic service.
+class SipBaseProtected : public SipTimerClient
 {
 	virtual void _define_vtable();
 	// You must not change mState without going through setSipState to make sure the state age is updated.
@@ -125,7 +127,7 @@ class SipBaseProtected
 	SipState getSipState() const { return mState; }
 	// (pat) Set the dialog state.  The purpose of this protected class is to enforce that the dialog type is set
 	// only with this method by all internal and external users.
-	void setSipState(SipState wState) { mState=wState; mStateAge.now(); }
+	void setSipState(SipState wState) { mState=wState; mStateAge.now(); stcKick(); }
 
 	/** Return TRUE if it looks like the SIP session is stuck indicating some internal error. */
 	bool sipIsStuck() const;
@@ -370,7 +370,7 @@ bool SipMOInviteClientTransactionLayer::moPeriodicService()
 		// The HANDOVER is inbound, but the invite is outbound like MOC.
 		if (getSipState() == Starting || getSipState() == HandoverInbound || getSipState() == MOSMSSubmit) {
 			sipWrite(getInvite());
-			mTimerAE.setDouble();
+			mTimerAE.setDouble(dgIsInvite() ? 64*T1 : T2);	// Timer A for INVITE, Timer E for MESSAGE.
 		} else {
 			mTimerAE.stop();
 		}
@@ -382,6 +382,8 @@ bool SipMOInviteClientTransactionLayer::moPeriodicService()
 	} else if (mTimerK.expired()) {		// Normal exit delay to absorb resends.
 		stopTimers();
 		if (! dgIsInvite()) { return true; }	// It is a SIP MESSAGE.
+		// There are no timers left to bring us back here, so check now whether the dialog is done.
+		return sipIsFinished();
 	} else if (sipIsFinished()) {
 		// If one of the kill timers is active, wait for it to expire, otherwise kill now.
 		return (mTimerBF.isActive() || mTimerD.isActive() || mTimerK.isActive()) ? false : true;
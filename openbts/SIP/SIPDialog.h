@@ -66,6 +66,7 @@ class SipInviteServerTransactionLayerBase: public SipTimers, public virtual SipD
 	// This is used by inbound BYE or CANCEL.  We dont care which because both kill off the dialog.
 	SipTimer mTimerJ;
 	void setTimerJ() { if (!dsPeer()->ipIsReliableTransport()) { mTimerJ.setOnce(64 * T1); } }
+	SipInviteServerTransactionLayerBase() { stcRegister(&mTimerJ); }
 	void SipMTBye(SipMessage *sipmsg);
 	void SipMTCancel(SipMessage *sipmsg);
 };
@@ -100,6 +101,8 @@ class SipMTInviteServerTransactionLayer : public virtual SipInviteServerTransact
 	void setTimerH() { if (!dsPeer()->ipIsReliableTransport()) { mTimerH.setOnce(64 * T1); } }
 
 	protected:
+	SipMTInviteServerTransactionLayer() { stcRegister(&mTimerG); stcRegister(&mTimerH); }
+
 	void mtWriteLowSide(SipMessage *sipmsg) {	// Outgoing message.
 		mtLastResponse = *sipmsg;
 		sipWrite(sipmsg);
@@ -139,6 +142,9 @@ class SipMOInviteClientTransactionLayer : public virtual SipInviteServerTransact
 	// Timers K and D are for non-invite client transactions, MO BYE and MO CANCEL.
 	SipTimer mTimerK;	// Timeout destroys dialog.
 	SipTimer mTimerD;	// Timeout destroys dialog.
+	SipMOInviteClientTransactionLayer() {
+		stcRegister(&mTimerAE); stcRegister(&mTimerBF); stcRegister(&mTimerK); stcRegister(&mTimerD);
+	}
 	void MOCSendINVITE(const L3LogicalChannel *chan = NULL);
 	void MOUssdSendINVITE(string ussd, const L3LogicalChannel *chan = NULL);
 	void handleSMSResponse(SipMessage *sipmsg);
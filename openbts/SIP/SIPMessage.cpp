@@ -283,10 +283,11 @@ string SipMessage::smPopVia()		// Pop and return the top via; modifies msmVias.
 
 string SipMessage::smGetProxy() const
 {
-	string topvia = commaListFront(msmVias);
-	if (topvia.empty()) { return string(""); }	// oops
-	SipVia via(topvia);
-	return via.mSentBy;
+	if (msmVias.empty()) { return string(""); }	// oops
+	// sipDecodeVia stops at the comma after the top via.
+	string sentBy, branch;
+	if (! sipDecodeVia(SipSlice(msmVias),&sentBy,&branch)) { LOG(ERR) << "Error parsing via:"<<msmVias; }
+	return sentBy;
 }
 
 void SipMessage::addCallTerminationReasonSM(CallTerminationCause::termGroup group, int cause, string desc) {
@@ -297,7 +298,9 @@ void SipMessage::addCallTerminationReasonSM(CallTerminationCause::termGroup grou
 
 string SipMessage::smGetBranch()
 {
-	return SipVia(msmVias).mViaBranch;
+	string sentBy, branch;
+	if (! sipDecodeVia(SipSlice(msmVias),&sentBy,&branch)) { LOG(ERR) << "Error parsing via:"<<msmVias; }
+	return branch;
 }
 
 string SipMessage::smGetReturnIPAndPort()
@@ -20,6 +20,8 @@
 #include <string.h>
 #include <Logger.h>
 #include <stdlib.h>
+#include <time.h>
+#include <iomanip>
 #include <CodecSet.h>
 #include <GSML3CCElements.h>
 #include "SIPParse.h"
@@ -30,6 +32,8 @@
 namespace SIP {
 using namespace std;
 
+#define NUMIES(tab) (sizeof(tab)/sizeof(tab[0]))
+
 struct SipParseError : public std::exception {
 	SipParseError() { LOG(DEBUG) << "SipParseError"; }
 	virtual const char *what() const throw() {
@@ -73,9 +77,9 @@ size_t trimleftn(const char *startp, size_t startpos/*=0*/, const char *trimchar
 // Trim both ends of a string.
 string trimboth(string input, const char *trimchars /*=" \t\r\n"*/)
 {
-	size_t end = trimrightn(input.c_str(),input.size());
+	size_t end = trimrightn(input.c_str(),input.size(),trimchars);
 	size_t start = (end==0) ? 0 : trimleftn(input.c_str(),0,trimchars);
-	return input.substr(start,end);
+	return input.substr(start,end-start);
 	//const char *bp = str.c_str();
 	//const char *endp = str.c_str() + str.size(), *ep = endp;		// points to the trailing nul.
 	//while (*bp && strchr(trimchars,*bp)) { bp++; }
@@ -155,6 +159,73 @@ class SipChar {
 
 char SipChar::charClassData[256];
 
+// Trim a slice; same as trimboth.
+static SipSlice sliceTrim(SipSlice in, const char *trimchars=" \t\r\n")
+{
+	while (in.sl && in.sp[in.sl-1] && strchr(trimchars,in.sp[in.sl-1])) { in.sl--; }
+	while (in.sl && in.sp[0] && strchr(trimchars,in.sp[0])) { in.sp++; in.sl--; }
+	return in;
+}
+
+SipSlice SipSliceScanner::scanToken()
+{
+	skipSpace();
+	const char *bp = pp;
+	while (pp < end && SipChar::isToken(*pp)) { pp++; }
+	return SipSlice(bp,pp-bp);
+}
+
+// Currently unsigned string of digits.
+bool SipSliceScanner::scanInt(int *result)
+{
+	skipSpace();
+	const char *bp = pp;
+	while (pp < end && isdigit((unsigned char)*pp)) { pp++; }
+	if (bp == pp) { return false; }
+	// Same result as the atoi of the old parser, which saturates long before 31 digits.
+	char digits[32];
+	unsigned len = min((unsigned)(pp - bp),(unsigned)sizeof(digits)-1);
+	memcpy(digits,bp,len); digits[len] = 0;
+	*result = atoi(digits);
+	return true;
+}
+
+// pp points at the quote starting the string.  Return string without the quotes.
+bool SipSliceScanner::scanQuotedString(string *result)
+{
+	assert(*pp == '"');
+	pp++;
+	result->clear();
+	while (pp < end) {
+		if (*pp == '"') { pp++; return true; }
+		if (*pp == '\\') { if (++pp == end) { break; } }
+		result->push_back(*pp++);
+	}
+	return false;
+}
+
+// The generic param is token = token or quoted string, with optional space around the '='.
+// Return 1 if there was a param, 0 if not, -1 on an unterminated quoted string.
+int SipSliceScanner::scanGenericParam(SipSlice *name, string *value)
+{
+	*name = scanToken();
+	if (scanChar('=')) {
+		if (pp < end && *pp == '"') {
+			if (! scanQuotedString(value)) { return -1; }
+		} else {
+			SipSlice tok = scanToken();
+			value->assign(tok.sp,tok.sl);
+		}
+		if (name->empty()) {
+			LOG(NOTICE) << "empty parameter ignored in:"<<string(pp,end-pp);
+			return 0;
+		}
+	} else {
+		value->clear();
+	}
+	return name->empty() ? 0 : 1;
+}
+
 
 // This is pretty easy to parse.  The major demarcation chars are reserved: @ ; ? &
 // [sip: | sips: ]  user [: password] @ host [: port] [;param=value]* [? hname=havalue [& hname=hvalue]* ]
@@ -183,7 +254,7 @@ string SipParamList::paramFind(const char*name)
 
 struct SipParseLine {
 	const char *currentLine;	// Start of current line being parsed, used only for error messages.
-	const char *pp;		// Pointer into the parse buffer.	It is const* for this class, but not for SipParseMessage
+	const char *pp;			// Pointer into the parse buffer.
 
 	void spLineInit(const char *buffer) { currentLine = pp = buffer; }
 	SipParseLine(const char* buffer) { spLineInit(buffer); }
@@ -346,15 +417,15 @@ string parseURI(const char *buffer, SipParamList &uriparams, SipParamList &heade
 // Extract a SIP parameter from a string containing a list of parameters.  They look like ;param1=value;param2=value ...
 // The input string need not start exactly at the beginning of the list.
 // The paramid is specified with the semi-colon and =, example: ";tag="
-static string extractParam(const char *pp, const char *paramid)
+SipSlice sipDecodeParam(SipSlice params, const char *paramid)
 {
-	const int taghdrlen = strlen(paramid);	// strlen(";tag=");
-	if (const char *tp = strstr(pp,paramid)) {
-		pp += taghdrlen;
-		const char *ep = strchr(pp,';');
-		return ep ? string(pp,ep-tp) : string(pp);
+	const unsigned taghdrlen = strlen(paramid);	// strlen(";tag=");
+	if (const char *tp = (const char*)memmem(params.sp,params.sl,paramid,taghdrlen)) {
+		const char *vp = tp + taghdrlen;
+		const char *ep = (const char*)memchr(vp,';',params.end()-vp);
+		return SipSlice(vp, (ep ? ep : params.end()) - vp);
 	}
-	return string("");	// Not found.
+	return SipSlice();	// Not found.
 }
 
 void SipPreposition::rebuild()
@@ -382,7 +453,7 @@ bool crackUri(string header, string *before, string *uri, string *tail)
 		return true;
 	}
 	size_t nUriEnd = header.find_first_of('>',nUriBegin);
-	if (nUriBegin == string::npos) { return false; }
+	if (nUriEnd == string::npos) { return false; }
 	// Warning: The display name may be a quoted string or multiple unquoted tokens.
 	if (before) *before = header.substr(0,trimrightn(header.c_str(),nUriBegin));
 	if (uri) *uri = header.substr(nUriBegin+1,nUriEnd-nUriBegin-1);
@@ -390,47 +461,43 @@ bool crackUri(string header, string *before, string *uri, string *tail)
 	return true;	// happiness
 }
 
+bool sipDecodeNameAddr(SipSlice header, SipSlice *display, SipSlice *uri, SipSlice *tail)
+{
+	const char *lt = (const char*)memchr(header.sp,'<',header.sl);
+	if (lt == NULL) {
+		// Old format allows the URI without <> but it is not possible to specify the tag parameter that way.
+		*display = SipSlice();
+		*uri = header;
+		*tail = SipSlice();
+		return true;
+	}
+	const char *gt = (const char*)memchr(lt,'>',header.end()-lt);
+	if (gt == NULL) { return false; }
+	// Warning: The display name may be a quoted string or multiple unquoted tokens.
+	*display = SipSlice(header.sp,trimrightn(header.sp,lt-header.sp));
+	*uri = SipSlice(lt+1,gt-lt-1);
+	*tail = SipSlice(gt+1,header.end()-gt-1);
+	return true;
+}
+
 // Parse immediately, only we're not going to do a full parse on this either.  All we care about is the tag.
 // Note that the tag param is outside the <uri>
-void SipPreposition::prepSet(const string header)
+void SipPreposition::prepSet(SipSlice header)
 {
-	mFullHeader = header;
+	mFullHeader.assign(header.sp,header.sl);
 	mDisplayName.clear();
 	mTag.clear();
 	mUri.clear();
 	if (header.empty()) { return; }
-	try {
-		if (1) {
-			// We dont need the parser for this.  It is trivial.
-			string uri, tail;
-			if (!crackUri(header,&mDisplayName,&uri,&tail)) {
-				LOG(ERR) << "Bad SIP Contact field:"<<header;
-				return;
-			}
-			mUri.uriSet(uri);
-			mTag = extractParam(tail.c_str(),";tag=");
-		} else {
-			// This code works fine, its just overkill.
-			SipParseLine parser(header.c_str());
-			string thing = parser.scanNonSpace();
-			parser.skipSpace();
-			if (*parser.pp == '<') {
-				mDisplayName = thing;	// Warning: this may or may not have quotes.
-				const char *ep = strchr(parser.pp,'>');
-				if (!ep) {
-					LOG(ERR) << "Bad SIP Contact field:"<<header;
-					ep = parser.pp + strlen(parser.pp);	// guess
-				}
-				mUri.uriSet(string(parser.pp+1,ep-parser.pp-1));	// SipUri strips the < > off the ends of the URI.
-				parser.pp = ep;
-				mTag = extractParam(parser.pp,";tag=");
-			} else {
-				mUri.uriSet(thing);
-			}
-		}
-	} catch (...) {
-		LOG(DEBUG) << "Caught SIP Parse error";
+	SipSlice display, uri, tail;
+	if (!sipDecodeNameAddr(header,&display,&uri,&tail)) {
+		LOG(ERR) << "Bad SIP Contact field:"<<mFullHeader;
+		return;
 	}
+	mDisplayName.assign(display.sp,display.sl);
+	mUri.uriSet(uri);
+	SipSlice tag = sipDecodeParam(tail,";tag=");
+	mTag.assign(tag.sp,tag.sl);
 }
 
 void parseToParams(string stuff, SipParamList &params)
@@ -478,208 +545,255 @@ void parseAuthenticate(string stuff, SipParamList &params)
 }
 
 // You can pass in the comma-separated list of vias and it will parse just the first.
+// Spaces are allowed anywhere in the via spec even though most people dont insert htem.
+// Example: "SIP / 2.0 / UDP host : port ; branch = branchstring"
+// The port may be empty. There may be options after the port.
+bool sipDecodeVia(SipSlice via, string *sentBy, string *branch)
+{
+	SipSliceScanner parser(via);
+	parser.scanToken();	// protocol-name
+	parser.scanChar('/');
+	parser.scanToken();	// protocol-version
+	parser.scanChar('/');
+	parser.scanToken();	// transport
+	SipSlice host = parser.scanToken();
+	sentBy->assign(host.sp,host.sl);
+	if (parser.scanChar(':')) {
+		SipSlice port = parser.scanToken();
+		sentBy->append(":");
+		sentBy->append(port.sp,port.sl);
+	}
+	// Now the list of via-params
+	while (parser.scanChar(';')) {
+		SipSlice name;
+		string value;
+		int more;
+		while ((more = parser.scanGenericParam(&name,&value)) > 0) {
+			if (name.caseEql("branch")) {     // not sure if this is case insensitive, but be safe.
+				*branch = value;
+				break;  // We can break; we dont care about any other parameters.
+			}
+		}
+		if (more < 0) { return false; }
+	}
+	return true;
+}
+
 void SipVia::viaParse(string vialine)
 {
 	LOG(DEBUG) <<LOGVAR(vialine);
 	this->assign(vialine);
-	// Spaces are allowed anywhere in the via spec even though most people dont insert htem.
-	// Example: "SIP / 2.0 / UDP host : port ; branch = branchstring"
-	// The port may be empty. There may be options after the port.
-	try {
-		SipParseLine parser(vialine.c_str());
-		parser.scanToken();	// protocol-name
-		parser.scanChar('/');
-		parser.scanToken();	// protocol-version
-		parser.scanChar('/');
-		parser.scanToken();	// transport
-		mSentBy = parser.scanToken();	// host
-		if (parser.scanChar(':')) {
-			mSentBy.append(":");
-			mSentBy.append(parser.scanToken());		// port
-		}
-		// Now the list of via-params
-		//SipParam param;
-		//while (parser.scanGenericParam(param)) {
-		//	if (strcaseeql(param.mName.c_str(),"branch")) {		// not sure if this is case insensitive, but be safe.
-		//		mViaBranch = param.mValue;
-		//		break;	// We can break; we dont care about any other parameters.
-		//	}
-		//}
-		while (parser.scanChar(';')) {
-			SipParam param;
-			while (parser.scanGenericParam(param)) {
-				if (strcaseeql(param.mName.c_str(),"branch")) {     // not sure if this is case insensitive, but be safe.
-					mViaBranch = param.mValue;
-					break;  // We can break; we dont care about any other parameters.
-				}
-			}
-		}
-	} catch(...) {
+	if (! sipDecodeVia(SipSlice(vialine),&mSentBy,&mViaBranch)) {
 		LOG(ERR) << "Error parsing via:"<<vialine;
 	}
-
-	// Another way I didnt use:
-	//int n = myscanf("%[^/ \t] / %[^/ \t] / %s %[^:; \t] : %[^; \t]",
-		//mProtocolName, mProtocolVersion, mTransport, mHost, mPort);
 }
 
-class SipParseMessage : SipParseLine {
-	char *start;	// Start of the parse buffer.
-	char *eolp;		// Pointer to end of current line.
-	unsigned linecnt;
+static const struct SipHeaderName {
+	const char *hnName, *hnCompact;
+	SipHeaderId hnId;
+} sSipHeaderNames[] = {
+	{ "to", "t", SipHdrTo },
+	{ "from", "f", SipHdrFrom },
+	{ "contact", "m", SipHdrContact },
+	{ "cseq", NULL, SipHdrCSeq },
+	{ "call-id", "i", SipHdrCallId },
+	{ "via", "v", SipHdrVia },
+	{ "record-route", NULL, SipHdrRecordRoute },
+	{ "route", NULL, SipHdrRoute },
+	{ "max-forwards", NULL, SipHdrMaxForwards },
+	{ "content-type", NULL, SipHdrContentType },
+	{ "reason", NULL, SipHdrReason },
+};
 
-	void spInit(char *buffer) {
-		start = buffer;
-		linecnt = 0;
-		eolp = NULL;
-		spLineInit(buffer);
+// The headers names themselves are case insensitive.
+static SipHeaderId sipHeaderId(SipSlice name)
+{
+	for (unsigned i = 0; i < sizeof(sSipHeaderNames)/sizeof(sSipHeaderNames[0]); i++) {
+		const SipHeaderName &hn = sSipHeaderNames[i];
+		if (name.caseEql(hn.hnName) || (hn.hnCompact && name.caseEql(hn.hnCompact))) { return hn.hnId; }
 	}
+	return SipHdrOther;
+}
 
-	void logError(const char *msg) {
-		LOG(ERR) << "SIP Parse error at line "<<linecnt<<" "<<msg<<". Parsing:'"<<pp<<"'"<< " SIP message="<<start;
+void SipMessageView::svError(const char *msg)
+{
+	LOG(ERR) << "SIP Parse error at line "<<mLineCount<<" "<<msg<< " SIP message="<<string(mBuffer,mBufferLen);
+}
+
+// Return 1 if there is another line, 0 at the blank line that ends the header, or -1 on error.
+// Line continuations are unfolded into the arena by substituting spaces for the CR,NL.
+int SipMessageView::svNextLine(const char **ppp, const char *end, SipSlice *line)
+{
+	const char *start = *ppp, *eol = start;
+	bool folded = false;
+	while (1) {
+		while ((eol = (const char*)memchr(eol,'\r',end-eol)) && (eol+1 == end || eol[1] != '\n')) { eol++; }
+		if (eol == NULL) { svError("unexpected end of message"); return -1; }
+		mLineCount++;
+		if (eol == start) { return 0; }		// Found the terminating blank line.
+		if (eol + 2 < end && (eol[2] == ' ' || eol[2] == '\t')) { folded = true; eol += 2; continue; }	// Continuation line.
+		break;
 	}
+	*ppp = eol + 2;
+	unsigned len = eol - start;
+	if (! folded) { *line = SipSlice(start,len); return 1; }
+	// The unfolded lines can not add up to more than the message.
+	if (mArena == NULL) { mArena = new char[mBufferLen]; }
+	char *dst = mArena + mArenaUsed;
+	for (unsigned i = 0; i < len; i++) {
+		dst[i] = (start[i] == '\r' && start[i+1] == '\n') ? ' ' : start[i];
+		if (dst[i] != start[i]) { dst[++i] = ' '; }
+	}
+	mArenaUsed += len;
+	*line = SipSlice(dst,len);
+	return 1;
+}
 
-	void spError(const char *msg) {
-		if (eolp) { *eolp = '\r'; }		// Make the buffer printable again.
-		logError(msg);
-		throw SipParseError();
+bool SipMessageView::svScanSipVersion(SipSliceScanner &scanner)
+{
+	if (scanner.end - scanner.pp < 3 || ! strncaseeql(scanner.pp,"SIP",3)) { svError("Expecting 'SIP'"); return false; }
+	scanner.pp += 3;	// skip over 'SIP'
+	if (scanner.pp == scanner.end || *scanner.pp++ != '/') { svError("Invalid SIP-version"); return false; }
+	SipSlice version = scanner.scanNonSpace();	// Discard the version number.  We dont really care what it is.
+	if (version.sl < 3 || strncmp(version.sp,"2.0",3)) { LOG(NOTICE) << "unexpected SIP version="<<version.str(); }
+	return true;
+}
+
+bool SipMessageView::svParse(const char *buffer, unsigned len)
+{
+	mBuffer = buffer;
+	mBufferLen = len;
+	const char *pp = buffer, *end = buffer + len;
+	SipSlice line;
+	// Scan the first line.
+	int more = svNextLine(&pp,end,&line);
+	if (more == 0) { svError("Empty SIP message"); }
+	if (more <= 0) { return false; }
+	// The message is either a request or a response.
+	// Response Status-Line     =  SIP-Version SP Status-Code SP Reason-Phrase CRLF
+	// Request Request-Line = Method SP Request-URI SP SIP-Version CRLF
+	SipSliceScanner first(line);
+	if (line.sl >= 3 && strncaseeql(line.sp,"SIP",3)) {
+		if (! svScanSipVersion(first)) { return false; }
+		if (! first.scanInt(&mCode)) { svError("expected integer"); return false; }
+		first.skipSpace();
+		mReason = first.rest();	// Rest of the line is the reason.
+	} else {
+		mMethod = first.scanNonSpace();
+		mReqUri = first.scanNonSpace();
+		first.skipSpace();
+		if (! svScanSipVersion(first)) { return false; }
 	}
 
-	// Return true if there is another line, and nul terminate it; false when the header is complete.
-	// Buffer is modified in place.  Line continuations are removed by substituting spaces for the CR,NL.
-	bool nextLine()
-	{
-		if (eolp) {
-			// Put the CR back so the message is printable in error messages.
-			*eolp = '\r'; 		// Put the CR back in the last line so the message is printable in error messages.
-			spLineInit(eolp+2);	// sets pp to start of next line.
-		}
-		eolp = Unconst(pp);
-		while ((eolp = strstr(eolp,"\r\n"))) {
-			LOG(DEBUG) <<LOGVAR((void*)start)<<LOGVAR((void*)pp)<<LOGVAR((void*)eolp);
-			linecnt++;
-			if (eolp == pp) { return false; }		// Found the terminating blank line.
-			if (eolp[2] == ' ' || eolp[2] == '\t') { *eolp++ = ' '; *eolp++ = ' '; continue; }	// Combine continuation lines.
-			*eolp = 0;								// Terminate.
-			return true;
-		}
-		spError("unexpected end of message");
-		/*NOTREACHED*/
-		return "";	// Never used.
+	// Get the rest of the header lines.
+	while ((more = svNextLine(&pp,end,&line)) > 0) {
+		SipSliceScanner hdr(line);
+		SipSlice name = hdr.scanToken();
+		if (name.empty() || ! hdr.scanChar(':')) { svError("Line without header"); return false; }
+		if (mNumHeaders >= cInlineHeaders) { mMoreHeaders.push_back(SipHeaderView()); }
+		SipHeaderView &view = mNumHeaders < cInlineHeaders ? mHeaders[mNumHeaders] : mMoreHeaders.back();
+		mNumHeaders++;
+		view.mId = sipHeaderId(name);
+		view.mName = name;
+		view.mValue = hdr.rest();
 	}
+	if (more < 0) { return false; }
+	mBody = SipSlice(pp+2,end-pp-2);	// pp is at the CR,NL of the blank line.
+	return true;
+}
 
-	void scanSipVersion()
-	{
-		if (!  (strncaseeql(pp,"SIP",3))) { spError("Expecting 'SIP'"); }
-		pp += 3;	// skip over 'SIP'
-		if (*pp++ != '/') { spError("Invalid SIP-version"); }
-		string version = scanNonSpace(); // Discard the version number.  We dont really care what it is.
-		// We hope it will be "2.0/UDP" or "2.0/TCP";
-		if (strncmp(version.c_str(),"2.0",3)) { LOG(NOTICE) << "unexpected SIP version="<<version; }
+const SipHeaderView *SipMessageView::svFind(SipHeaderId id) const
+{
+	for (unsigned i = 0; i < mNumHeaders; i++) {
+		const SipHeaderView &hdr = svHeader(i);
+		if (hdr.mId == id) { return &hdr; }
 	}
+	return NULL;
+}
 
-	// Buffer is modified in place - lines are terminated at eols.
-	public:
-	SipMessage * sipParse()
-	{
-		//LOG(DEBUG);
-		SipMessage *sipmsg = new SipMessage();
-		// Scan the first line.
-		if (!nextLine()) { spError("Empty SIP message"); }
-		//LOG(DEBUG);
-		// The message is either a request or a response.
-		// Response Status-Line     =  SIP-Version SP Status-Code SP Reason-Phrase CRLF
-		// SIP-Version    =  "SIP" "/" 1*DIGIT "." 1*DIGIT
-		// Request Request-Line = Method SP Request-URI SP SIP-Version CRLF
-		if (strncaseeql(pp,"SIP",3)) {
-			// This is a response.
-			scanSipVersion();
-			sipmsg->msmCode = scanInt();
-			skipSpace();
-			sipmsg->msmReason = string(pp);	// Rest of the line is the reason.
-		} else {
-			// This is a request.
-			sipmsg->msmReqMethod = scanNonSpace();
-			sipmsg->msmReqUri = scanNonSpace();
-			skipSpace();
-			scanSipVersion();
-		}
-		skipSpace();
-		//LOG(DEBUG);
-
-		// Get the rest of the header lines.
-		while (nextLine()) {
-			// We have a header line.  The headers names themselves are case insensitive.
-			LOG(DEBUG) << "nextLine="<<pp;
-			string name = scanToken();
-			LOG(DEBUG) << LOGVAR(name);
-			if (name.empty() || !scanChar(':')) { spError("Line without header"); }
-
-			if (strceql(name,"to") || strceql(name,"t")) {
-				sipmsg->msmTo.prepSet(string(pp));
-			} else if (strceql(name,"from") || strceql(name,"f")) {
-				sipmsg->msmFrom.prepSet(string(pp));
-			} else if (strceql(name,"contact") || strceql(name,"m")) {
-				sipmsg->msmContactValue = string(pp);
-			} else if (strceql(name,"CSeq")) {
-				sipmsg->msmCSeqNum = scanInt();
-				sipmsg->msmCSeqMethod = scanToken();
-			} else if (strceql(name,"call-id") || strceql(name,"i")) {
-				// The call-id string is defined as word[@word], but unless we are really interested
-				// in validating incoming SIP messages, we can simply scan for non-space.
-				sipmsg->msmCallId = scanNonSpace();
-			} else if (strceql(name,"via") || strceql(name,"v")) {
-				// Multiple vias can appear on separate lines or be comma separated in one line,
-				// so for simplicity we will just keep them all in a comma separated list.
-				commaListPushBack(&sipmsg->msmVias,pp);
-			} else if (strceql(name,"record-route")) {
-				commaListPushBack(&sipmsg->msmRecordRoutes,pp);
-			} else if (strceql(name,"route")) {
-				commaListPushBack(&sipmsg->msmRoutes,pp);
-			} else if (strceql(name,"max-forwards")) {
-				sipmsg->msmMaxForwards = trimboth(string(pp));	// We already trimmed left, but its ok to do it again.
-			// No need to treat this specially here, even though authenticate info does not follow normal SIP parsing rules.
-			//} else if (strceql(name,"www-authenticate")) {
-			//	// authenticate info does not follow normal SIP parsing rules.
-			//	sipmsg->msmAuthenticateValue = string(pp);
-			} else if (strceql(name,"content-type")) {
-				sipmsg->msmContentType = string(pp);
-			} else if (strceql(name,"reason")) {
-				sipmsg->msmReasonHeader = string(pp);
-			} else {
-				SipParam param(name,string(pp));
-				sipmsg->msmHeaders.push_back(param);
+// Same as commaListPushBack.
+static void sliceListPushBack(string *cl, SipSlice val)
+{
+	val = sliceTrim(val," ,");
+	if (! cl->empty()) { cl->append(","); }
+	cl->append(val.sp,val.sl);
+}
+
+SipMessage *SipMessageView::svMakeMessage() const
+{
+	SipMessage *sipmsg = new SipMessage();
+	sipmsg->msmCode = mCode;
+	sipmsg->msmReason.assign(mReason.sp,mReason.sl);
+	sipmsg->msmReqMethod.assign(mMethod.sp,mMethod.sl);
+	sipmsg->msmReqUri.assign(mReqUri.sp,mReqUri.sl);
+	for (unsigned i = 0; i < mNumHeaders; i++) {
+		const SipHeaderView &hdr = svHeader(i);
+		SipSlice value = hdr.mValue;
+		switch (hdr.mId) {
+		case SipHdrTo:
+			sipmsg->msmTo.prepSet(value);
+			break;
+		case SipHdrFrom:
+			sipmsg->msmFrom.prepSet(value);
+			break;
+		case SipHdrContact:
+			sipmsg->msmContactValue.assign(value.sp,value.sl);
+			break;
+		case SipHdrCSeq: {
+			SipSliceScanner scanner(value);
+			if (! scanner.scanInt(&sipmsg->msmCSeqNum)) {
+				LOG(ERR) << "SIP Parse error expected integer in CSeq:"<<value.str()<<" SIP message="<<string(mBuffer,mBufferLen);
+				delete sipmsg;
+				return NULL;
 			}
+			SipSlice method = scanner.scanToken();
+			sipmsg->msmCSeqMethod.assign(method.sp,method.sl);
+			break;
 		}
-		LOG(DEBUG) << "end";
-		if (pp[0] == '\r' && pp[1] == '\n') {
-			pp += 2;
-			sipmsg->msmBody = string(pp);
-		} else {
-			// Dont abort for this.  Just log an error.
-			logError("Missing message body");
+		case SipHdrCallId: {
+			// The call-id string is defined as word[@word], but unless we are really interested
+			// in validating incoming SIP messages, we can simply scan for non-space.
+			SipSliceScanner scanner(value);
+			SipSlice callid = scanner.scanNonSpace();
+			sipmsg->msmCallId.assign(callid.sp,callid.sl);
+			break;
+		}
+		// Multiple vias can appear on separate lines or be comma separated in one line,
+		// so for simplicity we will just keep them all in a comma separated list.
+		case SipHdrVia:
+			sliceListPushBack(&sipmsg->msmVias,value);
+			break;
+		case SipHdrRecordRoute:
+			sliceListPushBack(&sipmsg->msmRecordRoutes,value);
+			break;
+		case SipHdrRoute:
+			sliceListPushBack(&sipmsg->msmRoutes,value);
+			break;
+		case SipHdrMaxForwards: {
+			SipSlice mf = sliceTrim(value);
+			sipmsg->msmMaxForwards.assign(mf.sp,mf.sl);
+			break;
+		}
+		case SipHdrContentType:
+			sipmsg->msmContentType.assign(value.sp,value.sl);
+			break;
+		case SipHdrReason:
+			sipmsg->msmReasonHeader.assign(value.sp,value.sl);
+			break;
+		case SipHdrOther:
+			sipmsg->msmHeaders.push_back(SipParam(hdr.mName.str(),value.str()));
+			break;
 		}
-		return sipmsg;
 	}
-
-	SipParseMessage(char *buffer) { spInit(buffer); }
-};
+	sipmsg->msmBody.assign(mBody.sp,mBody.sl);
+	return sipmsg;
+}
 
 SipMessage *sipParseBuffer(const char *buffer)
 {
-	LOG(DEBUG) << "DEBUG";
-	// The SIP Parser modifies buffer, but puts it back the way it found it.
-	// This is OK because no thread contention for the buffer is possible because all callers pass a unique string for parsing.
-	SipParseMessage parser(Unconst(buffer));
-	SipMessage *result;
-	try {
-		result = parser.sipParse();
-	} catch (SipParseError) {
-		// error was already logged.
-		LOG(DEBUG) << "SipParseError caught";
-		return NULL;
-	}
-	return result;
+	SipMessageView view;
+	if (! view.svParse(buffer,strlen(buffer))) { return NULL; }	// error was already logged.
+	return view.svMakeMessage();
 }
 
 void codecsToSdp(Control::CodecSet codecs, string *codeclist, string *attrs)
@@ -713,35 +827,67 @@ void codecsToSdp(Control::CodecSet codecs, string *codeclist, string *attrs)
 }
 
 
+// Split an SDP line into white space separated tokens, up to maxTokens.  Return the number found.
+static unsigned sdpTokens(SipSlice line, SipSlice *tokens, unsigned maxTokens)
+{
+	SipSliceScanner scanner(line);
+	unsigned n = 0;
+	while (n < maxTokens) {
+		SipSlice tok = scanner.scanNonSpace();
+		if (tok.empty()) { break; }
+		tokens[n++] = tok;
+	}
+	return n;
+}
+
 // We dont fully parse it; just pull out the o,m,c,a lines.
+// Each line is tokenized in place, bounded by its own end, so a short line can not pick up fields from the next one.
 void SdpInfo::sdpParse(const char *buffer)
 {
 	const char *bp, *eol;
 	for (bp = buffer; bp && *bp; bp = eol ? eol+1 : NULL) {
 		eol = strchr(bp,'\n');
+		SipSlice line(bp, eol ? eol-bp : strlen(bp));
+		// The value, or nothing if the line is not type=value.
+		SipSlice value = (line.sl >= 2 && bp[1] == '=') ? SipSlice(bp+2,line.sl-2) : SipSlice();
+		SipSlice tok[6];
 		switch (*bp) {
-			case 'o':
-				if (myscanf(bp,"o=%s %s %s IN IP4 %s",&sdpUsername,&sdpSessionId, &sdpVersionId, &sdpHost) < 4) {
+			case 'o': {
+				// o=<username> <sess-id> <sess-version> IN IP4 <address>
+				unsigned n = sdpTokens(value,tok,6);
+				if (n >= 1) { sdpUsername.assign(tok[0].sp,tok[0].sl); }
+				if (n >= 2) { sdpSessionId.assign(tok[1].sp,tok[1].sl); }
+				if (n >= 3) { sdpVersionId.assign(tok[2].sp,tok[2].sl); }
+				if (n == 6 && tok[3].eql("IN") && tok[4].eql("IP4")) {
+					sdpHost.assign(tok[5].sp,tok[5].sl);
+				} else {
 					LOG(ERR) << "SDP unrecognized o= line, sdp:"<<buffer;
 				}
 				break;
+			}
 			case 'm': {
-				string portTmp;
-				if (myscanf(bp,"m=%*s %s %*s %s",&portTmp, &sdpCodecList) < 2) {
+				// m=<media> <port> <proto> <fmt> ...  We only look at the first fmt.
+				unsigned n = sdpTokens(value,tok,4);
+				sdpRtpPort = (n >= 2) ? atoi(tok[1].str().c_str()) : 0;
+				if (n >= 4) {
+					sdpCodecList.assign(tok[3].sp,tok[3].sl);
+				} else {
 					LOG(ERR) << "SDP unrecognized m= line, sdp:"<<buffer;
 				}
-				sdpRtpPort = atoi(portTmp.c_str());
 				break;
-				}
+			}
 			case 'c':
-				if (myscanf(bp,"c=IN IP4 %s",&sdpHost) < 1) {
+				// c=IN IP4 <address>
+				if (sdpTokens(value,tok,3) == 3 && tok[0].eql("IN") && tok[1].eql("IP4")) {
+					sdpHost.assign(tok[2].sp,tok[2].sl);
+				} else {
 					// If we were paranoid we could check if it matches the o= line.
 					LOG(ERR) << "SDP unrecognized c= line, sdp:"<<buffer;
 				}
 				break;
 			case 'a':
 				// It would crash if eol were null because SDP was truncated, so check.
-				if (eol) { sdpAttrs += string(bp,eol-bp+1); }
+				if (eol) { sdpAttrs.append(bp,eol-bp+1); }
 				break;
 		}
 	}
@@ -791,6 +937,194 @@ string SdpInfo::sdpValue()
 }
 
 
+
+static double nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Typical messages for registration, SMS and calls, including compact and continued headers.
+// SIPParseTest checks what the parsers get from these against the fields the previous parsers got.
+static const struct { const char *name; const char *text; } sSipSamples[] = {
+	{ "REGISTER",
+		"REGISTER sip:127.0.0.1 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28c9d2c8d0a4f2d2\r\n"
+		"From: IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=lgsvejhbthozqgra\r\n"
+		"To: IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>\r\n"
+		"Call-ID: 1574262386@127.0.0.1\r\n"
+		"CSeq: 521 REGISTER\r\n"
+		"Contact: <sip:IMSI001010000000001@127.0.0.1:5062>;expires=5400\r\n"
+		"Authorization: Digest, nonce=944a5c5a1e2b5d2f0b0b28d6a7f0a3e2, uri=001010000000001, response=a8f2b1c4\r\n"
+		"User-Agent: OpenBTS 4.0.0 Build Date Oct 19 2014\r\n"
+		"Max-Forwards: 70\r\n"
+		"P-PHY-Info: OpenBTS; TA=1 TE=0.392 UpRSSI=-26.0 TxPwr=33 DnRSSIdBm=-111\r\n"
+		"P-Access-Network-Info: 3GPP-GERAN; cgi-3gpp=0010103ef000a\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n" },
+	{ "401 Unauthorized",
+		"SIP/2.0 401 Unauthorized\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28c9d2c8d0a4f2d2;received=127.0.0.1\r\n"
+		"From: IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=lgsvejhbthozqgra\r\n"
+		"To: IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=2a3b\r\n"
+		"Call-ID: 1574262386@127.0.0.1\r\n"
+		"CSeq: 521 REGISTER\r\n"
+		"WWW-Authenticate: Digest realm=\"OpenBTS\",\r\n"
+		"  nonce=\"44f4eb5a6d2a4d8e8b0e0d4d2b3c1a0f\", algorithm=MD5\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n" },
+	{ "MESSAGE",
+		"MESSAGE sip:IMSI001010000000001@127.0.0.1:5062 SIP/2.0\r\n"
+		"v: SIP/2.0/UDP 127.0.0.1:5063;branch=z9hG4bK.e5c7a1b2\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5064 ; rport ; branch = \"z9hG4bK.7d\\\"q\"\r\n"
+		"f: 2102 <sip:2102@127.0.0.1>;tag=3c1e8f2a\r\n"
+		"t: sip:IMSI001010000000001@127.0.0.1\r\n"
+		"i: 8d2a7e14@127.0.0.1\r\n"
+		"CSeq: 17 MESSAGE\r\n"
+		"Content-Type: application/vnd.3gpp.sms\r\n"
+		"Max-Forwards:  70 \r\n"
+		"Content-Length: 34\r\n"
+		"\r\n"
+		"0001000a8121436587000005e8329bfd06" },
+	{ "INVITE",
+		"INVITE sip:IMSI001010000000001@127.0.0.1:5062 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5060;branch=z9hG4bK.1f2e3d4c,\r\n"
+		" SIP/2.0/UDP 10.0.0.5:5060;branch=z9hG4bK.9a8b\r\n"
+		"Record-Route: <sip:127.0.0.1;lr>\r\n"
+		"Route: <sip:10.0.0.5;lr>\r\n"
+		"From: \"Alice\" <sip:2102@127.0.0.1>;tag=as6d1b2c3e\r\n"
+		"To: <sip:IMSI001010000000001@127.0.0.1>\r\n"
+		"Contact: <sip:2102@10.0.0.5:5060>\r\n"
+		"Call-ID: 3a8f1c0e7b2d4e6f@10.0.0.5\r\n"
+		"CSeq: 102 INVITE\r\n"
+		"Max-Forwards: 69\r\n"
+		"Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO\r\n"
+		"Supported: replaces, timer\r\n"
+		"Content-Type: application/sdp\r\n"
+		"Content-Length: 233\r\n"
+		"\r\n"
+		"v=0\r\n"
+		"o=root 1821 1821 IN IP4 10.0.0.5\r\n"
+		"s=Asterisk PBX\r\n"
+		"c=IN IP4 10.0.0.5\r\n"
+		"t=0 0\r\n"
+		"m=audio 16414 RTP/AVP 3 0 8 101\r\n"
+		"a=rtpmap:3 GSM/8000\r\n"
+		"a=rtpmap:0 PCMU/8000\r\n"
+		"a=rtpmap:101 telephone-event/8000\r\n"
+		"a=fmtp:101 0-16\r\n"
+		"a=ptime:20\r\n"
+		"a=sendrecv\r\n" },
+	{ "200 OK",
+		"SIP/2.0 200 OK\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28a1\r\n"
+		"From: <sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf\r\n"
+		"To: <sip:2102@127.0.0.1>;tag=as0e1f2a3b\r\n"
+		"Call-ID: 20151203@127.0.0.1\r\n"
+		"CSeq: 1 INVITE\r\n"
+		"Contact: <sip:2102@10.0.0.5:5060>\r\n"
+		"Content-Type: application/sdp\r\n"
+		"Content-Length: 127\r\n"
+		"\r\n"
+		"v=0\r\n"
+		"o=root 1822 1822 IN IP4 10.0.0.5\r\n"
+		"s=Asterisk PBX\r\n"
+		"c=IN IP4 10.0.0.5\r\n"
+		"t=0 0\r\n"
+		"m=audio 18212 RTP/AVP 3\r\n"
+		"a=rtpmap:3 GSM/8000\r\n" },
+	{ "BYE",
+		"BYE sip:IMSI001010000000001@127.0.0.1:5062 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 10.0.0.5:5060;branch=z9hG4bK.0c1d\r\n"
+		"From: <sip:2102@127.0.0.1>;tag=as6d1b2c3e\r\n"
+		"To: <sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf\r\n"
+		"Call-ID: 3a8f1c0e7b2d4e6f@10.0.0.5\r\n"
+		"CSeq: 103 BYE\r\n"
+		"Reason: Q.850;cause=16;text=\"Normal Call Clearing\"\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n" },
+	{ "ACK",
+		"ACK sip:2102@10.0.0.5:5060 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28a2\r\n"
+		"From: <sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf\r\n"
+		"To: <sip:2102@127.0.0.1>;tag=as0e1f2a3b\r\n"
+		"Call-ID: 20151203@127.0.0.1\r\n"
+		"CSeq: 1 ACK\r\n"
+		"\r\n" },
+};
+
+// Mangle a message the way a broken peer or a truncated datagram might.
+static void sipFuzz(string &msg, uint32_t &seed)
+{
+	static const char sFuzzChars[] = ":;,<>\"\\\r\n \t=@/";
+#define FUZZRAND(n) ((seed = seed * 1103515245 + 12345), (unsigned)((seed >> 8) % (n)))
+	unsigned edits = 1 + FUZZRAND(3);
+	for (unsigned e = 0; e < edits && msg.size(); e++) {
+		unsigned pos = FUZZRAND(msg.size());
+		switch (FUZZRAND(6)) {
+		case 0: msg[pos] = sFuzzChars[FUZZRAND(sizeof(sFuzzChars)-1)]; break;
+		case 1: msg.erase(pos,1 + FUZZRAND(8)); break;
+		case 2: msg.insert(pos,"\r\n "); break;
+		case 3: msg.resize(pos); break;
+		case 4: {	// Duplicate a line.
+			size_t bol = msg.rfind('\n',pos), eol = msg.find('\n',pos);
+			bol = (bol == string::npos) ? 0 : bol+1;
+			if (eol != string::npos) { msg.insert(bol,msg.substr(bol,eol-bol+1)); }
+			break;
+		}
+		case 5: if (isalpha(msg[pos])) { msg[pos] ^= 0x20; } break;
+		}
+	}
+#undef FUZZRAND
+}
+
+void sipParserBenchmark(std::ostream &os, unsigned iterations)
+{
+	if (iterations == 0) iterations = 1;
+	os << "parse, ns per message" << endl;
+	os << setw(32) << left << "message" << right << setw(10) << "sip" << setw(10) << "sdp" << endl;
+	for (unsigned s = 0; s < NUMIES(sSipSamples); s++) {
+		const char *text = sSipSamples[s].text;
+		SipMessage *msg = sipParseBuffer(text);
+		if (msg == NULL) {
+			os << setw(32) << left << sSipSamples[s].name << right << " not parsed" << endl;
+			continue;
+		}
+		string body = msg->msmContentType == "application/sdp" ? msg->msmBody : string("");
+		delete msg;
+
+		double start = nowNs();
+		for (unsigned i = 0; i < iterations; i++) { delete sipParseBuffer(text); }
+		double sipNs = (nowNs() - start) / iterations;
+		double sdpNs = 0;
+		if (body.size()) {
+			start = nowNs();
+			for (unsigned i = 0; i < iterations; i++) { SdpInfo sdp; sdp.sdpParse(body.c_str()); }
+			sdpNs = (nowNs() - start) / iterations;
+		}
+		os << setw(32) << left << sSipSamples[s].name << right << fixed << setprecision(0)
+			<< setw(10) << sipNs << setw(10) << sdpNs << endl;
+		os.unsetf(ios::fixed);
+	}
+
+	// The parser logs every malformed message, so keep the fuzz run smaller than the timing run.
+	unsigned cases = max(1u,iterations / 10), rejected = 0;
+	uint32_t seed = 1;
+	for (unsigned c = 0; c < cases; c++) {
+		string text(sSipSamples[c % NUMIES(sSipSamples)].text);
+		sipFuzz(text,seed);
+		SipMessage *msg = sipParseBuffer(text.c_str());
+		if (msg == NULL) { rejected++; continue; }
+		if (msg->msmContentType == "application/sdp") { SdpInfo sdp; sdp.sdpParse(msg->msmBody.c_str()); }
+		// The via decoding is the other hand written scanner, so run it on the fuzzed vias too.
+		msg->smGetBranch();
+		msg->smGetProxy();
+		delete msg;
+	}
+	os << "fuzz: " << cases << " cases, " << rejected << " rejected" << endl;
+}
+
 // See L3Cause in L3Enums.h
 string CallTerminationCause::getQ850CallTermText(int l3Cause) {
 	switch ((GSM::L3Cause::CCCause) l3Cause) {
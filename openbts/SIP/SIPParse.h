@@ -17,8 +17,13 @@
 #ifndef _SIPPARSE_H_
 #define _SIPPARSE_H_ 1
 #include <string>
+#include <string.h>
+#include <strings.h>
 #include <Defines.h>
 #include <list>
+#include <vector>
+#include <ostream>
+#include <ctype.h>
 #include <Logger.h>
 //#include "SIPBase.h"
 
@@ -53,6 +58,105 @@ struct SipParamList : public list<SipParam> {
 
 string parseURI(const char *buffer, SipParamList &params, SipParamList &headers);
 
+// A piece of a SIP message: a pointer into the parse buffer and a length.  It is not nul terminated and
+// does not own the chars, so it is only good while the buffer it points into is.
+struct SipSlice {
+	const char *sp;
+	unsigned sl;
+	SipSlice() : sp(""), sl(0) {}
+	SipSlice(const char *wp, unsigned wl) : sp(wp), sl(wl) {}
+	explicit SipSlice(const string &str) : sp(str.data()), sl(str.size()) {}
+	bool empty() const { return sl == 0; }
+	const char *end() const { return sp + sl; }
+	string str() const { return string(sp,sl); }
+	bool eql(const char *lit) const { return strlen(lit) == sl && 0 == memcmp(sp,lit,sl); }
+	bool caseEql(const char *lit) const { return strlen(lit) == sl && 0 == strncasecmp(sp,lit,sl); }
+};
+
+// Scanning within a slice.  These are the same rules as the old nul-terminated SipParseLine, bounded by the end of the slice.
+struct SipSliceScanner {
+	const char *pp, *end;
+	SipSliceScanner(SipSlice s) : pp(s.sp), end(s.end()) {}
+	void skipSpace() { while (pp < end && isspace((unsigned char)*pp)) { pp++; } }
+	bool scanChar(int ch) {
+		skipSpace();
+		if (pp >= end || *pp != ch) { return false; }
+		pp++;
+		skipSpace();
+		return true;
+	}
+	SipSlice scanNonSpace() {
+		skipSpace();
+		const char *bp = pp;
+		while (pp < end && ! isspace((unsigned char)*pp)) { pp++; }
+		return SipSlice(bp,pp-bp);
+	}
+	SipSlice scanToken();
+	bool scanInt(int *result);
+	bool scanQuotedString(string *result);
+	int scanGenericParam(SipSlice *name, string *value);
+	SipSlice rest() const { return SipSlice(pp,end-pp); }
+};
+
+// The headers the parser breaks out into SipMessage fields.  Everything else is SipHdrOther.
+enum SipHeaderId {
+	SipHdrOther, SipHdrTo, SipHdrFrom, SipHdrContact, SipHdrCSeq, SipHdrCallId, SipHdrVia,
+	SipHdrRecordRoute, SipHdrRoute, SipHdrMaxForwards, SipHdrContentType, SipHdrReason
+};
+
+struct SipHeaderView {
+	SipHeaderId mId;
+	SipSlice mName;
+	SipSlice mValue;		///< Leading white space removed.  Continuation lines are unfolded into the arena.
+};
+
+// The SIP message parser.  It makes one pass over the datagram and records where the first line, each header
+// and the body are, without copying anything; the header names are looked up once.
+// The only chars it owns are for headers with continuation lines, which are unfolded into a per-message arena
+// allocated on first use.  The values are left undecoded; see the sipDecode functions below to pick them apart.
+// sipParseBuffer uses this to fill in a SipMessage, with one string assignment per field.
+class SipMessageView {
+	static const unsigned cInlineHeaders = 128;
+	const char *mBuffer;
+	char *mArena;			///< For unfolded continuation lines, or NULL.
+	unsigned mArenaUsed;
+	unsigned mLineCount;
+	unsigned mBufferLen;
+	void svError(const char *msg);
+	int svNextLine(const char **pp, const char *end, SipSlice *line);
+	bool svScanSipVersion(SipSliceScanner &scanner);
+	SipMessageView(const SipMessageView &);		// Not copyable; the slices may point into mArena.
+	SipMessageView &operator=(const SipMessageView &);
+
+	public:
+	int mCode;				///< Status code for a reply, 0 for a request.
+	SipSlice mMethod, mReqUri, mReason;
+	SipHeaderView mHeaders[cInlineHeaders];
+	std::vector<SipHeaderView> mMoreHeaders;	///< Headers past cInlineHeaders, which is rare enough to allocate for.
+	unsigned mNumHeaders;		///< Including mMoreHeaders.
+	SipSlice mBody;
+
+	SipMessageView() : mBuffer(NULL), mArena(NULL), mArenaUsed(0), mLineCount(0), mBufferLen(0), mCode(0), mNumHeaders(0) {}
+	~SipMessageView() { delete[] mArena; }
+	/** Parse a message; the view refers to the buffer, which must outlive it.  Return false if it is malformed. */
+	bool svParse(const char *buffer, unsigned len);
+	const SipHeaderView &svHeader(unsigned i) const { return i < cInlineHeaders ? mHeaders[i] : mMoreHeaders[i-cInlineHeaders]; }
+	/** The first header with this id, or NULL. */
+	const SipHeaderView *svFind(SipHeaderId id) const;
+	/** Build a SipMessage from the view. */
+	SipMessage *svMakeMessage() const;
+};
+
+// Lazy decoders for header values.
+/** Split a To, From or Contact into display name, uri and the tail after the '>'.  Return false if there is a '<' without a '>'. */
+extern bool sipDecodeNameAddr(SipSlice header, SipSlice *display, SipSlice *uri, SipSlice *tail);
+/** Return the value of a param in a param list, eg, paramid ";tag=", or an empty slice. */
+extern SipSlice sipDecodeParam(SipSlice params, const char *paramid);
+/** Pull the sent-by and branch out of a Via, or the first Via of a comma list.  Return false if it is malformed. */
+extern bool sipDecodeVia(SipSlice via, string *sentBy, string *branch);
+/** Time the SIP and SDP parsers on typical messages, and run the SIP parser on fuzzed copies of them. */
+extern void sipParserBenchmark(std::ostream &os, unsigned iterations);
+
 // RFC2396 describes URI generic syntax.
 // This is the subset of a full URI that we use.
 // We dont care about URI params or headers.
@@ -77,12 +181,14 @@ class SipUri : public string {		// The base class string contains the full URI.
 		return (where == string::npos) ? string("") : addr.substr(where+1);
 	}
 	// Create a uri from another full uri.  If it is <uri> chop off the < and >
-	void uriSet(string fullUri) {
-		if (fullUri.size() == 0) { clear(); return; }	// Dont let fullUri[0] will throw an exception.
-		if (fullUri[0] == '<') {
-			assign(fullUri.substr(1,fullUri.rfind('>')-1));
+	void uriSet(string fullUri) { uriSet(SipSlice(fullUri)); }
+	void uriSet(SipSlice fullUri) {
+		if (fullUri.empty()) { clear(); return; }
+		if (fullUri.sp[0] == '<') {
+			const char *gt = (const char*)memrchr(fullUri.sp,'>',fullUri.sl);
+			assign(fullUri.sp+1, gt ? gt-fullUri.sp-1 : fullUri.sl-1);
 		} else {
-			assign(fullUri);
+			assign(fullUri.sp,fullUri.sl);
 		}
 	}
 	// Create a uri from a username and host.
@@ -98,6 +204,7 @@ struct SipVia : string {
 	string mViaBranch;
 	void viaParse(string);
 	SipVia(string vialine) { viaParse(vialine); }
+	SipVia() {}
 };
 
 // This is a From: or To:
@@ -110,7 +217,8 @@ class SipPreposition {
 	string mTag;
 	void rebuild();
 	public:
-	void prepSet(const string header);	// immediately parses the string as a Contact.
+	void prepSet(const string header) { prepSet(SipSlice(header)); }	// immediately parses the string as a Contact.
+	void prepSet(SipSlice header);
 	void prepSetUri(string uri) {
 		mUri.uriSet(uri);
 		rebuild();
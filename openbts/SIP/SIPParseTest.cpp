@@ -0,0 +1,389 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+// Checks the SIP and SDP parsers against the fields the previous parsers (the line at a time SipParseMessage
+// and the sscanf SDP parser) extracted from the same messages.  Those parsers are gone; their results are recorded here.
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <OpenBTSConfig.h>
+#include "SIPMessage.h"
+#include "SIPParse.h"
+
+using namespace std;
+using namespace SIP;
+
+OpenBTSConfig gConfig;
+
+static int failures = 0;
+
+struct SipSample {
+	const char *name;
+	const char *text;
+	const char *fields[40];		// What the previous parsers found, as name=value, empty values left out; NULL terminated.
+};
+
+static const SipSample sSamples[] = {
+	{ "REGISTER",
+		"REGISTER sip:127.0.0.1 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28c9d2c8d0a4f2d2\r\n"
+		"From: IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=lgsvejhbthozqgra\r\n"
+		"To: IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>\r\n"
+		"Call-ID: 1574262386@127.0.0.1\r\n"
+		"CSeq: 521 REGISTER\r\n"
+		"Contact: <sip:IMSI001010000000001@127.0.0.1:5062>;expires=5400\r\n"
+		"Authorization: Digest, nonce=944a5c5a1e2b5d2f0b0b28d6a7f0a3e2, uri=001010000000001, response=a8f2b1c4\r\n"
+		"User-Agent: OpenBTS 4.0.0 Build Date Oct 19 2014\r\n"
+		"Max-Forwards: 70\r\n"
+		"P-PHY-Info: OpenBTS; TA=1 TE=0.392 UpRSSI=-26.0 TxPwr=33 DnRSSIdBm=-111\r\n"
+		"P-Access-Network-Info: 3GPP-GERAN; cgi-3gpp=0010103ef000a\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		{
+			"method=REGISTER",
+			"uri=sip:127.0.0.1",
+			"to=IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>",
+			"to.user=IMSI001010000000001",
+			"to.host=127.0.0.1",
+			"from=IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=lgsvejhbthozqgra",
+			"from.tag=lgsvejhbthozqgra",
+			"from.user=IMSI001010000000001",
+			"from.host=127.0.0.1",
+			"contact=<sip:IMSI001010000000001@127.0.0.1:5062>;expires=5400",
+			"call-id=1574262386@127.0.0.1",
+			"cseq=521 REGISTER",
+			"vias=SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28c9d2c8d0a4f2d2",
+			"branch=z9hG4bKobts28c9d2c8d0a4f2d2",
+			"proxy=127.0.0.1:5062",
+			"max-forwards=70",
+			"Authorization=Digest, nonce=944a5c5a1e2b5d2f0b0b28d6a7f0a3e2, uri=001010000000001, response=a8f2b1c4",
+			"User-Agent=OpenBTS 4.0.0 Build Date Oct 19 2014",
+			"P-PHY-Info=OpenBTS; TA=1 TE=0.392 UpRSSI=-26.0 TxPwr=33 DnRSSIdBm=-111",
+			"P-Access-Network-Info=3GPP-GERAN; cgi-3gpp=0010103ef000a",
+			"Content-Length=0",
+		NULL } },
+	{ "401 Unauthorized",
+		"SIP/2.0 401 Unauthorized\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28c9d2c8d0a4f2d2;received=127.0.0.1\r\n"
+		"From: IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=lgsvejhbthozqgra\r\n"
+		"To: IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=2a3b\r\n"
+		"Call-ID: 1574262386@127.0.0.1\r\n"
+		"CSeq: 521 REGISTER\r\n"
+		"WWW-Authenticate: Digest realm=\"OpenBTS\",\r\n"
+		"  nonce=\"44f4eb5a6d2a4d8e8b0e0d4d2b3c1a0f\", algorithm=MD5\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		{
+			"code=401",
+			"reason=Unauthorized",
+			"to=IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=2a3b",
+			"to.tag=2a3b",
+			"to.user=IMSI001010000000001",
+			"to.host=127.0.0.1",
+			"from=IMSI001010000000001 <sip:IMSI001010000000001@127.0.0.1>;tag=lgsvejhbthozqgra",
+			"from.tag=lgsvejhbthozqgra",
+			"from.user=IMSI001010000000001",
+			"from.host=127.0.0.1",
+			"call-id=1574262386@127.0.0.1",
+			"cseq=521 REGISTER",
+			"vias=SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28c9d2c8d0a4f2d2;received=127.0.0.1",
+			"branch=z9hG4bKobts28c9d2c8d0a4f2d2",
+			"proxy=127.0.0.1:5062",
+			"WWW-Authenticate=Digest realm=\"OpenBTS\",    nonce=\"44f4eb5a6d2a4d8e8b0e0d4d2b3c1a0f\", algorithm=MD5",
+			"Content-Length=0",
+		NULL } },
+	{ "MESSAGE",
+		"MESSAGE sip:IMSI001010000000001@127.0.0.1:5062 SIP/2.0\r\n"
+		"v: SIP/2.0/UDP 127.0.0.1:5063;branch=z9hG4bK.e5c7a1b2\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5064 ; rport ; branch = \"z9hG4bK.7d\\\"q\"\r\n"
+		"f: 2102 <sip:2102@127.0.0.1>;tag=3c1e8f2a\r\n"
+		"t: sip:IMSI001010000000001@127.0.0.1\r\n"
+		"i: 8d2a7e14@127.0.0.1\r\n"
+		"CSeq: 17 MESSAGE\r\n"
+		"Content-Type: application/vnd.3gpp.sms\r\n"
+		"Max-Forwards:  70 \r\n"
+		"Content-Length: 34\r\n"
+		"\r\n"
+		"0001000a8121436587000005e8329bfd06",
+		{
+			"method=MESSAGE",
+			"uri=sip:IMSI001010000000001@127.0.0.1:5062",
+			"to=sip:IMSI001010000000001@127.0.0.1",
+			"to.user=IMSI001010000000001",
+			"to.host=127.0.0.1",
+			"from=2102 <sip:2102@127.0.0.1>;tag=3c1e8f2a",
+			"from.tag=3c1e8f2a",
+			"from.user=2102",
+			"from.host=127.0.0.1",
+			"call-id=8d2a7e14@127.0.0.1",
+			"cseq=17 MESSAGE",
+			"vias=SIP/2.0/UDP 127.0.0.1:5063;branch=z9hG4bK.e5c7a1b2,SIP/2.0/UDP 127.0.0.1:5064 ; rport ; branch = \"z9hG4bK.7d\\\"q\"",
+			"branch=z9hG4bK.e5c7a1b2",
+			"proxy=127.0.0.1:5063",
+			"max-forwards=70",
+			"content-type=application/vnd.3gpp.sms",
+			"body=0001000a8121436587000005e8329bfd06",
+			"Content-Length=34",
+		NULL } },
+	{ "INVITE",
+		"INVITE sip:IMSI001010000000001@127.0.0.1:5062 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5060;branch=z9hG4bK.1f2e3d4c,\r\n"
+		" SIP/2.0/UDP 10.0.0.5:5060;branch=z9hG4bK.9a8b\r\n"
+		"Record-Route: <sip:127.0.0.1;lr>\r\n"
+		"Route: <sip:10.0.0.5;lr>\r\n"
+		"From: \"Alice\" <sip:2102@127.0.0.1>;tag=as6d1b2c3e\r\n"
+		"To: <sip:IMSI001010000000001@127.0.0.1>\r\n"
+		"Contact: <sip:2102@10.0.0.5:5060>\r\n"
+		"Call-ID: 3a8f1c0e7b2d4e6f@10.0.0.5\r\n"
+		"CSeq: 102 INVITE\r\n"
+		"Max-Forwards: 69\r\n"
+		"Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO\r\n"
+		"Supported: replaces, timer\r\n"
+		"Content-Type: application/sdp\r\n"
+		"Content-Length: 233\r\n"
+		"\r\n"
+		"v=0\r\n"
+		"o=root 1821 1821 IN IP4 10.0.0.5\r\n"
+		"s=Asterisk PBX\r\n"
+		"c=IN IP4 10.0.0.5\r\n"
+		"t=0 0\r\n"
+		"m=audio 16414 RTP/AVP 3 0 8 101\r\n"
+		"a=rtpmap:3 GSM/8000\r\n"
+		"a=rtpmap:0 PCMU/8000\r\n"
+		"a=rtpmap:101 telephone-event/8000\r\n"
+		"a=fmtp:101 0-16\r\n"
+		"a=ptime:20\r\n"
+		"a=sendrecv\r\n",
+		{
+			"method=INVITE",
+			"uri=sip:IMSI001010000000001@127.0.0.1:5062",
+			"to=<sip:IMSI001010000000001@127.0.0.1>",
+			"to.user=IMSI001010000000001",
+			"to.host=127.0.0.1",
+			"from=\"Alice\" <sip:2102@127.0.0.1>;tag=as6d1b2c3e",
+			"from.tag=as6d1b2c3e",
+			"from.user=2102",
+			"from.host=127.0.0.1",
+			"contact=<sip:2102@10.0.0.5:5060>",
+			"call-id=3a8f1c0e7b2d4e6f@10.0.0.5",
+			"cseq=102 INVITE",
+			"vias=SIP/2.0/UDP 127.0.0.1:5060;branch=z9hG4bK.1f2e3d4c,   SIP/2.0/UDP 10.0.0.5:5060;branch=z9hG4bK.9a8b",
+			"branch=z9hG4bK.1f2e3d4c",
+			"proxy=127.0.0.1:5060",
+			"routes=<sip:10.0.0.5;lr>",
+			"record-routes=<sip:127.0.0.1;lr>",
+			"max-forwards=69",
+			"content-type=application/sdp",
+			"body=v=0\r\no=root 1821 1821 IN IP4 10.0.0.5\r\ns=Asterisk PBX\r\nc=IN IP4 10.0.0.5\r\nt=0 0\r\nm=audio 16414 RTP/AVP 3 0 8 101\r\na=rtpmap:3 GSM/8000\r\na=rtpmap:0 PCMU/8000\r\na=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\na=ptime:20\r\na=sendrecv\r\n",
+			"Allow=INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO",
+			"Supported=replaces, timer",
+			"Content-Length=233",
+			"sdp.port=16414",
+			"sdp.user=root",
+			"sdp.host=10.0.0.5",
+			"sdp.session=1821",
+			"sdp.version=1821",
+			"sdp.codecs=3",
+			"sdp.attrs=a=rtpmap:3 GSM/8000\r\na=rtpmap:0 PCMU/8000\r\na=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\na=ptime:20\r\na=sendrecv\r\n",
+		NULL } },
+	{ "200 OK",
+		"SIP/2.0 200 OK\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28a1\r\n"
+		"From: <sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf\r\n"
+		"To: <sip:2102@127.0.0.1>;tag=as0e1f2a3b\r\n"
+		"Call-ID: 20151203@127.0.0.1\r\n"
+		"CSeq: 1 INVITE\r\n"
+		"Contact: <sip:2102@10.0.0.5:5060>\r\n"
+		"Content-Type: application/sdp\r\n"
+		"Content-Length: 127\r\n"
+		"\r\n"
+		"v=0\r\n"
+		"o=root 1822 1822 IN IP4 10.0.0.5\r\n"
+		"s=Asterisk PBX\r\n"
+		"c=IN IP4 10.0.0.5\r\n"
+		"t=0 0\r\n"
+		"m=audio 18212 RTP/AVP 3\r\n"
+		"a=rtpmap:3 GSM/8000\r\n",
+		{
+			"code=200",
+			"reason=OK",
+			"to=<sip:2102@127.0.0.1>;tag=as0e1f2a3b",
+			"to.tag=as0e1f2a3b",
+			"to.user=2102",
+			"to.host=127.0.0.1",
+			"from=<sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf",
+			"from.tag=ojbdmcqfrmpxmdpf",
+			"from.user=IMSI001010000000001",
+			"from.host=127.0.0.1",
+			"contact=<sip:2102@10.0.0.5:5060>",
+			"call-id=20151203@127.0.0.1",
+			"cseq=1 INVITE",
+			"vias=SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28a1",
+			"branch=z9hG4bKobts28a1",
+			"proxy=127.0.0.1:5062",
+			"content-type=application/sdp",
+			"body=v=0\r\no=root 1822 1822 IN IP4 10.0.0.5\r\ns=Asterisk PBX\r\nc=IN IP4 10.0.0.5\r\nt=0 0\r\nm=audio 18212 RTP/AVP 3\r\na=rtpmap:3 GSM/8000\r\n",
+			"Content-Length=127",
+			"sdp.port=18212",
+			"sdp.user=root",
+			"sdp.host=10.0.0.5",
+			"sdp.session=1822",
+			"sdp.version=1822",
+			"sdp.codecs=3",
+			"sdp.attrs=a=rtpmap:3 GSM/8000\r\n",
+		NULL } },
+	{ "BYE",
+		"BYE sip:IMSI001010000000001@127.0.0.1:5062 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 10.0.0.5:5060;branch=z9hG4bK.0c1d\r\n"
+		"From: <sip:2102@127.0.0.1>;tag=as6d1b2c3e\r\n"
+		"To: <sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf\r\n"
+		"Call-ID: 3a8f1c0e7b2d4e6f@10.0.0.5\r\n"
+		"CSeq: 103 BYE\r\n"
+		"Reason: Q.850;cause=16;text=\"Normal Call Clearing\"\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n",
+		{
+			"method=BYE",
+			"uri=sip:IMSI001010000000001@127.0.0.1:5062",
+			"to=<sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf",
+			"to.tag=ojbdmcqfrmpxmdpf",
+			"to.user=IMSI001010000000001",
+			"to.host=127.0.0.1",
+			"from=<sip:2102@127.0.0.1>;tag=as6d1b2c3e",
+			"from.tag=as6d1b2c3e",
+			"from.user=2102",
+			"from.host=127.0.0.1",
+			"call-id=3a8f1c0e7b2d4e6f@10.0.0.5",
+			"cseq=103 BYE",
+			"vias=SIP/2.0/UDP 10.0.0.5:5060;branch=z9hG4bK.0c1d",
+			"branch=z9hG4bK.0c1d",
+			"proxy=10.0.0.5:5060",
+			"reason-header=Q.850;cause=16;text=\"Normal Call Clearing\"",
+			"Content-Length=0",
+		NULL } },
+	{ "ACK",
+		"ACK sip:2102@10.0.0.5:5060 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28a2\r\n"
+		"From: <sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf\r\n"
+		"To: <sip:2102@127.0.0.1>;tag=as0e1f2a3b\r\n"
+		"Call-ID: 20151203@127.0.0.1\r\n"
+		"CSeq: 1 ACK\r\n"
+		"\r\n",
+		{
+			"method=ACK",
+			"uri=sip:2102@10.0.0.5:5060",
+			"to=<sip:2102@127.0.0.1>;tag=as0e1f2a3b",
+			"to.tag=as0e1f2a3b",
+			"to.user=2102",
+			"to.host=127.0.0.1",
+			"from=<sip:IMSI001010000000001@127.0.0.1>;tag=ojbdmcqfrmpxmdpf",
+			"from.tag=ojbdmcqfrmpxmdpf",
+			"from.user=IMSI001010000000001",
+			"from.host=127.0.0.1",
+			"call-id=20151203@127.0.0.1",
+			"cseq=1 ACK",
+			"vias=SIP/2.0/UDP 127.0.0.1:5062;branch=z9hG4bKobts28a2",
+			"branch=z9hG4bKobts28a2",
+			"proxy=127.0.0.1:5062",
+		NULL } },
+};
+
+// The fields of a parsed message that the rest of OpenBTS uses, as name=value, leaving out empty ones.
+static vector<string> sipFields(SipMessage *msg, const SdpInfo *sdp)
+{
+	vector<string> fields;
+#define FIELD(name,value) { string v = (value); if (v.size()) { fields.push_back(string(name) + "=" + v); } }
+	FIELD("code",msg->msmCode ? format("%d",msg->msmCode) : string(""));
+	FIELD("reason",msg->msmReason);
+	FIELD("method",msg->msmReqMethod);
+	FIELD("uri",msg->msmReqUri);
+	FIELD("to",msg->msmTo.value());
+	FIELD("to.tag",msg->msmTo.getTag());
+	FIELD("to.user",msg->msmTo.uriUsername());
+	FIELD("to.host",msg->msmTo.uriHostAndPort());
+	FIELD("from",msg->msmFrom.value());
+	FIELD("from.tag",msg->msmFrom.getTag());
+	FIELD("from.user",msg->msmFrom.uriUsername());
+	FIELD("from.host",msg->msmFrom.uriHostAndPort());
+	FIELD("contact",msg->msmContactValue);
+	FIELD("call-id",msg->msmCallId);
+	FIELD("cseq",format("%d %s",msg->msmCSeqNum,msg->msmCSeqMethod.c_str()));
+	FIELD("vias",msg->msmVias);
+	FIELD("branch",msg->smGetBranch());
+	FIELD("proxy",msg->smGetProxy());
+	FIELD("routes",msg->msmRoutes);
+	FIELD("record-routes",msg->msmRecordRoutes);
+	FIELD("max-forwards",msg->msmMaxForwards);
+	FIELD("content-type",msg->msmContentType);
+	FIELD("reason-header",msg->msmReasonHeader);
+	FIELD("body",msg->msmBody);
+	for (SipParamList::const_iterator it = msg->msmHeaders.begin(); it != msg->msmHeaders.end(); it++) {
+		FIELD(it->mName,it->mValue);
+	}
+	if (sdp) {
+		FIELD("sdp.port",format("%u",sdp->sdpRtpPort));
+		FIELD("sdp.user",sdp->sdpUsername);
+		FIELD("sdp.host",sdp->sdpHost);
+		FIELD("sdp.session",sdp->sdpSessionId);
+		FIELD("sdp.version",sdp->sdpVersionId);
+		FIELD("sdp.codecs",sdp->sdpCodecList);
+		FIELD("sdp.attrs",sdp->sdpAttrs);
+	}
+#undef FIELD
+	return fields;
+}
+
+static void checkSample(const SipSample &sample)
+{
+	SipMessage *msg = sipParseBuffer(sample.text);
+	if (msg == NULL) {
+		printf("%s: not parsed\n",sample.name);
+		failures++;
+		return;
+	}
+	SdpInfo sdp;
+	sdp.sdpRtpPort = 0;
+	bool isSdp = msg->msmContentType == "application/sdp";
+	if (isSdp) { sdp.sdpParse(msg->msmBody.c_str()); }
+	vector<string> got = sipFields(msg,isSdp ? &sdp : NULL);
+	delete msg;
+
+	unsigned want = 0;
+	while (sample.fields[want]) { want++; }
+	int bad = 0;
+	for (unsigned i = 0; i < max(want,(unsigned)got.size()); i++) {
+		const char *expected = i < want ? sample.fields[i] : "(none)";
+		string actual = i < got.size() ? got[i] : string("(none)");
+		if (actual != expected) {
+			printf("%s: expected %s\n%s: got      %s\n",sample.name,expected,sample.name,actual.c_str());
+			bad = 1;
+		}
+	}
+	printf("%s: %u fields%s\n",sample.name,(unsigned)got.size(),bad ? ", MISMATCH" : "");
+	failures += bad;
+}
+
+int main(int argc, char **argv)
+{
+	for (unsigned s = 0; s < sizeof(sSamples)/sizeof(sSamples[0]); s++) {
+		checkSample(sSamples[s]);
+	}
+	printf(failures ? "FAILED\n" : "PASSED\n");
+	return failures ? 1 : 0;
+}
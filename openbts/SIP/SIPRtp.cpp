@@ -49,9 +49,18 @@ int gCountRtpSockets = 0;
 
 namespace SIP {
 const bool rtpUseRealTime = true;	// Enables a bug fix for the RTP library.
+static const unsigned cRxMaxBacklog = 3;	// Frames queued by the RTP engine beyond which rxFrame drops the oldest.
 
 void SipRtp::rtpStop()
 {
+	if (mStream) {
+		ScopedLock lock(mRtpLock);	// Wait for rxFrame or txFrame to get out.
+		RtpStream *save = mStream;
+		mStream = NULL;
+		save->rsClose();
+		gCountRtpSessions--;
+		gCountRtpSockets--;
+	}
 	if (mSession) {
 		RtpSession *save = mSession;
 		mSession = NULL;		// Prevent rxFrame and txFrame from using it, which is overkill because we dont call this until the state is not Active.
@@ -64,6 +73,7 @@ void SipRtp::rtpStop()
 void SipRtp::rtpInit()
 {
 	mSession = NULL; 
+	mStream = NULL;
 	mTxTime = 0;
 	mRxTime = 0;
 	mRxRealTime = 0;
@@ -83,6 +93,7 @@ void SipRtp::rtpText(std::ostringstream&os) const
 	// warning: The unbelievably stupid << sends the mDTMS char verbatim, and it is 0, which prematurely terminates the string.
 	unsigned dtmf = mDTMF;
 	os <<LOGVAR(dtmf) <<LOGVARM(mDTMFDuration)<<LOGVARM(mDTMFStartTime);
+	if (mStream) { mStream->rsText(os); }
 }
 
 
@@ -90,6 +101,23 @@ void SipRtp::initRTP1(const char *d_ip_addr, unsigned d_port, unsigned dialogId)
 {
 	LOG(DEBUG) << LOGVAR(d_ip_addr)<<LOGVAR(d_port)<<vsdbText();
 
+	if (mStream) {
+		// Already running on the RTP engine; the peer may have moved.
+		if (!mStream->rsSetRemote(d_ip_addr,d_port)) { LOG(ERR) << "RTP cannot resolve"<<LOGVAR(d_ip_addr)<<vsdbText(); }
+		return;
+	}
+	if (mSession == NULL && rtpEngineEnabled()) {
+		unsigned dtmfPayloadType = gConfig.getBool("SIP.DTMF.RFC2833") ? gConfig.getNum("SIP.DTMF.RFC2833.PayloadType") : 0;
+		// Hardcode RTP session type to GSM full rate (GSM 06.10), same as below.
+		mStream = RtpStream::rsOpen(mRTPPort,d_ip_addr,d_port,3,dtmfPayloadType,gConfig.getNum("GSM.SpeechBuffer"));
+		if (mStream) {
+			gCountRtpSessions++;
+			gCountRtpSockets++;
+			return;
+		}
+		LOG(ERR) << "RTP engine could not open the stream, using the RTP library"<<vsdbText();
+	}
+
 	if(mSession == NULL) {
 		mSession = rtp_session_new(RTP_SESSION_SENDRECV);
 		gCountRtpSessions++;
@@ -225,6 +253,21 @@ static int get_rtp_tev_type(char dtmf){
 bool SipRtp::txDtmf()
 {
 	ScopedLock lock(mRtpLock);
+	if (mStream) {
+		if (!mDTMFEnding && mDTMFDuration >= 63200) { mDTMFEnding = 1; }	// See below.
+		int event = get_rtp_tev_type(mDTMF);
+		if (event < 0) { return false; }
+		bool ok = mStream->rsSendEvent(mDTMFStartTime,event,mDTMFDuration == 0,!!mDTMFEnding,10,mDTMFDuration);
+		LOG(DEBUG) <<LOGVAR(mDTMF) <<LOGVAR(mDTMFEnding) <<LOGVAR(mDTMFDuration) <<LOGVAR(ok);
+		mDTMFDuration += 160;
+		if (mDTMFEnding) {
+			if (mDTMFEnding++ >= 3) {
+				mDTMFEnding = 0;
+				mDTMF = 0;
+			}
+		}
+		return ok;
+	}
 	//true means start
 	bool start = (mDTMFDuration == 0);
 	mblk_t *m = rtp_session_create_telephone_event_packet(mSession,start);
@@ -323,12 +366,17 @@ void SipRtp::txFrame(AudioFrame* frame, unsigned numFlushed)
 	// I think this is caused by bugs in the RTP library.
 
 	mTxTime += (numFlushed+1)*160;
-	int result = rtp_session_send_with_ts(mSession, frame->begin(), nbytes, mTxTime);
-	LOG(DEBUG) << LOGVAR(mTxTime) <<LOGVAR(result);
+	if (mStream) {
+		mStream->rsSendFrame(mTxTime,frame->begin(),nbytes);
+		LOG(DEBUG) << LOGVAR(mTxTime);
+	} else {
+		int result = rtp_session_send_with_ts(mSession, frame->begin(), nbytes, mTxTime);
+		LOG(DEBUG) << LOGVAR(mTxTime) <<LOGVAR(result);
 
-	// (pat) The result is the number of bytes sent over the network, which includes nbytes data + 12 bytes of RTP header.
-	if (result < nbytes || result != 33+12) {
-		LOG(DEBUG) << "rtp_session_send_with_ts("<<nbytes<<") returned "<<result <<vsdbText();
+		// (pat) The result is the number of bytes sent over the network, which includes nbytes data + 12 bytes of RTP header.
+		if (result < nbytes || result != 33+12) {
+			LOG(DEBUG) << "rtp_session_send_with_ts("<<nbytes<<") returned "<<result <<vsdbText();
+		}
 	}
 
 	if (mDTMF) {
@@ -357,6 +405,19 @@ AudioFrame *SipRtp::rxFrame()
 		LOG(DEBUG) <<"skip"<<LOGVAR(vgetSipState());
 		return 0; 
 	}
+	if (mStream) {
+		// The RTP engine has already paced and de-jittered the stream; just take what is due.
+		ScopedLock lock(mRtpLock);
+		if (!mStream) { return NULL; }
+		// If we were not here for a while, eg, during call setup, skip the stale frames rather than adding the latency.
+		while (mStream->rsRxPending() > cRxMaxBacklog) { mStream->rsRxPop(); }
+		RtpMediaFrame *frame = mStream->rsRxFront();
+		if (frame == NULL) { return NULL; }
+		AudioFrame *result = new AudioFrame(frame->mData,(int)frame->mLength);
+		mRxTime = frame->mTimestamp;
+		mStream->rsRxPop();
+		return result;
+	}
 	int more = 0;
 
 	// The buffer size is:
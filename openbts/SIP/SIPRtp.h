@@ -21,6 +21,7 @@
 #include <CodecSet.h>
 #include <ByteVector.h>
 #include "SIPBase.h"
+#include "SIPRtpEngine.h"
 
 #include <ortp/ortp.h>
 #undef WARNING		// The nimrods defined this to "warning"
@@ -40,7 +41,8 @@ class SipRtp {
 	//@{
 	unsigned mRTPPort;
 	Control::CodecSet mCodec;
-	RtpSession * mSession;		///< RTP media session
+	RtpSession * mSession;		///< RTP media session, if we are using the RTP library.
+	RtpStream * mStream;		///< RTP media stream, if we are using the RTP engine.
 	unsigned int mTxTime;		///< RTP transmission timestamp in 8 kHz samples
 	unsigned int mRxTime;		///< RTP receive timestamp in 8 kHz samples
 	uint64_t mRxRealTime;		// In msecs.
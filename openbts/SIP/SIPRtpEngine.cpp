@@ -0,0 +1,477 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#define LOG_GROUP LogGroup::SIP		// Can set Log.Level.SIP for debugging
+#include <config.h>
+#include <OpenBTSConfig.h>
+#include <Logger.h>
+#include <Sockets.h>
+#include "SIPRtpEngine.h"
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <arpa/inet.h>
+
+namespace SIP {
+
+const unsigned RtpStream::cJitterSlots;		// min() takes references, so these need definitions.
+const unsigned RtpStream::cJitterMaxTarget;
+
+static RtpEngine *sRtpEngines = NULL;
+static unsigned sRtpNumEngines = 0;
+
+// Arrival time in RTP units, ie, 8kHz samples.
+static int64_t rtpArrivalTime()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (int64_t)now.tv_sec * 8000 + now.tv_nsec / 125000;
+}
+
+RtpStream::RtpStream()
+	: mSock(-1), mLocalPort(0), mStreamId(0), mEngine(NULL), mPayloadType(3), mDtmfPayloadType(0),
+	mTxSeq(random()), mTxSsrc(random()),
+	mRxSynced(false), mRxSsrc(0), mBaseTs(0), mPlayTs(0), mHighTs(0), mPlayHold(0), mIdleTicks(0),
+	mTarget(0), mAdaptive(false), mLastArrival(0), mLastArrivalTs(0), mJitterEstimate(0),
+	mRxPackets(0), mRxLate(0), mRxLost(0), mRxDropped(0), mRxForeign(0), mRxResyncs(0), mTxPackets(0), mTxErrors(0)
+{
+	memset(&mRemote,0,sizeof(mRemote));
+	mRemoteLatched = false;
+	for (unsigned i = 0; i < cJitterSlots; i++) { mJitter[i].mFull = false; }
+}
+
+RtpStream::~RtpStream()
+{
+	if (mSock >= 0) { close(mSock); }
+}
+
+RtpStream *RtpStream::rsOpen(unsigned localPort, const char *remoteIp, unsigned remotePort,
+	unsigned payloadType, unsigned dtmfPayloadType, int speechBuffer)
+{
+	if (sRtpNumEngines == 0) { return NULL; }
+	RtpStream *stream = new RtpStream();
+	stream->mLocalPort = localPort;
+	stream->mPayloadType = payloadType;
+	stream->mDtmfPayloadType = dtmfPayloadType;
+	if (speechBuffer == 1) {
+		stream->mAdaptive = true;
+		stream->mTarget = 3;	// Start at 60ms and let the jitter estimate move it.
+	} else {
+		stream->mTarget = min((unsigned)(speechBuffer + 19) / 20, cJitterMaxTarget);
+	}
+	if (!stream->rsSetRemote(remoteIp,remotePort)) {
+		LOG(ERR) << "RTP cannot resolve remote address"<<LOGVAR(remoteIp)<<LOGVAR(remotePort);
+		delete stream;
+		return NULL;
+	}
+
+	stream->mSock = socket(AF_INET,SOCK_DGRAM,0);
+	if (stream->mSock < 0) {
+		LOG(ERR) << "RTP socket failed: "<<strerror(errno);
+		delete stream;
+		return NULL;
+	}
+	int one = 1;
+	setsockopt(stream->mSock,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+	struct sockaddr_in local;
+	memset(&local,0,sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = INADDR_ANY;
+	local.sin_port = htons(localPort);
+	if (bind(stream->mSock,(struct sockaddr*)&local,sizeof(local)) < 0 ||
+		fcntl(stream->mSock,F_SETFL,O_NONBLOCK) < 0) {
+		LOG(ERR) << "RTP cannot open local port"<<LOGVAR(localPort)<<": "<<strerror(errno);
+		delete stream;
+		return NULL;
+	}
+
+	// Put it on the engine with the fewest streams.
+	RtpEngine *best = &sRtpEngines[0];
+	unsigned bestSize = best->reSize();
+	for (unsigned i = 1; i < sRtpNumEngines; i++) {
+		unsigned size = sRtpEngines[i].reSize();
+		if (size < bestSize) { best = &sRtpEngines[i]; bestSize = size; }
+	}
+	if (!best->reAdd(stream)) {
+		delete stream;
+		return NULL;
+	}
+	WATCHF("*** RTP engine stream local=%d remote=%s %d\n",localPort,remoteIp,remotePort);
+	return stream;
+}
+
+void RtpStream::rsClose()
+{
+	if (mEngine) { mEngine->reRemove(this); }
+	delete this;
+}
+
+bool RtpStream::rsSetRemote(const char *remoteIp, unsigned remotePort)
+{
+	struct sockaddr_in remote;
+	if (!resolveAddress(&remote,remoteIp,remotePort)) { return false; }
+	ScopedLock lock(mRemoteLock);
+	mRemote = remote;
+	mRemoteLatched = false;
+	return true;
+}
+
+bool RtpStream::rsSendPacket(unsigned payloadType, bool marker, uint32_t ts, const unsigned char *payload, unsigned len)
+{
+	unsigned char pkt[cRtpHeaderBytes + cRtpMaxPayload];
+	if (len > cRtpMaxPayload) { return false; }
+	pkt[0] = 0x80;		// Version 2, no padding, extension or CSRCs.
+	pkt[1] = (marker ? 0x80 : 0) | (payloadType & 0x7f);
+	pkt[2] = mTxSeq >> 8; pkt[3] = mTxSeq;
+	pkt[4] = ts >> 24; pkt[5] = ts >> 16; pkt[6] = ts >> 8; pkt[7] = ts;
+	pkt[8] = mTxSsrc >> 24; pkt[9] = mTxSsrc >> 16; pkt[10] = mTxSsrc >> 8; pkt[11] = mTxSsrc;
+	memcpy(pkt + cRtpHeaderBytes,payload,len);
+	mTxSeq++;
+
+	struct sockaddr_in remote;
+	{ ScopedLock lock(mRemoteLock); remote = mRemote; }
+	ssize_t result = sendto(mSock,pkt,cRtpHeaderBytes + len,MSG_DONTWAIT|MSG_NOSIGNAL,(struct sockaddr*)&remote,sizeof(remote));
+	if (result != (ssize_t)(cRtpHeaderBytes + len)) {
+		// Dont LOG every one of these; a dead peer would generate 50 per second.
+		if (mTxErrors++ == 0) { LOG(NOTICE) << "RTP send failed"<<LOGVAR(mLocalPort)<<": "<<strerror(errno); }
+		return false;
+	}
+	mTxPackets++;
+	return true;
+}
+
+bool RtpStream::rsSendFrame(uint32_t ts, const unsigned char *payload, unsigned len)
+{
+	return rsSendPacket(mPayloadType,mTxPackets == 0,ts,payload,len);
+}
+
+// RFC2833 3.5 telephone-event payload.
+bool RtpStream::rsSendEvent(uint32_t ts, unsigned event, bool start, bool end, unsigned volume, unsigned duration)
+{
+	if (mDtmfPayloadType == 0) { return false; }	// RFC2833 is not configured.
+	unsigned char payload[4];
+	payload[0] = event;
+	payload[1] = (end ? 0x80 : 0) | (volume & 0x3f);
+	payload[2] = duration >> 8;
+	payload[3] = duration;
+	return rsSendPacket(mDtmfPayloadType,start,ts,payload,sizeof(payload));
+}
+
+// The target jitter buffer depth in frames for the adaptive mode: three times the RFC3550 jitter estimate, rounded up.
+unsigned RtpStream::rsAdaptiveTarget() const
+{
+	unsigned jitter = mJitterEstimate / 16;
+	return max(1u,min((3*jitter + cRtpSamplesPerFrame - 1) / cRtpSamplesPerFrame,cJitterMaxTarget));
+}
+
+void RtpStream::rsResync(uint32_t ts, uint32_t ssrc)
+{
+	if (mRxSynced) { mRxResyncs++; }
+	for (unsigned i = 0; i < cJitterSlots; i++) { mJitter[i].mFull = false; }
+	mRxSynced = true;
+	mRxSsrc = ssrc;
+	mBaseTs = mPlayTs = mHighTs = ts;
+	if (mAdaptive) { mTarget = rsAdaptiveTarget(); }
+	mPlayHold = mTarget;
+	mIdleTicks = 0;
+}
+
+// Called by the engine thread for each packet.
+void RtpStream::rsReceive(const unsigned char *pkt, unsigned len, const struct sockaddr_in &from, int64_t now)
+{
+	// RFC3550 5.1 fixed header.
+	if (len < cRtpHeaderBytes || (pkt[0] >> 6) != 2) { return; }
+	unsigned hdr = cRtpHeaderBytes + 4 * (pkt[0] & 0x0f);
+	if (pkt[0] & 0x10) {		// Header extension.
+		if (hdr + 4 > len) { return; }
+		hdr += 4 + 4 * ((pkt[hdr+2] << 8) | pkt[hdr+3]);
+	}
+	if (pkt[0] & 0x20) {		// Padding.
+		unsigned padding = pkt[len-1];
+		len = (padding < len) ? len - padding : 0;
+	}
+	if (hdr > len) { return; }
+	unsigned payloadType = pkt[1] & 0x7f;
+	uint32_t ts = (pkt[4] << 24) | (pkt[5] << 16) | (pkt[6] << 8) | pkt[7];
+	uint32_t ssrc = (pkt[8] << 24) | (pkt[9] << 16) | (pkt[10] << 8) | pkt[11];
+
+	// Symmetric RTP: reply to wherever the peer is really sending from, which matters behind a NAT.
+	// Only the first packet after the remote is set may move it; anything from elsewhere after that is dropped,
+	// so a stray or hostile sender cannot take over the media stream.
+	{
+		ScopedLock lock(mRemoteLock);
+		if (from.sin_addr.s_addr != mRemote.sin_addr.s_addr || from.sin_port != mRemote.sin_port) {
+			if (mRemoteLatched) { mRxForeign++; return; }
+			LOG(INFO) << "RTP peer moved"<<LOGVAR(mLocalPort)<<" to "<<inet_ntoa(from.sin_addr)<<":"<<ntohs(from.sin_port);
+			mRemote = from;
+		}
+		mRemoteLatched = true;
+	}
+	mRxPackets++;
+
+	// We only play out speech; comfort noise and telephone-events from the peer are ignored, as before.
+	if (payloadType != mPayloadType) { return; }
+	unsigned payloadLen = len - hdr;
+	if (payloadLen > cRtpMaxPayload) { mRxDropped++; return; }
+
+	// RFC3550 6.4.1 interarrival jitter, kept times 16 to avoid the division.
+	if (mLastArrival) {
+		int64_t d = (now - mLastArrival) - (int32_t)(ts - mLastArrivalTs);
+		if (d < 0) { d = -d; }
+		if (d > 8000) { d = 8000; }		// Dont let a discontinuity blow up the estimate.
+		mJitterEstimate += (unsigned)d - ((mJitterEstimate + 8) / 16);
+	}
+	mLastArrival = now;
+	mLastArrivalTs = ts;
+
+	if (!mRxSynced || ssrc != mRxSsrc) {
+		rsResync(ts,ssrc);
+	} else {
+		int32_t delta = (int32_t)(ts - mPlayTs);
+		if (delta < 0) {
+			mRxLate++;
+			// A big backward jump is the peer restarting its timestamps, eg, after a handover.
+			if (delta > -(int32_t)(cJitterSlots * cRtpSamplesPerFrame)) { return; }
+			rsResync(ts,ssrc);
+		} else if (delta >= (int32_t)(cJitterSlots * cRtpSamplesPerFrame)) {
+			rsResync(ts,ssrc);		// Timestamp jump forward.
+		}
+	}
+
+	JitterSlot &slot = mJitter[((ts - mBaseTs) / cRtpSamplesPerFrame) & (cJitterSlots-1)];
+	if (slot.mFull && slot.mFrame.mTimestamp == ts) { return; }		// Duplicate.
+	slot.mFull = true;
+	slot.mFrame.mTimestamp = ts;
+	slot.mFrame.mLength = payloadLen;
+	memcpy(slot.mFrame.mData,pkt + hdr,payloadLen);
+	if ((int32_t)(ts - mHighTs) > 0) { mHighTs = ts; }
+	mIdleTicks = 0;
+}
+
+// Called by the engine thread every 20ms: move at most one frame from the jitter buffer to the channel thread.
+void RtpStream::rsTick()
+{
+	if (!mRxSynced) { return; }
+	if (mPlayHold) { mPlayHold--; return; }
+
+	int32_t depth = (int32_t)(mHighTs - mPlayTs) / (int32_t)cRtpSamplesPerFrame + 1;	// Frames buffered, including gaps.
+	if (depth <= 0) {
+		// Nothing buffered.  Keep the clock running through short gaps; after a long one,
+		// eg, the peer muted or went on hold, start over on the next packet.
+		if (++mIdleTicks > cJitterSlots) { mRxSynced = false; }
+		mPlayTs += cRtpSamplesPerFrame;
+		return;
+	}
+
+	if (mAdaptive) {
+		unsigned want = rsAdaptiveTarget();
+		if (want > mTarget) { mTarget++; return; }		// Let the buffer deepen by one frame.
+		if (want < mTarget) { mTarget--; }				// The trim below will shorten it.
+	}
+
+	// If the peer clock runs faster than ours or a burst arrived, drop the oldest frames to get back to the target latency.
+	while (depth > (int32_t)mTarget + 2) {
+		JitterSlot &old = mJitter[((mPlayTs - mBaseTs) / cRtpSamplesPerFrame) & (cJitterSlots-1)];
+		if (old.mFull) { old.mFull = false; mRxDropped++; }
+		mPlayTs += cRtpSamplesPerFrame;
+		depth--;
+	}
+
+	JitterSlot &slot = mJitter[((mPlayTs - mBaseTs) / cRtpSamplesPerFrame) & (cJitterSlots-1)];
+	if (slot.mFull && slot.mFrame.mTimestamp == mPlayTs) {
+		if (RtpMediaFrame *out = mRxRing.ringReserve()) {
+			*out = slot.mFrame;
+			mRxRing.ringPush();
+		} else {
+			mRxDropped++;		// The channel thread is not keeping up.
+		}
+	} else {
+		mRxLost++;
+	}
+	slot.mFull = false;
+	mPlayTs += cRtpSamplesPerFrame;
+}
+
+void RtpStream::rsText(std::ostream &os) const
+{
+	os << " rtpEngine=(" <<LOGVAR(mLocalPort) <<LOGVAR(mRxPackets) <<LOGVAR(mRxLate) <<LOGVAR(mRxLost)
+		<<LOGVAR(mRxDropped) <<LOGVAR(mRxForeign) <<LOGVAR(mRxResyncs) <<LOGVAR(mTarget)
+		<<LOGVAR2("jitterMs",mJitterEstimate / 16 / 8) <<LOGVAR(mTxPackets) <<LOGVAR(mTxErrors) <<")";
+}
+
+
+RtpEngine::~RtpEngine()
+{
+	if (mTimerFd >= 0) { close(mTimerFd); }
+	if (mEpoll >= 0) { close(mEpoll); }
+}
+
+bool RtpEngine::reOpen()
+{
+	mEpoll = epoll_create(64);		// The size is only a hint.
+	if (mEpoll < 0) {
+		LOG(ALERT) << "RTP engine epoll_create failed: "<<strerror(errno);
+		return false;
+	}
+	mTimerFd = timerfd_create(CLOCK_MONOTONIC,0);
+	if (mTimerFd < 0) {
+		LOG(ALERT) << "RTP engine timerfd_create failed: "<<strerror(errno);
+		return false;
+	}
+	struct itimerspec tick;
+	tick.it_interval.tv_sec = 0;
+	tick.it_interval.tv_nsec = 20 * 1000 * 1000;
+	tick.it_value = tick.it_interval;
+	timerfd_settime(mTimerFd,0,&tick,NULL);
+	struct epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = 0;		// Stream ids start at 1, so 0 is the timer.
+	if (epoll_ctl(mEpoll,EPOLL_CTL_ADD,mTimerFd,&ev) < 0) {
+		LOG(ALERT) << "RTP engine epoll_ctl failed: "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+void RtpEngine::reRun()
+{
+	mThread.start((void *(*)(void*))reServiceLoop,this);
+}
+
+bool RtpEngine::reAdd(RtpStream *stream)
+{
+	ScopedLock lock(mEngineLock);
+	if (++mNextId == 0) { ++mNextId; }
+	stream->mStreamId = mNextId;
+	struct epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = stream->mStreamId;
+	if (epoll_ctl(mEpoll,EPOLL_CTL_ADD,stream->mSock,&ev) < 0) {
+		LOG(ERR) << "RTP engine epoll_ctl failed: "<<strerror(errno);
+		return false;
+	}
+	stream->mEngine = this;
+	mStreams[stream->mStreamId] = stream;
+	return true;
+}
+
+void RtpEngine::reRemove(RtpStream *stream)
+{
+	// The engine thread holds mEngineLock while it touches a stream, and finds the stream by id for each epoll event,
+	// so once it is out of the map an event already returned by epoll_wait is harmless.
+	ScopedLock lock(mEngineLock);
+	epoll_ctl(mEpoll,EPOLL_CTL_DEL,stream->mSock,NULL);
+	mStreams.erase(stream->mStreamId);
+	stream->mEngine = NULL;
+}
+
+void *RtpEngine::reServiceLoop(void *arg)
+{
+	static_cast<RtpEngine*>(arg)->reService();
+	return NULL;
+}
+
+void RtpEngine::reService()
+{
+	const int cMaxEvents = 64;
+	struct epoll_event events[cMaxEvents];
+	unsigned char buf[MAX_UDP_LENGTH];
+	while (1) {
+		int n = epoll_wait(mEpoll,events,cMaxEvents,-1);
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			LOG(ALERT) << "RTP engine epoll_wait failed: "<<strerror(errno);
+			return;
+		}
+		int64_t now = rtpArrivalTime();
+		ScopedLock lock(mEngineLock);
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.u64 == 0) {
+				uint64_t expirations = 0;
+				if (read(mTimerFd,&expirations,sizeof(expirations)) != sizeof(expirations)) { continue; }
+				// If we were late, catch up, but not forever; the channel thread trims a backlog anyway.
+				if (expirations > 1) { mTicksLate += expirations - 1; }
+				unsigned ticks = min((unsigned)expirations,5u);
+				for (StreamMap::iterator it = mStreams.begin(); it != mStreams.end(); it++) {
+					for (unsigned t = 0; t < ticks; t++) { it->second->rsTick(); }
+				}
+				continue;
+			}
+			StreamMap::iterator it = mStreams.find((unsigned)events[i].data.u64);
+			if (it == mStreams.end()) { continue; }
+			RtpStream *stream = it->second;
+			while (1) {
+				struct sockaddr_in from;
+				socklen_t fromLen = sizeof(from);
+				ssize_t len = recvfrom(stream->mSock,buf,sizeof(buf),MSG_DONTWAIT,(struct sockaddr*)&from,&fromLen);
+				if (len < 0) { break; }
+				stream->rsReceive(buf,len,from,now);
+			}
+		}
+	}
+}
+
+void RtpEngine::reText(std::ostream &os)
+{
+	ScopedLock lock(mEngineLock);
+	os << "streams=" << mStreams.size() << " ticksLate=" << mTicksLate;
+}
+
+
+void rtpEngineStart()
+{
+	if (!gConfig.getBool("RTP.Engine")) { return; }
+	unsigned numEngines = gConfig.getNum("RTP.Engine.Threads");
+	if (numEngines == 0) { numEngines = 1; }
+	RtpEngine *engines = new RtpEngine[numEngines];
+	// Open them all before starting any thread, so a failure can just throw the lot away.
+	for (unsigned i = 0; i < numEngines; i++) {
+		if (!engines[i].reOpen()) {
+			LOG(ALERT) << "RTP engine failed to start, using the RTP library";
+			delete [] engines;
+			return;
+		}
+	}
+	for (unsigned i = 0; i < numEngines; i++) { engines[i].reRun(); }
+	sRtpEngines = engines;
+	sRtpNumEngines = numEngines;
+	LOG(INFO) << "RTP engine started with "<<numEngines<<" threads";
+}
+
+bool rtpEngineEnabled()
+{
+	return sRtpNumEngines && gConfig.getBool("RTP.Engine");
+}
+
+void rtpEngineText(std::ostream &os)
+{
+	if (sRtpNumEngines == 0) { os << "RTP engine off\n"; return; }
+	for (unsigned i = 0; i < sRtpNumEngines; i++) {
+		os << "RTP engine " << i << ": "; sRtpEngines[i].reText(os); os << "\n";
+	}
+}
+
+};	// namespace SIP
+// vim: ts=4 sw=4
@@ -0,0 +1,190 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#ifndef _SIPRTPENGINE_H_
+#define _SIPRTPENGINE_H_ 1
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <map>
+#include <ostream>
+#include <Threads.h>
+
+namespace SIP {
+
+// The RTP media engine.
+// Formerly each call owned an ortp RtpSession and the L3 channel thread pulled frames out of it by polling
+// rtp_session_recv_with_ts every 20ms, pacing itself with gettimeofday, which meant every voice call cost a socket poll
+// plus the library's jitter buffer locking on each pass through the L3 loop whether or not anything had arrived.
+// Now a few engine threads (RTP.Engine.Threads) own all the RTP sockets via epoll.  Each engine thread parses incoming
+// packets, jitter-buffers them by RTP timestamp, and on its own 20ms timerfd tick plays one frame per stream out into
+// a single-producer single-consumer ring, from which the channel thread takes it without taking any lock.
+// Uplink frames are small and arrive from the channel thread already paced by the radio, so they are built and sent
+// with a non-blocking sendto directly from the channel thread; there is nothing for the engine thread to do for them.
+// RTCP is not generated, so the engine is off by default (RTP.Engine) and calls use the ortp path.
+
+static const unsigned cRtpHeaderBytes = 12;
+static const unsigned cRtpMaxPayload = 40;		///< GSM FR is 33 bytes, TFO (3GPP 28.062 5.2.2) is 40.
+static const unsigned cRtpSamplesPerFrame = 160;	///< 20ms at 8000 Hz.
+
+struct RtpMediaFrame {
+	uint32_t mTimestamp;
+	unsigned mLength;
+	unsigned char mData[cRtpMaxPayload];
+};
+
+/**
+	Lock-free ring for exactly one producer thread and one consumer thread.
+	The producer owns mHead and the consumer owns mTail; each only reads the other's index.
+*/
+class RtpFrameRing {
+	static const unsigned cSize = 16;		///< 320ms of speech; must be a power of 2.
+	RtpMediaFrame mSlots[cSize];
+	volatile unsigned mHead;	///< Next slot to write, free running.
+	volatile unsigned mTail;	///< Next slot to read, free running.
+	public:
+	RtpFrameRing() : mHead(0), mTail(0) {}
+	unsigned ringSize() const { return mHead - mTail; }
+	/** Producer side: return the slot to fill, or NULL if full.  The slot is not visible until ringPush(). */
+	RtpMediaFrame *ringReserve() { return (mHead - mTail >= cSize) ? NULL : &mSlots[mHead & (cSize-1)]; }
+	void ringPush() { __sync_synchronize(); mHead = mHead + 1; }
+	/** Consumer side: return the oldest slot, or NULL if empty.  The slot stays valid until ringPop(). */
+	RtpMediaFrame *ringFront() {
+		if (mHead == mTail) { return NULL; }
+		__sync_synchronize();
+		return &mSlots[mTail & (cSize-1)];
+	}
+	void ringPop() { __sync_synchronize(); mTail = mTail + 1; }
+};
+
+class RtpEngine;
+
+/** One RTP media stream, ie, one socket.  Created by rsOpen and deleted by rsClose. */
+class RtpStream {
+	friend class RtpEngine;
+	static const unsigned cJitterSlots = 32;		///< Jitter buffer window in frames; must be a power of 2.
+	static const unsigned cJitterMaxTarget = 10;	///< 200ms, which is the limit of GSM.SpeechBuffer.
+
+	int mSock;
+	unsigned mLocalPort;
+	unsigned mStreamId;		///< Key in the engine map; the epoll event data.
+	RtpEngine *mEngine;
+	unsigned mPayloadType;
+	unsigned mDtmfPayloadType;
+
+	// Written by the engine thread when symmetric RTP learns the peer, read by the sending thread.
+	Mutex mRemoteLock;
+	struct sockaddr_in mRemote;
+	bool mRemoteLatched;	///< Set by the first packet after rsSetRemote; after that other sources are ignored.
+
+	// Transmit state, owned by the sending thread.
+	uint16_t mTxSeq;
+	uint32_t mTxSsrc;
+
+	// Receive state and the jitter buffer, owned by the engine thread.
+	struct JitterSlot { bool mFull; RtpMediaFrame mFrame; };
+	JitterSlot mJitter[cJitterSlots];
+	bool mRxSynced;			///< False until the first packet, and after a resync.
+	uint32_t mRxSsrc;
+	uint32_t mBaseTs;		///< Timestamp of jitter buffer slot 0, set at resync.
+	uint32_t mPlayTs;		///< Timestamp of the next frame to play out.
+	uint32_t mHighTs;		///< Highest timestamp received since the last resync.
+	unsigned mPlayHold;		///< Ticks to wait before starting play out, to fill the buffer to mTarget.
+	unsigned mIdleTicks;	///< Consecutive ticks with nothing buffered.
+	unsigned mTarget;		///< Jitter buffer depth in frames.
+	bool mAdaptive;
+	int64_t mLastArrival;	///< In 8kHz units, for the RFC3550 6.4.1 interarrival jitter.
+	uint32_t mLastArrivalTs;
+	unsigned mJitterEstimate;	///< RFC3550 6.4.1 'J' in 8kHz units, times 16.
+
+	// Frames ready for the channel thread.
+	RtpFrameRing mRxRing;
+
+	// Statistics, written by one thread, read approximately by the CLI.
+	unsigned mRxPackets, mRxLate, mRxLost, mRxDropped, mRxForeign, mRxResyncs, mTxPackets, mTxErrors;
+
+	RtpStream();
+	~RtpStream();
+	unsigned rsAdaptiveTarget() const;
+	void rsResync(uint32_t ts, uint32_t ssrc);
+	void rsReceive(const unsigned char *pkt, unsigned len, const struct sockaddr_in &from, int64_t now);
+	void rsTick();
+	bool rsSendPacket(unsigned payloadType, bool marker, uint32_t ts, const unsigned char *payload, unsigned len);
+
+	public:
+	/**
+		Open the local RTP port and connect the stream to an engine thread.
+		@param speechBuffer The GSM.SpeechBuffer value: 0 for none, 1 for adaptive, otherwise msecs.
+		@return the stream or NULL if the socket could not be opened.
+	*/
+	static RtpStream *rsOpen(unsigned localPort, const char *remoteIp, unsigned remotePort,
+		unsigned payloadType, unsigned dtmfPayloadType, int speechBuffer);
+	/** Remove the stream from its engine and delete it; the caller must not be using it in another thread. */
+	void rsClose();
+
+	/** Change the peer, eg, after a re-INVITE; return false if the address does not resolve. */
+	bool rsSetRemote(const char *remoteIp, unsigned remotePort);
+
+	/** Send a speech frame. */
+	bool rsSendFrame(uint32_t ts, const unsigned char *payload, unsigned len);
+	/** Send an RFC2833 telephone-event packet. */
+	bool rsSendEvent(uint32_t ts, unsigned event, bool start, bool end, unsigned volume, unsigned duration);
+	/** Take the next downlink frame, or NULL if none is due.  The frame stays valid until rsRxPop(). */
+	RtpMediaFrame *rsRxFront() { return mRxRing.ringFront(); }
+	void rsRxPop() { mRxRing.ringPop(); }
+	unsigned rsRxPending() const { return mRxRing.ringSize(); }
+
+	unsigned rsLocalPort() const { return mLocalPort; }
+	void rsText(std::ostream &os) const;
+};
+
+/** One engine thread: an epoll set of RTP sockets plus the 20ms play out clock. */
+class RtpEngine {
+	int mEpoll;
+	int mTimerFd;
+	Thread mThread;
+	Mutex mEngineLock;		///< Protects mStreams; held by the engine thread while it touches a stream.
+	typedef std::map<unsigned,RtpStream*> StreamMap;
+	StreamMap mStreams;
+	unsigned mNextId;
+	unsigned mTicksLate;	///< Timer expirations missed because the engine thread was late.
+
+	static void *reServiceLoop(void *arg);
+	void reService();
+
+	public:
+	RtpEngine() : mEpoll(-1), mTimerFd(-1), mNextId(0), mTicksLate(0) {}
+	/** Close the descriptors of an engine whose thread was never started. */
+	~RtpEngine();
+	/** Create the epoll set and the play out timer. */
+	bool reOpen();
+	/** Start the engine thread. */
+	void reRun();
+	bool reAdd(RtpStream *stream);
+	void reRemove(RtpStream *stream);
+	unsigned reSize() { ScopedLock lock(mEngineLock); return mStreams.size(); }
+	void reText(std::ostream &os);
+};
+
+/** Start the engine threads; a no-op if RTP.Engine is off. */
+extern void rtpEngineStart();
+/** True if new calls should use the engine rather than the ortp library. */
+extern bool rtpEngineEnabled();
+extern void rtpEngineText(std::ostream &os);
+
+};	// namespace SIP
+#endif
+// vim: ts=4 sw=4
@@ -344,7 +344,8 @@ bool SipClientTrLayer::TLPeriodicServiceV()
 		stDestroyV();
 		return true;
 	}
-	if (mstState == stCallingOrTrying && mTimerAE.expired()) { stWrite(&mstOutRequest); mTimerAE.setDouble(); }
+	// RFC3261 17.1.1.2 Timer A doubles without limit, bounded only by Timer B; 17.1.2.2 Timer E doubles up to T2.
+	if (mstState == stCallingOrTrying && mTimerAE.expired()) { stWrite(&mstOutRequest); mTimerAE.setDouble(stIsInvite() ? 64*T1 : T2); }
 	return false;
 }
 
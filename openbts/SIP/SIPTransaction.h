@@ -53,7 +53,7 @@ using namespace Control;
 
 
 DEFINE_MEMORY_LEAK_DETECTOR_CLASS(SipTransaction,MemCheckSipTransaction)
-class SipTransaction : public MemCheckSipTransaction, public SipTimers
+class SipTransaction : public MemCheckSipTransaction, public SipTimers, public SipTimerClient
 {
 	virtual void _define_vtable();		// Unused method to insure the compiler link phase is passified.
 	protected:
@@ -171,8 +171,12 @@ class SipClientTrLayer : public SipTransaction
 	// Downlink is toward the radio, Uplink is toward the outside world.
 	bool TLWriteHighSideV(SipMessage *msg);	// TL processes an incoming message from the outside world, returns true if should go to TU.
 	void TLWriteLowSideV(SipMessage *msg);	// TL processes uplink message to the outside world.
-	SipClientTrLayer() { mstState = stInitializing; }
-	void stDestroyV() { mstState = stTerminated; }
+	SipClientTrLayer() {
+		mstState = stInitializing;
+		stcRegister(&mTimerAE); stcRegister(&mTimerBF); stcRegister(&mTimerDK);
+	}
+	// Kick the timer wheel so the periodic service deletes us promptly.
+	void stDestroyV() { mstState = stTerminated; stcKick(); }
 	
 	public:
 	SipMessage mstOutRequest;	// outbound request, eg INVITE, MESSAGE, REGISTER.
@@ -348,6 +348,225 @@ std::ostream& operator<<(std::ostream& os, const SipTimer&t)
 	return os;
 }
 
+
+SipTimerClient::~SipTimerClient()
+{
+	SipTimerWheel::stwDetach(this);
+}
+
+void SipTimerClient::stcRegister(SipTimer *timer)
+{
+	assert(mStcNumTimers < cMaxTimers);
+	mStcTimers[mStcNumTimers++] = timer;
+	timer->mClient = this;
+}
+
+int64_t SipTimerClient::stcEarliest() const
+{
+	int64_t earliest = -1;
+	for (unsigned i = 0; i < mStcNumTimers; i++) {
+		const SipTimer *timer = mStcTimers[i];
+		if (! timer->mActive) { continue; }
+		int64_t end = timer->endMsecs();
+		if (earliest < 0 || end < earliest) { earliest = end; }
+	}
+	return earliest;
+}
+
+void SipTimerClient::stcArm(int64_t when)
+{
+	ScopedLock lock(SipTimerWheel::sStwLock);
+	if (! mStcWheel) { return; }
+	if (mStcSlot == SipTimerWheel::cExpiredSlot) { return; }	// Already due.
+	if (mStcSlot >= 0) {
+		if (mStcDeadline <= when) { return; }	// Already armed for an earlier time.
+		mStcWheel->stwUnlink(this);
+	}
+	mStcDeadline = when;
+	mStcWheel->stwInsert(this);
+	mStcWheel->mStwArms++;
+	SipTimerWheel::stwKick(when);
+}
+
+void SipTimerClient::stcKick()
+{
+	stcArm(SipTimerWheel::stwNow());
+}
+
+void SipTimerClient::stcRearm()
+{
+	int64_t when = stcEarliest();
+	if (when >= 0) { stcArm(when); }
+}
+
+
+Mutex SipTimerWheel::sStwLock;
+Signal SipTimerWheel::sStwWakeup;
+bool SipTimerWheel::sStwSleeping = false;
+int64_t SipTimerWheel::sStwWakeTime = 0;
+int64_t SipTimerWheel::sStwArmedAwake = -1;
+
+SipTimerWheel::SipTimerWheel() : mStwCount(0), mStwArms(0), mStwFires(0)
+{
+	for (int i = 0; i <= cExpiredSlot; i++) { mStwSlots[i] = NULL; }
+	mStwTick = stwNow() / cTickMsecs;
+}
+
+int64_t SipTimerWheel::stwNow()
+{
+	struct timeval now;
+	gettimeofday(&now,NULL);
+	return (int64_t)now.tv_sec*1000 + now.tv_usec/1000;
+}
+
+// The lock is held by the caller for all these private methods.
+void SipTimerWheel::stwLink(SipTimerClient *client, int slot)
+{
+	client->mStcSlot = slot;
+	client->mStcPrev = NULL;
+	client->mStcNext = mStwSlots[slot];
+	if (client->mStcNext) { client->mStcNext->mStcPrev = client; }
+	mStwSlots[slot] = client;
+	if (slot != cExpiredSlot) { mStwCount++; }
+}
+
+void SipTimerWheel::stwUnlink(SipTimerClient *client)
+{
+	int slot = client->mStcSlot;
+	assert(slot >= 0);
+	if (client->mStcPrev) { client->mStcPrev->mStcNext = client->mStcNext; } else { mStwSlots[slot] = client->mStcNext; }
+	if (client->mStcNext) { client->mStcNext->mStcPrev = client->mStcPrev; }
+	client->mStcPrev = client->mStcNext = NULL;
+	client->mStcSlot = -1;
+	if (slot != cExpiredSlot) { mStwCount--; }
+}
+
+void SipTimerWheel::stwInsert(SipTimerClient *client)
+{
+	if (mStwCount == 0) {
+		// The wheel is not advanced while it is empty, so catch it up first.
+		int64_t nowTick = stwNow() / cTickMsecs;
+		if (nowTick > mStwTick) { mStwTick = nowTick; }
+	}
+	// Round up so the client is never serviced before its deadline.
+	int64_t tick = (client->mStcDeadline + cTickMsecs - 1) / cTickMsecs;
+	if (tick < mStwTick) { tick = mStwTick; }
+	if (tick - mStwTick < (int64_t)cL0Slots) {
+		stwLink(client, tick & (cL0Slots-1));
+	} else {
+		int64_t rev = tick >> cL0Bits, curRev = mStwTick >> cL0Bits;
+		if (rev - curRev >= (int64_t)cL1Slots) { rev = curRev + cL1Slots - 1; }	// Park it; it is re-queued when it cascades.
+		stwLink(client, cL0Slots + (rev & (cL1Slots-1)));
+	}
+}
+
+void SipTimerWheel::stwKick(int64_t when)
+{
+	if (sStwSleeping) {
+		if (when < sStwWakeTime) { sStwWakeup.signal(); }
+	} else if (sStwArmedAwake < 0 || when < sStwArmedAwake) {
+		sStwArmedAwake = when;
+	}
+}
+
+void SipTimerWheel::stwAttach(SipTimerClient *client)
+{
+	{
+		ScopedLock lock(sStwLock);
+		if (client->mStcWheel == this) { return; }
+		if (client->mStcWheel) { client->mStcWheel->stwDetach(client); }
+		client->mStcWheel = this;
+	}
+	client->stcRearm();
+}
+
+void SipTimerWheel::stwDetach(SipTimerClient *client)
+{
+	ScopedLock lock(sStwLock);
+	if (! client->mStcWheel) { return; }
+	if (client->mStcSlot >= 0) { client->mStcWheel->stwUnlink(client); }
+	client->mStcWheel = NULL;
+}
+
+void SipTimerWheel::stwAdvance()
+{
+	ScopedLock lock(sStwLock);
+	int64_t nowTick = stwNow() / cTickMsecs;
+	if (mStwCount == 0) { if (nowTick >= mStwTick) { mStwTick = nowTick + 1; } return; }
+	while (mStwTick <= nowTick) {
+		if ((mStwTick & (cL0Slots-1)) == 0) {
+			// Starting a new level 0 revolution, so distribute the level 1 slot for it into level 0.
+			int slot = cL0Slots + ((mStwTick >> cL0Bits) & (cL1Slots-1));
+			while (SipTimerClient *client = mStwSlots[slot]) {
+				stwUnlink(client);
+				stwInsert(client);
+			}
+		}
+		int slot = mStwTick & (cL0Slots-1);
+		while (SipTimerClient *client = mStwSlots[slot]) {
+			stwUnlink(client);
+			stwLink(client,cExpiredSlot);
+			mStwFires++;
+		}
+		mStwTick++;
+	}
+}
+
+SipTimerClient *SipTimerWheel::stwPop()
+{
+	ScopedLock lock(sStwLock);
+	SipTimerClient *client = mStwSlots[cExpiredSlot];
+	if (client) { stwUnlink(client); }
+	return client;
+}
+
+int64_t SipTimerWheel::stwNextTime()
+{
+	ScopedLock lock(sStwLock);
+	if (mStwSlots[cExpiredSlot]) { return stwNow(); }
+	if (mStwCount == 0) { return -1; }
+	// Scan at most one revolution.  We must wake at the next revolution anyway to cascade level 1.
+	for (int64_t tick = mStwTick; ; tick++) {
+		if (mStwSlots[tick & (cL0Slots-1)] || ((tick & (cL0Slots-1)) == 0 && tick != mStwTick)) {
+			return tick * cTickMsecs;
+		}
+	}
+}
+
+unsigned SipTimerWheel::stwSize()
+{
+	ScopedLock lock(sStwLock);
+	return mStwCount;
+}
+
+void SipTimerWheel::stwText(std::ostream &os)
+{
+	ScopedLock lock(sStwLock);
+	os << "queued=" << mStwCount << " arms=" << mStwArms << " fires=" << mStwFires;
+}
+
+void SipTimerWheel::stwWakeup()
+{
+	ScopedLock lock(sStwLock);
+	stwKick(stwNow());
+}
+
+void SipTimerWheel::stwWait(int64_t wakeTime, long maxWait)
+{
+	ScopedLock lock(sStwLock);
+	int64_t now = stwNow();
+	int64_t until = now + maxWait;
+	if (wakeTime >= 0 && wakeTime < until) { until = wakeTime; }
+	// Something may have been armed since the caller computed wakeTime.
+	if (sStwArmedAwake >= 0 && sStwArmedAwake < until) { until = sStwArmedAwake; }
+	sStwArmedAwake = -1;
+	if (until <= now) { return; }
+	sStwSleeping = true;
+	sStwWakeTime = until;
+	sStwWakeup.wait(sStwLock,until - now);
+	sStwSleeping = false;
+}
+
 string makeMD5(string input)
 {
 	// (mike) disabled for now until licensing on md5 code can be clarified
@@ -131,17 +131,59 @@ struct SipTimers
 	static const int T4 = 5*1000;	// 5 seconds 17.1.2.2
 };
 
+class SipTimer;
+class SipTimerWheel;
+
+// An object that owns SipTimers and is serviced by a SipTimerWheel when the earliest of them expires.
+// Formerly the SIP service thread woke up every SIP.Timer.E/2 msecs and polled every transaction and dialog
+// to see if any timer had expired, so resends were late by up to that much and the cost grew with the number of calls.
+// Now the owner registers its SipTimers here, and setting any of them arms the owner on the wheel at that deadline.
+// Stopping a timer does not disarm the owner; it just gets a spurious service call and is re-armed at its next deadline.
+// The links are protected by the SipTimerWheel lock.
+class SipTimerClient
+{
+	friend class SipTimerWheel;
+	static const unsigned cMaxTimers = 8;
+	SipTimer *mStcTimers[cMaxTimers];
+	unsigned mStcNumTimers;
+	SipTimerWheel *mStcWheel;			///< The wheel servicing us, or NULL if not attached.
+	SipTimerClient *mStcPrev, *mStcNext;	///< Links in a wheel slot or the expired list.
+	int64_t mStcDeadline;				///< When we are queued for service, in msecs.
+	int mStcSlot;						///< The wheel slot we are queued in, or -1.
+	SipTimerClient(const SipTimerClient &);		// Not copyable, because the timers point at us.
+	SipTimerClient &operator=(const SipTimerClient &);
+
+	public:
+	SipTimerClient() : mStcNumTimers(0), mStcWheel(0), mStcPrev(0), mStcNext(0), mStcDeadline(0), mStcSlot(-1) {}
+	virtual ~SipTimerClient();
+	/** Register one of our timers; from then on setting the timer arms us. */
+	void stcRegister(SipTimer *timer);
+	/** Request service at time when, in msecs, if that is earlier than already requested.  No-op unless attached to a wheel. */
+	void stcArm(int64_t when);
+	/** Request service as soon as possible, used when a state change may let the owner be deleted. */
+	void stcKick();
+	/** Re-arm after service at the earliest active registered timer, if any. */
+	void stcRearm();
+	/** Deadline of the earliest active registered timer in msecs, or -1 if none are active. */
+	int64_t stcEarliest() const;
+};
+
 class SipTimer
 {
+	friend class SipTimerClient;
 	bool mActive;			///< true if timer is active
 	Timeval mEndTime;		///< the time at which this timer will expire
 	unsigned long mLimitTime;		///< timeout in milliseconds
+	SipTimerClient *mClient;	///< Owner to arm when the timer is set, or NULL.
 	//int mNextState;		// Payload.  Used as Procedure state to be invoked on timeout.  -1 means abort the procedure.
 
 	public:
-	SipTimer() : mActive(false), mLimitTime(0) {}
+	SipTimer() : mActive(false), mLimitTime(0), mClient(0) {}
 	bool isActive() { return mActive; }
 
+	/** The expiration time in msecs, rounded up so the timer has expired by then. */
+	int64_t endMsecs() const { return (int64_t)mEndTime.sec()*1000 + (mEndTime.usec()+999)/1000; }
+
 	bool expired() const {
 		if (!mActive) { return false; } // A non-active timer does not expire.
 		return mEndTime.passed();
@@ -153,6 +195,7 @@ class SipTimer
 		assert(mLimitTime!=0);
 		mEndTime = Timeval(mLimitTime);
 		mActive=true;
+		if (mClient) { mClient->stcArm(endMsecs()); }
 	} 
 	void set(long wLimitTime) {
 		mLimitTime = wLimitTime;
@@ -167,7 +210,7 @@ class SipTimer
 		assert(mLimitTime!=0);
 		unsigned long newTime = mLimitTime * 2;
 		if (newTime > maxTime) { newTime = maxTime; }
-		set(mLimitTime * 2);
+		set(newTime);
 	}
 	void stop() { mActive = false; }
 
@@ -189,6 +232,63 @@ class SipTimer
 std::ostream& operator<<(std::ostream& os, const SipTimer&);
 
 
+// A two level hierarchical timer wheel for SipTimerClients.  Arm and cancel are O(1), and the service thread
+// sleeps until the earliest occupied slot instead of polling.
+// Level 0 has cL0Slots slots of cTickMsecs each, about 2 seconds, which covers the T1 based resend timers;
+// level 1 has cL1Slots slots of one level 0 revolution each, about 2 minutes, which is longer than any RFC3261 timer.
+// Anything further out is parked in the last level 1 slot and re-queued when it cascades.
+// There is one wheel per container (the TU map and the dialog map) so each is expired under its own container lock,
+// but all the wheels share one lock and one service thread wakeup.
+class SipTimerWheel
+{
+	friend class SipTimerClient;
+	static const int cTickMsecs = 8;
+	static const unsigned cL0Bits = 8, cL0Slots = 1<<cL0Bits;
+	static const unsigned cL1Bits = 6, cL1Slots = 1<<cL1Bits;
+	static const int cExpiredSlot = cL0Slots + cL1Slots;	///< Pseudo-slot for the expired list.
+
+	static Mutex sStwLock;				///< Protects all the wheels and their clients.
+	static Signal sStwWakeup;			///< Wakes the service thread when an earlier deadline is armed.
+	static bool sStwSleeping;			///< True while the service thread is in stwWait.
+	static int64_t sStwWakeTime;		///< When the sleeping service thread will wake up, in msecs.
+	static int64_t sStwArmedAwake;		///< Earliest deadline armed while the service thread was awake.
+
+	SipTimerClient *mStwSlots[cExpiredSlot+1];
+	int64_t mStwTick;			///< The next tick to expire.
+	unsigned mStwCount;			///< Number of clients queued in the wheel proper, not counting the expired list.
+	unsigned mStwArms, mStwFires;	///< Statistics.
+
+	void stwLink(SipTimerClient *client, int slot);
+	void stwUnlink(SipTimerClient *client);
+	void stwInsert(SipTimerClient *client);
+	static void stwKick(int64_t when);
+
+	public:
+	SipTimerWheel();
+	/** Start servicing a client, armed at the earliest of its active timers. */
+	void stwAttach(SipTimerClient *client);
+	/** Stop servicing a client.  It is harmless to detach a client that is not attached. */
+	static void stwDetach(SipTimerClient *client);
+	/** Move every client whose deadline has passed to the expired list. */
+	void stwAdvance();
+	/** Dequeue the next client from the expired list, or return NULL.  The caller re-arms it with stcRearm() after servicing it. */
+	SipTimerClient *stwPop();
+	/** When the wheel next needs stwAdvance, in msecs, or -1 if it is empty. */
+	int64_t stwNextTime();
+	unsigned stwSize();
+	void stwText(std::ostream &os);
+
+	static int64_t stwNow();
+	/**
+		Block the service thread until wakeTime (msecs, or -1 for no limit) but at most maxWait msecs,
+		returning early if someone arms an earlier deadline.
+	*/
+	static void stwWait(int64_t wakeTime, long maxWait);
+	/** Make the service thread run a pass now. */
+	static void stwWakeup();
+};
+
+
 extern string make_tag();
 extern string make_branch(const char *name=NULL);
 extern string globallyUniqueId(const char *start);
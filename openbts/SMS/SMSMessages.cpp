@@ -322,6 +322,15 @@ void RPData::writeBody(RLFrame& dest, size_t& wp) const
 }
 
 
+void RPData::setMoreMessages(bool more)
+{
+	// GSM 03.40 9.2.3.2.  Only SMS-DELIVER carries TP-MMS; leave anything else alone.
+	TLFrame &tpdu = mUserData.mTPDU;
+	if (tpdu.size() < 8 || tpdu.MTI() != TLMessage::DELIVER) { return; }
+	tpdu[5] = !more;	// reversed sense: 0 means more messages are waiting.
+}
+
+
 void RPData::text(ostream& os) const
 {
 	RPMessage::text(os);
@@ -601,6 +601,9 @@ class RPData : public RPMessage {
 
 	const TLFrame& TPDU() const { return mUserData.TPDU(); }
 
+	/** Set TP-MMS in a downlink SMS-DELIVER to tell the MS whether more messages follow. */
+	void setMoreMessages(bool more);
+
 	int MTI() const { return Data; }
 	void parseBody( const RLFrame& frame, size_t &rp); 		
 	void writeBody( RLFrame & frame, size_t &wp ) const;
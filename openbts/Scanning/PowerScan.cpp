@@ -0,0 +1,280 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#include "PowerScan.h"
+#include <math.h>
+
+#include <Logger.h>
+
+
+using namespace std;
+
+
+static const double cChannelSpacing = 200.0e3;		///< ARFCN spacing, Hz
+static const double cChannelHalfWidth = 90.0e3;		///< Bins this close to the carrier count as the channel, Hz
+static const double cUsableFraction = 0.8;			///< Part of the capture bandwidth clear of the anti-alias rolloff
+static const double cBinWidth = 12.5e3;				///< Widest FFT bin we will accept, Hz
+static const double cSettleTime = 0.010;			///< Time to let the synthesizer and AGC settle after a retune, s
+static const unsigned cReadBlock = 512;				///< Samples per readSamples call
+static const unsigned cMaxEmptyReads = 100;			///< Reads in a row with no samples before we give up on the radio
+
+
+/** In-place radix-2 FFT.  x.size() must be a power of two. */
+static void fft(vector<complex<float> > &x)
+{
+	const unsigned n = x.size();
+	// Bit-reversal permutation.
+	for (unsigned i = 1, j = 0; i < n; i++) {
+		unsigned bit = n >> 1;
+		for (; j & bit; bit >>= 1) { j ^= bit; }
+		j ^= bit;
+		if (i < j) { swap(x[i],x[j]); }
+	}
+	// Butterflies.
+	for (unsigned len = 2; len <= n; len <<= 1) {
+		const complex<float> wlen = polar(1.0F, (float)(-2.0*M_PI/len));
+		for (unsigned i = 0; i < n; i += len) {
+			complex<float> w(1.0F,0.0F);
+			for (unsigned k = 0; k < len/2; k++) {
+				complex<float> u = x[i+k];
+				complex<float> v = x[i+k+len/2] * w;
+				x[i+k] = u + v;
+				x[i+k+len/2] = u - v;
+				w *= wlen;
+			}
+		}
+	}
+}
+
+
+PowerScan::PowerScan(ScanRadio &wRadio, SpectrumMap &wMap, GSM::GSMBand wBand,
+		SpectrumMap::LinkDirection wLinkDir, FrequencyConverter wConverter,
+		unsigned integrationTimeMs, double wDBmOffset)
+	:mRadio(wRadio),mMap(wMap),mBand(wBand),mLinkDir(wLinkDir),mConverter(wConverter),mDBmOffset(wDBmOffset)
+{
+	double rate = mRadio.sampleRate();
+
+	// FFT size: the smallest power of two that gives bins no wider than cBinWidth.
+	unsigned fftSize = 32;
+	while (rate / fftSize > cBinWidth) { fftSize <<= 1; }
+	mBlock.resize(fftSize);
+	mSpectrum.resize(fftSize);
+	mWindow.resize(fftSize);
+	for (unsigned i = 0; i < fftSize; i++) {
+		mWindow[i] = 0.5F - 0.5F*cos(2.0*M_PI*i/fftSize);	// Hann
+	}
+
+	double integrationTime = integrationTimeMs / 1000.0;
+	unsigned blocks = (unsigned) ceil(integrationTime * rate / fftSize);
+	mCaptureSamples = (blocks ? blocks : 1) * fftSize;
+	mSettleSamples = (unsigned) (cSettleTime * rate);
+	LOG(INFO) << "power scan at " << rate << " samples/sec, " << fftSize << " point FFT, "
+		<< mCaptureSamples << " samples per capture";
+}
+
+
+// Group the ARFCNs into captures that fit in the usable bandwidth.
+void PowerScan::plan(unsigned startARFCN, unsigned stopARFCN)
+{
+	double usable = cUsableFraction * mRadio.sampleRate();
+	ScanCapture *capture = NULL;
+	float low = 0, high = 0;
+	for (unsigned ARFCN = startARFCN; ARFCN <= stopARFCN; ARFCN++) {
+		float freq = mConverter(mBand,ARFCN) * 1000.0F;
+		if (capture) {
+			float newLow = freq < low ? freq : low;
+			float newHigh = freq > high ? freq : high;
+			if (newHigh - newLow + cChannelSpacing > usable) {
+				capture->mCenter = (low + high) / 2;
+				capture = NULL;
+			} else {
+				low = newLow;
+				high = newHigh;
+			}
+		}
+		if (!capture) {
+			capture = new ScanCapture;
+			mPlan.push_back(capture);
+			low = high = freq;
+		}
+		capture->mARFCNs.push_back(ARFCN);
+		capture->mFreqs.push_back(freq);
+	}
+	if (capture) { capture->mCenter = (low + high) / 2; }
+}
+
+
+void *PowerScan::readerThread(PowerScan *scan)
+{
+	scan->readCaptures();
+	return NULL;
+}
+
+void PowerScan::readCaptures()
+{
+	short buf[cReadBlock*2];
+	bool dead = false;
+	for (unsigned c = 0; c < mPlan.size(); c++) {
+		ScanCapture *capture = mPlan[c];
+		// Once the radio has stopped delivering, the rest of the captures go to the FFT side empty,
+		// so run() still gets every one it is waiting for and measure() skips them.
+		if (!dead) {
+			mRadio.tune(capture->mCenter);
+			unsigned skip = mSettleSamples;
+			unsigned empty = 0;
+			capture->mSamples.reserve(mCaptureSamples);
+			// Keep reading after the capture is full while the FFT side is more than a capture behind,
+			// so the radio is never left with samples backing up behind a retune.
+			while (capture->mSamples.size() < mCaptureSamples || mCaptured.size() > 1) {
+				int rd = mRadio.read(buf,cReadBlock);
+				if (rd <= 0) {
+					if (++empty < cMaxEmptyReads) { continue; }
+					LOG(ERR) << "no samples from the radio in " << empty << " reads at " << capture->mCenter
+						<< " Hz, abandoning the scan with " << mPlan.size() - c << " captures left";
+					dead = true;
+					break;
+				}
+				empty = 0;
+				for (int i = 0; i < rd; i++) {
+					if (skip) { skip--; continue; }
+					if (capture->mSamples.size() >= mCaptureSamples) { break; }
+					capture->mSamples.push_back(complex<float>(buf[2*i],buf[2*i+1]));
+				}
+			}
+		}
+		// A short capture would read low, so report nothing for it.
+		if (capture->mSamples.size() < mCaptureSamples) { capture->mSamples.clear(); }
+		mCaptured.write(capture);
+	}
+}
+
+
+// Welch's method: average the Hann-windowed power spectra of consecutive blocks,
+// then add up the bins around each carrier.
+void PowerScan::measure(const ScanCapture &capture, ChannelPowerList &results)
+{
+	const unsigned fftSize = mBlock.size();
+	const double rate = mRadio.sampleRate();
+	unsigned blocks = capture.mSamples.size() / fftSize;
+	if (blocks == 0) { return; }
+
+	for (unsigned k = 0; k < fftSize; k++) { mSpectrum[k] = 0; }
+	for (unsigned b = 0; b < blocks; b++) {
+		const complex<float> *in = &capture.mSamples[b*fftSize];
+		for (unsigned i = 0; i < fftSize; i++) { mBlock[i] = in[i] * mWindow[i]; }
+		fft(mBlock);
+		for (unsigned k = 0; k < fftSize; k++) { mSpectrum[k] += norm(mBlock[k]); }
+	}
+
+	// Scale so that the sum over all bins is the mean of |x|^2, the same units the old one-ARFCN-at-a-time scan used.
+	double windowPower = 0;
+	for (unsigned i = 0; i < fftSize; i++) { windowPower += mWindow[i]*mWindow[i]; }
+	double scale = 1.0 / (blocks * fftSize * windowPower);
+
+	for (unsigned a = 0; a < capture.mARFCNs.size(); a++) {
+		double offset = capture.mFreqs[a] - capture.mCenter;
+		double sum = 0;
+		for (unsigned k = 0; k < fftSize; k++) {
+			double binFreq = (k < fftSize/2 ? (double)k : (double)k - fftSize) * rate / fftSize;
+			if (fabs(binFreq - offset) <= cChannelHalfWidth) { sum += mSpectrum[k]; }
+		}
+		double power = sum * scale;
+		LOG(DEBUG) << "ARFCN " << capture.mARFCNs[a] << " freq " << capture.mFreqs[a] << " power " << power;
+		if (power == 0.0) { continue; }
+		results.push_back(ChannelPower(capture.mARFCNs[a], capture.mFreqs[a], 10.0*log10(power) + mDBmOffset));
+	}
+}
+
+
+unsigned PowerScan::run(unsigned startARFCN, unsigned stopARFCN)
+{
+	ChannelPowerList results;
+	scan(startARFCN,stopARFCN,results);
+	mMap.power(mBand,results,mLinkDir);
+	return results.size();
+}
+
+
+void PowerScan::scan(unsigned startARFCN, unsigned stopARFCN, ChannelPowerList &results)
+{
+	plan(startARFCN,stopARFCN);
+	LOG(INFO) << "scanning ARFCNs " << startARFCN << " to " << stopARFCN << " " << mLinkDir.string()
+		<< " in " << mPlan.size() << " captures";
+
+	// The reader tunes and reads capture n+1 while we do the FFTs for capture n.
+	mReaderThread.start((void*(*)(void*))readerThread,this);
+	for (unsigned c = 0; c < mPlan.size(); c++) {
+		ScanCapture *capture = mCaptured.read();
+		measure(*capture,results);
+		delete capture;
+	}
+	mReaderThread.join();
+	mPlan.clear();
+}
+
+
+void addPowerScanConfigurationKeys(ConfigurationKeyMap &map)
+{
+	ConfigurationKey *tmp;
+
+	tmp = new ConfigurationKey("PowerScanner.dBmOffset","0",
+		"dBm",
+		ConfigurationKey::FACTORY,
+		ConfigurationKey::VALRANGE,
+		"0:100",
+		false,
+		"Calibrated dBm level corresponding to full scale on the receiver."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("PowerScanner.DBPath","/var/run/PowerScannerResults.db",
+		"",
+		ConfigurationKey::FACTORY,
+		ConfigurationKey::FILEPATH,
+		"",
+		true,
+		"Path to the scanning results database."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("PowerScanner.IntegrationTime","250",
+		"milliseconds",
+		ConfigurationKey::FACTORY,
+		ConfigurationKey::VALRANGE,
+		"50:5000",
+		false,
+		"Power detection integration time in milliseconds.  "
+			"Every ARFCN in a capture is measured over the whole capture, so a wider capture does not shorten this."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("PowerScanner.RxGain","97",
+		"dB",
+		ConfigurationKey::FACTORY,
+		ConfigurationKey::VALRANGE,
+		"0:200",
+		false,
+		"Receiver gain for the power scanner program, raw value to setRxGain."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,129 @@
+/**@file Wideband channel power scanning for the SPECTRUM_MAP table. */
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#ifndef POWERSCAN_H
+#define POWERSCAN_H
+
+#include <complex>
+#include <vector>
+
+#include <Threads.h>
+#include <Interthread.h>
+#include <Configuration.h>
+#include <GSMCommon.h>
+
+#include "Scanning.h"
+
+
+/** GSM::uplinkFreqKHz or GSM::downlinkFreqKHz. */
+typedef unsigned (*FrequencyConverter)(GSM::GSMBand, unsigned);
+
+
+/**
+	The little a power scan needs from a radio.
+	The transceivers each have their own RadioDevice with different signatures and sample formats,
+	so each scanner program wraps its device in one of these.
+*/
+class ScanRadio {
+
+	public:
+
+	virtual ~ScanRadio() {}
+
+	/** The receive sample rate, in Hz. */
+	virtual double sampleRate() = 0;
+
+	/** Tune the receiver, in Hz. */
+	virtual bool tune(double freq) = 0;
+
+	/**
+		Read the next len complex samples into buf as interleaved I,Q in host byte order.
+		@return The number of samples read, which may be short.
+	*/
+	virtual int read(short *buf, int len) = 0;
+};
+
+
+/** One tuning of the radio and the samples read there. */
+struct ScanCapture {
+	std::vector<unsigned> mARFCNs;		///< The ARFCNs inside this capture.
+	std::vector<float> mFreqs;			///< Their frequencies, in Hz.
+	double mCenter;						///< Where the radio was tuned, in Hz.
+	std::vector<std::complex<float> > mSamples;
+};
+
+
+/**
+	Measure the power in a range of ARFCNs, several at a time.
+	The radio is tuned to one capture center after another; each capture is cut into
+	windowed FFT blocks and the power spectra averaged, and each ARFCN inside the capture
+	gets the power of the bins within its channel.  One thread tunes and reads the radio while
+	the caller's thread does the FFTs on the previous capture.  The results go into the
+	SpectrumMap in one transaction per run.
+*/
+class PowerScan {
+
+	private:
+
+	ScanRadio &mRadio;
+	SpectrumMap &mMap;
+	GSM::GSMBand mBand;
+	SpectrumMap::LinkDirection mLinkDir;
+	FrequencyConverter mConverter;
+	double mDBmOffset;
+
+	std::vector<ScanCapture*> mPlan;		///< Captures still to be read, in order.
+	InterthreadQueueWithWait<ScanCapture> mCaptured;	///< Read and waiting for the FFT.
+	unsigned mSettleSamples;				///< Samples to discard after each retune.
+	unsigned mCaptureSamples;				///< Samples to keep in each capture.
+	Thread mReaderThread;
+
+	/** FFT working storage. */
+	std::vector<std::complex<float> > mBlock;
+	std::vector<float> mWindow;
+	std::vector<double> mSpectrum;
+
+	void plan(unsigned startARFCN, unsigned stopARFCN);
+	void readCaptures();
+	static void *readerThread(PowerScan*);
+	void measure(const ScanCapture &capture, ChannelPowerList &results);
+
+	public:
+
+	/**
+		@param integrationTimeMs How long to listen at each tuning.
+		@param wDBmOffset The dBm level of full scale on the receiver.
+	*/
+	PowerScan(ScanRadio &wRadio, SpectrumMap &wMap, GSM::GSMBand wBand,
+		SpectrumMap::LinkDirection wLinkDir, FrequencyConverter wConverter,
+		unsigned integrationTimeMs, double wDBmOffset);
+
+	/** Scan startARFCN..stopARFCN inclusive and write the results.  Return the number of ARFCNs measured. */
+	unsigned run(unsigned startARFCN, unsigned stopARFCN);
+
+	/** Scan startARFCN..stopARFCN inclusive and append the results, without writing them to the map. */
+	void scan(unsigned startARFCN, unsigned stopARFCN, ChannelPowerList &results);
+};
+
+
+/** Add the PowerScanner.* keys to a scanner program's configuration key map. */
+void addPowerScanConfigurationKeys(ConfigurationKeyMap &map);
+
+
+#endif
+
+// vim: ts=4 sw=4
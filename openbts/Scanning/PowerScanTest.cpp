@@ -0,0 +1,136 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+// Scans a simulated radio that hears one tone over a little noise.
+// The ARFCN the tone falls in must get the tone's mean |x|^2, in dB, and every other ARFCN must be far below it,
+// whichever capture the tone lands in and wherever it sits inside its channel.
+// A radio that stops delivering samples must end the scan instead of hanging it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "PowerScan.h"
+
+using namespace std;
+
+ConfigurationTable gConfig;
+
+static const double cRate = 4 * 1625000.0 / 6.0;	// What the RAD1 scanner runs at.
+static const double cToneAmpl = 1000.0;
+static const double cMinRejectDB = 40.0;
+static const char *cDBPath = "/tmp/PowerScanTest.db";
+
+// ARFCN n at 900 MHz + n * 200 kHz, Hz.
+static unsigned testFreqKHz(GSM::GSMBand, unsigned ARFCN) { return 900000 + 200 * ARFCN; }
+
+class ToneRadio : public ScanRadio {
+	double mToneFreq;
+	double mCenter;
+	double mPhase;
+	int mGoodReads;			///< Reads before the radio goes quiet; negative for never.
+
+	public:
+	ToneRadio(double wToneFreq, int wGoodReads = -1)
+		:mToneFreq(wToneFreq),mCenter(0),mPhase(0),mGoodReads(wGoodReads)
+	{ }
+
+	double sampleRate() { return cRate; }
+	bool tune(double freq) { mCenter = freq; return true; }
+
+	int read(short *buf, int len)
+	{
+		if (mGoodReads == 0) { return 0; }
+		if (mGoodReads > 0) { mGoodReads--; }
+		// Like the radio's own filter, pass the tone only if it is inside the capture.
+		double offset = mToneFreq - mCenter;
+		double ampl = fabs(offset) < 0.45 * cRate ? cToneAmpl : 0.0;
+		for (int i = 0; i < len; i++) {
+			buf[2*i] = (short) lrint(ampl * cos(mPhase)) + random() % 5 - 2;
+			buf[2*i+1] = (short) lrint(ampl * sin(mPhase)) + random() % 5 - 2;
+			mPhase = fmod(mPhase + 2.0 * M_PI * offset / cRate, 2.0 * M_PI);
+		}
+		return len;
+	}
+};
+
+static int testTone(SpectrumMap &map, unsigned toneARFCN, double offsetHz)
+{
+	ToneRadio radio(testFreqKHz(GSM::EGSM900,toneARFCN) * 1000.0 + offsetHz);
+	PowerScan scan(radio,map,GSM::EGSM900,SpectrumMap::LinkDirection::Down,testFreqKHz,50,0.0);
+	ChannelPowerList results;
+	scan.scan(0,20,results);
+
+	int fail = 0;
+	if (results.size() != 21) {
+		printf("tone at ARFCN %u: %u results for 21 ARFCNs\n", toneARFCN, (unsigned) results.size());
+		return 1;
+	}
+
+	double expected = 20.0 * log10(cToneAmpl);
+	double toneDBm = -1000, worstDBm = -1000;
+	for (unsigned i = 0; i < results.size(); i++) {
+		const ChannelPower &p = results[i];
+		if (p.mFreq != testFreqKHz(GSM::EGSM900,p.mARFCN) * 1000.0F) {
+			printf("ARFCN %u reported at %g Hz\n", p.mARFCN, p.mFreq);
+			fail = 1;
+		}
+		if (p.mARFCN == toneARFCN) { toneDBm = p.mDBm; }
+		else if (p.mDBm > worstDBm) { worstDBm = p.mDBm; }
+	}
+
+	printf("tone at ARFCN %2u %+6.0f Hz: %.2f dB, expected %.2f, next strongest ARFCN %.2f dB\n",
+		toneARFCN, offsetHz, toneDBm, expected, worstDBm);
+	if (fabs(toneDBm - expected) > 0.5) { fail = 1; }
+	if (toneDBm - worstDBm < cMinRejectDB) { fail = 1; }
+	return fail;
+}
+
+// The radio goes quiet partway through; the captures read before that still count and the scan ends.
+static int testDeadRadio(SpectrumMap &map)
+{
+	ToneRadio radio(testFreqKHz(GSM::EGSM900,1) * 1000.0, 200);
+	PowerScan scan(radio,map,GSM::EGSM900,SpectrumMap::LinkDirection::Down,testFreqKHz,50,0.0);
+	ChannelPowerList results;
+	scan.scan(0,20,results);
+
+	printf("radio gone quiet: %u of 21 ARFCNs measured\n", (unsigned) results.size());
+	for (unsigned i = 0; i < results.size(); i++) {
+		if (results[i].mARFCN > 7) { return 1; }
+	}
+	return results.size() < 4;
+}
+
+int main(int argc, char **argv)
+{
+	int fail = 0;
+	srandom(7);
+	{
+		SpectrumMap map(cDBPath);
+
+		// Tones in the first, a middle and the last capture, on the carrier and near the channel edge.
+		fail |= testTone(map,0,0);
+		fail |= testTone(map,9,30000);
+		fail |= testTone(map,10,-60000);
+		fail |= testTone(map,20,75000);
+		fail |= testDeadRadio(map);
+	}
+	unlink(cDBPath);
+
+	printf(fail ? "FAILED\n" : "PASSED\n");
+	return fail;
+}
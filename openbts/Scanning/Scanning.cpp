@@ -113,6 +113,34 @@ void SpectrumMap::power(GSM::GSMBand band, unsigned ARFCN, LinkDirection& linkDi
 	power(band, ARFCN, frequency, linkDir, dBm);
 }
 
+// One statement prepared once and one commit for the lot; row-at-a-time autocommit costs a sync per row.
+void SpectrumMap::power(GSM::GSMBand band, const ChannelPowerList& powers, LinkDirection& linkDir)
+{
+	if (!mDB || powers.empty()) return;
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_statement(mDB,&stmt,"INSERT OR REPLACE INTO SPECTRUM_MAP (BAND,TIMESTAMP,ARFCN,RSSI,FREQ,LINK) "
+				"VALUES (?,?,?,?,?,?)")) {
+		LOG(ALERT) << "write to spectrum map failed: " << sqlite3_errmsg(mDB);
+		return;
+	}
+	unsigned now = (unsigned)time(NULL);
+	sqlite3_command(mDB,"BEGIN");
+	for (ChannelPowerList::const_iterator p=powers.begin(); p!=powers.end(); ++p) {
+		sqlite3_bind_int(stmt,1,(int)band);
+		sqlite3_bind_int(stmt,2,now);
+		sqlite3_bind_int(stmt,3,p->mARFCN);
+		sqlite3_bind_double(stmt,4,p->mDBm);
+		sqlite3_bind_double(stmt,5,p->mFreq);
+		sqlite3_bind_text(stmt,6,linkDir.string(),-1,SQLITE_STATIC);
+		if (sqlite3_run_query(mDB,stmt) != SQLITE_DONE) {
+			LOG(ALERT) << "write to spectrum map failed for ARFCN " << p->mARFCN << ": " << sqlite3_errmsg(mDB);
+		}
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+	if (!sqlite3_command(mDB,"COMMIT")) LOG(ALERT) << "write to spectrum map failed";
+}
+
 /*void SpectrumMap::power(GSM::GSMBand band, unsigned ARFCN, float freq, float dBm)
 {
 
@@ -20,6 +20,7 @@
 
 
 #include <list>
+#include <vector>
 #include <GSMCommon.h>
 
 struct sqlite3;
@@ -34,6 +35,20 @@ namespace GSM {
 typedef std::list<unsigned> ARFCNList;
 
 
+/** One ARFCN's measured power, for writing many to the SpectrumMap at once. */
+struct ChannelPower {
+	unsigned mARFCN;
+	float mFreq;		///< Hz
+	float mDBm;
+
+	ChannelPower(unsigned wARFCN, float wFreq, float wDBm)
+		:mARFCN(wARFCN),mFreq(wFreq),mDBm(wDBm)
+	{ }
+};
+
+typedef std::vector<ChannelPower> ChannelPowerList;
+
+
 /** A C++ API to the SPECTRUM_MAP database table. */
 class SpectrumMap {
 
@@ -101,6 +116,9 @@ class SpectrumMap {
 	/** Mark a given ARFCN as having a given power level. */
 	//void power(GSM::GSMBand band, unsigned ARFCN, float freq, float dBm);
 
+	/** Mark many ARFCNs at once, in a single transaction. */
+	void power(GSM::GSMBand band, const ChannelPowerList& powers, LinkDirection& linkDir);
+
 	/** Return a list of up to count of the most powerful ARFCNs in a given band. */
 	ARFCNList topPower(GSM::GSMBand band, unsigned count) const;
 
@@ -469,6 +469,33 @@ bool ::ARFCNManager::trxRunning()
 	return status == 0;
 }
 
+bool ::ARFCNManager::trxWaitReady(unsigned timeoutMs)
+{
+	// Unlike sendCommandPacket this uses a short read timeout and no retry limit,
+	// so we notice the transceiver within one probe period of it opening its control port.
+	const unsigned probeMs = 100;
+	char response[MAX_UDP_LENGTH];
+	Timeval deadline(timeoutMs);
+	ScopedLock lock(mControlLock);
+	while (!deadline.passed()) {
+		Timeval probeStart;
+		try {
+			mControlSocket.write("CMD POWEROFF");
+			int msgLen = mControlSocket.read(response,probeMs);
+			if ((msgLen>4) && (strncmp(response,"RSP ",4)==0)) {
+				// Discard any answers to earlier probes so they are not taken as the response to the next command.
+				while (mControlSocket.read(response,probeMs) > 0) {}
+				return true;
+			}
+		} catch (SocketError) {
+			// Nothing listening yet.
+		}
+		long used = probeStart.elapsed();
+		if (used < (long)probeMs) { usleep((probeMs-used)*1000); }
+	}
+	return false;
+}
+
 
 
 
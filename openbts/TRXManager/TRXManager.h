@@ -178,6 +178,13 @@ class ARFCNManager {
 	/** Just test if the transceiver is running without printing alarming messages. */
 	bool trxRunning();
 
+	/**
+		Probe the control socket until the transceiver answers, instead of sleeping a fixed time at startup.
+		@param timeoutMs How long to keep probing.
+		@return true if the transceiver answered.
+	*/
+	bool trxWaitReady(unsigned timeoutMs);
+
         /**     
 		Set maximum expected delay spread.
 		@param km Max network range in kilometers.
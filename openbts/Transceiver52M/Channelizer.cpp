@@ -0,0 +1,281 @@
+/*
+ * Polyphase channelizer and synthesis filterbanks
+ *
+ * Copyright 2014 Range Networks, Inc.
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <malloc.h>
+#include <iostream>
+
+#include "Channelizer.h"
+
+extern "C" {
+#include "convolve.h"
+}
+
+#ifndef M_PI
+#define M_PI			3.14159265358979323846264338327f
+#endif
+
+/* Maximum samples per channel in one call */
+#define MAX_CHAN_LEN		4096
+
+static float sinc(float x)
+{
+	if (x == 0.0)
+		return 0.9999999999;
+
+	return sin(M_PI * x) / (M_PI * x);
+}
+
+ChannelizerBase::ChannelizerBase(size_t m, size_t filt_len)
+	: subFilters(NULL), branchBuf(NULL), branchOut(NULL),
+	  dftCos(NULL), dftSin(NULL)
+{
+	this->m = m;
+	this->filt_len = filt_len;
+}
+
+ChannelizerBase::~ChannelizerBase()
+{
+	for (size_t i = 0; i < m; i++) {
+		if (subFilters)
+			free(subFilters[i]);
+		if (branchBuf)
+			free(branchBuf[i]);
+		if (branchOut)
+			free(branchOut[i]);
+	}
+
+	free(subFilters);
+	free(branchBuf);
+	free(branchOut);
+	delete[] dftCos;
+	delete[] dftSin;
+}
+
+/*
+ * Prototype lowpass with cutoff at half the channel spacing. For the
+ * channelizer, branch p filters input samples p, p + m, ... with taps
+ * h[l * m + m - 1 - p]; for synthesis, branch p produces output samples
+ * p, p + m, ... with taps h[l * m + p]. Either way the branch taps are
+ * stored reversed, interleaved with zeros, for convolve_real().
+ */
+bool ChannelizerBase::initBank(bool synthesis)
+{
+	size_t proto_len = m * filt_len;
+	size_t hist_len = filt_len - 1;
+	float *proto, sum = 0.0f, scale;
+	float midpt = (float) (proto_len - 1.0) / 2.0;
+
+	if ((m < 2) || (filt_len < 4) || (filt_len % 4))
+		return false;
+
+	proto = new float[proto_len];
+
+	/* Blackman-Harris window, as for the Resampler */
+	float a0 = 0.35875;
+	float a1 = 0.48829;
+	float a2 = 0.14128;
+	float a3 = 0.01168;
+
+	for (size_t i = 0; i < proto_len; i++) {
+		proto[i] = sinc(((float) i - midpt) / (float) m);
+		proto[i] *= a0 -
+			    a1 * cos(2 * M_PI * i / (proto_len - 1)) +
+			    a2 * cos(4 * M_PI * i / (proto_len - 1)) -
+			    a3 * cos(6 * M_PI * i / (proto_len - 1));
+		sum += proto[i];
+	}
+
+	/* Unity gain through a channel in both directions */
+	scale = synthesis ? (float) m / sum : 1.0f / sum;
+
+	subFilters = (float **) calloc(m, sizeof(float *));
+	branchBuf = (float **) calloc(m, sizeof(float *));
+	branchOut = (float **) calloc(m, sizeof(float *));
+
+	for (size_t p = 0; p < m; p++) {
+		subFilters[p] = (float *)
+				memalign(16, filt_len * 2 * sizeof(float));
+		branchBuf[p] = (float *)
+			       memalign(16, (hist_len + MAX_CHAN_LEN) *
+					    2 * sizeof(float));
+		branchOut[p] = (float *)
+			       memalign(16, MAX_CHAN_LEN * 2 * sizeof(float));
+		if (!subFilters[p] || !branchBuf[p] || !branchOut[p]) {
+			delete[] proto;
+			return false;
+		}
+
+		memset(branchBuf[p], 0, hist_len * 2 * sizeof(float));
+
+		for (size_t l = 0; l < filt_len; l++) {
+			size_t tap = l * m + (synthesis ? p : m - 1 - p);
+			float *h = &subFilters[p][2 * (filt_len - 1 - l)];
+			h[0] = proto[tap] * scale;
+			h[1] = 0.0f;
+		}
+	}
+
+	delete[] proto;
+
+	/* DFT matrix, indexed by (k * p) mod m */
+	dftCos = new float[m];
+	dftSin = new float[m];
+	for (size_t i = 0; i < m; i++) {
+		dftCos[i] = cos(2 * M_PI * i / m);
+		dftSin[i] = sin(2 * M_PI * i / m);
+	}
+
+	return true;
+}
+
+void ChannelizerBase::dft(float **in, size_t in_offset,
+			  float **out, size_t out_offset, size_t len, int sign)
+{
+	for (size_t n = 0; n < len; n++) {
+		for (size_t k = 0; k < m; k++) {
+			float re = 0.0f, im = 0.0f;
+			size_t idx = 0;
+
+			for (size_t p = 0; p < m; p++) {
+				float *x = &in[p][2 * (in_offset + n)];
+				float c = dftCos[idx];
+				float s = sign * dftSin[idx];
+
+				re += x[0] * c - x[1] * s;
+				im += x[0] * s + x[1] * c;
+
+				idx += k;
+				if (idx >= m)
+					idx -= m;
+			}
+
+			out[k][2 * (out_offset + n) + 0] = re;
+			out[k][2 * (out_offset + n) + 1] = im;
+		}
+	}
+}
+
+/* Filter len new samples in each branch buffer, then save the history */
+bool ChannelizerBase::filterBranches(size_t len)
+{
+	size_t hist_len = filt_len - 1;
+
+	for (size_t p = 0; p < m; p++) {
+		if (convolve_real(branchBuf[p], hist_len + len,
+				  subFilters[p], filt_len,
+				  branchOut[p], len,
+				  hist_len, len, 1, 0) < 0)
+			return false;
+
+		memmove(branchBuf[p], &branchBuf[p][2 * len],
+			hist_len * 2 * sizeof(float));
+	}
+
+	return true;
+}
+
+Channelizer::Channelizer(size_t m, size_t filt_len)
+	: ChannelizerBase(m, filt_len)
+{
+}
+
+bool Channelizer::init()
+{
+	return initBank(false);
+}
+
+int Channelizer::rotate(const float *in, size_t in_len, float **out)
+{
+	size_t hist_len = filt_len - 1;
+	size_t len = in_len / m;
+
+	if ((in_len % m) || !len || (len > MAX_CHAN_LEN)) {
+		std::cerr << "Invalid channelizer input length " << in_len
+			  << " for " << m << " channels" << std::endl;
+		return -1;
+	}
+
+	/* Commutate the input across the branches */
+	for (size_t n = 0; n < len; n++) {
+		for (size_t p = 0; p < m; p++) {
+			branchBuf[p][2 * (hist_len + n) + 0] = in[2 * (n * m + p) + 0];
+			branchBuf[p][2 * (hist_len + n) + 1] = in[2 * (n * m + p) + 1];
+		}
+	}
+
+	if (!filterBranches(len))
+		return -1;
+
+	dft(branchOut, 0, out, 0, len, -1);
+
+	return len;
+}
+
+Synthesis::Synthesis(size_t m, size_t filt_len)
+	: ChannelizerBase(m, filt_len)
+{
+}
+
+bool Synthesis::init()
+{
+	return initBank(true);
+}
+
+int Synthesis::rotate(float **in, size_t in_len, float *out)
+{
+	size_t hist_len = filt_len - 1;
+	float *zero = NULL;
+	float **chans;
+
+	if (!in_len || (in_len > MAX_CHAN_LEN)) {
+		std::cerr << "Invalid synthesis input length " << in_len
+			  << std::endl;
+		return -1;
+	}
+
+	/* Silent channels read from a zero buffer */
+	chans = new float *[m];
+	for (size_t k = 0; k < m; k++) {
+		chans[k] = in[k];
+		if (!chans[k]) {
+			if (!zero)
+				zero = (float *) calloc(in_len, 2 * sizeof(float));
+			chans[k] = zero;
+		}
+	}
+
+	/* Inverse DFT into the branch buffers, after the history */
+	dft(chans, 0, branchBuf, hist_len, in_len, 1);
+	delete[] chans;
+	free(zero);
+
+	if (!filterBranches(in_len))
+		return -1;
+
+	/* Commutate the branch outputs into the wideband stream */
+	for (size_t n = 0; n < in_len; n++) {
+		for (size_t p = 0; p < m; p++) {
+			out[2 * (n * m + p) + 0] = branchOut[p][2 * n + 0];
+			out[2 * (n * m + p) + 1] = branchOut[p][2 * n + 1];
+		}
+	}
+
+	return in_len * m;
+}
@@ -0,0 +1,104 @@
+/*
+ * Polyphase channelizer and synthesis filterbanks
+ *
+ * Copyright 2014 Range Networks, Inc.
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef _CHANNELIZER_H_
+#define _CHANNELIZER_H_
+
+#include <stddef.h>
+
+/*
+ * Critically sampled M channel filterbank. Channel k is centered at
+ * k * fs / M, so channels above M / 2 are the negative frequencies, and
+ * runs at fs / M. Each of the M branch filters is one partition of a
+ * single lowpass prototype, driven through convolve_real() like the
+ * Resampler partitions, and an M point DFT across the branches moves
+ * each channel to or from baseband. M is small, so the DFT is direct.
+ */
+class ChannelizerBase {
+protected:
+	/* Constructor for the filterbank
+	 *   @param m number of channels
+	 *   @param filt_len length of each polyphase subfilter
+	 */
+	ChannelizerBase(size_t m, size_t filt_len);
+	virtual ~ChannelizerBase();
+
+	/* Generate the branch filters and buffers
+	 *   @param synthesis true for the synthesis partitioning and gain
+	 *   @return false on error
+	 */
+	bool initBank(bool synthesis);
+
+	/* Multiply each column of branch outputs by the DFT matrix
+	 *   @param sign -1 for the forward transform, +1 for the inverse
+	 */
+	void dft(float **in, size_t in_offset,
+		 float **out, size_t out_offset, size_t len, int sign);
+
+	/* Run each branch filter over its buffered input */
+	bool filterBranches(size_t len);
+
+	size_t m;
+	size_t filt_len;
+
+	float **subFilters;
+	float **branchBuf;
+	float **branchOut;
+	float *dftCos;
+	float *dftSin;
+
+public:
+	/* Get number of channels */
+	size_t size() { return m; }
+
+	/* Get filter length
+	 *   @return number of taps in each filter partition
+	 */
+	size_t len() { return filt_len; }
+};
+
+class Channelizer : public ChannelizerBase {
+public:
+	Channelizer(size_t m, size_t filt_len = 16);
+
+	bool init();
+
+	/* Split wideband samples into channels
+	 *   @param in wideband complex float samples
+	 *   @param in_len input length, a multiple of the channel count
+	 *   @param out one buffer per channel, each receiving in_len / m
+	 *   @return samples written to each channel, negative on error
+	 */
+	int rotate(const float *in, size_t in_len, float **out);
+};
+
+class Synthesis : public ChannelizerBase {
+public:
+	Synthesis(size_t m, size_t filt_len = 16);
+
+	bool init();
+
+	/* Combine channels into wideband samples
+	 *   @param in one buffer per channel, NULL for a silent channel
+	 *   @param in_len samples in each channel buffer
+	 *   @param out wideband output of in_len * m samples
+	 *   @return number of samples outputted, negative on error
+	 */
+	int rotate(float **in, size_t in_len, float *out);
+};
+
+#endif /* _CHANNELIZER_H_ */
@@ -0,0 +1,303 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "FileDevice.h"
+
+#include <Logger.h>
+
+#define FILE_ARGS_PREFIX "file:"
+
+using namespace std;
+
+FileDevice::FileDevice(int wSPS, size_t wChans)
+  : sps(wSPS), chans(wChans), txFreq(0.0), rxFreq(0.0), rxGain(0.0), txGain(0.0),
+    fast(false), loop(false), exhausted(false),
+    rxFd(-1), txFd(-1), rxMap(NULL), rxMapLen(0), rxLen(0), rxStart(0),
+    samplesRead(0), samplesWritten(0)
+{
+  if (chans > 1) {
+    txRate = mcbtsWidth(chans) * MCBTS_SPACING;
+    rxRate = txRate;
+  } else {
+    txRate = GSMRATE * sps;
+    rxRate = GSMRATE;
+  }
+}
+
+FileDevice::~FileDevice()
+{
+  if (rxMap)
+    munmap((void *) rxMap, rxMapLen);
+  if (rxFd >= 0)
+    close(rxFd);
+  if (txFd >= 0)
+    close(txFd);
+}
+
+bool FileDevice::handles(const string &args)
+{
+  return args.compare(0, strlen(FILE_ARGS_PREFIX), FILE_ARGS_PREFIX) == 0;
+}
+
+bool FileDevice::readMeta(const string &path, map<string, string> &meta)
+{
+  ifstream in((path + ".meta").c_str());
+  string line;
+
+  if (!in.is_open())
+    return false;
+
+  while (getline(in, line)) {
+    size_t eq = line.find('=');
+    if ((line.empty()) || (line[0] == '#') || (eq == string::npos))
+      continue;
+    meta[line.substr(0, eq)] = line.substr(eq + 1);
+  }
+
+  return true;
+}
+
+bool FileDevice::writeMeta(const string &path,
+                           const map<string, string> &meta)
+{
+  ofstream out((path + ".meta").c_str());
+  map<string, string>::const_iterator itr;
+
+  if (!out.is_open())
+    return false;
+
+  for (itr = meta.begin(); itr != meta.end(); itr++)
+    out << itr->first << "=" << itr->second << endl;
+
+  return out.good();
+}
+
+bool FileDevice::openRx(const string &path)
+{
+  map<string, string> meta;
+  struct stat st;
+
+  if (!readMeta(path, meta)) {
+    LOG(ALERT) << "No metadata for receive capture " << path;
+    return false;
+  }
+
+  if (meta.count("format") && (meta["format"] != "sc16")) {
+    LOG(ALERT) << "Unsupported capture format " << meta["format"];
+    return false;
+  }
+
+  /* Captures must be at the receive rate, which is 1 sps for one ARFCN */
+  if (!meta.count("rate") ||
+      (fabs(strtod(meta["rate"].c_str(), NULL) - rxRate) > 1.0)) {
+    LOG(ALERT) << "Capture rate " << meta["rate"]
+               << " does not match receive rate " << rxRate;
+    return false;
+  }
+
+  if (meta.count("timestamp"))
+    rxStart = strtoull(meta["timestamp"].c_str(), NULL, 10);
+  if (meta.count("freq"))
+    rxFreq = strtod(meta["freq"].c_str(), NULL);
+
+  rxFd = ::open(path.c_str(), O_RDONLY);
+  if ((rxFd < 0) || (fstat(rxFd, &st) < 0)) {
+    LOG(ALERT) << "Cannot open receive capture " << path;
+    return false;
+  }
+
+  rxLen = st.st_size / (2 * sizeof(short));
+  if (!rxLen) {
+    LOG(ALERT) << "Empty receive capture " << path;
+    return false;
+  }
+
+  rxMapLen = rxLen * 2 * sizeof(short);
+  void *map = mmap(NULL, rxMapLen, PROT_READ, MAP_PRIVATE, rxFd, 0);
+  if (map == MAP_FAILED) {
+    LOG(ALERT) << "Cannot map receive capture " << path;
+    return false;
+  }
+  madvise(map, rxMapLen, MADV_SEQUENTIAL);
+  rxMap = (const short *) map;
+
+  LOG(INFO) << "Replaying " << rxLen << " samples from " << path;
+
+  return true;
+}
+
+bool FileDevice::openTx(const string &path)
+{
+  map<string, string> meta;
+  ostringstream rate;
+
+  txFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (txFd < 0) {
+    LOG(ALERT) << "Cannot open transmit recording " << path;
+    return false;
+  }
+
+  rate.precision(12);
+  rate << txRate;
+
+  meta["format"] = "sc16";
+  meta["rate"] = rate.str();
+  meta["timestamp"] = "0";
+
+  if (!writeMeta(path, meta)) {
+    LOG(ALERT) << "Cannot write metadata for " << path;
+    return false;
+  }
+
+  LOG(INFO) << "Recording transmit samples to " << path;
+
+  return true;
+}
+
+int FileDevice::open(const string &args, ReferenceType ref)
+{
+  string opts, opt;
+
+  if (!handles(args)) {
+    LOG(ALERT) << "Invalid file device arguments " << args;
+    return -1;
+  }
+
+  opts = args.substr(strlen(FILE_ARGS_PREFIX));
+  istringstream in(opts);
+
+  while (getline(in, opt, ',')) {
+    size_t eq = opt.find('=');
+    string key = opt.substr(0, eq);
+    string val = (eq == string::npos) ? "" : opt.substr(eq + 1);
+
+    if (key == "rx")
+      rxPath = val;
+    else if (key == "tx")
+      txPath = val;
+    else if (key == "rate")
+      fast = (val == "fast");
+    else if (key == "loop")
+      loop = (val != "0");
+    else
+      LOG(WARNING) << "Unknown file device option " << opt;
+  }
+
+  if (!rxPath.empty() && !openRx(rxPath))
+    return -1;
+
+  if (!txPath.empty() && !openTx(txPath))
+    return -1;
+
+  return chans > 1 ? MULTI_ARFCN : NORMAL;
+}
+
+bool FileDevice::start()
+{
+  gettimeofday(&startTime, NULL);
+  exhausted = false;
+
+  return true;
+}
+
+bool FileDevice::stop()
+{
+  return true;
+}
+
+void FileDevice::pace(TIMESTAMP timestamp)
+{
+  struct timeval now;
+  double due, elapsed;
+
+  due = (double) (timestamp - rxStart) / rxRate * 1.0e6;
+
+  gettimeofday(&now, NULL);
+  elapsed = (now.tv_sec - startTime.tv_sec) * 1.0e6 +
+            (now.tv_usec - startTime.tv_usec);
+
+  if (due > elapsed)
+    usleep((useconds_t) (due - elapsed));
+}
+
+int FileDevice::readSamples(short *buf, int len, bool *overrun,
+                            TIMESTAMP timestamp, bool *underrun,
+                            unsigned *RSSI)
+{
+  *overrun = false;
+  if (underrun)
+    *underrun = false;
+
+  if (!fast)
+    pace(timestamp + len);
+
+  /* Anything before or after the capture reads as silence */
+  memset(buf, 0, len * 2 * sizeof(short));
+
+  TIMESTAMP i = 0;
+  if (timestamp < rxStart)
+    i = std::min((TIMESTAMP) len, rxStart - timestamp);
+
+  while (rxMap && (i < (TIMESTAMP) len)) {
+    TIMESTAMP pos = timestamp + i - rxStart;
+    if (loop)
+      pos %= rxLen;
+
+    if (pos >= rxLen) {
+      exhausted = true;
+      break;
+    }
+
+    TIMESTAMP run = std::min((TIMESTAMP) len - i, rxLen - pos);
+    memcpy(&buf[2 * i], &rxMap[2 * pos], run * 2 * sizeof(short));
+    i += run;
+  }
+
+  samplesRead += len;
+
+  return len;
+}
+
+int FileDevice::writeSamples(short *buf, int len, bool *underrun,
+                             TIMESTAMP timestamp, bool isControl)
+{
+  *underrun = false;
+
+  /* Transmit timestamps count from zero at the transmit rate */
+  if (txFd >= 0) {
+    off_t offset = (off_t) timestamp * 2 * sizeof(short);
+    size_t bytes = len * 2 * sizeof(short);
+
+    if (pwrite(txFd, buf, bytes, offset) != (ssize_t) bytes)
+      LOG(ALERT) << "Transmit recording write failed";
+  }
+
+  samplesWritten += len;
+
+  return len;
+}
@@ -0,0 +1,143 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+#ifndef __FILE_DEVICE_H__
+#define __FILE_DEVICE_H__
+
+#include "radioDevice.h"
+
+#include <sys/time.h>
+#include <map>
+#include <string>
+
+/**
+  A radio device backed by files instead of hardware. Receive samples are
+  replayed from a memory mapped capture, and transmit samples are recorded
+  to a file, so the transceiver can run with no radio attached.
+
+  Sample files are raw interleaved 16-bit I/Q, the same format the device
+  layer passes to readSamples() and writeSamples(). Each has a sidecar
+  <file>.meta of key=value lines:
+    format=sc16         sample format, the only one supported
+    rate=270833.333     sample rate in Hz
+    timestamp=0         device timestamp of the first sample
+    freq=900000000      center frequency, informational
+  Other keys are kept for the tools that made the capture.
+
+  Device arguments are "file:" followed by comma separated options:
+    rx=<path>           capture to replay on the receive side
+    tx=<path>           record the transmit side to this file
+    rate=fast           replay as fast as the receive chain can take it,
+                        rather than in real time
+    loop=1              restart the capture when it runs out
+
+  With more than one ARFCN the device carries the wideband stream of
+  RadioInterfaceMulti, so both directions run at the channelizer rate
+  and a receive capture must have been made at that rate.
+*/
+class FileDevice: public RadioDevice {
+
+private:
+
+  int sps;
+  size_t chans;
+  double txRate, rxRate;
+  double txFreq, rxFreq;
+  double rxGain, txGain;
+
+  bool fast;
+  bool loop;
+  bool exhausted;
+
+  std::string rxPath, txPath;
+  int rxFd, txFd;
+  const short *rxMap;           ///< mapped receive capture
+  size_t rxMapLen;              ///< mapped length in bytes
+  TIMESTAMP rxLen;              ///< receive capture length in samples
+  TIMESTAMP rxStart;            ///< timestamp of the first capture sample
+
+  unsigned long long samplesRead;
+  unsigned long long samplesWritten;
+
+  struct timeval startTime;
+
+  bool openRx(const std::string &path);
+  bool openTx(const std::string &path);
+
+  /** Sleep until real time reaches a receive timestamp */
+  void pace(TIMESTAMP timestamp);
+
+public:
+
+  FileDevice(int sps, size_t chans = 1);
+  ~FileDevice();
+
+  /** True if the device arguments select a file device */
+  static bool handles(const std::string &args);
+
+  /** Read or write a sidecar metadata file */
+  static bool readMeta(const std::string &path,
+                       std::map<std::string, std::string> &meta);
+  static bool writeMeta(const std::string &path,
+                        const std::map<std::string, std::string> &meta);
+
+  /** True once a non-looping capture has been read to the end */
+  bool isExhausted() { return exhausted; }
+
+  int open(const std::string &args, ReferenceType ref);
+  bool start();
+  bool stop();
+
+  enum TxWindowType getWindowType() { return TX_WINDOW_FIXED; }
+  void setPriority() { }
+
+  int readSamples(short *buf, int len, bool *overrun,
+                  TIMESTAMP timestamp = 0xffffffff,
+                  bool *underrun = NULL,
+                  unsigned *RSSI = NULL);
+
+  int writeSamples(short *buf, int len, bool *underrun,
+                   TIMESTAMP timestamp = 0xffffffff,
+                   bool isControl = false);
+
+  bool updateAlignment(TIMESTAMP timestamp) { return true; }
+
+  bool setTxFreq(double wFreq) { txFreq = wFreq; return true; }
+  bool setRxFreq(double wFreq) { rxFreq = wFreq; return true; }
+
+  TIMESTAMP initialWriteTimestamp(void) { return 0; }
+  TIMESTAMP initialReadTimestamp(void) { return rxStart; }
+
+  double fullScaleInputValue() { return 32000 * 0.3; }
+  double fullScaleOutputValue() { return 32000; }
+
+  double setRxGain(double dB) { rxGain = dB; return rxGain; }
+  double getRxGain(void) { return rxGain; }
+  double maxRxGain(void) { return 0.0; }
+  double minRxGain(void) { return 0.0; }
+
+  double setTxGain(double dB) { txGain = dB; return txGain; }
+  double maxTxGain(void) { return 0.0; }
+  double minTxGain(void) { return 0.0; }
+
+  double getTxFreq() { return txFreq; }
+  double getRxFreq() { return rxFreq; }
+  double getSampleRate() { return txRate; }
+  double numberRead() { return samplesRead; }
+  double numberWritten() { return samplesWritten; }
+};
+
+#endif
@@ -0,0 +1,136 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses; see the COPYING file in the main directory for licensing information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+/*
+	Power scanner for the UHD and USRP1 transceivers, the same as TransceiverRAD1/PowerScanner.
+	Usage: PowerScanner [device args]
+	The capture width comes from PowerScanner.Carriers: a B100 or B2XX opened for several carriers
+	streams at the multi-ARFCN channelizer rate, and the scan measures that many more ARFCNs per tuning.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+
+#include "radioDevice.h"
+
+#include <Logger.h>
+#include <Configuration.h>
+#include <Scanning.h>
+#include <PowerScan.h>
+#include <GSMCommon.h>
+
+ConfigurationKeyMap getAllConfigurationKeys();
+ConfigurationTable gConfig("/etc/OpenBTS/OpenBTS.db", "PowerScanner", getAllConfigurationKeys());
+
+
+using namespace std;
+
+
+/** A Transceiver52M RadioDevice as a ScanRadio. */
+class DeviceScanRadio : public ScanRadio {
+
+  private:
+
+    RadioDevice *mDev;
+    TIMESTAMP mTimestamp;
+
+  public:
+
+    DeviceScanRadio(RadioDevice *wDev) : mDev(wDev), mTimestamp(wDev->initialReadTimestamp()) {}
+
+    double sampleRate() { return mDev->getSampleRate(); }
+
+    bool tune(double freq) { return mDev->setRxFreq(freq); }
+
+    int read(short *buf, int len) {
+      bool overrun, underrun;
+      int rd = mDev->readSamples(buf, len, &overrun, mTimestamp, &underrun);
+      if (overrun) LOG(NOTICE) << "receive overrun at " << mTimestamp;
+      mTimestamp += rd;
+      return rd;
+    }
+};
+
+
+int main(int argc, char *argv[])
+{
+  try {
+    gLogInit("PowerScanner", gConfig.getStr("Log.Level").c_str(), LOG_LOCAL7);
+
+    GSM::GSMBand band = (GSM::GSMBand)gConfig.getNum("GSM.Radio.Band");
+    SpectrumMap spectrumMap(gConfig.getStr("PowerScanner.DBPath").c_str());
+    int startARFCN, stopARFCN;
+    switch (band) {
+      case GSM::GSM850: startARFCN=130; stopARFCN=251; break;
+      case GSM::EGSM900: startARFCN=0; stopARFCN=124; break;
+      case GSM::DCS1800: startARFCN=512; stopARFCN=885; break;
+      case GSM::PCS1900: startARFCN=512; stopARFCN=810; break;
+      default:
+        LOG(ALERT) << "Unsupported GSM Band specified (config key GSM.Radio.Band). Exiting...";
+        return EXIT_FAILURE;
+    }
+
+    // One sample per symbol so the receive rate is the whole stream rate.
+    RadioDevice *dev = RadioDevice::make(1, false, gConfig.getNum("PowerScanner.Carriers"));
+    if (!dev || dev->open(argc > 1 ? argv[1] : "", RadioDevice::REF_INTERNAL) < 0) {
+      LOG(ALERT) << "Cannot open the radio. Exiting...";
+      return EXIT_FAILURE;
+    }
+    dev->setRxGain(gConfig.getNum("PowerScanner.RxGain"));
+    dev->start();
+
+    DeviceScanRadio radio(dev);
+    unsigned integrationTime = gConfig.getNum("PowerScanner.IntegrationTime");
+    double dBmOffset = gConfig.getNum("PowerScanner.dBmOffset");
+
+    cout << endl << "Scanning Uplink" << endl;
+    PowerScan up(radio, spectrumMap, band, SpectrumMap::LinkDirection::Up, &GSM::uplinkFreqKHz, integrationTime, dBmOffset);
+    cout << up.run(startARFCN, stopARFCN) << " ARFCNs measured" << endl;
+    cout << endl << "Scanning Downlink" << endl;
+    PowerScan down(radio, spectrumMap, band, SpectrumMap::LinkDirection::Down, &GSM::downlinkFreqKHz, integrationTime, dBmOffset);
+    cout << down.run(startARFCN, stopARFCN) << " ARFCNs measured" << endl;
+
+    dev->stop();
+    delete dev;
+
+  } catch (ConfigurationTableKeyNotFound e) {
+    cout << "Required configuration parameter " << e.key() << " not defined, exiting.";
+    return -1;
+  }
+
+  return 0;
+}
+
+ConfigurationKeyMap getAllConfigurationKeys()
+{
+	extern ConfigurationKeyMap getConfigurationKeys();
+	ConfigurationKeyMap map = getConfigurationKeys();
+	addPowerScanConfigurationKeys(map);
+	ConfigurationKey *tmp;
+
+	tmp = new ConfigurationKey("PowerScanner.Carriers","1",
+		"carriers",
+		ConfigurationKey::FACTORY,
+		ConfigurationKey::VALRANGE,
+		"1:15",
+		false,
+		"Open the radio as if for this many carriers, which on a B100 or B2XX widens each capture to the multi-ARFCN "
+			"channelizer rate so the power scanner measures more ARFCNs per tuning.  Other devices must use 1."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	return map;
+}
@@ -29,6 +29,7 @@
 
 
 #include <stdio.h>
+#include <time.h>
 #include "Transceiver.h"
 #include <Logger.h>
 
@@ -47,18 +48,88 @@
 /* Number of running values use in noise average */
 #define NOISE_CNT			20
 
+/* Frames a timeslot channel estimate is trusted before it is refreshed */
+#define CHAN_EST_FRAMES			50
+
+/*
+ * Fraction of channel energy outside the main tap pair that turns the
+ * equalizer on for a timeslot, and the lower value that turns it off.
+ * Noise alone keeps a clean channel below the off level down to an
+ * SNR of a few dB.
+ */
+#define EQ_SPREAD_ON			0.12
+#define EQ_SPREAD_OFF			0.08
+
+/* DFE feedforward taps */
+#define DFE_FF_TAPS			7
+
+/*
+ * Bursts with an RMS level below this multiple of the noise floor are
+ * not correlated. Noise alone rarely reaches it over a whole burst,
+ * while a RACH at the edge of detection sits near 1.2.
+ */
+#define ENERGY_GATE			1.1
+
+/* Bursts queued for each receive worker, and seconds between its reports */
+#define RX_RING_SIZE			64
+#define RX_REPORT_INTRVL		10.0
+
+struct Transceiver::RxWorker {
+  /** A burst and when it was queued */
+  struct Job {
+    radioVector *burst;
+    double queued;
+  };
+
+  Transceiver *trx;
+  Thread thread;
+  InterthreadRing<Job, RX_RING_SIZE> ring;
+
+  volatile bool running;        ///< cleared by the worker when it is told to stop
+
+  // Written by the receive thread
+  volatile unsigned drops;      ///< bursts dropped with the ring full
+  volatile unsigned maxDepth;   ///< deepest the ring has been
+
+  // Written by the worker, and reset at each report
+  unsigned count;
+  double waitSum, waitMax;      ///< seconds from queueing to demodulation
+  double dspSum, dspMax;        ///< seconds spent demodulating
+  double lastReport;
+
+  RxWorker(Transceiver *wTrx)
+    : trx(wTrx), thread(32768), running(true), drops(0), maxDepth(0), count(0),
+      waitSum(0.0), waitMax(0.0), dspSum(0.0), dspMax(0.0), lastReport(0.0)
+  { }
+};
+
+/** Receive worker thread loop */
+void *RxWorkerLoopAdapter(Transceiver::RxWorker *);
+
+static double monotonicTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
 Transceiver::Transceiver(int wBasePort,
 			 const char *TRXAddress,
 			 int wSPS,
 			 GSM::Time wTransmitLatency,
-			 RadioInterface *wRadioInterface)
-	:mDataSocket(wBasePort+2,TRXAddress,wBasePort+102),
-	 mControlSocket(wBasePort+1,TRXAddress,wBasePort+101),
-	 mClockSocket(wBasePort,TRXAddress,wBasePort+100),
-	 mSPSTx(wSPS), mSPSRx(1), mNoises(NOISE_CNT)
+			 RadioInterface *wRadioInterface,
+			 size_t wChan)
+	:mDataSocket(wBasePort+2+2*wChan,TRXAddress,wBasePort+102+2*wChan),
+	 mControlSocket(wBasePort+1+2*wChan,TRXAddress,wBasePort+101+2*wChan),
+	 mClockSocket(wChan ? 0 : wBasePort,TRXAddress,wBasePort+100),
+	 mSPSTx(wSPS), mSPSRx(1), mNoises(NOISE_CNT), mChan(wChan)
 {
   GSM::Time startTime(random() % gHyperframe,0);
 
+  // Carriers share the radio clock, which C0 has already set
+  if (mChan)
+    startTime = wRadioInterface->getClock()->get();
+
   mRxServiceLoopThread = new Thread(32768);
   mTxServiceLoopThread = new Thread(32768);
   mControlServiceLoopThread = new Thread(32768);       ///< thread to process control messages from GSM core
@@ -69,13 +140,25 @@ Transceiver::Transceiver(int wBasePort,
   mTransmitDeadlineClock = startTime;
   mLastClockUpdateTime = startTime;
   mLatencyUpdateTime = startTime;
-  mRadioInterface->getClock()->set(startTime);
+  if (!mChan)
+    mRadioInterface->getClock()->set(startTime);
   mMaxExpectedDelay = 0;
+  mMaxRACHDelay = 62;
+  mTSC = 0;
+  mEqualizer = false;
+
+  for (int i = 0; i < 8; i++) {
+    channelResponse[i] = NULL;
+    DFEForward[i] = NULL;
+    DFEFeedback[i] = NULL;
+    needDFE[i] = false;
+  }
 
   txFullScale = mRadioInterface->fullScaleInputValue();
   rxFullScale = mRadioInterface->fullScaleOutputValue();
 
   mOn = false;
+  mRxStop = false;
   mTxFreq = 0.0;
   mRxFreq = 0.0;
   mPower = -10;
@@ -84,6 +167,12 @@ Transceiver::Transceiver(int wBasePort,
 
 Transceiver::~Transceiver()
 {
+  stopRxWorkers();
+
+  for (int i = 0; i < 8; i++)
+    resetEqualizer(i);
+
+  mModulationCache.clear();
   sigProcLibDestroy();
   mTransmitPriorityQueue.clear();
 }
@@ -114,9 +203,7 @@ bool Transceiver::init()
 
     delete modBurst;
     mChanType[i] = NONE;
-    channelResponse[i] = NULL;
-    DFEForward[i] = NULL;
-    DFEFeedback[i] = NULL;
+    resetEqualizer(i);
     channelEstimateTime[i] = mTransmitDeadlineClock;
     mHandoverActive[i] = false;
   }
@@ -130,7 +217,7 @@ radioVector *Transceiver::fixRadioVector(BitVector &burst,
 {
 
   // modulate and stick into queue 
-  signalVector* modBurst = modulateBurst(burst,
+  signalVector* modBurst = mModulationCache.modulate(burst,
 					 8 + (wTime.TN() % 4 == 0),
 					 mSPSTx);
   scaleVector(*modBurst,txFullScale * pow(10,-RSSI/10));
@@ -231,7 +318,7 @@ void Transceiver::pushRadioVector(GSM::Time &nowTime)
 
   // What if sendVec is still NULL?
   // It can't be if there are no NULLs in the filler table.
-  mRadioInterface->driveTransmitRadio(*sendVec,false);
+  mRadioInterface->driveTransmitRadio(*sendVec,false,mChan);
   delete sendVec;
 
 }
@@ -327,19 +414,91 @@ Transceiver::CorrType Transceiver::expectedCorrType(GSM::Time currTime)
 
 }
 
+bool Transceiver::singleUserSlot(int timeslot)
+{
+  switch (mChanType[timeslot]) {
+  case I:
+  case II:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Transceiver::resetEqualizer(int timeslot)
+{
+  ScopedLock lock(mEqualizerLock[timeslot]);
+  delete channelResponse[timeslot];
+  delete DFEForward[timeslot];
+  delete DFEFeedback[timeslot];
+  channelResponse[timeslot] = NULL;
+  DFEForward[timeslot] = NULL;
+  DFEFeedback[timeslot] = NULL;
+  needDFE[timeslot] = false;
+}
+
+void Transceiver::updateEqualizer(int timeslot, signalVector *chan,
+                                  float offset, complex amplitude,
+                                  const GSM::Time &time)
+{
+  delete channelResponse[timeslot];
+  channelResponse[timeslot] = chan;
+  chanRespOffset[timeslot] = offset;
+  chanRespAmplitude[timeslot] = amplitude;
+  channelEstimateTime[timeslot] = time;
+  scaleVector(*chan, complex(1.0, 0.0) / amplitude);
+
+  float spread = channelSpread(*chan);
+  if (spread > EQ_SPREAD_ON)
+    needDFE[timeslot] = true;
+  else if (spread < EQ_SPREAD_OFF)
+    needDFE[timeslot] = false;
+
+  // Only slots with delay spread pay for the filter design
+  if (needDFE[timeslot] &&
+      !designDFE(*chan, SNRestimate[timeslot], DFE_FF_TAPS,
+                 &DFEForward[timeslot], &DFEFeedback[timeslot]))
+    needDFE[timeslot] = false;
+
+  LOG(DEBUG) << "TN " << timeslot << " delay spread " << spread
+             << ", SNR " << SNRestimate[timeslot]
+             << (needDFE[timeslot] ? ", equalizing" : "");
+}
+
+void Transceiver::addNoise(float avg)
+{
+  ScopedLock lock(mNoiseLock);
+  mNoises.insert(avg);
+}
+
+float Transceiver::noiseLevel()
+{
+  ScopedLock lock(mNoiseLock);
+  mNoiseLev = mNoises.avg();
+  return mNoiseLev;
+}
+
 SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
 				      int &RSSI,
 				      int &timingOffset)
 {
-  bool needDFE = false;
-  int success = 0;
-  complex amplitude = 0.0;
-  float TOA = 0.0, avg = 0.0;
-
   radioVector *rxBurst = (radioVector *) mReceiveFIFO->get();
 
   if (!rxBurst) return NULL;
 
+  return demodRadioVector(rxBurst, wTime, RSSI, timingOffset);
+}
+
+SoftVector *Transceiver::demodRadioVector(radioVector *rxBurst,
+					  GSM::Time &wTime,
+					  int &RSSI,
+					  int &timingOffset)
+{
+  bool equalize = false;
+  int success = 0;
+  complex amplitude = 0.0;
+  float TOA = 0.0, avg = 0.0;
+
   int timeslot = rxBurst->getTime().TN();
 
   CorrType corrType = expectedCorrType(rxBurst->getTime());
@@ -351,29 +510,36 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
 
   signalVector *vectorBurst = rxBurst;
 
+  // Hold off SETSLOT from freeing this timeslot's estimate and filters
+  ScopedLock eqLock(mEqualizerLock[timeslot]);
+
   energyDetect(*vectorBurst, 20 * mSPSRx, 0.0, &avg);
 
   // Update noise level
-  mNoiseLev = mNoises.avg();
+  float noiseLev = noiseLevel();
   avg = sqrt(avg);
 
+  // Skip the correlators on slots holding nothing but noise, which are
+  // most of them on an idle cell. Measure the whole burst, since a
+  // delayed RACH can miss the window energyDetect() looks at.
+  if (!aboveNoiseFloor(*vectorBurst, noiseLev, ENERGY_GATE)) {
+    addNoise(avg);
+    delete rxBurst;
+    return NULL;
+  }
+
   // run the proper correlator
   if (corrType==TSC) {
     LOG(DEBUG) << "looking for TSC at time: " << rxBurst->getTime();
-    signalVector *channelResp;
+    signalVector *channelResp = NULL;
+    float chanOffset = 0.0;
+
+    // Estimates are cheap, so every slot gets one to watch for delay spread,
+    // but a shared slot would mix the channels of different handsets
     double framesElapsed = rxBurst->getTime()-channelEstimateTime[timeslot];
-    bool estimateChannel = false;
-    if ((framesElapsed > 50) || (channelResponse[timeslot]==NULL)) {
-	if (channelResponse[timeslot]) delete channelResponse[timeslot];
-        if (DFEForward[timeslot]) delete DFEForward[timeslot];
-        if (DFEFeedback[timeslot]) delete DFEFeedback[timeslot];
-        channelResponse[timeslot] = NULL;
-        DFEForward[timeslot] = NULL;
-        DFEFeedback[timeslot] = NULL;
-	estimateChannel = true;
-    }
-    if (!needDFE) estimateChannel = false;
-    float chanOffset;
+    bool estimateChannel = mEqualizer && singleUserSlot(timeslot) &&
+      ((framesElapsed > CHAN_EST_FRAMES) || (channelResponse[timeslot]==NULL));
+
     success = analyzeTrafficBurst(*vectorBurst,
 				  mTSC,
 				  5.0,
@@ -385,31 +551,23 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
 				  &channelResp,
 				  &chanOffset);
     if (success) {
-      SNRestimate[timeslot] = amplitude.norm2()/(mNoiseLev*mNoiseLev+1.0); // this is not highly accurate
-      if (estimateChannel) {
-         LOG(DEBUG) << "estimating channel...";
-         channelResponse[timeslot] = channelResp;
-       	 chanRespOffset[timeslot] = chanOffset;
-         chanRespAmplitude[timeslot] = amplitude;
-	 scaleVector(*channelResp, complex(1.0,0.0)/amplitude);
-         designDFE(*channelResp, SNRestimate[timeslot], 7, &DFEForward[timeslot], &DFEFeedback[timeslot]);
-         channelEstimateTime[timeslot] = rxBurst->getTime();  
-         LOG(DEBUG) << "SNR: " << SNRestimate[timeslot] << ", DFE forward: " << *DFEForward[timeslot] << ", DFE backward: " << *DFEFeedback[timeslot];
-      }
+      SNRestimate[timeslot] = amplitude.norm2()/(noiseLev*noiseLev+1.0); // this is not highly accurate
+      if (channelResp)
+        updateEqualizer(timeslot, channelResp, chanOffset,
+                        amplitude, rxBurst->getTime());
+      equalize = needDFE[timeslot];
     }
     else {
-      channelResponse[timeslot] = NULL;
-      mNoises.insert(avg);
+      addNoise(avg);
     }
   }
   else {
     // RACH burst
-    success = detectRACHBurst(*vectorBurst, 6.0, mSPSRx, &amplitude, &TOA);
-    if (success > 0) {
-      channelResponse[timeslot] = NULL;
-    } else if (success == 0) {
-      mNoises.insert(avg);
-    } else {
+    success = detectRACHBurst(*vectorBurst, 6.0, mSPSRx, &amplitude, &TOA,
+                              mMaxRACHDelay);
+    if (success == 0) {
+      addNoise(avg);
+    } else if (success < 0) {
       if (success == -SIGERR_CLIP) {
         LOG(ALERT) << "Clipping detected on RACH input";
       } else {
@@ -424,7 +582,7 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
   // demodulate burst
   SoftVector *burst = NULL;
   if ((rxBurst) && (success)) {
-    if ((corrType==RACH) || (!needDFE)) {
+    if (!equalize) {
       burst = demodulateBurst(*vectorBurst, mSPSRx, amplitude, TOA);
     } else {
       scaleVector(*vectorBurst,complex(1.0,0.0)/amplitude);
@@ -447,6 +605,52 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
   return burst;
 }
 
+void Transceiver::setRxWorkers(unsigned n)
+{
+  if (!mRxWorkers.empty() || (n < 2))
+    return;
+
+  if ((n > 8) || (8 % n)) {
+    LOG(ALERT) << "Receive workers must divide 8 timeslots, not " << n;
+    return;
+  }
+
+  for (unsigned i = 0; i < n; i++)
+    mRxWorkers.push_back(new RxWorker(this));
+
+  LOG(INFO) << "Demodulating ARFCN " << mChan << " on " << n << " threads";
+}
+
+void Transceiver::stopRxWorkers()
+{
+  if (mRxWorkers.empty())
+    return;
+
+  if (mOn) {
+    // The receive thread is the only writer to the rings, so it stops
+    // first. Then a job without a burst tells each worker to exit.
+    mRxStop = true;
+    mRxServiceLoopThread->join();
+
+    RxWorker::Job stop;
+    stop.burst = NULL;
+    stop.queued = 0.0;
+    for (unsigned i = 0; i < mRxWorkers.size(); i++) {
+      while (!mRxWorkers[i]->ring.write(stop))
+        usleep(1000);
+      mRxWorkers[i]->thread.join();
+    }
+  }
+
+  for (unsigned i = 0; i < mRxWorkers.size(); i++) {
+    RxWorker::Job job;
+    while (mRxWorkers[i]->ring.readNoBlock(job))
+      delete job.burst;
+    delete mRxWorkers[i];
+  }
+  mRxWorkers.clear();
+}
+
 void Transceiver::start()
 {
   mControlServiceLoopThread->start((void * (*)(void*))ControlServiceLoopAdapter,(void*) this);
@@ -500,19 +704,9 @@ void Transceiver::driveControl()
       sprintf(response,"RSP POWERON 1");
     else {
       sprintf(response,"RSP POWERON 0");
-      if (!mOn) {
-        // Prepare for thread start
-        mPower = -20;
-        mRadioInterface->start();
-
-        // Start radio interface threads.
-        mTxServiceLoopThread->start((void * (*)(void*))TxServiceLoopAdapter,(void*) this);
-        mRxServiceLoopThread->start((void * (*)(void*))RxServiceLoopAdapter,(void*) this);
-        mTransmitPriorityQueueServiceLoopThread->start((void * (*)(void*))TransmitPriorityQueueServiceLoopAdapter,(void*) this);
-        writeClockInterface();
-
-        mOn = true;
-      }
+      powerOn();
+      for (unsigned i = 0; i < mCarriers.size(); i++)
+        mCarriers[i]->powerOn();
     }
   }
   else if (strcmp(command,"SETMAXDLY")==0) {
@@ -520,6 +714,8 @@ void Transceiver::driveControl()
     int maxDelay;
     sscanf(buffer,"%3s %s %d",cmdcheck,command,&maxDelay);
     mMaxExpectedDelay = maxDelay; // 1 GSM symbol is approx. 1 km
+    for (unsigned i = 0; i < mCarriers.size(); i++)
+      mCarriers[i]->mMaxExpectedDelay = maxDelay;
     sprintf(response,"RSP SETMAXDLY 0 %d",maxDelay);
   }
   else if (strcmp(command,"SETRXGAIN")==0) {
@@ -567,7 +763,7 @@ void Transceiver::driveControl()
     int freqKhz;
     sscanf(buffer,"%3s %s %d",cmdcheck,command,&freqKhz);
     mRxFreq = freqKhz*1.0e3+FREQOFFSET;
-    if (!mRadioInterface->tuneRx(mRxFreq)) {
+    if (!mRadioInterface->tuneRx(mRxFreq, mChan)) {
        LOG(ALERT) << "RX failed to tune";
        sprintf(response,"RSP RXTUNE 1 %d",freqKhz);
     }
@@ -580,7 +776,7 @@ void Transceiver::driveControl()
     sscanf(buffer,"%3s %s %d",cmdcheck,command,&freqKhz);
     //freqKhz = 890e3;
     mTxFreq = freqKhz*1.0e3+FREQOFFSET;
-    if (!mRadioInterface->tuneTx(mTxFreq)) {
+    if (!mRadioInterface->tuneTx(mTxFreq, mChan)) {
        LOG(ALERT) << "TX failed to tune";
        sprintf(response,"RSP TXTUNE 1 %d",freqKhz);
     }
@@ -596,6 +792,8 @@ void Transceiver::driveControl()
     else {
       mTSC = TSC;
       generateMidamble(mSPSRx, TSC);
+      for (unsigned i = 0; i < mCarriers.size(); i++)
+        mCarriers[i]->mTSC = TSC;
       sprintf(response,"RSP SETTSC 0 %d", TSC);
     }
   }
@@ -637,6 +835,7 @@ void Transceiver::driveControl()
     }     
     mChanType[timeslot] = (ChannelCombination) corrCode;
     setModulus(timeslot);
+    resetEqualizer(timeslot);
     sprintf(response,"RSP SETSLOT 0 %d %d",timeslot,corrCode);
 
   }
@@ -701,7 +900,7 @@ bool Transceiver::driveTransmitPriorityQueue()
   LOG(DEBUG) << "rcvd. burst at: " << GSM::Time(frameNum,timeSlot) <<LOGVAR(fillerFlag);
   
   int RSSI = (int) buffer[5];
-  static BitVector newBurst(gSlotLen);
+  BitVector newBurst(gSlotLen);
   BitVector::iterator itr = newBurst.begin();
   char *bufferItr = buffer+6;
   while (itr < newBurst.end()) 
@@ -724,6 +923,34 @@ bool Transceiver::driveTransmitPriorityQueue()
 
 }
  
+void Transceiver::sendBurst(SoftVector *rxBurst, GSM::Time &burstTime,
+                          int RSSI, int TOA)
+{
+  LOG(DEBUG) << "burst parameters: "
+	  << " time: " << burstTime
+	  << " RSSI: " << RSSI
+	  << " TOA: "  << TOA
+	  << " bits: " << *rxBurst;
+  
+  char burstString[gSlotLen+10];
+  burstString[0] = burstTime.TN();
+  for (int i = 0; i < 4; i++)
+    burstString[1+i] = (burstTime.FN() >> ((3-i)*8)) & 0x0ff;
+  burstString[5] = RSSI;
+  burstString[6] = (TOA >> 8) & 0x0ff;
+  burstString[7] = TOA & 0x0ff;
+  SoftVector::iterator burstItr = rxBurst->begin();
+
+  for (unsigned int i = 0; i < gSlotLen; i++) {
+    burstString[8+i] =(char) round((*burstItr++)*255.0);
+  }
+  burstString[gSlotLen+9] = '\0';
+  delete rxBurst;
+
+  ScopedLock lock(mDataLock);
+  mDataSocket.write(burstString,gSlotLen+10);
+}
+
 void Transceiver::driveReceiveFIFO() 
 {
 
@@ -732,36 +959,83 @@ void Transceiver::driveReceiveFIFO()
   int TOA;  // in 1/256 of a symbol
   GSM::Time burstTime;
 
-  mRadioInterface->driveReceiveRadio();
+  mRadioInterface->driveReceiveRadio(mChan);
 
-  rxBurst = pullRadioVector(burstTime,RSSI,TOA);
-
-  if (rxBurst) { 
+  if (mRxWorkers.empty()) {
+    rxBurst = pullRadioVector(burstTime,RSSI,TOA);
+    if (rxBurst)
+      sendBurst(rxBurst,burstTime,RSSI,TOA);
+    return;
+  }
 
-    LOG(DEBUG) << "burst parameters: "
-	  << " time: " << burstTime
-	  << " RSSI: " << RSSI
-	  << " TOA: "  << TOA
-	  << " bits: " << *rxBurst;
-    
-    char burstString[gSlotLen+10];
-    burstString[0] = burstTime.TN();
-    for (int i = 0; i < 4; i++)
-      burstString[1+i] = (burstTime.FN() >> ((3-i)*8)) & 0x0ff;
-    burstString[5] = RSSI;
-    burstString[6] = (TOA >> 8) & 0x0ff;
-    burstString[7] = TOA & 0x0ff;
-    SoftVector::iterator burstItr = rxBurst->begin();
-
-    for (unsigned int i = 0; i < gSlotLen; i++) {
-      burstString[8+i] =(char) round((*burstItr++)*255.0);
+  // Hand every burst to the worker for its timeslot. A full ring means
+  // the worker has fallen behind, and the burst is too late to matter.
+  while (radioVector *radioBurst = (radioVector *) mReceiveFIFO->get()) {
+    RxWorker *worker = mRxWorkers[radioBurst->getTime().TN() % mRxWorkers.size()];
+    RxWorker::Job job;
+    job.burst = radioBurst;
+    job.queued = monotonicTime();
+
+    if (!worker->ring.write(job)) {
+      delete radioBurst;
+      worker->drops = worker->drops + 1;
+      continue;
     }
-    burstString[gSlotLen+9] = '\0';
-    delete rxBurst;
 
-    mDataSocket.write(burstString,gSlotLen+10);
+    unsigned depth = worker->ring.size();
+    if (depth > worker->maxDepth)
+      worker->maxDepth = depth;
   }
+}
 
+void Transceiver::driveRxWorker(RxWorker *worker)
+{
+  int RSSI;
+  int TOA;  // in 1/256 of a symbol
+  GSM::Time burstTime;
+
+  RxWorker::Job job = worker->ring.read();
+  if (!job.burst) {
+    worker->running = false;
+    return;
+  }
+
+  double start = monotonicTime();
+  SoftVector *rxBurst = demodRadioVector(job.burst,burstTime,RSSI,TOA);
+  double end = monotonicTime();
+
+  // The core demultiplexes by timeslot, and each timeslot stays on one
+  // worker, so the bursts for any one channel still go out in order
+  if (rxBurst)
+    sendBurst(rxBurst,burstTime,RSSI,TOA);
+
+  double wait = start - job.queued;
+  double dsp = end - start;
+  worker->count++;
+  worker->waitSum += wait;
+  worker->dspSum += dsp;
+  if (wait > worker->waitMax)
+    worker->waitMax = wait;
+  if (dsp > worker->dspMax)
+    worker->dspMax = dsp;
+
+  if (end - worker->lastReport < RX_REPORT_INTRVL)
+    return;
+
+  if (worker->count) {
+    LOG(INFO) << "ARFCN " << mChan << " receive worker: "
+              << worker->count << " bursts, queue wait mean "
+              << 1.0e6 * worker->waitSum / worker->count << " max "
+              << 1.0e6 * worker->waitMax << " us, demod mean "
+              << 1.0e6 * worker->dspSum / worker->count << " max "
+              << 1.0e6 * worker->dspMax << " us, max depth "
+              << worker->maxDepth << ", dropped " << worker->drops;
+  }
+
+  worker->count = 0;
+  worker->waitSum = worker->waitMax = 0.0;
+  worker->dspSum = worker->dspMax = 0.0;
+  worker->lastReport = end;
 }
 
 void Transceiver::driveTransmitFIFO() 
@@ -818,9 +1092,36 @@ void Transceiver::driveTransmitFIFO()
 
 
 
+void Transceiver::powerOn()
+{
+  if (mOn)
+    return;
+
+  // Prepare for thread start
+  mPower = -20;
+  mRadioInterface->start();
+
+  // Start radio interface threads.
+  mTxServiceLoopThread->start((void * (*)(void*))TxServiceLoopAdapter,(void*) this);
+  mRxServiceLoopThread->start((void * (*)(void*))RxServiceLoopAdapter,(void*) this);
+  for (unsigned i = 0; i < mRxWorkers.size(); i++)
+    mRxWorkers[i]->thread.start((void * (*)(void*))RxWorkerLoopAdapter,(void*) mRxWorkers[i]);
+  mTransmitPriorityQueueServiceLoopThread->start((void * (*)(void*))TransmitPriorityQueueServiceLoopAdapter,(void*) this);
+  writeClockInterface();
+
+  mOn = true;
+}
+
 void Transceiver::writeClockInterface()
 {
   char command[50];
+
+  // Only C0 drives the core clock
+  if (mChan) {
+    mLastClockUpdateTime = mTransmitDeadlineClock;
+    return;
+  }
+
   // FIXME -- This should be adaptive.
   sprintf(command,"IND CLOCK %llu",(unsigned long long) (mTransmitDeadlineClock.FN()+2));
 
@@ -836,13 +1137,23 @@ void *RxServiceLoopAdapter(Transceiver *transceiver)
 {
   transceiver->setPriority();
 
-  while (1) {
+  while (!transceiver->mRxStop) {
     transceiver->driveReceiveFIFO();
     pthread_testcancel();
   }
   return NULL;
 }
 
+void *RxWorkerLoopAdapter(Transceiver::RxWorker *worker)
+{
+  worker->lastReport = monotonicTime();
+
+  while (worker->running)
+    worker->trx->driveRxWorker(worker);
+
+  return NULL;
+}
+
 void *TxServiceLoopAdapter(Transceiver *transceiver)
 {
   while (1) {
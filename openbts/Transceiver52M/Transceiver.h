@@ -37,6 +37,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include <vector>
+
 /** Define this to be the slot number to be logged. */
 //#define TRANSMIT_LOGGING 1
 
@@ -49,6 +51,7 @@ private:
   GSM::Time mLatencyUpdateTime;   ///< last time latency was updated
 
   UDPSocket mDataSocket;	  ///< socket for writing to/reading from GSM core
+  Mutex mDataLock;		  ///< one receive worker at a time writes bursts to the data socket
   UDPSocket mControlSocket;	  ///< socket for writing/reading control commands from GSM core
   UDPSocket mClockSocket;	  ///< socket for writing clock updates to GSM core
 
@@ -94,6 +97,18 @@ private:
 
   float mNoiseLev;      ///< Average noise level
   noiseVector mNoises;  ///< Vector holding running noise measurements
+  Mutex mNoiseLock;     ///< protects the noise measurements, which every receive worker updates
+
+  /** Receive worker, demodulating a share of the timeslots on its own thread */
+  struct RxWorker;
+  std::vector<RxWorker *> mRxWorkers;
+
+  /** Stop the receive thread and the workers, join them and free the workers */
+  void stopRxWorkers();
+
+  /** Add a noise measurement, and return the updated noise level */
+  void addNoise(float avg);
+  float noiseLevel();
 
   /** unmodulate a modulated burst */
 #ifdef TRANSMIT_LOGGING
@@ -112,6 +127,15 @@ private:
   SoftVector *pullRadioVector(GSM::Time &wTime,
 			   int &RSSI,
 			   int &timingOffset);
+
+  /** Demodulate a received burst, which is consumed */
+  SoftVector *demodRadioVector(radioVector *rxBurst,
+			       GSM::Time &wTime,
+			       int &RSSI,
+			       int &timingOffset);
+
+  /** Send a demodulated burst up to the GSM core, which is consumed */
+  void sendBurst(SoftVector *rxBurst, GSM::Time &wTime, int RSSI, int TOA);
    
   /** Set modulus for specific timeslot */
   void setModulus(int timeslot);
@@ -122,10 +146,16 @@ private:
   /** send messages over the clock socket */
   void writeClockInterface(void);
 
+  /** start the radio interface and service threads */
+  void powerOn();
+
   int mSPSTx;                          ///< number of samples per Tx symbol
   int mSPSRx;                          ///< number of samples per Rx symbol
 
+  size_t mChan;                        ///< carrier index on a multi-ARFCN radio
+  std::vector<Transceiver *> mCarriers; ///< other carriers, controlled through C0
   bool mOn;			       ///< flag to indicate that transceiver is powered on
+  volatile bool mRxStop;               ///< tells the receive thread to exit, when stopping the receive workers
   ChannelCombination mChanType[8];     ///< channel types for all timeslots
   double mTxFreq;                      ///< the transmit frequency
   double mRxFreq;                      ///< the receive frequency
@@ -133,9 +163,12 @@ private:
   unsigned mTSC;                       ///< the midamble sequence code
   int fillerModulus[8];                ///< modulus values of all timeslots, in frames
   signalVector *fillerTable[102][8];   ///< table of modulated filler waveforms for all timeslots
+  ModulationCache mModulationCache;    ///< recently modulated bursts, for bursts the GSM core repeats
   bool mHandoverActive[8];
   unsigned mMaxExpectedDelay;            ///< maximum expected time-of-arrival offset in GSM symbols
+  unsigned mMaxRACHDelay;                ///< RACH search past the nominal arrival in GSM symbols, which is the largest timing advance
 
+  bool mEqualizer;                     ///< equalize timeslots with multipath
   GSM::Time    channelEstimateTime[8]; ///< last timestamp of each timeslot's channel estimate
   signalVector *channelResponse[8];    ///< most recent channel estimate of all timeslots
   float        SNRestimate[8];         ///< most recent SNR estimate of all timeslots
@@ -143,6 +176,18 @@ private:
   signalVector *DFEFeedback[8];        ///< most recent DFE feedback filter of all timeslots
   float        chanRespOffset[8];      ///< most recent timing offset, e.g. TOA, of all timeslots
   complex      chanRespAmplitude[8];   ///< most recent channel amplitude of all timeslots
+  bool         needDFE[8];             ///< delay spread seen on the timeslot, equalize it
+  Mutex        mEqualizerLock[8];      ///< the control thread resets what the demodulating thread uses
+
+  /** True if one handset has the timeslot, so one channel estimate fits all its bursts */
+  bool singleUserSlot(int timeslot);
+
+  /** Take a new channel estimate for a timeslot and decide whether it needs the DFE */
+  void updateEqualizer(int timeslot, signalVector *chan, float offset,
+                       complex amplitude, const GSM::Time &time);
+
+  /** Drop the channel estimate and filters of a timeslot */
+  void resetEqualizer(int timeslot);
 
 public:
 
@@ -152,12 +197,14 @@ public:
       @param wSPS number of samples per GSM symbol
       @param wTransmitLatency initial setting of transmit latency
       @param radioInterface associated radioInterface object
+      @param wChan carrier index on the radio interface, 0 for C0
   */
   Transceiver(int wBasePort,
 	      const char *TRXAddress,
 	      int wSPS,
 	      GSM::Time wTransmitLatency,
-	      RadioInterface *wRadioInterface);
+	      RadioInterface *wRadioInterface,
+	      size_t wChan = 0);
    
   /** Destructor */
   ~Transceiver();
@@ -172,6 +219,25 @@ public:
   /** attach the radioInterface transmit FIFO */
   void transmitFIFO(VectorFIFO *wFIFO) { mTransmitFIFO = wFIFO;}
 
+  /**
+    Attach another carrier of the same radio. The core only sends
+    POWERON, SETTSC and SETMAXDLY to C0, which passes them on.
+  */
+  void addCarrier(Transceiver *trx) { mCarriers.push_back(trx); }
+
+  /** Search for RACH bursts up to this many symbols late, eg, GSM.MS.TA.Max */
+  void setMaxRACHDelay(unsigned delay) { mMaxRACHDelay = delay; }
+
+  /** Allow equalization of timeslots where delay spread is detected */
+  void setEqualizer(bool enable) { mEqualizer = enable; }
+
+  /**
+    Demodulate on this many worker threads, which must divide 8, with
+    the receive thread only servicing the radio. With 1 or less the
+    receive thread demodulates too. Call before the transceiver starts.
+  */
+  void setRxWorkers(unsigned n);
+
   // This magic flag is ORed with the TN TimeSlot in vectors passed to the transceiver
   // to indicate the radio block is a filler frame instead of a radio frame.
   // Must be higher than any possible TN.
@@ -184,6 +250,9 @@ protected:
   /** drive reception and demodulation of GSM bursts */ 
   void driveReceiveFIFO();
 
+  /** drive demodulation of the bursts queued for a receive worker */
+  void driveRxWorker(RxWorker *worker);
+
   /** drive transmission of GSM bursts */
   void driveTransmitFIFO();
 
@@ -198,6 +267,8 @@ protected:
 
   friend void *RxServiceLoopAdapter(Transceiver *);
 
+  friend void *RxWorkerLoopAdapter(RxWorker *);
+
   friend void *TxServiceLoopAdapter(Transceiver *);
 
   friend void *ControlServiceLoopAdapter(Transceiver *);
@@ -208,7 +208,7 @@ private:
 */
 class uhd_device : public RadioDevice {
 public:
-	uhd_device(int sps, bool skip_rx);
+	uhd_device(int sps, bool skip_rx, size_t chans);
 	~uhd_device();
 
 	int open(const std::string &args, ReferenceType ref);
@@ -270,6 +270,7 @@ private:
 	enum uhd_dev_type dev_type;
 
 	int sps;
+	size_t chans;
 	double tx_rate, rx_rate;
 
 	double tx_gain, tx_gain_min, tx_gain_max;
@@ -335,7 +336,7 @@ void uhd_msg_handler(uhd::msg::type_t type, const std::string &msg)
 	}
 }
 
-uhd_device::uhd_device(int sps, bool skip_rx)
+uhd_device::uhd_device(int sps, bool skip_rx, size_t chans)
 	: tx_gain(0.0), tx_gain_min(0.0), tx_gain_max(0.0),
 	  rx_gain(0.0), rx_gain_min(0.0), rx_gain_max(0.0),
 	  tx_freq(0.0), rx_freq(0.0), tx_spp(0), rx_spp(0),
@@ -344,6 +345,7 @@ uhd_device::uhd_device(int sps, bool skip_rx)
 {
 	this->sps = sps;
 	this->skip_rx = skip_rx;
+	this->chans = chans;
 }
 
 uhd_device::~uhd_device()
@@ -427,9 +429,14 @@ int uhd_device::set_rates(double tx_rate, double rx_rate)
 	double offset_limit = 1.0;
 	double tx_offset, rx_offset;
 
-	// B2XX is the only device where we set FPGA clocking
+	// B2XX is the only device where we set FPGA clocking. For multiple
+	// ARFCNs, pick a master clock that is an integer multiple of the
+	// channelizer rate.
 	if (dev_type == B2XX) {
-		if (set_master_clk(B2XX_CLK_RT) < 0)
+		double clk_rt = B2XX_CLK_RT;
+		if (chans > 1)
+			clk_rt = tx_rate * (size_t) (B2XX_CLK_RT / tx_rate);
+		if (set_master_clk(clk_rt) < 0)
 			return -1;
 	}
 
@@ -573,9 +580,20 @@ int uhd_device::open(const std::string &args, ReferenceType ref)
 	tx_spp = tx_stream->get_max_num_samps();
 	rx_spp = rx_stream->get_max_num_samps();
 
-	// Set rates
-	double _tx_rate = select_rate(dev_type, sps);
-	double _rx_rate = _tx_rate / sps;
+	// Set rates. Multiple ARFCNs share one wideband stream at the
+	// channelizer rate in both directions.
+	double _tx_rate, _rx_rate;
+	if (chans > 1) {
+		if ((dev_type != B100) && (dev_type != B2XX)) {
+			LOG(ALERT) << "Multiple ARFCNs require B100 or B2XX";
+			return -1;
+		}
+		_tx_rate = mcbtsWidth(chans) * MCBTS_SPACING;
+		_rx_rate = _tx_rate;
+	} else {
+		_tx_rate = select_rate(dev_type, sps);
+		_rx_rate = _tx_rate / sps;
+	}
 	if ((_tx_rate > 0.0) && (set_rates(_tx_rate, _rx_rate) < 0))
 		return -1;
 
@@ -584,7 +602,7 @@ int uhd_device::open(const std::string &args, ReferenceType ref)
 	rx_smpl_buf = new smpl_buf(buf_len, rx_rate);
 
 	// Set receive chain sample offset 
-	double offset = get_dev_offset(dev_type, sps);
+	double offset = get_dev_offset(dev_type, chans > 1 ? 1 : sps);
 	if (offset == 0.0) {
 		LOG(ERR) << "Unsupported configuration, no correction applied";
 		ts_offset = 0;
@@ -598,6 +616,9 @@ int uhd_device::open(const std::string &args, ReferenceType ref)
 	// Print configuration
 	LOG(INFO) << "\n" << usrp_dev->get_pp_string();
 
+	if (chans > 1)
+		return MULTI_ARFCN;
+
 	switch (dev_type) {
 	case B100:
 		return RESAMP_64M;
@@ -1116,7 +1137,7 @@ std::string smpl_buf::str_code(ssize_t code)
 	}
 }
 
-RadioDevice *RadioDevice::make(int sps, bool skip_rx)
+RadioDevice *RadioDevice::make(int sps, bool skip_rx, size_t chans)
 {
-	return new uhd_device(sps, skip_rx);
+	return new uhd_device(sps, skip_rx, chans);
 }
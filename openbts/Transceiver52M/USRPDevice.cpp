@@ -569,7 +569,12 @@ bool USRPDevice::setTxFreq(double wFreq) { return true;};
 bool USRPDevice::setRxFreq(double wFreq) { return true;};
 #endif
 
-RadioDevice *RadioDevice::make(int sps, bool skipRx)
+RadioDevice *RadioDevice::make(int sps, bool skipRx, size_t chans)
 {
-	return new USRPDevice(sps, skipRx);
+  if (chans != 1) {
+    LOG(ALERT) << "USRP1 does not support multiple ARFCNs";
+    return NULL;
+  }
+
+  return new USRPDevice(sps, skipRx);
 }
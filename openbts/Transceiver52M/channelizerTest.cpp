@@ -0,0 +1,137 @@
+/*
+ * Channelizer round trip test
+ *
+ * Copyright 2014 Range Networks, Inc.
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Stands in for the device: each carrier gets a few random tones inside
+ * its channel, the synthesis bank combines them into one wideband stream
+ * and the channelizer splits it again. Every carrier must come back as
+ * it went in, delayed by the two banks, and an empty channel must stay
+ * empty.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "Channelizer.h"
+
+#include <Configuration.h>
+
+ConfigurationTable gConfig;
+
+#define NUM_SAMPLES		(CHUNK * 40)
+#define CHUNK			96
+#define NUM_TONES		3
+#define MAX_ERROR_DB		-60.0
+
+int main(int argc, char **argv)
+{
+	size_t m = 8, delay, silent;
+	int fail = 0;
+
+	if (argc > 1)
+		m = atoi(argv[1]);
+
+	Synthesis synthesis(m);
+	Channelizer channelizer(m);
+	if (!synthesis.init() || !channelizer.init()) {
+		printf("Filterbank failed to initialize\n");
+		return 1;
+	}
+
+	delay = synthesis.len() - 1;
+	silent = m / 2;
+
+	float **in = new float *[m];
+	float **out = new float *[m];
+	float **inChunk = new float *[m];
+	float **outChunk = new float *[m];
+	float *wide = new float[2 * NUM_SAMPLES * m];
+
+	srandom(1);
+	for (size_t k = 0; k < m; k++) {
+		in[k] = new float[2 * NUM_SAMPLES];
+		out[k] = new float[2 * NUM_SAMPLES];
+
+		float freq[NUM_TONES], ampl[NUM_TONES];
+		for (int t = 0; t < NUM_TONES; t++) {
+			freq[t] = (random() % 1000) / 1000.0 * 0.5 - 0.25;
+			ampl[t] = (k == silent) ? 0.0 : (random() % 100) / 100.0;
+		}
+
+		for (int n = 0; n < NUM_SAMPLES; n++) {
+			in[k][2 * n + 0] = 0.0;
+			in[k][2 * n + 1] = 0.0;
+			for (int t = 0; t < NUM_TONES; t++) {
+				in[k][2 * n + 0] += ampl[t] * cos(2 * M_PI * freq[t] * n);
+				in[k][2 * n + 1] += ampl[t] * sin(2 * M_PI * freq[t] * n);
+			}
+		}
+	}
+
+	for (int n = 0; n < NUM_SAMPLES; n += CHUNK) {
+		for (size_t k = 0; k < m; k++) {
+			inChunk[k] = &in[k][2 * n];
+			outChunk[k] = &out[k][2 * n];
+		}
+
+		if ((synthesis.rotate(inChunk, CHUNK, &wide[2 * n * m]) < 0) ||
+		    (channelizer.rotate(&wide[2 * n * m], CHUNK * m,
+					outChunk) < 0)) {
+			printf("Filterbank rotation failed\n");
+			return 1;
+		}
+	}
+
+	for (size_t k = 0; k < m; k++) {
+		double err = 0.0, pow = 1e-20;
+
+		for (int n = 2 * delay; n < NUM_SAMPLES - (int) delay; n++) {
+			float *x = &out[k][2 * (n + delay)];
+			float *y = &in[k][2 * n];
+
+			err += (x[0] - y[0]) * (x[0] - y[0]) +
+			       (x[1] - y[1]) * (x[1] - y[1]);
+			pow += y[0] * y[0] + y[1] * y[1];
+		}
+
+		/* The silent channel is measured against unit power */
+		if (k == silent)
+			pow = NUM_SAMPLES - 3 * delay;
+
+		double db = 10.0 * log10(err / pow + 1e-20);
+		printf("Channel %2u: error %6.1f dB%s\n", (unsigned) k, db,
+		       (k == silent) ? " (silent)" : "");
+
+		if (db > MAX_ERROR_DB)
+			fail = 1;
+	}
+
+	printf("%s\n", fail ? "FAIL" : "PASS");
+
+	for (size_t k = 0; k < m; k++) {
+		delete[] in[k];
+		delete[] out[k];
+	}
+	delete[] in;
+	delete[] out;
+	delete[] inChunk;
+	delete[] outChunk;
+	delete[] wide;
+
+	return fail;
+}
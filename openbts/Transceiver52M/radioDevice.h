@@ -16,12 +16,26 @@
 #define __RADIO_DEVICE_H__
 
 #include <string>
+#include <stddef.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
 #define GSMRATE       1625e3/6
+#define MCBTS_SPACING  400000.0
+
+/** Channelizer width for chans carriers: the next power of two above
+    chans, so that the outer bins are left free for the filter rolloff */
+static inline size_t mcbtsWidth(size_t chans)
+{
+  size_t m = 4;
+
+  while (m < chans + 1)
+    m <<= 1;
+
+  return m;
+}
 
 /** a 64-bit virtual timestamp for radio data */
 typedef unsigned long long TIMESTAMP;
@@ -34,11 +48,11 @@ class RadioDevice {
   enum TxWindowType { TX_WINDOW_USRP1, TX_WINDOW_FIXED };
 
   /* Radio interface types */
-  enum RadioInterfaceType { NORMAL, RESAMP_64M, RESAMP_100M };
+  enum RadioInterfaceType { NORMAL, RESAMP_64M, RESAMP_100M, MULTI_ARFCN };
 
   enum ReferenceType { REF_INTERNAL, REF_EXTERNAL, REF_GPS };
 
-  static RadioDevice *make(int sps, bool skipRx = false);
+  static RadioDevice *make(int sps, bool skipRx = false, size_t chans = 1);
 
   virtual ~RadioDevice() { }
 
@@ -138,12 +138,12 @@ int RadioInterface::unRadioifyVector(float *floatVector,
   return newVector.size();
 }
 
-bool RadioInterface::tuneTx(double freq)
+bool RadioInterface::tuneTx(double freq, size_t chan)
 {
   return mRadio->setTxFreq(freq);
 }
 
-bool RadioInterface::tuneRx(double freq)
+bool RadioInterface::tuneRx(double freq, size_t chan)
 {
   return mRadio->setRxFreq(freq);
 }
@@ -151,6 +151,9 @@ bool RadioInterface::tuneRx(double freq)
 
 void RadioInterface::start()
 {
+  if (mOn)
+    return;
+
   LOG(INFO) << "starting radio interface...";
 #ifdef USRP1
   mAlignRadioServiceLoopThread.start((void * (*)(void*))AlignRadioServiceLoopAdapter,
@@ -183,7 +186,8 @@ void RadioInterface::alignRadio() {
 }
 #endif
 
-void RadioInterface::driveTransmitRadio(signalVector &radioBurst, bool zeroBurst)
+void RadioInterface::driveTransmitRadio(signalVector &radioBurst, bool zeroBurst,
+                                        size_t chan)
 {
   if (!mOn)
     return;
@@ -196,7 +200,7 @@ void RadioInterface::driveTransmitRadio(signalVector &radioBurst, bool zeroBurst
   pushBuffer();
 }
 
-void RadioInterface::driveReceiveRadio() {
+void RadioInterface::driveReceiveRadio(size_t chan) {
 
   if (!mOn) return;
 
@@ -21,6 +21,10 @@
 #include "radioVector.h"
 #include "radioClock.h"
 
+class Resampler;
+class Channelizer;
+class Synthesis;
+
 /** class to interface the transceiver with the USRP */
 class RadioInterface {
 
@@ -77,8 +81,8 @@ private:
 
 public:
 
-  /** start the interface */
-  void start();
+  /** start the interface, if not already started */
+  virtual void start();
 
   /** intialization */
   virtual bool init(int type);
@@ -100,16 +104,16 @@ public:
   void attach(RadioDevice *wRadio, int wRadioOversampling);
 
   /** return the receive FIFO */
-  VectorFIFO* receiveFIFO() { return &mReceiveFIFO;}
+  virtual VectorFIFO* receiveFIFO(size_t chan = 0) { return &mReceiveFIFO;}
 
   /** return the basestation clock */
   RadioClock* getClock(void) { return &mClock;};
 
   /** set transmit frequency */
-  bool tuneTx(double freq);
+  virtual bool tuneTx(double freq, size_t chan = 0);
 
   /** set receive frequency */
-  bool tuneRx(double freq);
+  virtual bool tuneRx(double freq, size_t chan = 0);
 
   /** set receive gain */
   double setRxGain(double dB);
@@ -118,10 +122,11 @@ public:
   double getRxGain(void);
 
   /** drive transmission of GSM bursts */
-  void driveTransmitRadio(signalVector &radioBurst, bool zeroBurst);
+  virtual void driveTransmitRadio(signalVector &radioBurst, bool zeroBurst,
+                                  size_t chan = 0);
 
   /** drive reception of GSM bursts */
-  void driveReceiveRadio();
+  virtual void driveReceiveRadio(size_t chan = 0);
 
   void setPowerAttenuation(double atten);
 
@@ -175,3 +180,74 @@ public:
   bool init(int type);
   void close();
 };
+
+/*
+ * Several ARFCNs on one device. Each carrier is resampled between its
+ * transceiver rate and the 400 kHz channel spacing, and a polyphase
+ * filterbank moves the carriers to or from one wideband stream at
+ * M * 400 kHz. Carrier c sits at bin c - (chans - 1) / 2 so that C0 is
+ * at or just below the device center. The Transceiver for each carrier
+ * passes its index as the chan argument.
+ */
+class RadioInterfaceMulti : public RadioInterface {
+
+private:
+  size_t mChans;
+  size_t mWidth;
+
+  VectorFIFO *mReceiveFIFOs;
+
+  Channelizer *channelizer;
+  Synthesis *synthesis;
+  Resampler **upsamplers;
+  Resampler **dnsamplers;
+
+  signalVector **innerSendBuffers;
+  signalVector **outerSendBuffers;
+  signalVector **innerRecvBuffers;
+  signalVector **outerRecvBuffers;
+  signalVector *wideSendBuffer;
+  signalVector *wideRecvBuffer;
+
+  long *sendCursors;                  ///< may be negative for a lagging carrier
+
+  double mTxCenter;
+  double mRxCenter;
+
+  Mutex mTxLock;
+  Mutex mRxLock;
+
+  /** channelizer bin of a carrier */
+  size_t chanBin(size_t chan);
+
+  /** carrier offset from the device center, in channel spacings */
+  int chanOffset(size_t chan);
+
+  /** push one chunk, zero filling lagging carriers if forced */
+  void pushChunk(bool force);
+
+  void pushBuffer();
+  void pullBuffer();
+
+public:
+
+  RadioInterfaceMulti(RadioDevice* wRadio = NULL,
+		      size_t chans = 2,
+		      int receiveOffset = 3,
+		      int wSPS = 4,
+		      GSM::Time wStartTime = GSM::Time(0));
+
+  ~RadioInterfaceMulti();
+
+  bool init(int type);
+  void close();
+
+  VectorFIFO* receiveFIFO(size_t chan = 0);
+
+  bool tuneTx(double freq, size_t chan = 0);
+  bool tuneRx(double freq, size_t chan = 0);
+
+  void driveTransmitRadio(signalVector &radioBurst, bool zeroBurst,
+                          size_t chan = 0);
+  void driveReceiveRadio(size_t chan = 0);
+};
@@ -0,0 +1,486 @@
+/*
+ * Multi-carrier radio interface
+ *
+ * Copyright 2014 Range Networks, Inc.
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <radioInterface.h>
+#include <Logger.h>
+
+#include <algorithm>
+
+#include "Resampler.h"
+#include "Channelizer.h"
+
+extern "C" {
+#include "convert.h"
+}
+
+/* Resampling between the GSM rate and the 400 kHz channel spacing */
+#define MULTI_INRATE			65
+#define MULTI_OUTRATE			96
+
+/* Inner buffer length in chunks */
+#define NUMCHUNKS			24
+
+/* Receive bursts held for a carrier that is not draining its FIFO */
+#define MAX_RX_BACKLOG			64
+
+static int multi_tx_inchunk = 0;
+static int multi_tx_outchunk = 0;
+static int multi_rx_inchunk = 0;
+static int multi_rx_outchunk = 0;
+
+RadioInterfaceMulti::RadioInterfaceMulti(RadioDevice *wRadio,
+					 size_t chans,
+					 int wReceiveOffset,
+					 int wSPS,
+					 GSM::Time wStartTime)
+	: RadioInterface(wRadio, wReceiveOffset, wSPS, wStartTime),
+	  mChans(chans), mWidth(mcbtsWidth(chans)), mReceiveFIFOs(NULL),
+	  channelizer(NULL), synthesis(NULL),
+	  upsamplers(NULL), dnsamplers(NULL),
+	  innerSendBuffers(NULL), outerSendBuffers(NULL),
+	  innerRecvBuffers(NULL), outerRecvBuffers(NULL),
+	  wideSendBuffer(NULL), wideRecvBuffer(NULL),
+	  sendCursors(NULL), mTxCenter(0.0), mRxCenter(0.0)
+{
+}
+
+RadioInterfaceMulti::~RadioInterfaceMulti()
+{
+	close();
+}
+
+void RadioInterfaceMulti::close()
+{
+	for (size_t i = 0; i < mChans; i++) {
+		if (upsamplers)
+			delete upsamplers[i];
+		if (dnsamplers)
+			delete dnsamplers[i];
+		if (innerSendBuffers)
+			delete innerSendBuffers[i];
+		if (innerRecvBuffers)
+			delete innerRecvBuffers[i];
+	}
+
+	for (size_t i = 0; i < mWidth; i++) {
+		if (outerSendBuffers)
+			delete outerSendBuffers[i];
+		if (outerRecvBuffers)
+			delete outerRecvBuffers[i];
+	}
+
+	delete[] upsamplers;
+	delete[] dnsamplers;
+	delete[] innerSendBuffers;
+	delete[] outerSendBuffers;
+	delete[] innerRecvBuffers;
+	delete[] outerRecvBuffers;
+	delete[] sendCursors;
+	delete[] mReceiveFIFOs;
+	delete wideSendBuffer;
+	delete wideRecvBuffer;
+	delete channelizer;
+	delete synthesis;
+
+	upsamplers = NULL;
+	dnsamplers = NULL;
+	innerSendBuffers = NULL;
+	outerSendBuffers = NULL;
+	innerRecvBuffers = NULL;
+	outerRecvBuffers = NULL;
+	sendCursors = NULL;
+	mReceiveFIFOs = NULL;
+	wideSendBuffer = NULL;
+	wideRecvBuffer = NULL;
+	channelizer = NULL;
+	synthesis = NULL;
+
+	RadioInterface::close();
+}
+
+int RadioInterfaceMulti::chanOffset(size_t chan)
+{
+	return (int) chan - (int) (mChans - 1) / 2;
+}
+
+size_t RadioInterfaceMulti::chanBin(size_t chan)
+{
+	return (chanOffset(chan) + mWidth) % mWidth;
+}
+
+/* Initialize I/O specific objects */
+bool RadioInterfaceMulti::init(int type)
+{
+	close();
+
+	if (type != RadioDevice::MULTI_ARFCN) {
+		LOG(ALERT) << "Invalid device configuration";
+		return false;
+	}
+
+	if ((mChans < 2) || (mChans >= mWidth) ||
+	    ((mSPSTx != 1) && (mSPSTx != 4))) {
+		LOG(ALERT) << "Invalid multi-carrier configuration, "
+			   << mChans << " carriers at " << mSPSTx << " sps";
+		return false;
+	}
+
+	multi_tx_inchunk = MULTI_INRATE * 4;
+	multi_tx_outchunk = MULTI_OUTRATE * 4 / mSPSTx;
+	multi_rx_inchunk = MULTI_INRATE * 4;
+	multi_rx_outchunk = MULTI_OUTRATE * 4;
+
+	channelizer = new Channelizer(mWidth);
+	synthesis = new Synthesis(mWidth);
+	if (!channelizer->init() || !synthesis->init()) {
+		LOG(ALERT) << "Filterbank failed to initialize";
+		return false;
+	}
+
+	mReceiveFIFOs = new VectorFIFO[mChans];
+	sendCursors = new long[mChans];
+	upsamplers = new Resampler *[mChans];
+	dnsamplers = new Resampler *[mChans];
+	innerSendBuffers = new signalVector *[mChans];
+	innerRecvBuffers = new signalVector *[mChans];
+	outerSendBuffers = new signalVector *[mWidth];
+	outerRecvBuffers = new signalVector *[mWidth];
+
+	for (size_t i = 0; i < mChans; i++) {
+		upsamplers[i] = NULL;
+		dnsamplers[i] = NULL;
+		innerSendBuffers[i] = NULL;
+		innerRecvBuffers[i] = NULL;
+	}
+
+	for (size_t i = 0; i < mWidth; i++) {
+		outerSendBuffers[i] = NULL;
+		outerRecvBuffers[i] = NULL;
+	}
+
+	/* One resampler pair per carrier, since each keeps its own history */
+	for (size_t i = 0; i < mChans; i++) {
+		dnsamplers[i] = new Resampler(MULTI_INRATE, MULTI_OUTRATE);
+		if (!dnsamplers[i]->init()) {
+			LOG(ALERT) << "Rx resampler failed to initialize";
+			return false;
+		}
+
+		upsamplers[i] = new Resampler(MULTI_OUTRATE / mSPSTx,
+					      MULTI_INRATE);
+		if (!upsamplers[i]->init()) {
+			LOG(ALERT) << "Tx resampler failed to initialize";
+			return false;
+		}
+
+		innerSendBuffers[i] =
+			new signalVector(NUMCHUNKS * multi_tx_inchunk,
+					 upsamplers[i]->len());
+		innerRecvBuffers[i] =
+			new signalVector(NUMCHUNKS * multi_rx_inchunk);
+		sendCursors[i] = 0;
+	}
+
+	/*
+	 * Channelizer outputs feed the receive resamplers and need the
+	 * same headroom. Every bin gets a buffer, whether or not a
+	 * carrier is there, because the filterbank computes them all.
+	 */
+	for (size_t i = 0; i < mWidth; i++) {
+		outerSendBuffers[i] = new signalVector(multi_tx_outchunk);
+		outerRecvBuffers[i] =
+			new signalVector(multi_rx_outchunk, dnsamplers[0]->len());
+	}
+
+	wideSendBuffer = new signalVector(multi_tx_outchunk * mWidth);
+	wideRecvBuffer = new signalVector(multi_rx_outchunk * mWidth);
+
+	convertSendBuffer = new short[wideSendBuffer->size() * 2];
+	convertRecvBuffer = new short[wideRecvBuffer->size() * 2];
+
+	recvCursor = 0;
+
+	LOG(INFO) << "Multi-carrier interface with " << mChans
+		  << " carriers in " << mWidth << " channels";
+
+	return true;
+}
+
+VectorFIFO *RadioInterfaceMulti::receiveFIFO(size_t chan)
+{
+	if (!mReceiveFIFOs || (chan >= mChans))
+		return NULL;
+
+	return &mReceiveFIFOs[chan];
+}
+
+/*
+ * C0 sets the device center so that it sits at its own bin, and every
+ * other carrier must land on the grid that implies.
+ */
+bool RadioInterfaceMulti::tuneTx(double freq, size_t chan)
+{
+	double center = freq - chanOffset(chan) * MCBTS_SPACING;
+
+	if (chan >= mChans)
+		return false;
+
+	if (!chan) {
+		mTxCenter = center;
+		return mRadio->setTxFreq(center);
+	}
+
+	if (fabs(center - mTxCenter) > 1.0) {
+		LOG(ALERT) << "Tx carrier " << chan << " at " << freq
+			   << " Hz is not on the C0 channel grid";
+		return false;
+	}
+
+	return true;
+}
+
+bool RadioInterfaceMulti::tuneRx(double freq, size_t chan)
+{
+	double center = freq - chanOffset(chan) * MCBTS_SPACING;
+
+	if (chan >= mChans)
+		return false;
+
+	if (!chan) {
+		mRxCenter = center;
+		return mRadio->setRxFreq(center);
+	}
+
+	if (fabs(center - mRxCenter) > 1.0) {
+		LOG(ALERT) << "Rx carrier " << chan << " at " << freq
+			   << " Hz is not on the C0 channel grid";
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Queue a burst for one carrier. The wideband stream can only be sent
+ * once every carrier has a chunk buffered, so a carrier that falls a
+ * whole buffer behind is zero filled, and the part of its next burst
+ * that would have gone out in the meantime is dropped to keep the
+ * carriers aligned.
+ */
+void RadioInterfaceMulti::driveTransmitRadio(signalVector &radioBurst,
+					     bool zeroBurst, size_t chan)
+{
+	size_t skip = 0, len = radioBurst.size();
+
+	if (!mOn || (chan >= mChans))
+		return;
+
+	ScopedLock lock(mTxLock);
+
+	signalVector *buf = innerSendBuffers[chan];
+
+	while (sendCursors[chan] + (long) len > (long) buf->size())
+		pushChunk(true);
+
+	if (sendCursors[chan] < 0)
+		skip = std::min((size_t) -sendCursors[chan], len);
+
+	complex *dst = buf->begin() + sendCursors[chan] + skip;
+	if (zeroBurst)
+		std::fill(dst, dst + len - skip, complex(0.0, 0.0));
+	else
+		std::copy(radioBurst.begin() + skip, radioBurst.end(), dst);
+
+	sendCursors[chan] += len;
+
+	pushBuffer();
+}
+
+void RadioInterfaceMulti::pushBuffer()
+{
+	for (;;) {
+		for (size_t i = 0; i < mChans; i++) {
+			if (sendCursors[i] < multi_tx_inchunk)
+				return;
+		}
+
+		pushChunk(false);
+	}
+}
+
+/* Send one chunk of all carriers to the device */
+void RadioInterfaceMulti::pushChunk(bool force)
+{
+	int rc, num_sent, wide_len = multi_tx_outchunk * mWidth;
+	float *chans[mWidth];
+
+	for (size_t i = 0; i < mWidth; i++)
+		chans[i] = NULL;
+
+	for (size_t i = 0; i < mChans; i++) {
+		signalVector *buf = innerSendBuffers[i];
+		size_t bin = chanBin(i);
+
+		if (sendCursors[i] < multi_tx_inchunk) {
+			if (!force)
+				LOG(ALERT) << "Carrier " << i << " send underflow";
+
+			long valid = std::max(sendCursors[i], 0L);
+			std::fill(buf->begin() + valid,
+				  buf->begin() + multi_tx_inchunk,
+				  complex(0.0, 0.0));
+		}
+
+		rc = upsamplers[i]->rotate((float *) buf->begin(),
+					   multi_tx_inchunk,
+					   (float *) outerSendBuffers[bin]->begin(),
+					   multi_tx_outchunk);
+		if (rc < 0)
+			LOG(ALERT) << "Sample rate upsampling error";
+
+		chans[bin] = (float *) outerSendBuffers[bin]->begin();
+
+		if (sendCursors[i] > multi_tx_inchunk) {
+			std::copy(buf->begin() + multi_tx_inchunk,
+				  buf->begin() + sendCursors[i], buf->begin());
+		}
+
+		sendCursors[i] -= multi_tx_inchunk;
+	}
+
+	if (synthesis->rotate(chans, multi_tx_outchunk,
+			      (float *) wideSendBuffer->begin()) < 0)
+		LOG(ALERT) << "Synthesis error";
+
+	/* Carriers add, so back off to keep the sum out of clipping */
+	convert_float_short(convertSendBuffer,
+			    (float *) wideSendBuffer->begin(),
+			    powerScaling / mChans, 2 * wide_len);
+
+	num_sent = mRadio->writeSamples(convertSendBuffer,
+					wide_len,
+					&underrun,
+					writeTimestamp);
+	if (num_sent != wide_len) {
+		LOG(ALERT) << "Transmit error " << num_sent;
+	}
+
+	writeTimestamp += wide_len;
+}
+
+/* Receive a timestamped chunk and split it into all carriers */
+void RadioInterfaceMulti::pullBuffer()
+{
+	bool local_underrun;
+	int rc, num_recv, wide_len = multi_rx_outchunk * mWidth;
+	float *chans[mWidth];
+
+	if (recvCursor > innerRecvBuffers[0]->size() - multi_rx_inchunk)
+		return;
+
+	num_recv = mRadio->readSamples(convertRecvBuffer,
+				       wide_len,
+				       &overrun,
+				       readTimestamp,
+				       &local_underrun);
+	if (num_recv != wide_len) {
+		LOG(ALERT) << "Receive error " << num_recv;
+		return;
+	}
+
+	convert_short_float((float *) wideRecvBuffer->begin(),
+			    convertRecvBuffer, 2 * wide_len);
+
+	underrun |= local_underrun;
+	readTimestamp += (TIMESTAMP) wide_len;
+
+	for (size_t i = 0; i < mWidth; i++)
+		chans[i] = (float *) outerRecvBuffers[i]->begin();
+
+	if (channelizer->rotate((float *) wideRecvBuffer->begin(),
+				wide_len, chans) < 0) {
+		LOG(ALERT) << "Channelizer error";
+		return;
+	}
+
+	for (size_t i = 0; i < mChans; i++) {
+		rc = dnsamplers[i]->rotate(chans[chanBin(i)],
+					   multi_rx_outchunk,
+					   (float *) (innerRecvBuffers[i]->begin() +
+						      recvCursor),
+					   multi_rx_inchunk);
+		if (rc < 0)
+			LOG(ALERT) << "Sample rate downsampling error";
+	}
+
+	recvCursor += multi_rx_inchunk;
+}
+
+/*
+ * Any carrier's receive thread may drive the device; each pass frames
+ * bursts for every carrier, so the clock still ticks once per slot.
+ */
+void RadioInterfaceMulti::driveReceiveRadio(size_t chan)
+{
+	if (!mOn || (chan >= mChans))
+		return;
+
+	if (mReceiveFIFOs[chan].size() > 8)
+		return;
+
+	ScopedLock lock(mRxLock);
+
+	pullBuffer();
+
+	GSM::Time rcvClock = mClock.get();
+	rcvClock.decTN(receiveOffset);
+	unsigned tN = rcvClock.TN();
+	int rcvSz = recvCursor;
+	int readSz = 0;
+	const int symbolsPerSlot = gSlotLen + 8;
+
+	/* Using the 157-156-156-156 symbols per timeslot format */
+	while (rcvSz > (symbolsPerSlot + (tN % 4 == 0)) * mSPSRx) {
+		int burstSz = (symbolsPerSlot + (tN % 4 == 0)) * mSPSRx;
+
+		for (size_t i = 0; (rcvClock.FN() >= 0) && (i < mChans); i++) {
+			if (mReceiveFIFOs[i].size() > MAX_RX_BACKLOG)
+				continue;
+
+			signalVector rxVector(burstSz);
+			complex *src = innerRecvBuffers[i]->begin() + readSz;
+			std::copy(src, src + burstSz, rxVector.begin());
+			mReceiveFIFOs[i].put(new radioVector(rxVector, rcvClock));
+		}
+
+		mClock.incTN();
+		rcvClock.incTN();
+		readSz += burstSz;
+		rcvSz -= burstSz;
+
+		tN = rcvClock.TN();
+	}
+
+	if (readSz > 0) {
+		for (size_t i = 0; i < mChans; i++) {
+			complex *buf = innerRecvBuffers[i]->begin();
+			std::copy(buf + readSz, buf + recvCursor, buf);
+		}
+
+		recvCursor -= readSz;
+	}
+}
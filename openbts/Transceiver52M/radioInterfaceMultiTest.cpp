@@ -0,0 +1,168 @@
+/*
+ * Multi-carrier radio interface loopback test
+ *
+ * Copyright 2014 Range Networks, Inc.
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Runs RadioInterfaceMulti on the file device in both directions. One
+ * carrier at a time sends a tone and the others send zero bursts; the
+ * wideband recording is then replayed through a second interface. The
+ * tone must come back on the carrier that sent it, and every other
+ * carrier must stay quiet, so the bin mapping, the filterbanks and the
+ * file device at the channelizer rate are all covered.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+
+#include "radioInterface.h"
+#include "FileDevice.h"
+
+#include <Configuration.h>
+
+ConfigurationTable gConfig;
+
+#define NUM_CHANS		3
+#define SPS			4
+#define BURST_LEN		(156 * SPS)
+#define NUM_BURSTS		400
+#define SKIP_BURSTS		40
+#define TONE_HZ			50000.0
+#define TONE_AMPL		3000.0
+#define MIN_ISOLATION_DB	30.0
+
+static const char *capture = "/tmp/radioInterfaceMultiTest.sc16";
+
+static bool transmit(size_t active)
+{
+	FileDevice device(SPS, NUM_CHANS);
+	std::string args = std::string("file:tx=") + capture;
+	double phase = 0.0, step = 2.0 * M_PI * TONE_HZ / (GSMRATE * SPS);
+
+	if (device.open(args, RadioDevice::REF_INTERNAL) !=
+	    RadioDevice::MULTI_ARFCN) {
+		printf("File device did not open as multi-carrier\n");
+		return false;
+	}
+
+	RadioInterfaceMulti radio(&device, NUM_CHANS, 0, SPS, GSM::Time(0));
+	if (!radio.init(RadioDevice::MULTI_ARFCN)) {
+		printf("Multi-carrier interface failed to initialize\n");
+		return false;
+	}
+	radio.start();
+
+	signalVector burst(BURST_LEN);
+	for (int n = 0; n < NUM_BURSTS; n++) {
+		for (int i = 0; i < BURST_LEN; i++) {
+			burst[i] = complex(TONE_AMPL * cos(phase),
+					   TONE_AMPL * sin(phase));
+			phase += step;
+		}
+
+		for (size_t chan = 0; chan < NUM_CHANS; chan++)
+			radio.driveTransmitRadio(burst, chan != active, chan);
+	}
+
+	return true;
+}
+
+static bool receive(double *energy, int *count)
+{
+	FileDevice device(SPS, NUM_CHANS);
+	std::string args = std::string("file:rx=") + capture + ",rate=fast";
+	int bursts = 0;
+
+	for (size_t chan = 0; chan < NUM_CHANS; chan++)
+		energy[chan] = 0.0;
+
+	if (device.open(args, RadioDevice::REF_INTERNAL) !=
+	    RadioDevice::MULTI_ARFCN) {
+		printf("Cannot replay the wideband recording\n");
+		return false;
+	}
+
+	RadioInterfaceMulti radio(&device, NUM_CHANS, 0, SPS, GSM::Time(0));
+	if (!radio.init(RadioDevice::MULTI_ARFCN)) {
+		printf("Multi-carrier interface failed to initialize\n");
+		return false;
+	}
+	radio.start();
+
+	while (!device.isExhausted()) {
+		radio.driveReceiveRadio(0);
+
+		for (size_t chan = 0; chan < NUM_CHANS; chan++) {
+			VectorFIFO *fifo = radio.receiveFIFO(chan);
+			while (radioVector *rxBurst = fifo->get()) {
+				/* Skip the filterbank and resampler delay */
+				if (rxBurst->getTime().FN() * 8 +
+				    rxBurst->getTime().TN() >= SKIP_BURSTS) {
+					for (size_t i = 0; i < rxBurst->size(); i++)
+						energy[chan] += (*rxBurst)[i].norm2();
+					if (!chan)
+						bursts++;
+				}
+				delete rxBurst;
+			}
+		}
+	}
+
+	if (bursts < (NUM_BURSTS - 2 * SKIP_BURSTS)) {
+		printf("Only %i bursts received\n", bursts);
+		return false;
+	}
+
+	*count = bursts;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	double energy[NUM_CHANS], level;
+	int bursts, fail = 0;
+
+	for (size_t active = 0; active < NUM_CHANS; active++) {
+		if (!transmit(active) || !receive(energy, &bursts))
+			return 1;
+
+		/* The transmit side backs off by the carrier count */
+		level = sqrt(energy[active] / (bursts * 156)) /
+			(TONE_AMPL / NUM_CHANS);
+		printf("tone on carrier %zu: received at %.2f of sent\n",
+		       active, level);
+		if ((level < 0.5) || (level > 2.0))
+			fail = 1;
+
+		for (size_t chan = 0; chan < NUM_CHANS; chan++) {
+			if (chan == active)
+				continue;
+
+			double isolation = 10.0 * log10(energy[active] /
+						(energy[chan] + 1e-9));
+			printf("tone on carrier %zu: carrier %zu down %.1f dB\n",
+			       active, chan, isolation);
+			if (isolation < MIN_ISOLATION_DB)
+				fail = 1;
+		}
+	}
+
+	remove(capture);
+	remove((std::string(capture) + ".meta").c_str());
+	printf(fail ? "FAILED\n" : "PASSED\n");
+	return fail;
+}
@@ -0,0 +1,356 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+/*
+	Receive chain benchmark over the file device.
+
+	replayBench -g <capture> [-n bursts] [-t tsc] [-s seed] [-S snr]
+		Write a synthetic capture of normal bursts with random
+		payloads, in every timeslot, with additive noise.
+
+	replayBench [-r] [-d delay] [-m percent] <capture>
+		Replay a capture through FileDevice and RadioInterface, and
+		detect and demodulate every burst as the Transceiver does.
+		Report bursts per second, the latency of each stage and how
+		many bursts were detected and decoded. Captures made with -g
+		carry their seed, so the payload bits are checked too. The
+		exit status is nonzero if fewer than the -m percentage decode.
+		Replay is as fast as possible unless -r asks for real time,
+		and -d sets the maximum expected delay in symbols, as
+		SETMAXDLY does for the Transceiver.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "radioInterface.h"
+#include "FileDevice.h"
+
+#include <Logger.h>
+#include <Configuration.h>
+#include <GSMCommon.h>
+
+ConfigurationTable gConfig;
+
+using namespace std;
+
+#define BURST_LEN		148
+#define TSC_POS			61
+#define BURST_AMPL		8000.0
+
+/* Latency samples for one stage of the receive chain */
+class StageStats {
+  const char *mName;
+  vector<double> mUsecs;
+
+public:
+  StageStats(const char *wName) : mName(wName) { }
+
+  void add(double usecs) { mUsecs.push_back(usecs); }
+
+  void print()
+  {
+    double sum = 0.0;
+
+    if (mUsecs.empty()) {
+      printf("%-10s %8u\n", mName, 0);
+      return;
+    }
+
+    sort(mUsecs.begin(), mUsecs.end());
+    for (size_t i = 0; i < mUsecs.size(); i++)
+      sum += mUsecs[i];
+
+    printf("%-10s %8u %9.2f %9.2f %9.2f %9.2f\n", mName,
+           (unsigned) mUsecs.size(), sum / mUsecs.size(),
+           mUsecs[mUsecs.size() / 2],
+           mUsecs[mUsecs.size() * 99 / 100],
+           mUsecs.back());
+  }
+};
+
+static double usecs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1.0e6 + ts.tv_nsec / 1.0e3;
+}
+
+/* Payload of burst n; the generator and the checker must agree */
+static void makeBurst(BitVector &bits, unsigned seed, unsigned n, unsigned tsc)
+{
+  unsigned state = seed ^ (n * 2654435761u);
+
+  for (int i = 0; i < BURST_LEN; i++)
+    bits[i] = (rand_r(&state) >> 8) & 0x01;
+
+  for (int i = 0; i < 3; i++) {
+    bits[i] = 0;
+    bits[BURST_LEN - 1 - i] = 0;
+  }
+
+  for (int i = 0; i < 26; i++)
+    bits[TSC_POS + i] = gTrainingSequence[tsc][i];
+}
+
+static float gaussian()
+{
+  float u1 = (random() + 1.0) / (RAND_MAX + 2.0);
+  float u2 = (random() + 1.0) / (RAND_MAX + 2.0);
+
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static int generate(const char *path, unsigned bursts, unsigned tsc,
+                    unsigned seed, float snr)
+{
+  map<string, string> meta;
+  ostringstream rate, val;
+  BitVector bits(BURST_LEN);
+  float sigma = BURST_AMPL / sqrt(2.0) / pow(10.0, snr / 20.0);
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return 1;
+  }
+
+  srandom(seed);
+
+  for (unsigned n = 0; n < bursts; n++) {
+    int tn = n % 8;
+    makeBurst(bits, seed, n, tsc);
+
+    signalVector *burst = modulateBurst(bits, 8 + (tn % 4 == 0), 1);
+    vector<short> samples(2 * burst->size());
+    for (size_t i = 0; i < burst->size(); i++) {
+      float re = (*burst)[i].real() * BURST_AMPL + sigma * gaussian();
+      float im = (*burst)[i].imag() * BURST_AMPL + sigma * gaussian();
+      samples[2 * i + 0] = (short) max(-32767.0f, min(32767.0f, re));
+      samples[2 * i + 1] = (short) max(-32767.0f, min(32767.0f, im));
+    }
+    delete burst;
+
+    if (write(fd, &samples[0], samples.size() * sizeof(short)) < 0) {
+      perror(path);
+      close(fd);
+      return 1;
+    }
+  }
+  close(fd);
+
+  rate.precision(12);
+  rate << GSMRATE;
+  meta["format"] = "sc16";
+  meta["rate"] = rate.str();
+  meta["timestamp"] = "0";
+  val << bursts; meta["bursts"] = val.str(); val.str("");
+  val << tsc; meta["tsc"] = val.str(); val.str("");
+  val << seed; meta["seed"] = val.str(); val.str("");
+  val << snr; meta["snr"] = val.str();
+
+  if (!FileDevice::writeMeta(path, meta)) {
+    fprintf(stderr, "Cannot write metadata for %s\n", path);
+    return 1;
+  }
+
+  printf("Wrote %u bursts to %s\n", bursts, path);
+  return 0;
+}
+
+static int replay(const char *path, bool realtime, unsigned maxDelay,
+                  float minDecoded)
+{
+  map<string, string> meta;
+  unsigned tsc = 0, seed = 0, total = 0, bursts = 0;
+  unsigned detected = 0, decoded = 0, bitErrors = 0;
+  bool check = false;
+  BitVector ref(BURST_LEN);
+  StageStats receive("receive"), detect("detect"), demod("demod");
+
+  if (!FileDevice::readMeta(path, meta)) {
+    fprintf(stderr, "No metadata for %s\n", path);
+    return 1;
+  }
+  if (meta.count("tsc"))
+    tsc = atoi(meta["tsc"].c_str());
+  if (meta.count("seed")) {
+    seed = strtoul(meta["seed"].c_str(), NULL, 10);
+    check = true;
+  }
+  if (meta.count("bursts"))
+    total = atoi(meta["bursts"].c_str());
+
+  FileDevice device(4);
+  string args = string("file:rx=") + path;
+  if (!realtime)
+    args += ",rate=fast";
+
+  if (device.open(args, RadioDevice::REF_INTERNAL) != RadioDevice::NORMAL)
+    return 1;
+
+  /* No receive offset, so slot n of the capture is burst n */
+  RadioInterface radio(&device, 0, 4, GSM::Time(0, 0));
+  if (!radio.init(RadioDevice::NORMAL))
+    return 1;
+
+  generateMidamble(1, tsc);
+  radio.start();
+
+  VectorFIFO *fifo = radio.receiveFIFO();
+  double begin = usecs();
+
+  while (!device.isExhausted() || fifo->size()) {
+    double t0 = usecs();
+    radio.driveReceiveRadio();
+    receive.add(usecs() - t0);
+
+    while (radioVector *rxBurst = fifo->get()) {
+      complex amplitude;
+      float TOA, avg;
+      GSM::Time time = rxBurst->getTime();
+      unsigned n = time.FN() * 8 + time.TN();
+
+      /* Silence read past the end of a generated capture */
+      if (total && (n >= total)) {
+        delete rxBurst;
+        continue;
+      }
+      bursts++;
+
+      t0 = usecs();
+      energyDetect(*rxBurst, 20, 0.0, &avg);
+      int rc = analyzeTrafficBurst(*rxBurst, tsc, 5.0, 1,
+                                   &amplitude, &TOA, maxDelay);
+      detect.add(usecs() - t0);
+
+      if (rc <= 0) {
+        delete rxBurst;
+        continue;
+      }
+      detected++;
+
+      t0 = usecs();
+      SoftVector *bits = demodulateBurst(*rxBurst, 1, amplitude, TOA);
+      demod.add(usecs() - t0);
+
+      if (check) {
+        unsigned errs = 0;
+        makeBurst(ref, seed, n, tsc);
+        for (int i = 0; i < BURST_LEN; i++)
+          errs += ((*bits)[i] > 0.5) != ref[i];
+        bitErrors += errs;
+        decoded += (errs == 0);
+      }
+
+      delete bits;
+      delete rxBurst;
+    }
+  }
+
+  double elapsed = (usecs() - begin) / 1.0e6;
+  double rate = bursts / elapsed;
+
+  printf("%u bursts in %.3f s, %.0f bursts/s, %.1fx real time\n",
+         bursts, elapsed, rate, rate / (GSMRATE / 156.25));
+  printf("detected %u (%.2f%%)", detected,
+         bursts ? 100.0 * detected / bursts : 0.0);
+  if (check) {
+    printf(", decoded %u (%.2f%%), BER %.2e", decoded,
+           bursts ? 100.0 * decoded / bursts : 0.0,
+           detected ? (double) bitErrors / (detected * BURST_LEN) : 0.0);
+  }
+  printf("\n\n%-10s %8s %9s %9s %9s %9s\n", "stage (us)", "count",
+         "mean", "p50", "p99", "max");
+  receive.print();
+  detect.print();
+  demod.print();
+
+  float success = bursts ? 100.0 * (check ? decoded : detected) / bursts : 0.0;
+  return (success < minDecoded) ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *genPath = NULL;
+  unsigned bursts = 8 * 26 * 100, tsc = 2, seed = 1, maxDelay = 4;
+  float snr = 20.0, minDecoded = 0.0;
+  bool realtime = false;
+  int opt, rc;
+
+  while ((opt = getopt(argc, argv, "g:n:t:s:S:rd:m:")) != -1) {
+    switch (opt) {
+    case 'g':
+      genPath = optarg;
+      break;
+    case 'n':
+      bursts = atoi(optarg);
+      break;
+    case 't':
+      tsc = atoi(optarg) & 0x07;
+      break;
+    case 's':
+      seed = strtoul(optarg, NULL, 10);
+      break;
+    case 'S':
+      snr = atof(optarg);
+      break;
+    case 'r':
+      realtime = true;
+      break;
+    case 'd':
+      maxDelay = atoi(optarg);
+      break;
+    case 'm':
+      minDecoded = atof(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s -g <capture> [-n bursts] [-t tsc] "
+                      "[-s seed] [-S snr]\n"
+                      "       %s [-r] [-d delay] [-m percent] <capture>\n",
+              argv[0], argv[0]);
+      return 1;
+    }
+  }
+
+  gLogInit("replayBench", "WARNING");
+
+  if (!sigProcLibSetup(1)) {
+    fprintf(stderr, "Failed to initialize signal processing library\n");
+    return 1;
+  }
+
+  if (genPath)
+    rc = generate(genPath, bursts, tsc, seed, snr);
+  else if (optind < argc)
+    rc = replay(argv[optind], realtime, maxDelay, minDecoded);
+  else {
+    fprintf(stderr, "No capture given\n");
+    rc = 1;
+  }
+
+  sigProcLibDestroy();
+
+  return rc;
+}
@@ -27,10 +27,12 @@
 
 #include "Transceiver.h"
 #include "radioDevice.h"
+#include "FileDevice.h"
 #include "DummyLoad.h"
 
 #include <time.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <GSMCommon.h>
 #include <Logger.h>
@@ -109,14 +111,43 @@ int testConfig(const char *filename)
   return 0; 
 }
 
+/*
+ * Receive worker threads per carrier. Timeslots are dealt out by TN, so
+ * the count must divide 8. One, the default, demodulates inline on the
+ * receive thread. Zero shares the online cores between the carriers and
+ * stays inline if there are too few to go round.
+ */
+static int rxThreads(int chans)
+{
+  int n = 1;
+  if (gConfig.defines("TRX.RxThreads"))
+    n = gConfig.getNum("TRX.RxThreads");
+  if (n > 0)
+    return n;
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN) / chans;
+  for (n = 8; n > 1; n /= 2) {
+    if (n <= cores)
+      break;
+  }
+
+  return n;
+}
+
 int main(int argc, char *argv[])
 {
-  int trxPort, radioType, fail = 0;
+  int trxPort, radioType, chans = 1, fail = 0;
   std::string deviceArgs, logLevel, trxAddr, refstr;
   RadioDevice *usrp = NULL;
   RadioDevice::ReferenceType refType;
   RadioInterface *radio = NULL;
-  Transceiver *trx = NULL;
+  std::vector<Transceiver *> trx;
+
+  // OpenBTS passes the number of ARFCNs as the first argument
+  if (argc > 1)
+    chans = atoi(argv[1]);
+  if (chans < 1)
+    chans = 1;
 
   if (argc == 3)
     deviceArgs = std::string(argv[2]);
@@ -170,7 +201,17 @@ int main(int argc, char *argv[])
 
   srandom(time(NULL));
 
-  usrp = RadioDevice::make(SPS);
+  /* Replay and record sample files instead of driving a radio */
+  if (FileDevice::handles(deviceArgs)) {
+    usrp = new FileDevice(SPS, chans);
+  } else {
+    usrp = RadioDevice::make(SPS, false, chans);
+  }
+  if (!usrp) {
+    LOG(ALERT) << "Transceiver exiting..." << std::endl;
+    return EXIT_FAILURE;
+  }
+
   radioType = usrp->open(deviceArgs, refType);
   if (radioType < 0) {
     LOG(ALERT) << "Transceiver exiting..." << std::endl;
@@ -185,6 +226,9 @@ int main(int argc, char *argv[])
   case RadioDevice::RESAMP_100M:
     radio = new RadioInterfaceResamp(usrp, 3, SPS, false);
     break;
+  case RadioDevice::MULTI_ARFCN:
+    radio = new RadioInterfaceMulti(usrp, chans, 3, SPS, false);
+    break;
   default:
     LOG(ALERT) << "Unsupported configuration";
     fail = 1;
@@ -196,14 +240,27 @@ int main(int argc, char *argv[])
     goto shutdown;
   }
 
-  trx = new Transceiver(trxPort, trxAddr.c_str(), SPS, GSM::Time(3,0), radio);
-  if (!trx->init()) {
-    LOG(ALERT) << "Failed to initialize transceiver";
-    fail = 1;
-    goto shutdown;
+  // One Transceiver per carrier, with the others controlled through C0
+  for (int i = 0; i < chans; i++) {
+    trx.push_back(new Transceiver(trxPort, trxAddr.c_str(), SPS,
+                                  GSM::Time(3,0), radio, i));
+    if (!trx[i]->init()) {
+      LOG(ALERT) << "Failed to initialize transceiver " << i;
+      fail = 1;
+      goto shutdown;
+    }
+    trx[i]->receiveFIFO(radio->receiveFIFO(i));
+    if (gConfig.defines("TRX.Equalizer"))
+      trx[i]->setEqualizer(gConfig.getBool("TRX.Equalizer"));
+    if (gConfig.defines("GSM.MS.TA.Max"))
+      trx[i]->setMaxRACHDelay(gConfig.getNum("GSM.MS.TA.Max"));
+    trx[i]->setRxWorkers(rxThreads(chans));
+    if (i)
+      trx[0]->addCarrier(trx[i]);
   }
-  trx->receiveFIFO(radio->receiveFIFO());
-  trx->start();
+
+  for (int i = 0; i < chans; i++)
+    trx[i]->start();
 
   while (!gbShutdown)
     sleep(1);
@@ -211,7 +268,8 @@ int main(int argc, char *argv[])
 shutdown:
   std::cout << "Shutting down transceiver..." << std::endl;
 
-  delete trx;
+  for (unsigned i = 0; i < trx.size(); i++)
+    delete trx[i];
   delete radio;
   delete usrp;
 
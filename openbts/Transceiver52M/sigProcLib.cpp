@@ -31,6 +31,12 @@ extern "C" {
 /* Clipping detection threshold */
 #define CLIP_THRESH     30000.0f
 
+/* Symbol spaced taps in a traffic burst channel estimate */
+#define CHAN_EST_LEN    6
+
+/* Largest DFE feedforward filter the fixed size solver handles */
+#define DFE_MAX_TAPS    16
+
 #define TABLESIZE 1024
 
 /** Lookup tables for trigonometric approximation */
@@ -98,13 +104,53 @@ struct PulseSequence {
   void *c1_buffer;
 };
 
+/*
+ * Table driven modulator. The modulator output is linear in the rotated
+ * C0 and C1 symbol sequences, and both pulses span a whole number of symbol
+ * periods, so each sps sample output block is j^k times a function of the
+ * last few unrotated symbols. Each symbol is one of {-1, 0, +1} (zero in the
+ * guard and where the Laurent C1 sequence is not defined), so a block is
+ * found by indexing the table with those symbols as base 3 digits. The
+ * 4 sps Laurent table is 3^4 * 3^2 blocks, 23 kB, which fits in L1 cache.
+ */
+struct ModulatorTable {
+  ModulatorTable() : blocks(NULL)
+  {
+  }
+
+  ~ModulatorTable()
+  {
+    delete[] blocks;
+  }
+
+  int sps;
+  int c0Span;          /* Symbols spanned by the C0 pulse */
+  int c1Span;          /* Symbols spanned by the C1 pulse */
+  unsigned c0Mod;      /* 3^(c0Span - 1), to age out the oldest digit */
+  unsigned c1Mod;
+  unsigned c0Zero;     /* Index with all C0 symbols zero */
+  unsigned c1Zero;
+  unsigned c1Count;    /* 3^c1Span */
+  complex *blocks;
+};
+
 CorrelationSequence *gMidambles[] = {NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL};
 CorrelationSequence *gRACHSequence = NULL;
 PulseSequence *GSMPulse = NULL;
 PulseSequence *GSMPulse1 = NULL;
+ModulatorTable *GSMModTable = NULL;
+
+/* Transceivers sharing the tables above, one per carrier */
+static int sigProcLibUsers = 0;
 
 void sigProcLibDestroy()
 {
+  if (sigProcLibUsers > 1) {
+    sigProcLibUsers--;
+    return;
+  }
+  sigProcLibUsers = 0;
+
   for (int i = 0; i < 8; i++) {
     delete gMidambles[i];
     gMidambles[i] = NULL;
@@ -117,6 +163,7 @@ void sigProcLibDestroy()
   delete gRACHSequence;
   delete GSMPulse;
   delete GSMPulse1;
+  delete GSMModTable;
 
   GMSKRotationN = NULL;
   GMSKRotation1 = NULL;
@@ -125,6 +172,7 @@ void sigProcLibDestroy()
   gRACHSequence = NULL;
   GSMPulse = NULL;
   GSMPulse1 = NULL;
+  GSMModTable = NULL;
 }
 
 // dB relative to 1.0.
@@ -542,6 +590,87 @@ static PulseSequence *generateGSMPulse(int sps, int symbolLength)
   return pulse;
 }
 
+static unsigned power3(int n)
+{
+  unsigned r = 1;
+
+  while (n-- > 0)
+    r *= 3;
+
+  return r;
+}
+
+/*
+ * Precompute the output blocks for every combination of symbols under the
+ * pulses. With the START_ONLY convolution, a symbol at sample k * sps
+ * contributes h[len - 1 - t] to output sample k * sps + t, so symbol k - d
+ * lands in block k through taps len - 1 - d * sps - t. The C0 symbol d
+ * blocks back carries rotation j^-d relative to block k, and the C1 symbol
+ * carries a further j.
+ */
+static ModulatorTable *generateModulatorTable(int sps, PulseSequence *pulse)
+{
+  ModulatorTable *table;
+  int c0_len, c1_len;
+  unsigned count;
+
+  if (!pulse || !pulse->c0 || !pulse->c1)
+    return NULL;
+
+  c0_len = pulse->c0->size();
+  c1_len = pulse->c1->size();
+
+  table = new ModulatorTable();
+  table->sps = sps;
+  table->c0Span = (c0_len + sps - 1) / sps;
+  table->c1Span = (c1_len + sps - 1) / sps;
+  table->c0Mod = power3(table->c0Span - 1);
+  table->c1Mod = power3(table->c1Span - 1);
+  table->c0Zero = (power3(table->c0Span) - 1) / 2;
+  table->c1Zero = (power3(table->c1Span) - 1) / 2;
+  table->c1Count = power3(table->c1Span);
+
+  count = power3(table->c0Span) * table->c1Count;
+  table->blocks = new complex[count * sps];
+
+  /* Rotations j^-d for d = 0..3 */
+  static const complex rot[4] = {
+    complex(1, 0), complex(0, -1), complex(-1, 0), complex(0, 1)
+  };
+
+  for (unsigned idx = 0; idx < count; idx++) {
+    unsigned c0_idx = idx / table->c1Count;
+    unsigned c1_idx = idx % table->c1Count;
+    complex *block = table->blocks + idx * sps;
+
+    for (int t = 0; t < sps; t++)
+      block[t] = complex(0, 0);
+
+    /* Least significant digit is the newest symbol, ie. d = 0 */
+    for (int d = 0; d < table->c0Span; d++) {
+      float sym = (float) (c0_idx % 3) - 1.0f;
+      c0_idx /= 3;
+      for (int t = 0; t < sps; t++) {
+        int tap = c0_len - 1 - d * sps - t;
+        if (tap >= 0)
+          block[t] += rot[d & 3] * (sym * pulse->c0->begin()[tap].real());
+      }
+    }
+
+    for (int d = 0; d < table->c1Span; d++) {
+      float sym = (float) (c1_idx % 3) - 1.0f;
+      c1_idx /= 3;
+      for (int t = 0; t < sps; t++) {
+        int tap = c1_len - 1 - d * sps - t;
+        if (tap >= 0)
+          block[t] += rot[(d + 3) & 3] * (sym * pulse->c1->begin()[tap].real());
+      }
+    }
+  }
+
+  return table;
+}
+
 signalVector* frequencyShift(signalVector *y,
 			     signalVector *x,
 			     float freq,
@@ -766,18 +895,165 @@ static signalVector *modulateBurstBasic(const BitVector &bits,
   return shaped;
 }
 
+/*
+ * Table driven equivalent of modulateBurstLaurent(). The symbols fed through
+ * the table are the unrotated C0 and C1 sequences that function builds,
+ * including the padding and edge bits, so the output matches the
+ * convolution to within float rounding of the rotation vectors.
+ */
+#define MOD_TABLE_MAX_SYMS	256
+
+static signalVector *modulateBurstTable(const BitVector &bits,
+					int guard_len, ModulatorTable *table)
+{
+  int sps = table->sps;
+  int n = bits.size();
+  int syms, c0_span = table->c0Span, c1_span = table->c1Span;
+  unsigned c0_idx, c1_idx;
+  unsigned char c0[MOD_TABLE_MAX_SYMS], c1[MOD_TABLE_MAX_SYMS];
+  signalVector *shaped;
+  signalVector::iterator itr;
+
+  if (guard_len < 4)
+    guard_len = 4;
+
+  syms = n + guard_len;
+  if ((n < 2) || (syms + c0_span > MOD_TABLE_MAX_SYMS))
+    return modulateBurstLaurent(bits, guard_len, sps);
+
+  /*
+   * Symbol digits are 0 for -1, 1 for zero and 2 for +1. Symbol k is
+   * stored at k + span, behind zero symbols, so that the digit leaving
+   * the pulse window is always at k.
+   */
+  for (int k = 0; k < syms + c0_span; k++)
+    c0[k] = c1[k] = 1;
+
+  unsigned char *c0_sym = c0 + c0_span;
+  unsigned char *c1_sym = c1 + c1_span;
+
+  /* Padded start bit 0, burst bits, padded end bit 1 */
+  c0_sym[0] = 0;
+  for (int k = 1; k <= n; k++)
+    c0_sym[k] = (bits[k - 1] & 0x01) ? 2 : 0;
+  c0_sym[n + 1] = 2;
+
+  /* C1 phase, with the fixed start magic */
+  c1_sym[2] = 2 - c0_sym[2];
+  for (int k = 3; k <= n + 1; k++) {
+    if ((bits[k - 2] ^ bits[k - 3]) & 0x01)
+      c1_sym[k] = c0_sym[k];
+    else
+      c1_sym[k] = 2 - c0_sym[k];
+  }
+
+  shaped = new signalVector(sps * syms);
+  itr = shaped->begin();
+
+  c0_idx = table->c0Zero;
+  c1_idx = table->c1Zero;
+
+  for (int k = 0; k < syms; k++) {
+    c0_idx = (c0_idx - c0[k] * table->c0Mod) * 3 + c0_sym[k];
+    c1_idx = (c1_idx - c1[k] * table->c1Mod) * 3 + c1_sym[k];
+
+    const complex *block = table->blocks +
+                           (c0_idx * table->c1Count + c1_idx) * sps;
+
+    /* Apply the j^k rotation by swapping and negating */
+    switch (k & 3) {
+    case 0:
+      for (int t = 0; t < sps; t++)
+        *itr++ = block[t];
+      break;
+    case 1:
+      for (int t = 0; t < sps; t++)
+        *itr++ = complex(-block[t].imag(), block[t].real());
+      break;
+    case 2:
+      for (int t = 0; t < sps; t++)
+        *itr++ = complex(-block[t].real(), -block[t].imag());
+      break;
+    case 3:
+      for (int t = 0; t < sps; t++)
+        *itr++ = complex(block[t].imag(), -block[t].real());
+      break;
+    }
+  }
+
+  return shaped;
+}
+
 /* Assume input bits are not differentially encoded */
 signalVector *modulateBurst(const BitVector &wBurst, int guardPeriodLength,
 			    int sps, bool emptyPulse)
 {
   if (emptyPulse)
     return rotateBurst(wBurst, guardPeriodLength, sps);
+  else if ((sps == 4) && GSMModTable)
+    return modulateBurstTable(wBurst, guardPeriodLength, GSMModTable);
   else if (sps == 4)
     return modulateBurstLaurent(wBurst, guardPeriodLength, sps);
   else
     return modulateBurstBasic(wBurst, guardPeriodLength, sps);
 }
 
+signalVector *ModulationCache::modulate(const BitVector &wBurst,
+                                       int guardPeriodLength, int sps)
+{
+  std::string key(wBurst.size() + 2, 0);
+  key[0] = (char) guardPeriodLength;
+  key[1] = (char) sps;
+  for (unsigned i = 0; i < wBurst.size(); i++)
+    key[i + 2] = wBurst[i] & 0x01;
+
+  EntryMap::iterator found = mIndex.find(key);
+  if (found != mIndex.end()) {
+    mHits++;
+    mEntries.splice(mEntries.begin(), mEntries, found->second);
+    return new signalVector(*found->second->burst);
+  }
+
+  mMisses++;
+  signalVector *burst = modulateBurst(wBurst, guardPeriodLength, sps);
+  if (!burst || !mCapacity)
+    return burst;
+
+  if (mEntries.size() >= mCapacity) {
+    Entry &oldest = mEntries.back();
+    mIndex.erase(oldest.key);
+    delete oldest.burst;
+    mEntries.pop_back();
+  }
+
+  Entry entry;
+  entry.key = key;
+  entry.burst = new signalVector(*burst);
+  mEntries.push_front(entry);
+  mIndex[key] = mEntries.begin();
+
+  return burst;
+}
+
+void ModulationCache::clear()
+{
+  for (EntryList::iterator itr = mEntries.begin(); itr != mEntries.end(); itr++)
+    delete itr->burst;
+
+  mEntries.clear();
+  mIndex.clear();
+}
+
+/* Reference convolution modulator, kept for verifying the tables */
+signalVector *modulateBurstReference(const BitVector &wBurst,
+                                     int guardPeriodLength, int sps)
+{
+  if (sps == 4)
+    return modulateBurstLaurent(wBurst, guardPeriodLength, sps);
+  else
+    return modulateBurstBasic(wBurst, guardPeriodLength, sps);
+}
+
 float sinc(float x)
 {
   if ((x >= 0.01F) || (x <= -0.01F)) return (sinLookup(x)/x);
@@ -1225,6 +1501,11 @@ bool energyDetect(signalVector &rxBurst,
   return (energy/windowLength > detectThreshold*detectThreshold);
 }
 
+bool aboveNoiseFloor(signalVector &rxBurst, float noiseLevel, float gate)
+{
+  return sqrtf(vectorPower(rxBurst)) >= noiseLevel * gate;
+}
+
 /*
  * Detect a burst based on correlation and peak-to-average ratio
  *
@@ -1288,13 +1569,18 @@ static int detectClipping(signalVector &burst, float thresh)
  * Correlation window parameters:
  *   target: Tail bits + RACH length (reduced from 41 to a multiple of 4)
  *   head: Search 4 symbols before target 
- *   tail: Search 10 symbols after target
+ *   tail: Search 10 symbols after target, plus the maximum expected delay
+ *
+ * An MS sends its RACH before it has a timing advance, so in a large cell
+ * the window has to cover the whole round trip. The window is clipped to
+ * the end of the burst.
  */
 int detectRACHBurst(signalVector &rxBurst,
 		    float thresh,
 		    int sps,
 		    complex *amp,
-		    float *toa)
+		    float *toa,
+		    unsigned max_toa)
 {
   int rc, start, target, head, tail, len;
   float _toa;
@@ -1310,10 +1596,12 @@ int detectRACHBurst(signalVector &rxBurst,
 
   target = 8 + 40;
   head = 4;
-  tail = 10;
+  tail = 10 + max_toa;
 
   start = (target - head) * sps - 1;
   len = (head + tail) * sps;
+  if (start + len > (int) rxBurst.size())
+    len = rxBurst.size() - start;
   sync = gRACHSequence;
   corr = signalVector(len);
 
@@ -1380,6 +1668,38 @@ int analyzeTrafficBurst(signalVector &rxBurst, unsigned tsc, float thresh,
     return 0;
   }
 
+  /*
+   * The correlation around the peak is the channel as seen through the
+   * modulation pulse. Take the symbol spaced window holding the most
+   * energy, so a late path stronger than the first is kept as well.
+   */
+  if (chan_req) {
+    *chan = NULL;
+
+    if ((sps == 1) && (len >= CHAN_EST_LEN)) {
+      float energy, max = -1.0f;
+      int best = 0;
+
+      for (int i = 0; i <= len - CHAN_EST_LEN; i++) {
+        energy = 0.0f;
+        for (int j = 0; j < CHAN_EST_LEN; j++)
+          energy += corr[i + j].norm2();
+
+        if (energy > max) {
+          max = energy;
+          best = i;
+        }
+      }
+
+      *chan = new signalVector(CHAN_EST_LEN);
+      corr.segmentCopyTo(**chan, best, CHAN_EST_LEN);
+      scaleVector(**chan, complex(1.0, 0.0) / sync->gain);
+
+      if (chan_offset)
+        *chan_offset = _toa + sync->toa - best;
+    }
+  }
+
   /* Subtract forward search bits from delay */
   _toa -= head * sps;
   if (toa)
@@ -1387,14 +1707,6 @@ int analyzeTrafficBurst(signalVector &rxBurst, unsigned tsc, float thresh,
   if (amp)
     *amp = _amp;
 
-  /* Equalization not currently supported */
-  if (chan_req) {
-    *chan = new signalVector(6 * sps);
-
-    if (chan_offset)
-      *chan_offset = 0.0;
-  }
-
   return 1;
 }
 
@@ -1451,98 +1763,112 @@ SoftVector *demodulateBurst(signalVector &rxBurst, int sps,
     
 // Assumes symbol-spaced sampling!!!
 // Based upon paper by Al-Dhahir and Cioffi
+float channelSpread(const signalVector &chan)
+{
+  float total = 0.0f, pair, max = 0.0f;
+
+  if (chan.size() < 2)
+    return 0.0f;
+
+  for (size_t i = 0; i < chan.size(); i++)
+    total += chan[i].norm2();
+
+  for (size_t i = 0; i < chan.size() - 1; i++) {
+    pair = chan[i].norm2() + chan[i + 1].norm2();
+    if (pair > max)
+      max = pair;
+  }
+
+  if (total <= 0.0f)
+    return 0.0f;
+
+  return (total - max) / total;
+}
+
+/*
+ * MMSE-DFE design by fast Cholesky factorization of the channel
+ * covariance. Everything lives in fixed size arrays on the stack, so a
+ * design costs O(Nf * (Nf + nu)) with no allocation, and the output
+ * filters are reused when the caller passes them back at the same size.
+ */
 bool designDFE(signalVector &channelResponse,
 	       float SNRestimate,
 	       int Nf,
 	       signalVector **feedForwardFilter,
 	       signalVector **feedbackFilter)
 {
-  
-  signalVector G0(Nf);
-  signalVector G1(Nf);
-  signalVector::iterator G0ptr = G0.begin();
-  signalVector::iterator G1ptr = G1.begin();
-  signalVector::iterator chanPtr = channelResponse.begin();
-
-  int nu = channelResponse.size()-1;
-
-  *G0ptr = 1.0/sqrtf(SNRestimate);
-  for(int j = 0; j <= nu; j++) {
-    *G1ptr = chanPtr->conj();
-    G1ptr++; chanPtr++;
-  }
-
-  signalVector *L[Nf];
-  signalVector::iterator Lptr;
-  float d;
-  for(int i = 0; i < Nf; i++) {
-    d = G0.begin()->norm2() + G1.begin()->norm2();
-    L[i] = new signalVector(Nf+nu);
-    Lptr = L[i]->begin()+i;
-    G0ptr = G0.begin(); G1ptr = G1.begin();
-    while ((G0ptr < G0.end()) &&  (Lptr < L[i]->end())) {
-      *Lptr = (*G0ptr*(G0.begin()->conj()) + *G1ptr*(G1.begin()->conj()) )/d;
-      Lptr++;
-      G0ptr++;
-      G1ptr++;
-    }
-    complex k = (*G1.begin())/(*G0.begin());
-
-    if (i != Nf-1) {
-      signalVector G0new = G1;
-      scaleVector(G0new,k.conj());
-      addVector(G0new,G0);
-
-      signalVector G1new = G0;
-      scaleVector(G1new,k*(-1.0));
-      addVector(G1new,G1);
-      delayVector(G1new,-1.0);
-
-      scaleVector(G0new,1.0/sqrtf(1.0+k.norm2()));
-      scaleVector(G1new,1.0/sqrtf(1.0+k.norm2()));
-      G0 = G0new;
-      G1 = G1new;
-    }
-  }
+  complex G0[DFE_MAX_TAPS], G1[DFE_MAX_TAPS];
+  complex L[DFE_MAX_TAPS][2 * DFE_MAX_TAPS];
+  complex v[DFE_MAX_TAPS];
+  complex *h = channelResponse.begin();
+  float d = 1.0f;
 
-  *feedbackFilter = new signalVector(nu);
-  L[Nf-1]->segmentCopyTo(**feedbackFilter,Nf,nu);
-  scaleVector(**feedbackFilter,(complex) -1.0);
-  conjugateVector(**feedbackFilter);
-
-  signalVector v(Nf);
-  signalVector::iterator vStart = v.begin();
-  signalVector::iterator vPtr;
-  *(vStart+Nf-1) = (complex) 1.0;
-  for(int k = Nf-2; k >= 0; k--) {
-    Lptr = L[k]->begin()+k+1;
-    vPtr = vStart + k+1;
-    complex v_k = 0.0;
-    for (int j = k+1; j < Nf; j++) {
-      v_k -= (*vPtr)*(*Lptr);
-      vPtr++; Lptr++;
-    }
-     *(vStart + k) = v_k;
+  int nu = channelResponse.size() - 1;
+
+  if ((Nf < 1) || (Nf > DFE_MAX_TAPS) || (nu < 1) || (nu >= Nf) ||
+      (SNRestimate <= 0.0f))
+    return false;
+
+  for (int j = 0; j < Nf; j++) {
+    G0[j] = 0.0f;
+    G1[j] = (j <= nu) ? h[j].conj() : complex(0.0f);
   }
+  G0[0] = 1.0 / sqrtf(SNRestimate);
 
-  *feedForwardFilter = new signalVector(Nf);
-  signalVector::iterator w = (*feedForwardFilter)->end();
   for (int i = 0; i < Nf; i++) {
-    delete L[i];
-    complex w_i = 0.0;
-    int endPt = ( nu < (Nf-1-i) ) ? nu : (Nf-1-i);
-    vPtr = vStart+i;
-    chanPtr = channelResponse.begin();
-    for (int k = 0; k < endPt+1; k++) {
-      w_i += (*vPtr)*(chanPtr->conj());
-      vPtr++; chanPtr++;
+    d = G0[0].norm2() + G1[0].norm2();
+
+    complex g0 = G0[0].conj();
+    complex g1 = G1[0].conj();
+    int end = (Nf < Nf + nu - i) ? Nf : Nf + nu - i;
+    for (int j = 0; j < end; j++)
+      L[i][i + j] = (G0[j] * g0 + G1[j] * g1) / d;
+
+    if (i == Nf - 1)
+      break;
+
+    /* Rotate, then advance G1 one tap since its lead is now zero */
+    complex k = G1[0] / G0[0];
+    float norm = 1.0f / sqrtf(1.0f + k.norm2());
+
+    for (int j = 0; j < Nf; j++) {
+      complex g0new = (G0[j] + G1[j] * k.conj()) * norm;
+      complex g1new = (G1[j] - G0[j] * k) * norm;
+      G0[j] = g0new;
+      if (j > 0)
+        G1[j - 1] = g1new;
     }
-    *--w = w_i/d;
+    G1[Nf - 1] = 0.0f;
+  }
+
+  if (!*feedbackFilter || ((*feedbackFilter)->size() != (size_t) nu)) {
+    delete *feedbackFilter;
+    *feedbackFilter = new signalVector(nu);
   }
+  for (int j = 0; j < nu; j++)
+    (**feedbackFilter)[j] = L[Nf - 1][Nf + j].conj() * -1.0f;
 
+  v[Nf - 1] = 1.0f;
+  for (int k = Nf - 2; k >= 0; k--) {
+    complex v_k = 0.0f;
+    for (int j = k + 1; j < Nf; j++)
+      v_k -= v[j] * L[k][j];
+    v[k] = v_k;
+  }
+
+  if (!*feedForwardFilter || ((*feedForwardFilter)->size() != (size_t) Nf)) {
+    delete *feedForwardFilter;
+    *feedForwardFilter = new signalVector(Nf);
+  }
+  for (int i = 0; i < Nf; i++) {
+    complex w_i = 0.0f;
+    int endPt = (nu < Nf - 1 - i) ? nu : Nf - 1 - i;
+    for (int k = 0; k <= endPt; k++)
+      w_i += v[i + k] * h[k].conj();
+    (**feedForwardFilter)[Nf - 1 - i] = w_i / d;
+  }
 
   return true;
-  
 }
 
 // Assumes symbol-rate sampling!!!!
@@ -1614,12 +1940,17 @@ bool sigProcLibSetup(int sps)
   if ((sps != 1) && (sps != 4))
     return false;
 
+  if (sigProcLibUsers++)
+    return true;
+
   initTrigTables();
   initGMSKRotationTables(sps);
 
   GSMPulse1 = generateGSMPulse(1, 2);
-  if (sps > 1)
+  if (sps > 1) {
     GSMPulse = generateGSMPulse(sps, 2);
+    GSMModTable = generateModulatorTable(sps, GSMPulse);
+  }
 
   if (!generateRACHSequence(1)) {
     sigProcLibDestroy();
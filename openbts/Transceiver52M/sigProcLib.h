@@ -19,6 +19,10 @@
 #include "Complex.h"
 #include "GSMTransfer.h"
 
+#include <list>
+#include <map>
+#include <string>
+
 
 using namespace GSM;
 
@@ -131,7 +135,7 @@ float vectorNorm2(const signalVector &x);
 /** Compute the average power of a vector */
 float vectorPower(const signalVector &x);
 
-/** Setup the signal processing library */
+/** Setup the signal processing library, shared by all carriers */
 bool sigProcLibSetup(int sps);
 
 /** Destroy the signal processing library */
@@ -190,6 +194,49 @@ signalVector *modulateBurst(const BitVector &wBurst,
 			    int guardPeriodLength,
 			    int sps, bool emptyPulse = false);
 
+/** GMSK modulate by direct convolution, the reference for the table driven modulateBurst */
+signalVector *modulateBurstReference(const BitVector &wBurst,
+				     int guardPeriodLength, int sps);
+
+/**
+  LRU cache of modulated bursts, for the bursts the GSM core sends over
+  and over: FCCH, repeated BCCH system information, and dummy bursts.
+  Not thread safe; the transmit path modulates from a single thread.
+*/
+class ModulationCache {
+
+ private:
+
+  struct Entry {
+    std::string key;
+    signalVector *burst;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+  EntryList mEntries;      ///< most recently used first
+  EntryMap mIndex;
+  unsigned mCapacity;
+  unsigned mHits;
+  unsigned mMisses;
+
+ public:
+
+  ModulationCache(unsigned wCapacity = 64):
+    mCapacity(wCapacity), mHits(0), mMisses(0)
+    {}
+
+  ~ModulationCache() { clear(); }
+
+  /** Return a new copy of the modulated burst, modulating only on a miss */
+  signalVector *modulate(const BitVector &wBurst, int guardPeriodLength, int sps);
+
+  void clear();
+
+  unsigned hits() const { return mHits; }
+  unsigned misses() const { return mMisses; }
+};
+
 /** Sinc function */
 float sinc(float x);
 
@@ -274,6 +321,17 @@ bool energyDetect(signalVector &rxBurst,
                   float detectThreshold,
                   float *avgPwr = NULL);
 
+/**
+        Check a whole burst against the noise floor before correlating it.
+        energyDetect() only looks at the start of the burst, which a
+        delayed RACH can miss.
+        @param rxBurst The received GSM burst of interest.
+        @param noiseLevel The RMS noise level.
+        @param gate The multiple of the noise level the burst RMS must reach.
+        @return True if the burst may hold a signal.
+*/
+bool aboveNoiseFloor(signalVector &rxBurst, float noiseLevel, float gate);
+
 /**
         RACH correlator/detector.
         @param rxBurst The received GSM burst of interest.
@@ -281,13 +339,15 @@ bool energyDetect(signalVector &rxBurst,
         @param sps The number of samples per GSM symbol.
         @param amplitude The estimated amplitude of received RACH burst.
         @param TOA The estimate time-of-arrival of received RACH burst.
+        @param maxTOA The maximum expected time-of-arrival
         @return positive if threshold value is reached, negative on error, zero otherwise
 */
 int detectRACHBurst(signalVector &rxBurst,
                     float detectThreshold,
                     int sps,
                     complex *amplitude,
-                    float* TOA);
+                    float* TOA,
+                    unsigned maxTOA = 0);
 
 /**
         Normal burst correlator, detector, channel estimator.
@@ -299,7 +359,7 @@ int detectRACHBurst(signalVector &rxBurst,
         @param TOA The estimate time-of-arrival of received TSC burst.
         @param maxTOA The maximum expected time-of-arrival
         @param requestChannel Set to true if channel estimation is desired.
-        @param channelResponse The estimated channel.
+        @param channelResponse The estimated channel, symbol spaced; only estimated at 1 sps, otherwise set to NULL.
         @param channelResponseOffset The time offset b/w the first sample of the channel response and the reported TOA.
         @return positive if threshold value is reached, negative on error, zero otherwise
 */
@@ -335,6 +395,15 @@ signalVector *decimateVector(signalVector &wVector,
 SoftVector *demodulateBurst(signalVector &rxBurst, int sps,
                             complex channel, float TOA);
 
+/**
+	Measure the multipath in a symbol spaced channel estimate. At one
+	sample per symbol the GMSK pulse alone fills two adjacent taps, so
+	energy outside the strongest pair comes from delayed paths.
+	@param chan The channel estimate from analyzeTrafficBurst().
+	@return The fraction of channel energy outside the strongest tap pair.
+*/
+float channelSpread(const signalVector &chan);
+
 /**
 	Design the necessary filters for a decision-feedback equalizer.
 	@param channelResponse The multipath channel that we're mitigating.
@@ -343,6 +412,7 @@ SoftVector *demodulateBurst(signalVector &rxBurst, int sps,
 	@param feedForwardFilter The designed feed forward filter.
 	@param feedbackFilter The designed feedback filter.
 	@return True if DFE can be designed.
+	Filters passed in at the right size are reused rather than reallocated.
 */
 bool designDFE(signalVector &channelResponse,
 	       float SNRestimate,
@@ -0,0 +1,279 @@
+/*
+ * GMSK modulator test
+ *
+ * Copyright 2014 Range Networks, Inc.
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * The table driven modulator must match modulation by direct convolution
+ * for random bursts, both guard period lengths and both sample rates,
+ * and the modulation cache must return the same burst it was given and
+ * count its hits, misses and evictions.
+ *
+ * On the 1 sps receive side, the energy gate must drop noise alone but
+ * pass a RACH at any delay, and the RACH detector must find it at every
+ * delay up to the largest timing advance.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "sigProcLib.h"
+#include "GSMCommon.h"
+
+#include <Configuration.h>
+
+ConfigurationTable gConfig;
+
+#define NUM_BURSTS		2000
+/* The reference rotates by float vectors, which is good to about 5e-4 */
+#define MAX_ERROR		1e-3
+
+/* ENERGY_GATE in Transceiver.cpp */
+#define ENERGY_GATE		1.1
+#define NUM_NOISE_BURSTS	2000
+#define NUM_RACH_BURSTS		100
+#define RACH_SNR_DB		6.0
+#define MAX_TA			62
+
+static void randomBurst(BitVector &burst)
+{
+	for (size_t i = 0; i < burst.size(); i++)
+		burst[i] = random() & 0x01;
+}
+
+/* Largest sample difference, relative to the largest reference sample */
+static double maxError(signalVector *x, signalVector *ref)
+{
+	double err = 0.0, amp = 0.0;
+
+	for (size_t i = 0; i < ref->size(); i++) {
+		complex d = (*x)[i] - (*ref)[i];
+		err = fmax(err, sqrt(d.norm2()));
+		amp = fmax(amp, sqrt((*ref)[i].norm2()));
+	}
+
+	return amp > 0.0 ? err / amp : err;
+}
+
+static bool sameBurst(signalVector *x, signalVector *y)
+{
+	if (x->size() != y->size())
+		return false;
+
+	for (size_t i = 0; i < x->size(); i++) {
+		if ((*x)[i] != (*y)[i])
+			return false;
+	}
+
+	return true;
+}
+
+static int testModulator(int sps)
+{
+	double err, worst = 0.0;
+	BitVector burst(148);
+	int fail = 0;
+
+	for (int n = 0; n < NUM_BURSTS; n++) {
+		int guard = 8 + (n % 2);
+
+		/* Start with the all zeros and all ones corner cases */
+		if (n < 2) {
+			for (size_t i = 0; i < burst.size(); i++)
+				burst[i] = n;
+		} else {
+			randomBurst(burst);
+		}
+
+		signalVector *x = modulateBurst(burst, guard, sps);
+		signalVector *ref = modulateBurstReference(burst, guard, sps);
+
+		if (x->size() != ref->size()) {
+			printf("sps %i: burst length %zu, reference %zu\n",
+			       sps, x->size(), ref->size());
+			fail = 1;
+		} else {
+			err = maxError(x, ref);
+			worst = fmax(worst, err);
+		}
+
+		delete x;
+		delete ref;
+	}
+
+	printf("sps %i: worst relative error %g\n", sps, worst);
+	if (worst > MAX_ERROR) {
+		printf("sps %i: table modulator does not match the reference\n", sps);
+		fail = 1;
+	}
+
+	return fail;
+}
+
+static int testCache(int sps)
+{
+	ModulationCache cache(4);
+	BitVector bursts[4];
+	int fail = 0;
+
+	for (int i = 0; i < 4; i++) {
+		bursts[i].resize(148);
+		randomBurst(bursts[i]);
+	}
+
+	/* First use misses, second hits, and both match the modulator */
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < 4; i++) {
+			signalVector *x = cache.modulate(bursts[i], 8, sps);
+			signalVector *y = modulateBurst(bursts[i], 8, sps);
+			if (!sameBurst(x, y)) {
+				printf("sps %i: cached burst %i differs\n", sps, i);
+				fail = 1;
+			}
+			delete x;
+			delete y;
+		}
+	}
+	if (cache.hits() != 4 || cache.misses() != 4) {
+		printf("sps %i: %u hits, %u misses, expected 4 and 4\n",
+		       sps, cache.hits(), cache.misses());
+		fail = 1;
+	}
+
+	/* The guard period is part of the key */
+	delete cache.modulate(bursts[0], 9, sps);
+	if (cache.misses() != 5) {
+		printf("sps %i: guard period not in the cache key\n", sps);
+		fail = 1;
+	}
+
+	/* That evicted the least recently used, burst 0 with guard 8 */
+	delete cache.modulate(bursts[0], 8, sps);
+	delete cache.modulate(bursts[3], 8, sps);
+	if (cache.hits() != 5 || cache.misses() != 6) {
+		printf("sps %i: %u hits, %u misses after eviction, expected 5 and 6\n",
+		       sps, cache.hits(), cache.misses());
+		fail = 1;
+	}
+
+	return fail;
+}
+
+static float gauss()
+{
+	float u1 = (random() + 1.0) / (RAND_MAX + 2.0);
+	float u2 = (random() + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* A 1 sps slot of unit power complex noise, with a RACH of the given SNR and delay */
+static void makeSlot(signalVector &slot, float snr, int delay)
+{
+	signalVector *rach = NULL;
+
+	if (snr > -100.0) {
+		BitVector bits(88);
+		randomBurst(bits);
+		for (int i = 0; i < 8; i++)
+			bits[i] = 0;
+		for (int i = 0; i < 41; i++)
+			bits[8 + i] = GSM::gRACHSynchSequence[i];
+		rach = modulateBurst(bits, 0, 1);
+	}
+
+	float ampl = pow(10.0, snr / 20.0);
+	for (size_t i = 0; i < slot.size(); i++) {
+		slot[i] = complex(gauss(), gauss()) * (float) M_SQRT1_2;
+		int k = (int) i - 2 - delay;
+		if (rach && (k >= 0) && (k < (int) rach->size()))
+			slot[i] += (*rach)[k] * ampl;
+	}
+
+	delete rach;
+}
+
+static int testRACH()
+{
+	signalVector slot(156);
+	float avg, noiseLev = 0.0;
+	complex amp;
+	float toa;
+	int passed = 0, fail = 0;
+
+	/* The noise level as the Transceiver tracks it */
+	for (int n = 0; n < 100; n++) {
+		makeSlot(slot, -200.0, 0);
+		energyDetect(slot, 20, 0.0, &avg);
+		noiseLev += sqrt(avg) / 100;
+	}
+
+	for (int n = 0; n < NUM_NOISE_BURSTS; n++) {
+		makeSlot(slot, -200.0, 0);
+		passed += aboveNoiseFloor(slot, noiseLev, ENERGY_GATE);
+	}
+	/* A few get through to the correlators, which reject them */
+	printf("energy gate: %i of %i noise bursts passed\n",
+	       passed, NUM_NOISE_BURSTS);
+	if (passed > NUM_NOISE_BURSTS / 20)
+		fail = 1;
+
+	for (int delay = 0; delay <= MAX_TA; delay += 10) {
+		int gated = 0, found = 0, short_found = 0;
+
+		for (int n = 0; n < NUM_RACH_BURSTS; n++) {
+			makeSlot(slot, RACH_SNR_DB, delay);
+			if (!aboveNoiseFloor(slot, noiseLev, ENERGY_GATE)) {
+				gated++;
+				continue;
+			}
+			if (detectRACHBurst(slot, 6.0, 1, &amp, &toa, MAX_TA) > 0)
+				found++;
+			if (detectRACHBurst(slot, 6.0, 1, &amp, &toa, 0) > 0)
+				short_found++;
+		}
+
+		printf("RACH delay %2i: %i gated, %i found, %i without the TA window\n",
+		       delay, gated, found, short_found);
+		if (gated || (found < NUM_RACH_BURSTS * 8 / 10))
+			fail = 1;
+	}
+
+	return fail;
+}
+
+int main(int argc, char **argv)
+{
+	int fail = 0;
+	int sps[] = { 1, 4 };
+
+	srandom(1);
+
+	for (int i = 0; i < 2; i++) {
+		if (!sigProcLibSetup(sps[i])) {
+			printf("sigProcLibSetup(%i) failed\n", sps[i]);
+			return 1;
+		}
+		fail |= testModulator(sps[i]);
+		fail |= testCache(sps[i]);
+		if (sps[i] == 1)
+			fail |= testRACH();
+		sigProcLibDestroy();
+	}
+
+	printf(fail ? "FAILED\n" : "PASSED\n");
+	return fail;
+}
@@ -20,51 +20,43 @@
 #include "RAD1Device.h"
 #include <Interthread.h>
 #include <Scanning.h>
+#include <PowerScan.h>
 #include <GSMCommon.h>
 
-#include <list>
-
 ConfigurationKeyMap getAllConfigurationKeys();
 ConfigurationTable gConfig("/etc/OpenBTS/OpenBTS.db", "PowerScanner", getAllConfigurationKeys());
 
 
 using namespace std;
 
-typedef unsigned (*FrequencyConverter)(GSM::GSMBand, unsigned);
-int scanDirection(RAD1Device *rad, TIMESTAMP &timestamp,             // Physical RAD values
-                  GSM::GSMBand band, int startARFCN, int stopARFCN,  // GSM band values
-                  FrequencyConverter arfcnToFreqKHz,                 // Frequency determiner
-		  SpectrumMap::LinkDirection linkDir,
-                  SpectrumMap &spectrumMap);
-
 
-class ARFCNVector {
+/** The RAD1 as a ScanRadio. */
+class RAD1ScanRadio : public ScanRadio {
 
   private:
 
-    double mPower;
-    unsigned mARFCN;
-    float mFreq;
-    SpectrumMap::LinkDirection mLinkDir;
+    RAD1Device *mRad;
+    TIMESTAMP mTimestamp;
 
   public:
 
-    ARFCNVector(double &wPower, unsigned &wARFCN, float &freq, SpectrumMap::LinkDirection &linkDir) {
-        mPower = wPower;
-        mARFCN = wARFCN;
-        mFreq = freq;
-        mLinkDir = linkDir;
-    }
-
-    unsigned ARFCN() const { return mARFCN;}
-
-    double power() const {return mPower;}
+    RAD1ScanRadio(RAD1Device *wRad, TIMESTAMP wTimestamp) : mRad(wRad), mTimestamp(wTimestamp) {}
 
-    SpectrumMap::LinkDirection linkDirection() const { return mLinkDir; }
+    double sampleRate() { return mRad->getSampleRate(); }
 
-    float frequency() const { return mFreq; }
+    bool tune(double freq) { return mRad->setRxFreq(freq); }
 
-    bool operator>(const ARFCNVector &other) const {return mPower < other.mPower;}
+    int read(short *buf, int len) {
+      bool overrun;
+      int rd = mRad->readSamples(buf,len,&overrun,mTimestamp);
+      // The RAD1 delivers USB byte order.
+      for (int i = 0; i < rd; i++) {
+        uint32_t *wordPtr = (uint32_t *) &buf[2*i];
+        *wordPtr = usrp_to_host_u32(*wordPtr);
+      }
+      mTimestamp += rd;
+      return rd;
+    }
 };
 
 
@@ -84,15 +76,25 @@ int main(int argc, char *argv[])
         exit(-1);
     }
 
-    RAD1Device *rad = new RAD1Device(1625.0e3/6.0);
+    RAD1Device *rad = new RAD1Device(gConfig.getNum("PowerScanner.SampleRate"));
     rad->make(false, 0);
     rad->start();
-    TIMESTAMP timestamp = 19000;
+
+    rad->setRxFreq(GSM::uplinkFreqKHz(band, startARFCN) * 1000.0);
+    rad->updateAlignment(40000);
+    rad->updateAlignment(41000);
+    rad->setRxGain(gConfig.getNum("PowerScanner.RxGain"));
+
+    RAD1ScanRadio radio(rad, 19000);
+    unsigned integrationTime = gConfig.getNum("PowerScanner.IntegrationTime");
+    double dBmOffset = gConfig.getNum("PowerScanner.dBmOffset");
 
     cout << endl << "Scanning Uplink" << endl;
-    scanDirection(rad, timestamp, band, startARFCN, stopARFCN, &GSM::uplinkFreqKHz, SpectrumMap::LinkDirection::Up, spectrumMap);
+    PowerScan up(radio, spectrumMap, band, SpectrumMap::LinkDirection::Up, &GSM::uplinkFreqKHz, integrationTime, dBmOffset);
+    cout << up.run(startARFCN, stopARFCN) << " ARFCNs measured" << endl;
     cout << endl << "Scanning Downlink" << endl;
-    scanDirection(rad, timestamp, band, startARFCN, stopARFCN, &GSM::downlinkFreqKHz, SpectrumMap::LinkDirection::Down, spectrumMap);
+    PowerScan down(radio, spectrumMap, band, SpectrumMap::LinkDirection::Down, &GSM::downlinkFreqKHz, integrationTime, dBmOffset);
+    cout << down.run(startARFCN, stopARFCN) << " ARFCNs measured" << endl;
 
   } catch (ConfigurationTableKeyNotFound e) {
     cout << "Required configuration parameter " << e.key() << " not defined, exiting.";
@@ -102,109 +104,21 @@ int main(int argc, char *argv[])
   return 0;
 }
 
-int scanDirection(RAD1Device *rad, TIMESTAMP &timestamp, GSM::GSMBand band, int startARFCN, int stopARFCN,
-    FrequencyConverter arfcnToFreqKHz, SpectrumMap::LinkDirection linkDir, SpectrumMap &spectrumMap)
-{
-  list<ARFCNVector> results;
-  float integrationTime = ((float)gConfig.getNum("PowerScanner.IntegrationTime"))/1000.0F;
-
-  float startFreq = arfcnToFreqKHz(band, startARFCN) * 1000.0F;
-  rad->setRxFreq(startFreq);
-
-  rad->updateAlignment(40000);
-  rad->updateAlignment(41000);
-
-  rad->setRxGain(gConfig.getNum("PowerScanner.RxGain"));
-
-  for (unsigned ARFCN=startARFCN; ARFCN <= stopARFCN; ARFCN++) {
-    float currFreq = arfcnToFreqKHz(band, ARFCN) * 1000.0F;
-    double sum = 0.0;
-    double num = 0.0;
-    rad->setRxFreq(currFreq);
-
-    while (num < integrationTime*270833.33) {
-      short readBuf[512*2];
-      bool underrun;
-      int rd = rad->readSamples(readBuf,512,&underrun,timestamp);
-      if (rd) {
-	for (int i = 0; i < rd; i++) {
-	  uint32_t *wordPtr = (uint32_t *) &readBuf[2*i];
-	  *wordPtr = usrp_to_host_u32(*wordPtr);
-	  sum += (readBuf[2*i+1]*readBuf[2*i+1] + readBuf[2*i]*readBuf[2*i]);
-	  num += 1.0;
-	}
-      }
-      timestamp += rd;
-    }
-
-    double currPower = sum/num;
-	// HACK
-    printf("At freq %f (ARFCN %5d), the average power is %10.2f\n",currFreq,ARFCN,currPower);
-    ARFCNVector res(currPower,ARFCN, currFreq, linkDir);
-    results.push_back(res);
-  }
-
-  for (list<ARFCNVector>::iterator rp=results.begin(); rp!=results.end(); ++rp) {
-    double currPower = rp->power();
-    unsigned ARFCN = rp->ARFCN();
-    float freq = rp->frequency();
-    SpectrumMap::LinkDirection linkDir = rp->linkDirection();
-
-    if (currPower==0.0) continue;
-
-    double dBm = 10.0F*log10(currPower) + gConfig.getNum("PowerScanner.dBmOffset");
-    spectrumMap.power(band,ARFCN,freq,linkDir,dBm);
-  }
-
-  return 0;
-}
-
 ConfigurationKeyMap getAllConfigurationKeys()
 {
 	extern ConfigurationKeyMap getConfigurationKeys();
 	ConfigurationKeyMap map = getConfigurationKeys();
+	addPowerScanConfigurationKeys(map);
 	ConfigurationKey *tmp;
 
-	tmp = new ConfigurationKey("PowerScanner.dBmOffset","0",
-		"dBm",
-		ConfigurationKey::FACTORY,
-		ConfigurationKey::VALRANGE,
-		"0:100",
-		false,
-		"Calibrated dBm level corresponding to full scale on the receiver."
-	);
-	map[tmp->getName()] = *tmp;
-	delete tmp;
-
-	tmp = new ConfigurationKey("PowerScanner.DBPath","/var/run/PowerScannerResults.db",
-		"",
-		ConfigurationKey::FACTORY,
-		ConfigurationKey::FILEPATH,
-		"",
-		true,
-		"Path to the scanning results database."
-	);
-	map[tmp->getName()] = *tmp;
-	delete tmp;
-
-	tmp = new ConfigurationKey("PowerScanner.IntegrationTime","250",
-		"milliseconds",
-		ConfigurationKey::FACTORY,
-		ConfigurationKey::VALRANGE,
-		"50:5000",
-		false,
-		"Power detection integration time in milliseconds."
-	);
-	map[tmp->getName()] = *tmp;
-	delete tmp;
-
-	tmp = new ConfigurationKey("PowerScanner.RxGain","97",
-		"dB",
+	tmp = new ConfigurationKey("PowerScanner.SampleRate","1083333",
+		"samples/second",
 		ConfigurationKey::FACTORY,
 		ConfigurationKey::VALRANGE,
-		"0:200",
+		"270833:4333333",
 		false,
-		"Receiver gain for the power scanner program, raw value to setRxGain."
+		"Receive sample rate for the power scanner.  "
+			"Each capture covers as many ARFCNs as fit in about 80% of this, so a higher rate scans faster, up to what USB can carry."
 	);
 	map[tmp->getName()] = *tmp;
 	delete tmp;
@@ -34,6 +34,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include "Threads.h"
 #include "RAD1Device.h"
 
@@ -170,6 +171,16 @@ RAD1Device::RAD1Device (double _desiredSampleRate)
   decimRate = (unsigned int) round(masterClockRate/_desiredSampleRate);
   actualSampleRate = masterClockRate/decimRate;
   rxGain = 0;
+  rxThread = NULL;
+  rxRunning = false;
+  data = NULL;
+  rxOverrun = false;
+  rxUnderrun = false;
+  rxRSSI = 0;
+  usbOverruns = usbUnderruns = ringOverruns = latePackets = 0;
+  maxBuffered = 0;
+  maxWait = 0.0;
+  lastReport = 0.0;
 
   // This default value matches the RAD1r3.
   PC = 0;    // bits 3,2     Core power 15mA
@@ -192,8 +203,13 @@ bool RAD1Device::make(bool wSkipRx, int devID)
   string rbf = "fpga.rbf";
   
   if (!skipRx) {
+  // More transfers in flight ride out longer stalls of the stream thread
+  int rxTransfers = 0;
+  if (gConfig.defines("TRX.USBTransfers"))
+    rxTransfers = gConfig.getNum("TRX.USBTransfers");
+
   try {
-    m_uRx = rnrad1Rx::make(devID,decimRate, rbf,"ezusb.ihx");
+    m_uRx = rnrad1Rx::make(devID,decimRate, rbf,"ezusb.ihx",rxTransfers);
     m_uRx->setFpgaMasterClockFreq(masterClockRate);
   }
   
@@ -294,6 +310,8 @@ bool RAD1Device::start()
     writeLock.unlock();
   }
 
+  // A restart gets a fresh ring
+  delete[] data;
   data = new short[currDataSize];
   dataStart = 0;
   dataEnd = 0;
@@ -311,6 +329,13 @@ bool RAD1Device::start()
   else
   started = m_uTx->start();
 
+  // Reap receive transfers as they complete, whatever the reader is doing
+  if (started && !skipRx && !rxThread) {
+    rxRunning = true;
+    rxThread = new Thread();
+    rxThread->start((void * (*)(void*))RxStreamAdapter,(void*) this);
+  }
+
   return started;
 #else
   gettimeofday(&lastReadTime,NULL);
@@ -323,13 +348,19 @@ bool RAD1Device::stop()
 #ifndef SWLOOPBACK 
   if (!m_uRx) return false;
   if (!m_uTx) return false;
+
+  // The stream thread finishes its current transfer and exits
+  if (rxThread) {
+    rxRunning = false;
+    rxThread->join();
+    delete rxThread;
+    rxThread = NULL;
+  }
   
   // power down
   m_uTx->writeIO((~POWER_UP|RX_TXN),(POWER_UP|RX_TXN|ENABLE));
   m_uRx->writeIO(~POWER_UP,(POWER_UP|ENABLE));
   
-  delete[] currData;
-  
   started = false;
   return !started;
 #else
@@ -387,6 +418,140 @@ double RAD1Device::setRxGain(double dB) {
 }
 
 
+/** Seconds on the monotonic clock */
+static double rxClock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+void RAD1Device::rxPacket(uint32_t *tmpBuf)
+{
+  TIMESTAMP pktTimestamp = usrp_to_host_u32(tmpBuf[1]);
+  uint32_t word0 = usrp_to_host_u32(tmpBuf[0]);
+  uint32_t chan = (word0 >> 16) & 0x1f;
+  unsigned payloadSz = word0 & 0x1ff;
+
+  // (pat) FIXME I dont think this incremeintHi32 logic works...  SVGDBG look at this
+  bool incrementHi32 = ((lastPktTimestamp & 0x0ffffffffllu) > pktTimestamp);
+  if (incrementHi32 && (timeStart!=0)) {
+    LOG(DEBUG) << "high 32 increment!!!";
+    hi32Timestamp++;
+  }
+  pktTimestamp = (((TIMESTAMP) hi32Timestamp) << 32) | pktTimestamp;
+  lastPktTimestamp = pktTimestamp;
+
+  if (chan == 0x01f) {
+    // control reply, check to see if its ping reply
+    uint32_t word2 = usrp_to_host_u32(tmpBuf[2]);
+    if ((word2 >> 16) == ((0x01 << 8) | 0x02)) {
+      TIMESTAMP newTimestampOffset = pktTimestamp - pingTimestamp + PINGOFFSET;
+      if ((timestampOffset==0) || fabs((float) newTimestampOffset-(float) timestampOffset)/(float) timestampOffset < 0.1)
+        timestampOffset = newTimestampOffset;
+      else { // new offset is more than 10% from old one, then its bogus, so ignore it and keep going
+        LOG(ERR) << "Ignoring bad update of timestamp offset: " << newTimestampOffset << ", keeping offset at " << timestampOffset;
+      }
+      LOG(NOTICE) << "updating timestamp offset to: " << timestampOffset;
+      isAligned = true;
+    }
+    return;
+  }
+  if (chan != 0) {
+    LOG(DEBUG) << "chan: " << chan << ", timestamp: " << pktTimestamp << ", sz:" << payloadSz;
+    return;
+  }
+  if ((word0 >> 28) & 0x04) {
+    rxUnderrun = true;
+    usbUnderruns++;
+  }
+  rxRSSI = (word0 >> 21) & 0x3f;
+
+  if (!isAligned) return;
+
+  // Samples already read can't be filled in any more
+  if ((timeStart != 0) && (pktTimestamp < timeStart)) {
+    latePackets++;
+    return;
+  }
+
+  TIMESTAMP pktEnd = pktTimestamp + payloadSz/2/sizeof(short);
+  if ((timeStart != 0) && (pktEnd > timeStart + currDataSize/2))
+    ringOverruns++;
+
+  unsigned cursorStart = (pktTimestamp - timeStart + dataStart) % (currDataSize/2);
+  if (cursorStart*2 + payloadSz/2 > currDataSize) {
+    // need to circle around buffer
+    // (pat) This is trickey. For a cicular copy using memcpy(a,b,c); memcpy(d,e,f); it is required that e==b+c,
+    // but it does because tmpBuf is (uint32_t*)
+    memcpy(data+cursorStart*2,tmpBuf+2,(currDataSize-cursorStart*2)*sizeof(short));
+    memcpy(data,tmpBuf+2+(currDataSize/2-cursorStart),payloadSz-(currDataSize-cursorStart*2)*sizeof(short));
+  }
+  else {
+    memcpy(data+cursorStart*2,tmpBuf+2,payloadSz);
+  }
+  if (pktEnd > timeEnd)
+    timeEnd = pktEnd;
+
+  if ((timeStart != 0) && (timeEnd - timeStart > maxBuffered))
+    maxBuffered = timeEnd - timeStart;
+}
+
+void RAD1Device::rxStream()
+{
+  static const int RX_REPORT_INTRVL = 10;
+  uint32_t readBuf[MAX_BLOCK_SIZE/4];
+  bool overrun;
+
+  // Each read waits for one transfer, which goes straight back to libusb
+  int readLen = m_uRx->read((void *)readBuf,m_uRx->blockSize(),&overrun);
+  if (readLen < 0) {
+    LOG(ERR) << "USB receive failed";
+    usleep(1000);
+    return;
+  }
+
+  ScopedLock lock(rxLock);
+
+  if (overrun) {
+    rxOverrun = true;
+    usbOverruns++;
+  }
+
+  for (int pktNum = 0; pktNum < (readLen/512); pktNum++)
+    rxPacket(readBuf+pktNum*512/4);
+
+  rxReady.signal();
+
+  double now = rxClock();
+  if (now - lastReport < RX_REPORT_INTRVL)
+    return;
+
+  if (usbOverruns || usbUnderruns || ringOverruns || latePackets) {
+    LOG(NOTICE) << "USB streaming: " << usbOverruns << " overruns, "
+                << usbUnderruns << " underruns, " << ringOverruns
+                << " ring overruns, " << latePackets << " late packets";
+  }
+  LOG(INFO) << "USB streaming: at most " << maxBuffered
+            << " samples buffered, longest read wait "
+            << 1.0e6 * maxWait << " us";
+
+  usbOverruns = usbUnderruns = ringOverruns = latePackets = 0;
+  maxBuffered = 0;
+  maxWait = 0.0;
+  lastReport = now;
+}
+
+void *RxStreamAdapter(RAD1Device *dev)
+{
+  dev->lastReport = rxClock();
+
+  while (dev->rxRunning)
+    dev->rxStream();
+
+  return NULL;
+}
+
 // NOTE: Assumes sequential reads
 // (pat) The RSSI argument appears unused by anyone.
 int RAD1Device::readSamples(short *buf, int len, bool *overrun, 
@@ -396,103 +561,45 @@ int RAD1Device::readSamples(short *buf, int len, bool *overrun,
 {
 #ifndef SWLOOPBACK 
   if (!m_uRx) return 0;
-  
-  timestamp += timestampOffset;
-  
-  if (timestamp + len < timeStart) {
-    memset(buf,0,len*2*sizeof(short));
-    return len;
-  }
 
-  if (underrun) *underrun = false;
- 
-  uint32_t readBuf[20000];
- 
-  // (pat) Step 1 is to read from USB into *data, which is a 2M*sizeof(short) buffer.
+  // The stream thread reads from USB into *data, which is a 2M*sizeof(short) buffer.
   // The packet timestamp is used as an index into the data buffer so packets are arranged in order of increasing timestamp.
+  ScopedLock lock(rxLock);
+
+  double waitStart = 0.0;
   while (1) {
-    //guestimate USB read size
-    int readLen=0;
-    {
-      int numSamplesNeeded = (int) (timestamp + (TIMESTAMP) len - timeEnd);
-      if (numSamplesNeeded <=0) break;
-      readLen = 512 * ((int) ceil((float) numSamplesNeeded/126.0));
-      if (readLen > 8000) readLen= (8000/512)*512;
+    // A ping reply can move the offset while we wait
+    TIMESTAMP want = timestamp + timestampOffset;
+
+    if (want + len < timeStart) {
+      memset(buf,0,len*2*sizeof(short));
+      return len;
     }
-    
-    // read USRP packets, parse and save A/D data as needed
-    readLen = m_uRx->read((void *)readBuf,readLen,overrun);
-    for(int pktNum = 0; pktNum < (readLen/512); pktNum++) {
-      // tmpBuf points to start of a USB packet
-      uint32_t* tmpBuf = (uint32_t *) (readBuf+pktNum*512/4);
-      TIMESTAMP pktTimestamp = usrp_to_host_u32(tmpBuf[1]);
-      uint32_t word0 = usrp_to_host_u32(tmpBuf[0]);
-      uint32_t chan = (word0 >> 16) & 0x1f;
-      unsigned payloadSz = word0 & 0x1ff;
-      LOG(DEBUG) << "first two bytes: " << hex << word0 << " " << dec << pktTimestamp;
-
-      // (pat) FIXME I dont think this incremeintHi32 logic works...  SVGDBG look at this
-      bool incrementHi32 = ((lastPktTimestamp & 0x0ffffffffllu) > pktTimestamp);
-      if (incrementHi32 && (timeStart!=0)) {
-           LOG(DEBUG) << "high 32 increment!!!";
-           hi32Timestamp++;
-      }
-      pktTimestamp = (((TIMESTAMP) hi32Timestamp) << 32) | pktTimestamp;
-      lastPktTimestamp = pktTimestamp;
-
-      if (chan == 0x01f) {
-		// control reply, check to see if its ping reply
-			uint32_t word2 = usrp_to_host_u32(tmpBuf[2]);
-		if ((word2 >> 16) == ((0x01 << 8) | 0x02)) {
-			timestamp -= timestampOffset;
-			TIMESTAMP newTimestampOffset = pktTimestamp - pingTimestamp + PINGOFFSET;
-			if ((timestampOffset==0) || fabs((float) newTimestampOffset-(float) timestampOffset)/(float) timestampOffset < 0.1)
-				timestampOffset = newTimestampOffset;
-			else { // new offset is more than 10% from old one, then its bogus, so ignore it and keep going
-				LOG(ERR) << "Ignoring bad update of timestamp offset: " << newTimestampOffset << ", keeping offset at " << timestampOffset;
-			}
-			LOG(NOTICE) << "updating timestamp offset to: " << timestampOffset;
-			timestamp += timestampOffset;
-			isAligned = true;
-		}
-		continue;
-      }
-      if (chan != 0) {
-    	  LOG(DEBUG) << "chan: " << chan << ", timestamp: " << pktTimestamp << ", sz:" << payloadSz;
-    	  continue;
-      }
-      if ((word0 >> 28) & 0x04) {
-    	  if (underrun) *underrun = true;
-    	  LOG(DEBUG) << "UNDERRUN in TRX->USRP interface";
-      }
-      if (RSSI) *RSSI = (word0 >> 21) & 0x3f;
-      
-      if (!isAligned) continue;
-      
-      unsigned cursorStart = pktTimestamp - timeStart + dataStart;
-      while (cursorStart*2 > currDataSize) {
-    	  cursorStart -= currDataSize/2;
-      }
-      if (cursorStart*2 + payloadSz/2 > currDataSize) {
-		// need to circle around buffer
-		// (pat) This is trickey. For a cicular copy using memcpy(a,b,c); memcpy(d,e,f); it is required that e==b+c,
-		// but it does because tmpBuf is (uint32_t*)
-		memcpy(data+cursorStart*2,tmpBuf+2,(currDataSize-cursorStart*2)*sizeof(short));
-		memcpy(data,tmpBuf+2+(currDataSize/2-cursorStart),payloadSz-(currDataSize-cursorStart*2)*sizeof(short));
-      }
-      else {
-    	  memcpy(data+cursorStart*2,tmpBuf+2,payloadSz);
-      }
-      if (pktTimestamp + payloadSz/2/sizeof(short) > timeEnd) 
-    	  timeEnd = pktTimestamp+payloadSz/2/sizeof(short);
 
-      //LOG(DEBUG) << "timeStart: " << timeStart << ", timeEnd: " << timeEnd << ", pktTimestamp: " << pktTimestamp;
+    if (timeEnd >= want + len) {
+      timestamp = want;
+      break;
+    }
+
+    if (waitStart == 0.0)
+      waitStart = rxClock();
+    rxReady.wait(rxLock,1000);
+  }
+
+  if (waitStart != 0.0) {
+    double wait = rxClock() - waitStart;
+    if (wait > maxWait)
+      maxWait = wait;
+  }
 
-    }	
-  }     
+  *overrun = rxOverrun;
+  rxOverrun = false;
+  if (underrun) *underrun = rxUnderrun;
+  rxUnderrun = false;
+  if (RSSI) *RSSI = rxRSSI;
  
   // copy desired data to buf
-  unsigned bufStart = dataStart+(timestamp-timeStart);
+  unsigned bufStart = (dataStart+(timestamp-timeStart)) % (currDataSize/2);
   if (bufStart + len < currDataSize/2) { 
     //LOG(DEBUG) << "bufStart: " << bufStart;
     memcpy(buf,data+bufStart*2,len*2*sizeof(short));
@@ -559,10 +666,10 @@ int RAD1Device::writeSamples(short *buf, int len, bool *underrun,
 			     unsigned long long timestamp,
 			     bool isControl) 
 {
-  writeLock.lock();
-
 #ifndef SWLOOPBACK 
   if (!m_uTx) return 0;
+
+  writeLock.lock();
  
   static uint32_t outData[128*200];
  
@@ -40,6 +40,7 @@
 #include "bytesex.h"
 
 #include <Configuration.h>
+#include <Threads.h>
 
 extern ConfigurationTable gConfig;
 
@@ -62,6 +63,11 @@ private:
   bool started;			///< flag indicates USRP has started
   bool skipRx;			///< set if USRP is transmit-only.
 
+  /*
+    Receive ring, indexed by timestamp. The stream thread parses each USB
+    transfer into it and readSamples() copies out from timeStart, both
+    under rxLock, which is only held for the copies.
+  */
   static const unsigned int currDataSize_log2 = 21;
   static const unsigned int currDataSize = (1 << currDataSize_log2);
   short *data;
@@ -73,6 +79,23 @@ private:
 
   Mutex writeLock;
 
+  Thread *rxThread;		///< thread reaping USB receive transfers into the ring
+  volatile bool rxRunning;	///< cleared to stop rxThread
+  Mutex rxLock;			///< protects the ring and timestampOffset
+  Signal rxReady;		///< signalled as the ring gains samples
+  bool rxOverrun;		///< USB overrun since the last readSamples()
+  bool rxUnderrun;		///< transmit underrun since the last readSamples()
+  unsigned rxRSSI;		///< RSSI of the latest data packet
+
+  /** Streaming counters, logged and cleared every RX_REPORT_INTRVL */
+  unsigned usbOverruns;		///< overruns reported by the FPGA
+  unsigned usbUnderruns;	///< transmit underruns reported by the FPGA
+  unsigned ringOverruns;	///< packets written over samples not yet read
+  unsigned latePackets;		///< packets that arrived after their samples were read
+  unsigned maxBuffered;		///< most samples buffered ahead of the reader
+  double maxWait;		///< longest readSamples() wait for samples, in seconds
+  double lastReport;
+
   short *currData;		///< internal data buffer when reading from USRP
   TIMESTAMP currTimestamp;	///< timestamp of internal data buffer
   unsigned currLen;		///< size of internal data buffer
@@ -162,6 +185,15 @@ private:
 
   /** Set the receiver frequency */
   bool rx_setFreq(double freq, double *actual_freq);
+
+  /** Parse a USB receive packet into the ring, with rxLock held */
+  void rxPacket(uint32_t *pkt);
+
+  /** Reap USB receive transfers and parse them into the ring */
+  void rxStream();
+
+  friend void *RxStreamAdapter(RAD1Device *);
+  friend class RAD1DeviceTest;
   
  public:
 
@@ -259,5 +291,8 @@ private:
 
 };
 
+/** USB receive streaming thread */
+void *RxStreamAdapter(RAD1Device *);
+
 #endif // _RAD1_DEVICE_H_
 
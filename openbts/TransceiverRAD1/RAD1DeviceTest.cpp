@@ -0,0 +1,192 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses; see the COPYING file in the main directory for licensing information for this specific distribution.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+/*
+  Runs the RAD1Device receive path against a mock board. The mock streams
+  packets whose samples hold their own timestamps, and answers a ping with
+  a control packet, so every sample readSamples() returns can be checked
+  against the timestamp it was asked for, across reader stalls and across
+  a stop() and start() of the device.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+
+// Stand in for rnrad1.h, so RAD1Device.cpp builds against the mock
+#define RNRAD1_H
+
+static const int MAX_BLOCK_SIZE = 16 * 1024;
+enum {
+  FR_ATR_MASK_0 = 20, FR_ATR_TXVAL_0, FR_ATR_RXVAL_0,
+  SPI_ENABLE_TX_A = 0x10, SPI_ENABLE_RX_A = 0x20,
+  SPI_FMT_MSB = 0, SPI_FMT_HDR_0 = 0
+};
+
+static volatile bool gPingPending = false;
+static volatile unsigned long long gPingTs = 0;
+
+struct rnrad1Base {
+  bool writeOE(unsigned, unsigned) { return true; }
+  bool writeIO(unsigned, unsigned) { return true; }
+  int readIO() { return 0; }
+  bool writeFpgaReg(int, int) { return true; }
+  bool setPga(int, double) { return true; }
+  double pga(int) { return 0; }
+  double pgaMax() { return 20; }
+  bool setMux(int) { return true; }
+  bool setAdcBufferBypass(int, bool) { return true; }
+  bool writeAuxDac(int, int) { return true; }
+  bool writeSpi(int, int, int, unsigned char *, int) { return true; }
+  double fpgaMasterClockFreq() { return 52e6; }
+  void setFpgaMasterClockFreq(double) { }
+  bool start() { return true; }
+};
+
+class rnrad1Rx : public rnrad1Base {
+ public:
+  unsigned long long ts;
+
+  rnrad1Rx() : ts(5000000) { }
+  static rnrad1Rx *make(int, unsigned, std::string, std::string, int) { return new rnrad1Rx; }
+  bool setRxFreq(double) { return true; }
+  double rxFreq() { return 0; }
+  int blockSize() const { return 4096; }
+
+  /** Eight packets of 126 samples, about as often as the board sends them */
+  int read(void *buf, int len, bool *overrun)
+  {
+    *overrun = false;
+    usleep(1800);
+    uint32_t *p = (uint32_t *) buf;
+    for (int n = 0; n < len / 512; n++, p += 128) {
+      if (gPingPending) {
+        gPingPending = false;
+        p[0] = (0x1f << 16) | 8;
+        p[1] = (uint32_t) (ts - 1000);
+        p[2] = (0x0102u << 16);
+        continue;
+      }
+      p[0] = 504;
+      p[1] = (uint32_t) ts;
+      short *s = (short *) (p + 2);
+      for (int i = 0; i < 126; i++)
+        s[2*i] = s[2*i+1] = (short) ((ts + i) & 0x7fff);
+      ts += 126;
+    }
+    return len;
+  }
+};
+
+class rnrad1Tx : public rnrad1Base {
+ public:
+  static rnrad1Tx *make(int, unsigned, std::string, std::string) { return new rnrad1Tx; }
+  bool setTxFreq(double) { return true; }
+  double txFreq() { return 0; }
+
+  /** Remember a ping, for the receive side to answer */
+  int write(const void *buf, int len, bool *)
+  {
+    const uint32_t *p = (const uint32_t *) buf;
+    if (((p[0] >> 16) & 0x1f) == 0x1f) {
+      gPingTs = p[1];
+      gPingPending = true;
+    }
+    return len;
+  }
+};
+
+#include "RAD1Device.cpp"
+
+ConfigurationTable gConfig;
+
+class RAD1DeviceTest {
+
+  RAD1Device dev;
+  unsigned bad, zero;
+
+  public:
+
+  RAD1DeviceTest() : dev(52e6/96), bad(0), zero(0)
+  {
+    dev.m_uRx = new rnrad1Rx;
+    dev.m_uTx = new rnrad1Tx;
+    dev.skipRx = false;
+    dev.samplesRead = dev.samplesWritten = 0;
+  }
+
+  /** Start the device and read, stalling now and then; false on a bad start */
+  bool run(int reads)
+  {
+    if (!dev.start() || !dev.rxThread) {
+      printf("device did not start streaming\n");
+      return false;
+    }
+    dev.updateAlignment(1000);
+
+    TIMESTAMP t = dev.initialReadTimestamp();
+    short buf[2*625];
+    for (int k = 0; k < reads; k++) {
+      bool overrun, underrun;
+      int n = dev.readSamples(buf, 625, &overrun, t, &underrun, NULL);
+      TIMESTAMP want = t + dev.timestampOffset;
+      for (int i = 0; i < n; i++) {
+        if (buf[2*i] == 0 && buf[2*i+1] == 0) {
+          zero++;
+          continue;
+        }
+        if ((unsigned short) buf[2*i] != ((want + i) & 0x7fff))
+          bad++;
+      }
+      t += n;
+      if (k % 500 == 250)
+        usleep(100000);
+    }
+
+    printf("bad %u zero %u offset %lld ring overruns %u late %u max buffered %u max wait %.0f us\n",
+           bad, zero, (long long) dev.timestampOffset, dev.ringOverruns,
+           dev.latePackets, dev.maxBuffered, dev.maxWait * 1e6);
+    return true;
+  }
+
+  /** Stop the device; the stream thread must be gone */
+  bool stop()
+  {
+    dev.stop();
+    if (dev.rxThread || dev.rxRunning) {
+      printf("stream thread still running after stop\n");
+      return false;
+    }
+    return true;
+  }
+
+  bool clean() const { return bad == 0; }
+};
+
+int main(int argc, char **argv)
+{
+  RAD1DeviceTest test;
+
+  if (!test.run(3000) || !test.stop())
+    return 1;
+
+  // A second start must bring the stream thread back
+  if (!test.run(1000) || !test.stop())
+    return 1;
+
+  bool ok = test.clean();
+  printf(ok ? "PASSED\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -41,7 +41,8 @@ class rnrad1Rx : public rnrad1Core
   rnrad1Rx (int whichBoard,
 	    unsigned int wDecimRate,
 	    const std::string fpgaFilename,
-	    const std::string firmwareFilename);
+	    const std::string firmwareFilename,
+	    int wNumBlocks);
 
   bool writeHwMuxReg();
   bool enable(bool on);
@@ -54,10 +55,12 @@ public:
 
   ~rnrad1Rx ();
 
+  /** numBlocks is the number of USB transfers kept in flight, 0 for the default */
   static rnrad1Rx* make(int whichBoard,
 			unsigned int wDecimRate,
 			const std::string fpgaFilename,
-			const std::string firmwareFilename);
+			const std::string firmwareFilename,
+			int numBlocks);
 
   bool setDecimRate (unsigned int rate);
 
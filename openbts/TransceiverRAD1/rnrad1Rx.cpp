@@ -19,7 +19,8 @@ using namespace ad9862;
 rnrad1Rx::rnrad1Rx (int whichBoard,
 		    unsigned int wDecimRate,
 		    const std::string fpgaFilename = "",
-		    const std::string firmwareFilename = "")
+		    const std::string firmwareFilename = "",
+		    int wNumBlocks = 0)
   : rnrad1Core(whichBoard,RAD1_RX_INTERFACE,RAD1_RX_ALTINTERFACE,fpgaFilename,firmwareFilename,false)
 {
 
@@ -56,7 +57,7 @@ rnrad1Rx::rnrad1Rx (int whichBoard,
 
   // check fusb buffering parameters
   int blockSize = 4096; //fusb::default_block_size();
-  int numBlocks = 128; //std::max (1, fusb::default_buffer_size() / blockSize);
+  int numBlocks = wNumBlocks ? wNumBlocks : 128; //std::max (1, fusb::default_buffer_size() / blockSize);
 
   mDevHandle = fusb::make_devhandle (getHandle(), getContext());
   mEndptHandle = mDevHandle->make_ephandle (RAD1_RX_ENDPOINT, true,
@@ -113,13 +114,15 @@ bool rnrad1Rx::setRxFreq (double freq)
 rnrad1Rx *rnrad1Rx::make(int whichBoard,
 			 unsigned int wDecimRate,
 			 const std::string fpgaFilename = "",
-			 const std::string firmwareFilename = "")
+			 const std::string firmwareFilename = "",
+			 int numBlocks = 0)
 {
   try {
     rnrad1Rx *u = new rnrad1Rx(whichBoard,
 			       wDecimRate,
 			       fpgaFilename,
-			       firmwareFilename);
+			       firmwareFilename,
+			       numBlocks);
     return u;
   }
   catch (...) {
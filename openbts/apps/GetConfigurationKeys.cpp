@@ -174,6 +174,10 @@ static void makeHandoverKeys(ConfigurationKeyMap &map)
 	HandoverKey(map, "RXLEV_DL.History", 6, "periods", "2:32",  History_Help);
 	HandoverKey(map, "RXLEV_DL.Margin",   10, "dB", "0:100", RXLEV_Help);
 	HandoverKey(map, "RXLEV_DL.PenaltyTime",  20, "seconds", "0:99999", PenaltyTime_Help);
+	HandoverKey(map, "Prepare.Margin", 0, "dB", "0:100",
+		"Ask the target BTS to reserve a channel for a handover once RXDIFF is within this many dB of GSM.Handover.Margin, "
+		"so the handover does not wait for a channel allocation.  Only neighbors that take binary peering messages are asked.  "
+		"0, the default, disables.");
 
 }
 
@@ -1843,6 +1847,30 @@ ConfigurationKeyMap getConfigurationKeys()
 	}
 
 
+	{ ConfigurationKey tmp("GSM.Executor.CPUAffinity","0",
+		"",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::BOOLEAN,
+		"",
+		true,
+		"1 to pin each channel executor thread to its own CPU."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
+	{ ConfigurationKey tmp("GSM.Executor.Threads","0",
+		"threads",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"0:16",
+		true,
+		"Number of threads that run the periodic channel service tasks.  "
+			"Channels are assigned to threads by ARFCN.  "
+			"0 means one thread per ARFCN, see GSM.Radio.ARFCNs."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
 	{ ConfigurationKey tmp("GSM.Timer.Handover.Holdoff","10",
 		"seconds",
 		ConfigurationKey::CUSTOMERTUNE,
@@ -2013,6 +2041,7 @@ ConfigurationKeyMap getConfigurationKeys()
 			"One symbol period of round-trip delay is about 0.55 km of distance.  "
 			"Ignore RACH bursts with delays greater than this.  "
 			"Can be used to limit service range.  "
+			"The transceiver searches for RACH bursts up to this delay; it reads this at startup.  "
 			"Valid range is 1..62."
 	);
 	map[tmp.getName()] = tmp;
@@ -2344,7 +2373,8 @@ ConfigurationKeyMap getConfigurationKeys()
 		"Expected worst-case delay spread in symbol periods, roughly 3.7 us or 1.1 km per unit.  "
 			"This parameter is dependent on the terrain type in the installation area.  "
 			"Typical values are: 1 for open terrain and small coverage areas, a value of 4 is strongly recommended for large coverage areas.  "
-			"This parameter has a large effect on computational requirements of the software radio; values greater than 4 should be avoided."
+			"This parameter has a large effect on computational requirements of the software radio; values greater than 4 should be avoided.  "
+			"It does not limit the RACH search, which covers GSM.MS.TA.Max."
 	);
 	map[tmp.getName()] = tmp;
 	}
@@ -2605,6 +2635,19 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp.getName()] = tmp;
 	}
 
+	{ ConfigurationKey tmp("Peering.Binary","0",
+		"",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::BOOLEAN,
+		"",
+		false,
+		"Send handover messages to neighbors that support it in the compact binary format, "
+			"with sequence numbers and a retransmit timer, instead of text.  "
+			"This BTS also advertises the binary format to its neighbors only if this is set."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
 	{ ConfigurationKey tmp("Peering.Neighbor.RefreshAge","60",
 		"seconds",
 		ConfigurationKey::CUSTOMERTUNE,
@@ -2663,6 +2706,31 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp.getName()] = tmp;
 	}
 
+	{ ConfigurationKey tmp("RTP.Engine","0",
+		"",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::BOOLEAN,
+		"",
+		false,
+		"Carry speech on the built-in RTP engine, which serves all calls from a few epoll threads, instead of the RTP library.  "
+			"The engine does not send RTCP.  "
+			"Affects calls started after the change; the engine threads themselves are started only if this is on at startup."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
+	{ ConfigurationKey tmp("RTP.Engine.Threads","1",
+		"threads",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"1:8",
+		true,
+		"Number of RTP engine threads.  Each thread serves up to a few hundred calls; "
+			"use more only on a multi-core machine with many TRX."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
 	{ ConfigurationKey tmp("RTP.Range","98",
 		"ports",
 		ConfigurationKey::CUSTOMERTUNE,
@@ -3026,6 +3094,32 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp.getName()] = tmp;
 	}
 
+	{ ConfigurationKey tmp("SMS.MT.Linger","0",
+		"seconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:10",
+		false,
+		"Seconds to hold the channel open after a mobile-terminated SMS in case another one arrives for the same handset, "
+			"so a backlog from the SMSC is delivered on one channel instead of paging for each message.  "
+			"Zero, the default, releases the channel as soon as the last transaction ends."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
+	{ ConfigurationKey tmp("TRX.Equalizer","0",
+		"",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::BOOLEAN,
+		"",
+		true,
+		"1 to equalize uplink bursts on timeslots where multipath delay spread is detected.  "
+			"Channel estimates are refreshed periodically on every timeslot, and only the timeslots that need it pay for equalization.  "
+			"Only TCH/F and TCH/H with one subchannel are equalized, since the other channel types share a timeslot between handsets."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
 	{ ConfigurationKey tmp("TRX.IP","127.0.0.1",
 		"",
 		ConfigurationKey::CUSTOMERWARN,
@@ -3078,6 +3172,20 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp.getName()] = tmp;
 	}
 
+	{ ConfigurationKey tmp("TRX.RxThreads","1",
+		"",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::CHOICE,
+		"0,1,2,4,8",
+		true,
+		"Number of threads that demodulate uplink bursts for each ARFCN.  "
+			"Timeslots are dealt out to the threads by timeslot number.  "
+			"1, the default, demodulates inline on the thread that services the radio.  "
+			"0 picks a number to suit the processor cores available."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
 	{ ConfigurationKey tmp("TRX.Timeout.Clock","10",
 		"seconds",
 		ConfigurationKey::DEVELOPER,
@@ -3089,6 +3197,17 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp.getName()] = tmp;
 	}
 
+	{ ConfigurationKey tmp("TRX.Timeout.Ready","30",
+		"seconds",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"5:120",
+		false,
+		"How long to keep probing a newly started Transceiver during system startup before giving up and continuing anyway."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
 	// unused?
 	{ ConfigurationKey tmp("TRX.Timeout.Start","2",
 		"seconds",
@@ -3115,6 +3234,18 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp.getName()] = tmp;
 	}
 
+	{ ConfigurationKey tmp("TRX.USBTransfers","128",
+		"",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"16:512",
+		true,
+		"Number of 4 KB USB receive transfers the RAD1 transceiver keeps in flight.  "
+			"More transfers ride out longer scheduling delays before the radio overruns, at the cost of memory."
+	);
+	map[tmp.getName()] = tmp;
+	}
+
 #if 0
 	//kurtis
 	// (pat 3-2014) Removed.  This is a great idea that cannot work yet in the transceiver because of the order of initialization
@@ -3200,6 +3331,7 @@ void OpenBTSConfig::configUpdateKeys()
 	SAVE_NUMERIC_KEY(GSM.Handover.Ny1);
 
 	SAVE_NUMERIC_KEY(GSM.Handover.History.Max);
+	SAVE_NUMERIC_KEY(GSM.Handover.Prepare.Margin);
 	//not implemented: SAVE_NUMERIC_KEY(GSM.Handover.Penalty.Damping);
 
 	SAVE_NUMERIC_KEY(GSM.Handover.RXLEV_DL.Target);
@@ -3214,6 +3346,10 @@ void OpenBTSConfig::configUpdateKeys()
 	SAVE_NUMERIC_KEY(GSM.MS.TA.Damping);
 	SAVE_NUMERIC_KEY(GSM.MS.TA.Max);
 
+	SAVE_NUMERIC_KEY(GSM.Radio.RSSITarget);
+	SAVE_NUMERIC_KEY(GSM.Radio.RSSIAveragePeriod);
+	SAVE_NUMERIC_KEY(GSM.Radio.SNRTarget);
+
 	SAVE_NUMERIC_KEY(GSM.Timer.T3103);
 	SAVE_NUMERIC_KEY(GSM.Timer.T3105);
 	SAVE_NUMERIC_KEY(GSM.Timer.T3109);
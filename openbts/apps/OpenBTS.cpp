@@ -20,6 +20,7 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <stdexcept>
 #include <config.h>	// For VERSION
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -190,6 +191,163 @@ void startTransceiver()
 
 
 
+/**
+	Startup is split into phases that each run in their own thread as soon as the phases they depend on are done,
+	so subsystems that do not depend on each other (the transceiver, the sqlite tables, the SIP interface)
+	come up concurrently.  The elapsed time of each phase is logged so we can see where restart time goes.
+*/
+class StartupPlan {
+	struct Phase {
+		StartupPlan *mPlan;
+		const char *mName;
+		void (*mFunc)();
+		std::vector<unsigned> mDeps;
+		bool mStarted, mDone;
+		Timeval mStartTime;
+		long mElapsed;		///< ms
+		Thread mThread;
+		Phase() : mPlan(NULL), mName(NULL), mFunc(NULL), mStarted(false), mDone(false), mElapsed(0) {}
+	};
+	std::vector<Phase*> mPhases;
+	Mutex mLock;
+	Signal mPhaseDone;
+	std::string mFailedKey;		///< Set if a phase threw ConfigurationTableKeyNotFound.
+	const char *mFailedPhase;	///< Set if a phase threw anything; no more phases are started after that.
+
+	static void *phaseRunner(Phase *phase);
+	bool depsDone(const Phase *phase) const;
+
+	public:
+	StartupPlan() : mFailedPhase(NULL) {}
+	~StartupPlan() { for (unsigned i = 0; i < mPhases.size(); i++) { delete mPhases[i]; } }
+
+	/** Add a phase and return its index for use as a dependency of later phases. */
+	unsigned addPhase(const char *name, void (*func)(), int dep1 = -1, int dep2 = -1);
+
+	/** Run all phases and return when they are all done. */
+	void run();
+};
+
+
+unsigned StartupPlan::addPhase(const char *name, void (*func)(), int dep1, int dep2)
+{
+	Phase *phase = new Phase;
+	phase->mPlan = this;
+	phase->mName = name;
+	phase->mFunc = func;
+	if (dep1 >= 0) { phase->mDeps.push_back(dep1); }
+	if (dep2 >= 0) { phase->mDeps.push_back(dep2); }
+	mPhases.push_back(phase);
+	return mPhases.size() - 1;
+}
+
+
+bool StartupPlan::depsDone(const Phase *phase) const
+{
+	for (unsigned i = 0; i < phase->mDeps.size(); i++) {
+		if (!mPhases[phase->mDeps[i]]->mDone) { return false; }
+	}
+	return true;
+}
+
+
+void *StartupPlan::phaseRunner(Phase *phase)
+{
+	StartupPlan *plan = phase->mPlan;
+	std::string failedKey;
+	bool failed = true;
+	try {
+		phase->mFunc();
+		failed = false;
+	} catch (ConfigurationTableKeyNotFound e) {
+		failedKey = e.key();
+		LOG(EMERG) << "startup phase " << phase->mName << " failed: required configuration parameter " << e.key() << " not defined";
+	} catch (exception &e) {
+		LOG(EMERG) << "startup phase " << phase->mName << " failed: C++ standard exception: " << e.what();
+	} catch (...) {
+		LOG(EMERG) << "startup phase " << phase->mName << " failed: unrecognized C++ exception";
+	}
+	ScopedLock lock(plan->mLock);
+	phase->mElapsed = phase->mStartTime.elapsed();
+	phase->mDone = true;
+	if (failedKey.size()) { plan->mFailedKey = failedKey; }
+	if (failed && !plan->mFailedPhase) { plan->mFailedPhase = phase->mName; }
+	plan->mPhaseDone.broadcast();
+	return NULL;
+}
+
+
+void StartupPlan::run()
+{
+	Timeval planStart;
+	ScopedLock lock(mLock);
+	while (true) {
+		// After a failure let the running phases finish but start no more.
+		if (!mFailedPhase) {
+			for (unsigned i = 0; i < mPhases.size(); i++) {
+				Phase *phase = mPhases[i];
+				if (phase->mStarted || !depsDone(phase)) { continue; }
+				phase->mStarted = true;
+				phase->mStartTime.now();
+				phase->mThread.start((void*(*)(void*))phaseRunner,phase);
+			}
+		}
+		unsigned running = 0;
+		for (unsigned i = 0; i < mPhases.size(); i++) {
+			if (mPhases[i]->mStarted && !mPhases[i]->mDone) { running++; }
+		}
+		if (running == 0) { break; }
+		mPhaseDone.wait(mLock);
+	}
+	for (unsigned i = 0; i < mPhases.size(); i++) {
+		if (!mPhases[i]->mStarted) {
+			LOG(NOTICE) << "startup phase " << mPhases[i]->mName << " not run";
+			continue;
+		}
+		mPhases[i]->mThread.join();
+		LOG(NOTICE) << "startup phase " << mPhases[i]->mName << " took " << mPhases[i]->mElapsed << " ms";
+	}
+	LOG(NOTICE) << "startup phases took " << planStart.elapsed() << " ms total";
+	if (mFailedKey.size()) { throw ConfigurationTableKeyNotFound(mFailedKey); }
+	if (mFailedPhase) { throw runtime_error(string("startup phase ") + mFailedPhase + " failed"); }
+}
+
+
+static Thread transceiverThread;
+
+static void startupTransceiver()
+{
+	// (pat 3-16-2014) If there are multiple instances of OpenBTS running, dont go talking to some random transceiver.
+	// (pat) We dont - we talk to the transceiver on the specified port.
+	// is the radio running?
+	LOG(INFO) << "checking transceiver";
+	bool haveTRX = gTRX.ARFCN(0)->trxWaitReady(500);
+	if (haveTRX) {
+		LOG(NOTICE) << "transceiver already running";
+		return;
+	}
+	//LOG(ALERT) << "starting the transceiver";
+	transceiverThread.start((void*(*)(void*)) startTransceiver, NULL);
+	// Ping the radio until it answers instead of sleeping while the FPGA code loads.
+	if (!gTRX.ARFCN(0)->trxWaitReady(1000*gConfig.getNum("TRX.Timeout.Ready"))) {
+		LOG(ALERT) << "transceiver did not respond within TRX.Timeout.Ready";
+	}
+}
+
+static void startupNeighbors()
+{
+	gNeighborTable.NeighborTableInit(
+		gConfig.getStr("Peering.NeighborTable.Path").c_str());
+}
+
+static void startupControl() { Control::controlInit(); }		// init Layer3: TMSITable, TransactionTable.
+static void startupPhysStatus() { gPhysStatus.open(gConfig.getStr("Control.Reporting.PhysStatusTable").c_str()); }
+static void startupGSM() { gBTS.gsmInit(); }
+static void startupSIP() { SIP::SIPInterfaceStart(); }
+static void startupPeering() { gPeerInterface.start(); }
+
+
+
 void createStats()
 {
 	// count of OpenBTS start events
@@ -312,6 +470,9 @@ void createStats()
 	//gReports.create("OpenBTS.GSM.RR.Handover.Outbound.Success");
 	// histogram of timing advance for accepted RACH bursts
 	gReports.create("OpenBTS.GSM.RR.RACH.TA.Accepted",0,63);
+	// histograms of timing advance and RA for all RACH bursts
+	gReports.create("OpenBTS.GSM.RR.RACH.TA.All",0,63);
+	gReports.create("OpenBTS.GSM.RR.RACH.RA.All",0,255);
 
 	//gReports.create("Transceiver.StaleBurst");
 	//gReports.create("Transceiver.Command.Received");
@@ -331,6 +492,16 @@ void createStats()
 	// (pat) 1-2014 Added RTP thread performance reporting.
 	gReports.create("OpenBTS.RTP.AverageSlack");	// Average head room.
 	gReports.create("OpenBTS.RTP.MinSlack");	// Minimum slack.  Negative is a whoops.
+
+	// Latency histograms, see ReportHistogram.
+	// time from the last burst of an SDCCH or SACCH block to the L2 frame
+	gReports.createHistogram("OpenBTS.GSM.L1.BurstToL2Usecs");
+	// time from transaction start to call connect, for MOC and MTC
+	gReports.createHistogram("OpenBTS.GSM.CC.SetupMsecs");
+	// time from the arrival of a MT-SMS to the RP-ACK from the handset
+	gReports.createHistogram("OpenBTS.GSM.SMS.MTSMS.DeliveryMsecs");
+	// time from sending REQ HANDOVER to the neighbor's RSP HANDOVER
+	gReports.createHistogram("OpenBTS.GSM.RR.Handover.PreparationMsecs");
 }
 
 
@@ -569,6 +740,7 @@ struct TimeSlots {
 int main(int argc, char *argv[])
 {
 	//mtrace();       // (pat) Enable memory leak detection.  Unfortunately, huge amounts of code have been started in the constructors above.
+	Timeval startupTime;
 	gLogGroup.setAll();
 	processArgs(argc, argv);
 
@@ -583,9 +755,6 @@ int main(int argc, char *argv[])
 
 	gReports.incr("OpenBTS.Starts");
 
-	gNeighborTable.NeighborTableInit(
-		gConfig.getStr("Peering.NeighborTable.Path").c_str());
-
 
 	try {
 
@@ -596,42 +765,21 @@ int main(int argc, char *argv[])
 	LOG(ALERT) << "OpenBTS reading config file "<<cOpenBTSConfigFile;
 
 	COUT("\n\n" << gOpenBTSWelcome << "\n");
-	Control::controlInit();		// init Layer3: TMSITable, TransactionTable.
-	gPhysStatus.open(gConfig.getStr("Control.Reporting.PhysStatusTable").c_str());
-	gBTS.gsmInit();
-	gParser.addCommands();
-
 	COUT("\nStarting the system...");
 
-	// (pat 3-16-2014) If there are multiple instances of OpenBTS running, dont go talking to some random transceiver.
-	// (pat) We dont - we talk to the transceiver on the specified port.
-	bool haveTRX = false;
-	//if (! bAllowMultipleInstances) {
-		// is the radio running?
-		// Start the transceiver interface.
-		LOG(INFO) << "checking transceiver";
-		//gTRX.ARFCN(0)->powerOn();
-		//sleep(gConfig.getNum("TRX.Timeout.Start"));
-		//bool haveTRX = gTRX.ARFCN(0)->powerOn(false);		This prints an inapplicable warning message.
-		haveTRX = gTRX.ARFCN(0)->trxRunning();			// This does not print an inapplicable warning message.
-	//}
-
-	Thread transceiverThread;
-	if (!haveTRX) {
-		//LOG(ALERT) << "starting the transceiver";
-		transceiverThread.start((void*(*)(void*)) startTransceiver, NULL);
-		// sleep to let the FPGA code load
-		// TODO: we should be "pinging" the radio instead of sleeping
-		sleep(5);
-	} else {
-		LOG(NOTICE) << "transceiver already running";
+	{
+		// The beacon is built from the neighbor list, and the SIP interface needs the transaction table.
+		StartupPlan plan;
+		plan.addPhase("transceiver",startupTransceiver);
+		unsigned neighbors = plan.addPhase("neighbors",startupNeighbors);
+		unsigned control = plan.addPhase("control",startupControl);
+		plan.addPhase("physstatus",startupPhysStatus);
+		unsigned gsm = plan.addPhase("gsm",startupGSM,neighbors);
+		plan.addPhase("sip",startupSIP,control);
+		plan.addPhase("peering",startupPeering,neighbors,gsm);
+		plan.run();
 	}
-
-	// Start the SIP interface.
-	SIP::SIPInterfaceStart();
-
-	// Start the peer interface
-	gPeerInterface.start();
+	gParser.addCommands();
 
 	// Sync factory calibration as defaults from radio EEPROM
 	signed sdrsn = gTRX.ARFCN(0)->getFactoryCalibration("sdrsn");
@@ -798,7 +946,7 @@ int main(int argc, char *argv[])
 	gBTS.gsmStart();
 
 
-	LOG(INFO) << "system ready";
+	LOG(NOTICE) << "system ready after " << startupTime.elapsed() << " ms";
 
 	gNodeManager.setAppLogicHandler(&nmHandler);
 	gNodeManager.start(gConfig.getNum("NodeManager.Commands.Port"), gConfig.getNum("NodeManager.Events.Port"));
@@ -320,6 +320,41 @@ static void oops(const char *fmt, ...)
 	exit(1);
 }
 
+// Print the response to a "stream" command: <len>data chunks as the server produces them, ended by a zero length.
+// There is no limit on the total size, since no chunk is kept after it is printed.
+static bool readStream(int fd)
+{
+	while (true) {
+		int len;
+		int nread = recv(fd, &len, sizeof(len), MSG_WAITALL);
+		if (nread < 0) {
+			perror("receiving stream");
+			return false;
+		}
+		if (nread != (int) sizeof(len)) {
+			printf("Remote connection closed\n");
+			exit(1);
+		}
+		len = ntohl(len);
+		if (len == 0) { return true; }
+		if (len >= bufsz-1) {
+			printf("Chunk of %d bytes is too long\n", len);
+			exit(1);
+		}
+		nread = recv(fd, resbuf, len, MSG_WAITALL);
+		if (nread < 0) {
+			perror("receiving stream");
+			return false;
+		}
+		if (nread != len) {
+			printf("Remote connection closed\n");
+			exit(1);
+		}
+		fwrite(resbuf, 1, len, stdout);
+		fflush(stdout);
+	}
+}
+
 bool doCmd(int fd, char *cmd) // return false to abort/exit
 {
 	int nread = 0;
@@ -336,6 +371,7 @@ bool doCmd(int fd, char *cmd) // return false to abort/exit
 		perror("sending stream");
 		return false;
 	}
+	if (strncmp("stream ", cmd, 7) == 0) { return readStream(fd); }
 	nread = recv(fd, &len, sizeof(len), 0);
 	if (nread < 0) {
 		perror("receiving stream");
@@ -40,6 +40,7 @@ class OpenBTSConfig : public ConfigurationTable {
 
 			struct History { int Max; } History;
 			struct Noise { int Factor; } Noise;
+			struct Prepare { int Margin; } Prepare;
 
 			struct RXLEV_DL { float Target; int History, Margin, PenaltyTime; } RXLEV_DL;
 		} Handover;
@@ -47,6 +48,9 @@ class OpenBTSConfig : public ConfigurationTable {
 			struct Power { int Min, Max, Damping; } Power;
 			struct TA { int Damping, Max; } TA;
 		} MS;
+		struct {
+			int RSSITarget, RSSIAveragePeriod, SNRTarget;
+		} Radio;
 		struct {
 			int T3103, T3105, T3109, T3113, T3212;
 		} Timer;
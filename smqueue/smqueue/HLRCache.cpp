@@ -0,0 +1,276 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribuion.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/*
+ * HLRCache.cpp - In-process cache of subscriber registry lookups.
+ */
+
+#include "HLRCache.h"
+
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+
+#include <Configuration.h>
+#include <Logger.h>
+
+using namespace std;
+using namespace SMqueue;
+
+extern ConfigurationTable gConfig;
+
+/* How often to stat the registry database for changes, and to throw out
+   expired entries, in seconds.  */
+#define HLRCACHE_CHECK_SECS	1
+#define HLRCACHE_SWEEP_SECS	60
+
+HLRCache::HLRCache(SubscriberRegistry &hlr)
+	: mHLR(hlr),
+	  mHits(0), mNegativeHits(0), mMisses(0), mFlushes(0), mRegistryChanges(0),
+	  mLastCheck(0), mLastSweep(0),
+	  mDBTime(0), mWALTime(0), mDBSize(0), mWALSize(0)
+{
+}
+
+char *HLRCache::getIMSI2(const char *ISDN)
+{
+	return lookup(QueryIMSI, ISDN);
+}
+
+char *HLRCache::getCLIDLocal(const char *IMSI)
+{
+	return lookup(QueryCLIDLocal, IMSI);
+}
+
+char *HLRCache::mapCLIDGlobal(const char *local)
+{
+	return lookup(QueryCLIDGlobal, local);
+}
+
+char *HLRCache::getRegistrationIP(const char *IMSI)
+{
+	return lookup(QueryRegistrationIP, IMSI);
+}
+
+char *HLRCache::getIMSI2Fresh(const char *ISDN)
+{
+	return fresh(QueryIMSI, ISDN);
+}
+
+char *HLRCache::getCLIDLocalFresh(const char *IMSI)
+{
+	return fresh(QueryCLIDLocal, IMSI);
+}
+
+time_t HLRCache::getRegTimeFresh(const char *IMSI)
+{
+	if (IMSI == NULL || *IMSI == '\0')
+		return 0;
+	ScopedLock lock(mLock);
+	string regTime = mHLR.imsiGet(IMSI, "regTime");
+	return strtol(regTime.c_str(), NULL, 10);
+}
+
+unsigned HLRCache::registryChanges()
+{
+	ScopedLock lock(mLock);
+	checkRegistry(time(NULL));
+	return mRegistryChanges;
+}
+
+SubscriberRegistry::Status HLRCache::addUser(const char *IMSI, const char *CLID)
+{
+	SubscriberRegistry::Status status;
+	{
+		ScopedLock lock(mLock);
+		status = mHLR.addUser(IMSI, CLID);
+	}
+	invalidate(IMSI);
+	return status;
+}
+
+/* Ask the registry itself, under the lock.  */
+char *HLRCache::fresh(Query q, const char *key)
+{
+	ScopedLock lock(mLock);
+	return query(q, key);
+}
+
+/* Ask the registry itself.  Caller holds mLock.  */
+char *HLRCache::query(Query q, const char *key)
+{
+	switch (q) {
+	case QueryIMSI:			return mHLR.getIMSI2(key);
+	case QueryCLIDLocal:		return mHLR.getCLIDLocal(key);
+	case QueryCLIDGlobal:		return mHLR.mapCLIDGlobal(key);
+	case QueryRegistrationIP:	return mHLR.getRegistrationIP(key);
+	default:			return NULL;
+	}
+}
+
+char *HLRCache::lookup(Query q, const char *key)
+{
+	if (key == NULL)
+		return query(q, key);	// Let the registry complain about it.
+
+	int ttl = gConfig.getNum("SubscriberRegistry.Cache.TTL");
+	int negativeTTL = gConfig.getNum("SubscriberRegistry.Cache.NegativeTTL");
+	time_t now = time(NULL);
+
+	ScopedLock lock(mLock);
+	if (ttl <= 0) {
+		return query(q, key);
+	}
+
+	checkRegistry(now);
+
+	EntryMap::iterator it = mEntries[q].find(key);
+	if (it != mEntries[q].end() && it->second.expires > now) {
+		if (!it->second.found) {
+			mNegativeHits++;
+			return NULL;
+		}
+		mHits++;
+		return strdup(it->second.value.c_str());
+	}
+
+	mMisses++;
+	char *result = query(q, key);
+	if (result == NULL && negativeTTL <= 0) {
+		if (it != mEntries[q].end())
+			mEntries[q].erase(it);
+		return NULL;
+	}
+
+	Entry &e = mEntries[q][key];
+	e.found = (result != NULL);
+	e.value = result ? result : "";
+	e.expires = now + (result ? ttl : negativeTTL);
+	return result;
+}
+
+/*
+ * The registry is written by other processes (sipauthserve on every
+ * REGISTER, the web and CLI tools) so we can't see the changes directly.
+ * It runs in WAL mode, so a write shows up as a change to the -wal file
+ * first and the database file at checkpoint; either one means our
+ * answers may be stale.
+ */
+void HLRCache::checkRegistry(time_t now)
+{
+	if (now - mLastCheck < HLRCACHE_CHECK_SECS)
+		return;
+	mLastCheck = now;
+
+	string db = gConfig.getStr("SubscriberRegistry.db");
+	string wal = db + "-wal";
+	struct stat dbst, walst;
+	memset(&dbst, 0, sizeof(dbst));
+	memset(&walst, 0, sizeof(walst));
+	stat(db.c_str(), &dbst);
+	stat(wal.c_str(), &walst);
+
+	if (dbst.st_mtime != mDBTime || dbst.st_size != mDBSize
+	    || walst.st_mtime != mWALTime || walst.st_size != mWALSize) {
+		mDBTime = dbst.st_mtime;
+		mDBSize = dbst.st_size;
+		mWALTime = walst.st_mtime;
+		mWALSize = walst.st_size;
+		LOG(DEBUG) << "Subscriber registry changed, flushing cache";
+		mRegistryChanges++;
+		clear();
+		return;
+	}
+
+	if (now - mLastSweep >= HLRCACHE_SWEEP_SECS) {
+		sweep(now);
+	}
+}
+
+/* Throw out expired entries so the cache doesn't grow without bound.  */
+void HLRCache::sweep(time_t now)
+{
+	mLastSweep = now;
+	for (int q = 0; q < QueryMax; q++) {
+		EntryMap::iterator it = mEntries[q].begin();
+		while (it != mEntries[q].end()) {
+			if (it->second.expires <= now)
+				mEntries[q].erase(it++);
+			else
+				++it;
+		}
+	}
+}
+
+/* Caller holds mLock.  */
+void HLRCache::clear()
+{
+	for (int q = 0; q < QueryMax; q++)
+		mEntries[q].clear();
+	mFlushes++;
+}
+
+void HLRCache::flush()
+{
+	ScopedLock lock(mLock);
+	clear();
+}
+
+/* Compare IMSIs with or without the "IMSI" prefix SIP usernames carry.  */
+static const char *imsiDigits(const char *name)
+{
+	if (0 == strncasecmp(name, "imsi", 4))
+		return name + 4;
+	return name;
+}
+
+void HLRCache::invalidate(const char *IMSI)
+{
+	if (IMSI == NULL || *IMSI == '\0')
+		return;
+	const char *digits = imsiDigits(IMSI);
+
+	ScopedLock lock(mLock);
+	for (int q = 0; q < QueryMax; q++) {
+		EntryMap::iterator it = mEntries[q].begin();
+		while (it != mEntries[q].end()) {
+			if (!it->second.found
+			    || 0 == strcmp(digits, imsiDigits(it->first.c_str()))
+			    || 0 == strcmp(digits, imsiDigits(it->second.value.c_str())))
+				mEntries[q].erase(it++);
+			else
+				++it;
+		}
+	}
+	// A new IMSI can change what a phone number maps to globally.
+	mEntries[QueryCLIDGlobal].clear();
+}
+
+string HLRCache::stats()
+{
+	ScopedLock lock(mLock);
+	size_t entries = 0;
+	for (int q = 0; q < QueryMax; q++)
+		entries += mEntries[q].size();
+
+	ostringstream os;
+	os << "HLR cache " << entries << " entries, "
+	   << mHits << " hits, "
+	   << mNegativeHits << " negative hits, "
+	   << mMisses << " misses, "
+	   << mFlushes << " flushes.";
+	return os.str();
+}
@@ -0,0 +1,124 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribuion.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/*
+ * HLRCache.h - In-process cache of the subscriber registry lookups
+ * that smqueue makes for every message it routes.
+ *
+ * Every message costs several sqlite queries (IMSI to number, number to
+ * IMSI, IMSI to cell) and a bulk send repeats the same ones thousands of
+ * times.  Answers, including "not found", are kept for a short time.
+ * The whole cache is dropped when the registry database changes on disk,
+ * which is what happens when a handset registers, and entries for an
+ * IMSI are dropped when a REGISTER for it passes through smqueue.
+ * The changes are counted, so smqueue can tell when to look for handsets
+ * that have come back.
+ */
+
+#ifndef HLRCACHE_H
+#define HLRCACHE_H
+
+#include <sys/types.h>
+#include <time.h>
+#include <map>
+#include <string>
+
+#include <Threads.h>
+#include <SubscriberRegistry.h>
+
+namespace SMqueue {
+
+class HLRCache {
+
+	public:
+
+	HLRCache(SubscriberRegistry &hlr);
+
+	/* These have the same contract as the SubscriberRegistry methods
+	   of the same name: the result is a C string that the caller must
+	   free(), or NULL if there is no answer.  */
+	char *getIMSI2(const char *ISDN);
+	char *getCLIDLocal(const char *IMSI);
+	char *mapCLIDGlobal(const char *local);
+	char *getRegistrationIP(const char *IMSI);
+
+	/* The same, but always asking the registry, for callers that are
+	   waiting for it to change and cannot take a cached answer.  */
+	char *getIMSI2Fresh(const char *ISDN);
+	char *getCLIDLocalFresh(const char *IMSI);
+
+	/* When the subscriber last registered, in seconds since the epoch,
+	   or 0 if we don't know.  Always asks the registry.  */
+	time_t getRegTimeFresh(const char *IMSI);
+
+	/* Look at the registry database now, and return how many times we
+	   have seen it change.  */
+	unsigned registryChanges();
+
+	/* Add a subscriber to the registry, and forget what we knew about it.  */
+	SubscriberRegistry::Status addUser(const char *IMSI, const char *CLID);
+
+	/* Forget everything about one subscriber, and every "not found".  */
+	void invalidate(const char *IMSI);
+
+	/* Forget everything.  */
+	void flush();
+
+	/* One line of counters for the debug shortcodes.  */
+	std::string stats();
+
+	private:
+
+	enum Query {
+		QueryIMSI,		// getIMSI2
+		QueryCLIDLocal,		// getCLIDLocal
+		QueryCLIDGlobal,	// mapCLIDGlobal
+		QueryRegistrationIP,	// getRegistrationIP
+		QueryMax
+	};
+
+	struct Entry {
+		bool found;
+		std::string value;
+		time_t expires;
+	};
+	typedef std::map<std::string, Entry> EntryMap;
+
+	SubscriberRegistry &mHLR;
+	Mutex mLock;			// Also serializes use of the registry's sqlite handle.
+	EntryMap mEntries[QueryMax];
+
+	unsigned mHits;
+	unsigned mNegativeHits;
+	unsigned mMisses;
+	unsigned mFlushes;
+	unsigned mRegistryChanges;
+
+	time_t mLastCheck;		// When we last looked at the database files.
+	time_t mLastSweep;		// When we last threw out expired entries.
+	time_t mDBTime, mWALTime;	// Modification times of the database and its write-ahead log.
+	off_t mDBSize, mWALSize;
+
+	char *lookup(Query q, const char *key);
+	char *fresh(Query q, const char *key);
+	char *query(Query q, const char *key);
+	void checkRegistry(time_t now);
+	void sweep(time_t now);
+	void clear();
+};
+
+} // namespace SMqueue
+
+#endif
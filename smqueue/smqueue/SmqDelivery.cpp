@@ -0,0 +1,293 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribuion.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/*
+ * SmqDelivery.cpp
+ *
+ * Delivery lanes; see SmqDelivery.h.
+ */
+
+#include <string.h>
+#include <sstream>
+
+#include "smqueue.h"
+#include "smsc.h"
+#include "SmqDelivery.h"
+
+#include <Configuration.h>
+#include <Logger.h>
+
+using namespace std;
+using namespace SMqueue;
+
+extern ConfigurationTable gConfig;
+
+SmqDelivery *smqDelivery;
+
+/* How long an idle lane sleeps before checking for shutdown, ms.  */
+#define LANE_IDLE_MS	1000
+
+
+SmqHistogram::SmqHistogram(const char *name)
+	: mName(name), mCount(0), mMax(0)
+{
+	memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+/* Bucket 0 is under 1ms, bucket n is [2^(n-1), 2^n) ms.  */
+void SmqHistogram::sample(unsigned long ms)
+{
+	unsigned b = 0;
+	while (b < NumBuckets - 1 && (1UL << b) <= ms)
+		b++;
+	mBuckets[b]++;
+	mCount++;
+	if (ms > mMax)
+		mMax = ms;
+}
+
+/* Upper edge of the bucket holding the given percentile.  */
+unsigned long SmqHistogram::percentile(unsigned pct) const
+{
+	unsigned long want = (mCount * pct + 99) / 100;
+	unsigned long seen = 0;
+	for (unsigned b = 0; b < NumBuckets; b++) {
+		seen += mBuckets[b];
+		if (seen >= want)
+			return b == NumBuckets - 1 ? mMax : (1UL << b);
+	}
+	return mMax;
+}
+
+string SmqHistogram::text() const
+{
+	ostringstream os;
+	os << mName << " n=" << mCount;
+	if (mCount) {
+		os << " p50<" << percentile(50) << "ms"
+		   << " p99<" << percentile(99) << "ms"
+		   << " max=" << mMax << "ms";
+	}
+	return os.str();
+}
+
+
+SmqDelivery::SmqDelivery(unsigned numLanes)
+	: mStopped(false), mQueueWait("wait"), mSend("send"), mDelivery("deliver"),
+	  mDispatched(0)
+{
+	if (numLanes == 0)
+		numLanes = 1;
+	LOG(INFO) << "Starting " << numLanes << " delivery lanes";
+	for (unsigned i = 0; i < numLanes; i++) {
+		Lane *lane = new Lane;
+		lane->owner = this;
+		lane->index = i;
+		mLanes.push_back(lane);
+		pthread_create(&lane->thread, NULL, LaneThread, (void*) lane);
+	}
+}
+
+SmqDelivery::~SmqDelivery()
+{
+	stop();
+	for (unsigned i = 0; i < mLanes.size(); i++)
+		delete mLanes[i];
+}
+
+void SmqDelivery::stop()
+{
+	if (mStopped)
+		return;
+	mStopped = true;
+	for (unsigned i = 0; i < mLanes.size(); i++) {
+		mLanes[i]->ready.signal();
+		pthread_join(mLanes[i]->thread, NULL);
+	}
+}
+
+void SmqDelivery::drain()
+{
+	time_t now = msgettime();
+	for (unsigned i = 0; i < mLanes.size(); i++) {
+		Lane *lane = mLanes[i];
+		ScopedLock lock(lane->lock);
+		while (!lane->msgs.empty()) {
+			short_msg_p_list::iterator qmsg = lane->msgs.begin();
+			smq.time_sorted_list.splice(smq.time_sorted_list.begin(), lane->msgs, qmsg);
+			qmsg->retries--;		// Dispatch counted an attempt that never went out.
+			smq.set_state(qmsg, REQUEST_MSG_DELIVERY, now);
+		}
+		lane->queuedAt.clear();
+	}
+}
+
+/* The cell a message is going to, as host:port from its request URI.  */
+string SmqDelivery::btsOf(short_msg_pending *qmsg)
+{
+	string bts;
+	if (qmsg->parsed && qmsg->parsed->req_uri) {
+		if (qmsg->parsed->req_uri->host)
+			bts = qmsg->parsed->req_uri->host;
+		if (qmsg->parsed->req_uri->port)
+			bts += string(":") + qmsg->parsed->req_uri->port;
+	}
+	return bts;
+}
+
+bool SmqDelivery::mayDispatch(const string &bts, time_t now, time_t &retryAt)
+{
+	time_t spacing = gConfig.getNum("SMS.RateLimit.PerBTS");
+	if (spacing <= 0)
+		return true;
+
+	map<string, time_t>::iterator it = mLastSend.find(bts);
+	if (it != mLastSend.end() && now < it->second + spacing) {
+		retryAt = it->second + spacing;
+		return false;
+	}
+	mLastSend[bts] = now;
+	return true;
+}
+
+void SmqDelivery::dispatch(short_msg_p_list::iterator qmsg)
+{
+	string bts = btsOf(&*qmsg);
+	unsigned long hash = 5381;
+	for (size_t i = 0; i < bts.size(); i++)
+		hash = hash * 33 + (unsigned char) bts[i];
+	Lane *lane = mLanes[hash % mLanes.size()];
+
+	time_t now = msgettime();
+	qmsg->delivery_start = now;
+
+	ScopedLock lock(lane->lock);
+	lane->msgs.splice(lane->msgs.end(), smq.time_sorted_list, qmsg);	// Caller holds the list lock.
+	lane->queuedAt.push_back(now);
+	lane->ready.signal();
+	mDispatched++;
+}
+
+void *SmqDelivery::LaneThread(void *arg)
+{
+	Lane *lane = (Lane*) arg;
+	lane->owner->runLane(lane);
+	return NULL;
+}
+
+void SmqDelivery::runLane(Lane *lane)
+{
+	LOG(DEBUG) << "Start delivery lane " << lane->index;
+	lane->lock.lock();
+	while (!smq.stop_main_loop) {
+		if (lane->msgs.empty()) {
+			lane->ready.wait(lane->lock, LANE_IDLE_MS);
+			continue;
+		}
+		deliver(lane);
+	}
+	lane->lock.unlock();
+	LOG(DEBUG) << "End delivery lane " << lane->index;
+}
+
+/* Send the message at the front of the lane.  Called and returns with the
+   lane locked, but drops the lock while working so dispatch() can go on.
+   The message goes back on the main list, waiting for the cell's answer,
+   before the datagram is sent, so a fast 2xx always finds it there.  */
+void SmqDelivery::deliver(Lane *lane)
+{
+	short_msg_p_list mine;
+	mine.splice(mine.begin(), lane->msgs, lane->msgs.begin());
+	time_t queuedAt = lane->queuedAt.front();
+	lane->queuedAt.pop_front();
+	lane->lock.unlock();
+
+	short_msg_p_list::iterator qmsg = mine.begin();
+	enum sm_state newstate = ASKED_FOR_MSG_DELIVERY;
+	bool send = false;
+	string text, scheme, host, port;
+	time_t start = msgettime();
+
+	if (!pack_sms_for_delivery(qmsg)) {
+		LOG(ERR) << "pack_sms_for_delivery returned non 0";
+		newstate = NO_STATE;
+	} else {
+		qmsg->make_text_valid();
+		LOG(DEBUG) << endl << "--Deliver message:";
+		LOG(DEBUG) << qmsg->text;
+		if (!qmsg->parse()) {
+			LOG(DEBUG) << "Datagram not sent for '" << qmsg->qtag << "'";
+		} else {
+			LOG(INFO) << "Delivering '"
+				  << qmsg->qtag << "' from "
+				  << qmsg->parsed->from->url->username
+				  << " at "
+				  << qmsg->parsed->req_uri->host
+				  << ":" << qmsg->parsed->req_uri->port
+				  << " on lane " << lane->index << ".";
+
+			// Once it is back on the list the writer may answer or
+			// delete it, so send from copies.
+			osip_uri_t *uri = qmsg->parsed->req_uri;
+			text.assign(qmsg->text, qmsg->text_length);
+			scheme = uri->scheme ? uri->scheme : "";
+			host = uri->host ? uri->host : "";
+			port = uri->port ? uri->port : "";
+			send = true;
+		}
+	}
+
+	// Back on the main list; set_state() moves it to its new time.
+	smq.lockSortedList();
+	smq.time_sorted_list.splice(smq.time_sorted_list.begin(), mine);
+	smq.set_state(qmsg, newstate);
+	smq.unlockSortedList();
+
+	// FIXME, if we can't deliver the datagram we
+	// just do the same thing regardless of the result.
+	if (send && !smq.my_network.deliver_datagram(text.data(), text.size(),
+			scheme.empty() ? NULL : scheme.c_str(),
+			host.empty() ? NULL : host.c_str(),
+			port.empty() ? NULL : port.c_str()))
+		LOG(DEBUG) << "Datagram not sent to " << host << ":" << port;
+
+	time_t end = msgettime();
+	{
+		ScopedLock lock(mStatsLock);
+		mQueueWait.sample(start - queuedAt);
+		mSend.sample(end - start);
+	}
+
+	lane->lock.lock();
+}
+
+string SmqDelivery::stats()
+{
+	size_t queued = 0;
+	for (unsigned i = 0; i < mLanes.size(); i++) {
+		ScopedLock lock(mLanes[i]->lock);
+		queued += mLanes[i]->msgs.size();
+	}
+
+	ScopedLock lock(mStatsLock);
+	ostringstream os;
+	os << "Delivery " << mLanes.size() << " lanes, "
+	   << queued << " sending, "
+	   << mDispatched << " sent; "
+	   << mQueueWait.text() << "; "
+	   << mSend.text() << "; "
+	   << mDelivery.text() << ".";
+	return os.str();
+}
@@ -0,0 +1,119 @@
+/*
+* Copyright 2014 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribuion.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+*/
+
+/*
+ * SmqDelivery.h
+ *
+ * Worker threads that put messages on the wire.
+ *
+ * The writer thread still runs the state machine in process_timeout(),
+ * but when a message reaches REQUEST_MSG_DELIVERY it is taken off
+ * time_sorted_list and handed to a delivery lane, which repacks it,
+ * puts it back on the list in ASKED_FOR_MSG_DELIVERY and then sends it.
+ * While a message is in a lane no other thread can see it, so anything
+ * that walks the whole queue, like saving it, must drain() the lanes.
+ *
+ * The lane is picked from the BTS address, so messages for one handset
+ * (and for one cell) go out in queue order, and a cell whose address is
+ * slow to resolve only holds up its own lane.
+ */
+
+#ifndef SMQDELIVERY_H_
+#define SMQDELIVERY_H_
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Threads.h>
+#include "smqueue.h"
+
+/* Latency samples in power-of-two millisecond buckets.  */
+class SmqHistogram {
+public:
+	SmqHistogram(const char *name);
+
+	void sample(unsigned long ms);
+	std::string text() const;
+
+private:
+	enum { NumBuckets = 20 };		// Top bucket is everything over ~9 minutes.
+	const char *mName;
+	unsigned long mBuckets[NumBuckets];
+	unsigned long mCount;
+	unsigned long mMax;
+
+	unsigned long percentile(unsigned pct) const;
+};
+
+class SmqDelivery {
+public:
+	SmqDelivery(unsigned numLanes);
+	~SmqDelivery();
+
+	/* Take a message off time_sorted_list and queue it for sending.
+	   Caller holds the sorted list lock.  */
+	void dispatch(SMqueue::short_msg_p_list::iterator qmsg);
+
+	/* Put every message still waiting in a lane back on time_sorted_list,
+	   due now.  Caller holds the sorted list lock.  */
+	void drain();
+
+	/* Wait for the lanes to exit once smq.stop_main_loop is set.  */
+	void stop();
+
+	/* Per-cell rate limit.  Return true if a message may be sent to
+	   this BTS now; otherwise set when to try again.  */
+	bool mayDispatch(const std::string &bts, time_t now, time_t &retryAt);
+
+	/* The cell answered 2xx; record how long that took.  */
+	void delivered(unsigned long ms) { ScopedLock lock(mStatsLock); mDelivery.sample(ms); }
+
+	/* One line of counters for the debug shortcodes.  */
+	std::string stats();
+
+	static std::string btsOf(SMqueue::short_msg_pending *qmsg);
+
+private:
+	struct Lane {
+		SmqDelivery *owner;
+		unsigned index;
+		pthread_t thread;
+		Mutex lock;
+		Signal ready;
+		SMqueue::short_msg_p_list msgs;		// Owned by the lane until sent.
+		std::deque<time_t> queuedAt;		// When each of msgs was dispatched.
+	};
+
+	std::vector<Lane*> mLanes;
+	bool mStopped;					// Lanes joined.
+	std::map<std::string, time_t> mLastSend;	// Per BTS; writer thread only.
+
+	Mutex mStatsLock;
+	SmqHistogram mQueueWait;			// Dispatch to a worker picking it up.
+	SmqHistogram mSend;				// Repack and send.
+	SmqHistogram mDelivery;				// Dispatch to the cell's 2xx.
+	unsigned long mDispatched;
+
+	static void *LaneThread(void *arg);
+	void runLane(Lane *lane);
+	void deliver(Lane *lane);
+};
+
+extern SmqDelivery *smqDelivery;
+
+#endif /* SMQDELIVERY_H_ */
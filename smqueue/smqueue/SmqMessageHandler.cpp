@@ -28,6 +28,7 @@
 #include "SmqMessageHandler.h"
 #include "SmqReader.h"
 #include "SmqWriter.h"
+#include "SmqDelivery.h"
 
 // Pointers to handlers for the reader and writer queues
 SmqReader* smqReader;
@@ -37,6 +38,7 @@ SmqWriter* smqWriter;
 // Static function to start the threads
 void SmqMessageHandler::StartThreads() {
 	LOG(INFO) << "Start reader and writer threads";
+	smqDelivery = new SmqDelivery(gConfig.getNum("SMS.Delivery.Workers"));
 	smqReader = new SmqReader();
 	smqWriter = new SmqWriter();
 }
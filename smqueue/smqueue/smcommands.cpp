@@ -40,6 +40,7 @@
 #include "smqueue.h"
 #include "smnet.h"
 #include "smsc.h"
+#include "SmqDelivery.h"
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -94,6 +95,8 @@ shortcode_quick_chk (const char *imsi, const char *msgtext,
 	ostringstream answer;
 	
 	answer << scp->scp_smq->time_sorted_list.size() << " queued.";  // No lock okay
+	answer << " " << scp->scp_smq->my_hlr_cache.stats();
+	answer << " " << smqDelivery->stats();
 	scp->scp_reply = new_strdup(answer.str().c_str());
 	return SCA_REPLY;
 }
@@ -164,7 +167,7 @@ shortcode_four_one_one (const char *imsi, const char *msgtext,
 	answer << username;
 
 	answer << ", ";
-	char *newfrom = scp->scp_smq->my_hlr.getCLIDLocal(username);
+	char *newfrom = scp->scp_smq->my_hlr_cache.getCLIDLocal(username);
 	answer << "phonenum " << newfrom;
 
 	time_t now = time(NULL);  // Use real time for logging
@@ -319,7 +322,7 @@ shortcode_register (const char *imsi, const char *msgtext,
    LOG(DEBUG) << "Register IMSI:" << imsi << " phonenum:" << phonenum;
    if (!badnum) {
 
-	existing = smq->my_hlr.getCLIDLocal(imsi);
+	existing = smq->my_hlr_cache.getCLIDLocalFresh(imsi);
 	if (existing) {
 		// There are two ways to get here.  One is to send a
 		// registration shortcode when you've already registered.
@@ -335,7 +338,7 @@ shortcode_register (const char *imsi, const char *msgtext,
 			       << gConfig.getStr("SC.Register.Msg.AlreadyB").c_str(); 
 		}
 	} else {
-		existing = smq->my_hlr.getIMSI2(phonenum);
+		existing = smq->my_hlr_cache.getIMSI2Fresh(phonenum);
 		if (existing) {
 			LOG(DEBUG) << phonenum << " is already in the HLR";
 			answer << gConfig.getStr("SC.Register.Msg.TakenA").c_str()
@@ -346,7 +349,7 @@ shortcode_register (const char *imsi, const char *msgtext,
 			// Neither the IMSI nor the phonenum is in use.
 			// Book 'em, danno!
 
-			did = smq->my_hlr.addUser(imsi, phonenum);
+			did = smq->my_hlr_cache.addUser(imsi, phonenum);
 			switch (did) {
 			case SubscriberRegistry::SUCCESS:
 				// Phone#<->IMSI is set up; now register
@@ -98,8 +98,6 @@ SMnet::send_dgram(char *buffer, size_t buffsize, char *toaddr,
 bool
 SMnet::deliver_msg_datagram(SMqueue::short_msg_pending *smp)
 {
-	char *scheme, *host, *port;
-	int s, i;
 	// Make sure the text is valid before writing it for debug,
 	// or delivering it to a handset.
 	smp->make_text_valid();
@@ -110,16 +108,23 @@ SMnet::deliver_msg_datagram(SMqueue::short_msg_pending *smp)
 	LOG(DEBUG) << endl << "--Deliver message:";
 	LOG(DEBUG) << smp->text;
 
+	/* Get the addressing info (and the SIP msg itself) out of the msg */
+	if (!smp->parse()) return false;
+	return deliver_datagram(smp->text, smp->text_length,
+		smp->parsed->req_uri->scheme, smp->parsed->req_uri->host,
+		smp->parsed->req_uri->port);
+}
+
+bool
+SMnet::deliver_datagram(const char *text, size_t length,
+			const char *scheme, const char *host, const char *port)
+{
+	int s, i;
+
 	// We need to have at least ONE socket open (for sending on).
 	if (!sockets || numsockets == 0)
 		return false;
 
-	/* Get the addressing info (and the SIP msg itself) out of the msg */
-	if (!smp->parse()) return false;
-	scheme = smp->parsed->req_uri->scheme;
-	host   = smp->parsed->req_uri->host;
-	port   = smp->parsed->req_uri->port;
-	
 	struct addrinfo myhints;
 	struct addrinfo *myaddrs, *ap;
 
@@ -130,7 +135,7 @@ SMnet::deliver_msg_datagram(SMqueue::short_msg_pending *smp)
 	myhints.ai_flags = AI_IDN;		// Int'l dom names OK.
 #endif
 	if (!scheme)
-		scheme = (char * const)"sip";
+		scheme = "sip";
 	if (!port)
 		port = scheme;	// More specific port is better
 
@@ -156,7 +161,7 @@ SMnet::deliver_msg_datagram(SMqueue::short_msg_pending *smp)
 			    sockinfo[j].protofam == ap->ai_protocol &&
 			    sockinfo[j].addrlen == ap->ai_addrlen) {
 				i = sendto (sockets[j].fd, 
-					smp->text, smp->text_length,
+					text, length,
 					flags, ap->ai_addr, ap->ai_addrlen);
 				if (i < 0) {
 					break;	// Try another address
@@ -234,6 +234,15 @@ class SMnet {
 	bool
 	deliver_msg_datagram(short_msg_pending *);
 
+	/*
+	 * Send an already packed message to scheme://host:port.
+	 * Same result as deliver_msg_datagram; the caller need not
+	 * hold the message while this resolves the address.
+	 */
+	bool
+	deliver_datagram(const char *text, size_t length,
+			 const char *scheme, const char *host, const char *port);
+
 	/*
  	 * The global name of this host (facing the network).
 	 */
@@ -34,6 +34,7 @@
 #include <fcntl.h>          // open
 #include <ctype.h>		// isdigit
 #include <string>
+#include <vector>
 #include <stdlib.h>
 
 #undef WARNING
@@ -45,6 +46,7 @@
 
 #include "QueuedMsgHdrs.h"
 #include "SmqMessageHandler.h"
+#include "SmqDelivery.h"
 #include "SmqTest.h"
 
 using namespace std;
@@ -377,7 +379,23 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 		if (sent_msg->parsed &&
 		    sent_msg->parsed->sip_method &&
 		    0 == strcmp("MESSAGE", sent_msg->parsed->sip_method)) {
-			sent_msg->write_cdr(my_hlr);
+			sent_msg->write_cdr(my_hlr_cache);
+			if (sent_msg->delivery_start)
+				smqDelivery->delivered(msgettime() - sent_msg->delivery_start);
+		}
+
+		// The handset is reachable right now, so send anything
+		// else we are holding for it along behind this one.
+		if (sent_msg->parsed && sent_msg->parsed->sip_method) {
+			if (0 == strcmp("MESSAGE", sent_msg->parsed->sip_method)
+			    && sent_msg->parsed->req_uri) {
+				release_msgs_for(sent_msg->parsed->req_uri->username);
+			} else if (0 == strcmp("REGISTER", sent_msg->parsed->sip_method)
+			    && sent_msg->parsed->to && sent_msg->parsed->to->url) {
+				// Its number and cell may have just changed.
+				my_hlr_cache.invalidate(sent_msg->parsed->to->url->username);
+				release_msgs_for(sent_msg->parsed->to->url->username);
+			}
 		}
 
 		// Whether a response to a REGISTER or a MESSAGE, delete
@@ -386,9 +404,6 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 		resplist.splice(resplist.begin(),
 				time_sorted_list, sent_msg);
 		resplist.pop_front();	// pop and delete the sent_msg.
-
-		// FIXME, consider breaking loose any other messages for
-		// the same destination now.
 		break;
 
 	case 4: // 4xx -- failure by client
@@ -435,6 +450,96 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 	// when resplist goes out of scope.
 } // handle_response
 
+/*
+ * Messages for a handset that was out of coverage sit in the AWAITING_TRY
+ * states, each on its own retry timer, so without this they would trickle
+ * back to the cell one at a time and each could cost another page and
+ * another SDCCH.  Once we know the handset is back, send them all now;
+ * the cell queues them on the handset and delivers them on one channel.
+ * Messages already ASKED_FOR_MSG_DELIVERY are left alone so we don't
+ * send duplicates while the cell is still working on them.
+ *
+ * A message waiting for delivery is addressed to the IMSI.  One still
+ * waiting for its SIP URL may be addressed to the handset's number, so
+ * those match on either.
+ */
+void
+SMq::release_msgs_for(const char *imsi)
+{
+	std::vector<short_msg_p_list::iterator> batch;
+	short_msg_p_list::iterator x;
+	char *number;
+
+	if (imsi == NULL || *imsi == '\0')
+		return;
+
+	number = my_hlr_cache.getCLIDLocal(imsi);
+
+	lockSortedList();
+	for (x = time_sorted_list.begin(); x != time_sorted_list.end(); x++) {
+		if (x->state != AWAITING_TRY_MSG_DELIVERY
+		    && x->state != AWAITING_TRY_DESTINATION_SIPURL)
+			continue;
+		if (x->parsed == NULL || x->parsed->req_uri == NULL
+		    || x->parsed->req_uri->username == NULL)
+			continue;
+		const char *dest = x->parsed->req_uri->username;
+		if (0 != strcmp(imsi, dest)
+		    && (x->state != AWAITING_TRY_DESTINATION_SIPURL
+			|| number == NULL || 0 != strcmp(number, dest)))
+			continue;
+		batch.push_back(x);
+	}
+
+	// set_state() inserts ahead of messages with the same time, so
+	// walk the batch backwards to keep the original delivery order.
+	time_t now = msgettime();
+	for (size_t i = batch.size(); i-- > 0; ) {
+		x = batch[i];
+		set_state(x, x->state == AWAITING_TRY_MSG_DELIVERY?
+				REQUEST_MSG_DELIVERY: REQUEST_DESTINATION_SIPURL,
+			  now);
+	}
+	unlockSortedList();
+	free(number);
+
+	if (batch.size()) {
+		LOG(INFO) << "Releasing " << batch.size()
+			  << " queued messages for " << imsi;
+	}
+}
+
+void
+SMq::release_msgs_for_registered()
+{
+	std::map<std::string, time_t> waiting;	// IMSI, and when we last tried it.
+	short_msg_p_list::iterator x;
+
+	unsigned changes = my_hlr_cache.registryChanges();
+	if (changes == registry_changes)
+		return;
+	registry_changes = changes;
+
+	lockSortedList();
+	for (x = time_sorted_list.begin(); x != time_sorted_list.end(); x++) {
+		if (x->state != AWAITING_TRY_MSG_DELIVERY || x->parsed == NULL
+		    || x->parsed->req_uri == NULL
+		    || x->parsed->req_uri->username == NULL)
+			continue;
+		time_t &last = waiting[x->parsed->req_uri->username];
+		if (x->delivery_start > last)
+			last = x->delivery_start;
+	}
+	unlockSortedList();
+
+	std::map<std::string, time_t>::iterator it;
+	for (it = waiting.begin(); it != waiting.end(); it++) {
+		time_t regTime = my_hlr_cache.getRegTimeFresh(it->first.c_str());
+		if (regTime && regTime * 1000 > it->second)
+			release_msgs_for(it->first.c_str());
+	}
+}
+
 /*
  * Find a queued message, based on its tag value.  Return an iterator
  * that can be used to remove it from the list if desired.
@@ -934,17 +1039,18 @@ short_msg_pending::check_host_port (char *host, char *port)
 	return true;
 }
 
-void short_msg_pending::write_cdr(SubscriberRegistry& hlr) const
+void short_msg_pending::write_cdr(HLRCache& hlr) const
 {
 	char * from = parsed->from->url->username;
 	char * dest = parsed->to->url->username;
 	time_t now = time(NULL);  // Need real time for CDR
 
 	if (gCDRFile) {
-		char * user = hlr.getIMSI2(from); // I am not a fan of this hlr call here. Probably a decent performance hit...
+		char * user = hlr.getIMSI2(from);	// Cached, so usually no database hit.
 		// source, sourceIMSI, dest, date
-		fprintf(gCDRFile,"%s,%s,%s,%s", from, user, dest, ctime(&now));
+		fprintf(gCDRFile,"%s,%s,%s,%s", from, user ? user : "", dest, ctime(&now));
 		fflush(gCDRFile);
+		free(user);
 	} else {
 		LOG(ALERT) << "CDR file at " << gConfig.getStr("CDRFile").c_str() << " could not be created or opened!";
 	}
@@ -969,7 +1075,22 @@ check_to_user (char *user)
 */
 
 
+/* Work through every message that is due, up to a limit so the writer
+   thread still gets back to its mqueue now and then.  */
+#define PROCESS_TIMEOUT_MAX	100
+
 void SMq::process_timeout()
+{
+	release_msgs_for_registered();
+	for (int i = 0; i < PROCESS_TIMEOUT_MAX; i++) {
+		if (!process_next())
+			break;
+	}
+}
+
+/* Process the message at the head of the queue, if it is due.
+   Return false if there was nothing to do.  */
+bool SMq::process_next()
 {
 	time_t now = msgettime();
 	short_msg_p_list::iterator qmsg;
@@ -991,14 +1112,14 @@ void SMq::process_timeout()
 		if (empty) {
 			unlockSortedList();
 			//LOG(DEBUG) << "Message queue is empty";
-			return;			/* Empty queue */
+			return false;		/* Empty queue */
 		}
 
 		//LOG(DEBUG) << "Queue size " << time_sorted_list.size();
 		if (qmsg->next_action_time > now) {
 			unlockSortedList();
 			//LOG(DEBUG) << "Not time to processs message";
-			return;			/* Wait until later to do more */
+			return false;		/* Wait until later to do more */
 		}
 
 		// Got message to process from queue
@@ -1043,6 +1164,10 @@ void SMq::process_timeout()
 					          << qmsg->parsed->sip_method;
 					newstate = NO_STATE;
 				} else {
+					// A handset that sends is a handset we can reach.
+					if (qmsg->parsed->from && qmsg->parsed->from->url) {
+						release_msgs_for(qmsg->parsed->from->url->username);
+					}
 					// Real messages go here
 					// Check for short-code and handle it.
 					// If handle_short_code() returns true, it sets newstate
@@ -1128,17 +1253,6 @@ void SMq::process_timeout()
 			/* We are trying to deliver to the handset now (or
 			   again after congestion).  */
 
-			// Check for short-code and handle it.
-			// If handle_short_code() returns true, it sets newstate
-			// on its own
-			if (!pack_sms_for_delivery(qmsg))
-			{
-				// Error...
-				LOG(ERR) << "pack_sms_for_delivery returned non 0";
-				set_state(qmsg, NO_STATE);
-				break;
-			}
-
 			// make sure messages eventually get discarded
 			if (gConfig.getNum("SMS.MaxRetries")) {
 				if (qmsg->retries > gConfig.getNum("SMS.MaxRetries")) {
@@ -1155,7 +1269,8 @@ void SMq::process_timeout()
 			if (msSMSRateLimit > 0) {
 				if (msSMSRateLimit >= spacingTimer.elapsed()) {
 					LOG(INFO) << "RateLimit: trying too soon, not sending yet";
-					qmsg->next_action_time += msSMSRateLimit; // Should this be set timeout svgfix
+					qmsg->retries--;
+					set_state(qmsg, qmsg->state, now + msSMSRateLimit);	// Re-sorts it behind the others
 					break; // Delay the message
 				}
 				// Go ahead and process message
@@ -1163,26 +1278,21 @@ void SMq::process_timeout()
 				spacingTimer.now();
 			}
 
-			// debug_dump();
-			// Only print delivering msg if delivering to non-
-			// localhost.
-			LOG(INFO) << "Delivering '"
-				     << qmsg->qtag << "' from "
-				     << qmsg->parsed->from->url->username
-				     << " at "
-				     << qmsg->parsed->req_uri->host
-				     << ":" << qmsg->parsed->req_uri->port
-				     << ".";
-
-			// FIXME, if we can't deliver the datagram we
-			// just do the same thing regardless of the result.
-			LOG(DEBUG) << "Before deliver set state action time " << qmsg->next_action_time;
-			// Try and send datagram
-			if (my_network.deliver_msg_datagram(&*qmsg))
-				set_state(qmsg, ASKED_FOR_MSG_DELIVERY);   // Message sent okay
-			else
-				set_state(qmsg, ASKED_FOR_MSG_DELIVERY); // This makes more sense than back to REQUEST_DESTINATION_SIPURL
-			LOG(DEBUG) << "After deliver set state action time " << qmsg->next_action_time;
+			// and per cell, so one busy cell doesn't starve the others
+			{
+				time_t retryAt;
+				if (!smqDelivery->mayDispatch(SmqDelivery::btsOf(&*qmsg), now, retryAt)) {
+					LOG(DEBUG) << "RateLimit: cell busy, not sending yet";
+					qmsg->retries--;
+					set_state(qmsg, qmsg->state, retryAt);
+					break;
+				}
+			}
+
+			// Packing and sending happen on a delivery lane,
+			// which puts it back in ASKED_FOR_MSG_DELIVERY.
+			LOG(DEBUG) << "Dispatch '" << qmsg->qtag << "' action time " << qmsg->next_action_time;
+			smqDelivery->dispatch(qmsg);
 			break;
 
 		case ASKED_FOR_MSG_DELIVERY:
@@ -1228,8 +1338,9 @@ void SMq::process_timeout()
 		unlockSortedList();
 
 		//LOG(DEBUG) << "End process_timeout";
+		return true;
 
-} // SMq::process_timeout on reader thread
+} // SMq::process_next on writer thread
 
 
 
@@ -1484,6 +1595,10 @@ void SMq::CleaupAfterMainreaderLoop() {
 
     // The rest of this code never gets run (unless main_loop exits
     // based upon getting a "reboot" sms or signal or something).
+
+    // Let the delivery lanes finish, so what they still hold gets saved.
+    if (smqDelivery)
+    	smqDelivery->stop();
     if (smq.reexec_smqueue) {
     	LOG(WARNING) << "====== Re-Execing! ======";
 		if (!smq.save_queue_to_file(savefile)) {  //Save file on shutdown
@@ -1637,6 +1752,7 @@ bool
 SMq::ready_to_register (short_msg_p_list::iterator qmsg)
 {
 	char *callerid, *imsi;
+	bool ready;
 
 	qmsg->parse();
 	if (!qmsg->parsed ||
@@ -1644,8 +1760,11 @@ SMq::ready_to_register (short_msg_p_list::iterator qmsg)
 	    !qmsg->parsed->from->url)
 		return false;
 	imsi = qmsg->parsed->from->url->username;
-	callerid = my_hlr.getCLIDLocal(imsi);
-	return (callerid != NULL);
+	// We are polling for the registry to change, so skip the cache.
+	callerid = my_hlr_cache.getCLIDLocalFresh(imsi);
+	ready = (callerid != NULL);
+	free(callerid);
+	return ready;
 }
 
 
@@ -1915,7 +2034,7 @@ SMq::lookup_from_address (short_msg_pending *qmsg)
 	/* Look up the IMSI in the Home Location Register. */
 	char *newfrom;
 
-	newfrom = my_hlr.getCLIDLocal(fromusername);
+	newfrom = my_hlr_cache.getCLIDLocal(fromusername);
 	if (!newfrom) {
 		/* ==================FIXME KLUDGE====================
 		 * Here is our fake table of IMSIs and phone numbers
@@ -1966,7 +2085,7 @@ bool SMq::to_is_deliverable(const char *to)
 	
 	isDeliverable = (short_code_map.find(to) != short_code_map.end());
 	if (!isDeliverable) {
-		char *newdest = my_hlr.getIMSI2(to);
+		char *newdest = my_hlr_cache.getIMSI2(to);
 	
 		if (newdest
 	 	    && 0 != strncmp("imsi", newdest, 4) 
@@ -1989,7 +2108,7 @@ bool
 SMq::from_is_deliverable(const char *from)
 {
 	bool isDeliverable = false;
-	char *newdest = my_hlr.getCLIDLocal(from);
+	char *newdest = my_hlr_cache.getCLIDLocal(from);
 
 	isDeliverable = (newdest != NULL);
 
@@ -2047,7 +2166,7 @@ SMq::lookup_uri_imsi (short_msg_pending *qmsg)
 				   && 0 != strncmp("IMSI", username, 4))) {
 		// We have a phone number.  It needs translation.
 
-		char *newdest = my_hlr.getIMSI2(username);  // Get IMSI from phone number
+		char *newdest = my_hlr_cache.getIMSI2(username);  // Get IMSI from phone number
 		if (!newdest) {
 			/* ==================FIXME KLUDGE====================
 `				 * Here is our fake table of IMSIs and phone numbers
@@ -2094,7 +2213,7 @@ SMq::lookup_uri_imsi (short_msg_pending *qmsg)
 			// sender's local ph#.  Map it to the global ph#.
 			LOG(INFO) << "using global SIP relay " << global_relay << " to route message to " << username;
 			char *newfrom;
-			newfrom = my_hlr.mapCLIDGlobal(
+			newfrom = my_hlr_cache.mapCLIDGlobal(
 					qmsg->parsed->from->url->username);
 			if (newfrom) {
 				osip_free(qmsg->parsed->from->url->username);
@@ -2282,7 +2401,7 @@ SMq::lookup_uri_hostport (short_msg_pending *qmsg)
 		/* imsi is an IMSI at this point.  */
 		LOG(DEBUG) << "We have an IMSI: " << imsi;
 		newport = NULL;
-		newhost = my_hlr.getRegistrationIP (imsi);
+		newhost = my_hlr_cache.getRegistrationIP (imsi);
 	}
 
 	LOG(DEBUG) << "We are going to try to send to " << newhost << " on " << newport;
@@ -2492,7 +2611,8 @@ void SMq::main_loop(int msTMO)
 void SMq::debug_dump() {
 
 	time_t now = msgettime();
-	LOG(DEBUG) << "Dump message queue";
+	LOG(DEBUG) << "Dump message queue; " << my_hlr_cache.stats();
+	LOG(DEBUG) << smqDelivery->stats();
 	lockSortedList();
 	short_msg_p_list::iterator x = time_sorted_list.begin();
 	for (; x != time_sorted_list.end(); ++x) {
@@ -2523,6 +2643,8 @@ SMq::save_queue_to_file(std::string qfile)
 		return false;
 
 	lockSortedList(); // Lock file during the write.  Check the time on this.
+	if (smqDelivery)
+		smqDelivery->drain();	// Messages in the lanes are not on the list.
 	// Example of what should be in the file
 	// === 10 -506057005 127.0.0.1:5062 640 0 0
 	// === state  next_action_time  network_address  length  ms_to_sc  need_repack  message_text
@@ -3268,6 +3390,18 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("SMS.Delivery.Workers","4",
+		"threads",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"1:32",
+		true,
+		"Number of threads sending messages to the BTS units.  "
+			"Messages for one BTS always go through the same thread, in order."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("SMS.FakeSrcSMSC","0000",
 		"",
 		ConfigurationKey::CUSTOMER,
@@ -3337,6 +3471,17 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("SMS.RateLimit.PerBTS","0",
+		"milliseconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:10000",
+		false,
+		"Limit delivery rate to any one BTS to one message every X milliseconds, so a bulk send to one cell does not hold up the others. Set to 0 to disable."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	// TODO : pretty sure this isn't used anywhere...
 	tmp = new ConfigurationKey("SubscriberRegistry.A3A8","../comp128",
 		"",
@@ -3349,6 +3494,31 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("SubscriberRegistry.Cache.NegativeTTL","5",
+		"seconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:600",
+		false,
+		"How long to remember that a subscriber registry lookup found nothing.  "
+			"Set to 0 to always ask the registry again."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("SubscriberRegistry.Cache.TTL","60",
+		"seconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:3600",
+		false,
+		"How long to remember the answer to a subscriber registry lookup.  "
+			"The cache is also emptied whenever the registry database changes.  "
+			"Set to 0 to disable the cache."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("SubscriberRegistry.db","/var/lib/asterisk/sqlite3dir/sqlite3.db",
 		"",
 		ConfigurationKey::CUSTOMERWARN,
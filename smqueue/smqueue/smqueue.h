@@ -38,6 +38,7 @@
 
 #include "smnet.h"			// My network support
 #include <SubscriberRegistry.h>			// My home location register
+#include "HLRCache.h"				// and the cache in front of it
 
 #include <Logger.h>
 void ProcessReceivedMsg();
@@ -548,6 +549,8 @@ class short_msg_pending: public short_msg {
 	time_t next_action_time;	// When to do something different
 	int retries;			// How many times we've retried
 					// this message.
+	time_t delivery_start;		// When it was last handed to a
+					// delivery lane, in ms.
 	char srcaddr[16];		// Source address (ipv4 or 6 or ...)
 	socklen_t srcaddrlen;		// Valid length of src address.
 	char *qtag;			// Tag that identifies this msg
@@ -572,6 +575,7 @@ class short_msg_pending: public short_msg {
 		state (NO_STATE),
 		next_action_time (0),
 		retries (0),
+		delivery_start (0),
 		// srcaddr({0}),  // can't seem to initialize an array?
 		srcaddrlen(0),
 		qtag (NULL),
@@ -587,6 +591,7 @@ class short_msg_pending: public short_msg {
 		state (NO_STATE),
 		next_action_time (0),
 		retries (0),
+		delivery_start (0),
 		// srcaddr({0}),  // can't seem to initialize an array?
 		srcaddrlen(0),
 		qtag (NULL),
@@ -601,6 +606,7 @@ class short_msg_pending: public short_msg {
 		state (NO_STATE),
 		next_action_time (0),
 		retries (0),
+		delivery_start (0),
 		// srcaddr({0}),  // can't seem to initialize an array?
 		srcaddrlen(0),
 		qtag (NULL),
@@ -622,6 +628,7 @@ class short_msg_pending: public short_msg {
 		state (smp.state),
 		next_action_time (smp.next_action_time),
 		retries (smp.retries),
+		delivery_start (smp.delivery_start),
 		// srcaddr({0}),  // can't seem to initialize an array?
 		srcaddrlen(smp.srcaddrlen),
 		qtag (NULL),
@@ -692,6 +699,7 @@ class short_msg_pending: public short_msg {
 		state (NO_STATE),
 		next_action_time (0),
 		retries (0),
+		delivery_start (0),
 		// srcaddr({0}),  // can't seem to initialize an array?
 		srcaddrlen(0),
 		qtag (NULL),
@@ -753,7 +761,7 @@ class short_msg_pending: public short_msg {
 	check_host_port(char *host, char *port);
 
 	/* Generate a billing record. */
-	void write_cdr(SubscriberRegistry& hlr) const;
+	void write_cdr(HLRCache& hlr) const;
 
 };
 
@@ -871,6 +879,11 @@ class SMq {
 	   messages and looking up their return and destination addresses.  */
 	SubscriberRegistry my_hlr;
 
+	/* Every registry lookup and update goes through this rather than
+	   straight to my_hlr, so a burst of messages doesn't repeat the same
+	   queries and only one thread at a time uses the registry.  */
+	HLRCache my_hlr_cache;
+
 	/* Where to send SMS's that we can't route locally. */
 	std::string global_relay;
 	std::string global_relay_port;
@@ -893,6 +906,9 @@ class SMq {
 	int register_call_seq;
 	bool have_register_call_id;
 
+	/* The registry changes we have already looked at, from my_hlr_cache.  */
+	unsigned registry_changes;
+
 	/* Set this to true when you want main loop to stop.  */
 	bool stop_main_loop;
 
@@ -909,6 +925,7 @@ class SMq {
 		time_sorted_list (),
 		my_network (),
 		my_hlr(),
+		my_hlr_cache(my_hlr),
 		global_relay(""),
 		my_ipaddress(""),
 		my_2nd_ipaddress(""),
@@ -917,6 +934,7 @@ class SMq {
 		register_call_id(""),
 		register_call_seq(0),
 		have_register_call_id(false),
+		registry_changes(0),
 		stop_main_loop (false),
 		reexec_smqueue (false)
 	{
@@ -1000,6 +1018,7 @@ class SMq {
 
 	/* If nothing happens for a while, handle that.  */
 	void process_timeout();
+	bool process_next();
 
 	/* Send a SIP response to acknowledge reciept of a short msg. */
 	void respond_sip_ack(int errcode, short_msg_pending *smp, char *netaddr, size_t netaddrlen);
@@ -1072,6 +1091,20 @@ class SMq {
 	void
 	handle_response(short_msg_p_list::iterator qmsg);
 
+	/* A subscriber has just been heard from.  Move everything still
+	   waiting on a retry timer for that IMSI to the front of the queue,
+	   so the whole batch reaches the cell while the handset's channel
+	   is still open.  */
+	void
+	release_msgs_for(const char *imsi);
+
+	/* Handsets register through sipauthserve, not us, so we only see it
+	   as a change to the registry database.  When it changes, release
+	   the messages for every IMSI that has registered since we last
+	   tried to deliver to it.  */
+	void
+	release_msgs_for_registered();
+
 	/* Search the message queue to find a message whose tag matches.  */
 	bool
 	find_queued_msg_by_tag(short_msg_p_list::iterator &mymsg,
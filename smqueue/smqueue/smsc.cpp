@@ -311,7 +311,7 @@ short_code_action submitSMS(const char *imsi, const TLSubmit& submit,
 		*term = '\0';
 		char* SMTPPayload = term+1;
 		// Get the sender's E.164 to put in the subject line.
-		char* clid = scp->scp_smq->my_hlr.getCLIDLocal(imsi);
+		char* clid = scp->scp_smq->my_hlr_cache.getCLIDLocal(imsi);
 		char subjectLine[200];
 		if (!clid) sprintf(subjectLine,"from %s",imsi);
 		else {
@@ -325,7 +325,7 @@ short_code_action submitSMS(const char *imsi, const TLSubmit& submit,
 	}
 //#endif
 
-	char* destinationNumber = scp->scp_smq->my_hlr.getIMSI2(address.digits());
+	char* destinationNumber = scp->scp_smq->my_hlr_cache.getIMSI2(address.digits());
 
 	// Send to smqueue or HTTP gateway, depending on what's defined in the config.
 	// And whether of not we can resolve the destination, and a global relay does not exist,